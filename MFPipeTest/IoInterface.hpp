@@ -19,6 +19,76 @@ public:
 	virtual bool close() = 0;
 	virtual ssize_t read(uint8_t *buf, size_t size) = 0;
 	virtual ssize_t write(const uint8_t *buf, size_t size) = 0;
+
+	/**
+	 * @brief Reverse direction used by reader to send control records back to writer.
+	 *        Returns -1 if transport has no feedback path.
+	 */
+	virtual ssize_t readFeedback(uint8_t *buf, size_t size) { return -1; }
+	virtual ssize_t writeFeedback(const uint8_t *buf, size_t size) { return -1; }
+
+	/**
+	 * @brief Whether transport has the feedback path, hints that rely on it do nothing otherwise.
+	 */
+	virtual bool hasFeedback() const { return false; }
+
+	/**
+	 * @brief Number of the connection data goes over, changes when transport connects to a peer again or to
+	 *        another one. The stream starts over then, what parsers and writers kept of the previous one is stale.
+	 *        Write that has to connect again writes nothing, so a record never starts on one connection
+	 *        and ends on another. Stays 0 for transports without connections.
+	 */
+	virtual uint32_t getConnection() const { return 0; }
+
+	/**
+	 * @brief Makes transport recover lost data, giving it up after deadlineMs (0 for default). Called before open.
+	 *        Returns false if transport doesn't lose data or can't recover it.
+	 */
+	virtual bool setReliable(int deadlineMs) { return false; }
+
+	/**
+	 * @brief Makes transport send parity of each groupSize datagrams, so reader rebuilds one lost datagram
+	 *        of a group without asking for it. Called before open. Returns false if transport can't do it.
+	 */
+	virtual bool setParity(int groupSize) { return false; }
+
+	/**
+	 * @brief Spreads writes at bytesPerSecond, 0 turns it off. May be called while writing.
+	 *        Returns false if transport doesn't need pacing or can't do it.
+	 */
+	virtual bool setPacing(uint64_t bytesPerSecond) { return false; }
+
+	/**
+	 * @brief Options of multicast group the pipe address may name: hop limit of sent datagrams, whether they
+	 *        loop back to readers of the sending host and local address of interface to use, empty for default.
+	 *        Called before open. Returns false if transport has no multicast.
+	 */
+	virtual bool setMulticast(int ttl, bool isLoop, const std::string &iface) { return false; }
+
+	/**
+	 * @brief Lets other readers of the process open the same address, transport spreads incoming data among them
+	 *        by sender, so data of one writer goes to one reader. Called before open.
+	 *        Returns false if transport can't share an address.
+	 */
+	virtual bool setReusePort() { return false; }
+
+	/**
+	 * @brief Whether a writer sends to this io now. Socket sharing the address has none until the first
+	 *        datagram of a writer and again once the writer went quiet. Transports that can't tell return true.
+	 */
+	virtual bool hasPeer() const { return true; }
+
+	/**
+	 * @brief Sets send and receive buffers of sockets to bytes instead of transport default. Called before open.
+	 *        Returns false if transport has no socket buffers.
+	 */
+	virtual bool setBuffers(size_t bytes) { return false; }
+
+	/**
+	 * @brief Makes large writes go out of caller's memory without a copy to the kernel. Called before open.
+	 *        Returns false if transport or system can't do it.
+	 */
+	virtual bool setZeroCopy(bool isZeroCopy) { return !isZeroCopy; }
 };
 
 #endif // PIPEINTERFACE_HPP
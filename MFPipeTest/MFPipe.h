@@ -24,6 +24,33 @@ public:
 		int nMessagesFlushed;
 	}	MF_PIPE_INFO;
 
+	typedef struct MF_PIPE_LATENCY
+	{
+		long long nSamples;
+		long long nMinNs;
+		long long nMeanNs;
+		long long nP50Ns;
+		long long nP90Ns;
+		long long nP99Ns;
+		long long nP999Ns;
+		long long nMaxNs;
+	}	MF_PIPE_LATENCY;
+
+	typedef struct MF_PIPE_LATENCY_INFO
+	{
+		MF_PIPE_LATENCY writeQueue;
+		MF_PIPE_LATENCY readQueue;
+		MF_PIPE_LATENCY endToEnd;
+	}	MF_PIPE_LATENCY_INFO;
+
+	typedef struct MF_PIPE_COMPRESSION_INFO
+	{
+		long long nObjectsCompressed;
+		long long nObjectsBypassed;
+		long long nBytesIn;
+		long long nBytesOut;
+	}	MF_PIPE_COMPRESSION_INFO;
+
 	typedef	enum eMFFlashFlags
 	{
 		eMFFL_ResetCounters	= 0x2,
@@ -39,6 +66,10 @@ public:
 	virtual MF_HRESULT PipeInfoGet(/*[out]*/ std::string *pStrPipeName,
 								   /*[in]*/ const std::string &strChannel,
 								   MF_PIPE_INFO* _pPipeInfo) = 0;
+	virtual MF_HRESULT PipeLatencyGet(/*[in]*/ const std::string &strChannel,
+									  /*[out]*/ MF_PIPE_LATENCY_INFO* _pLatencyInfo) = 0;
+	virtual MF_HRESULT PipeCompressionGet(/*[in]*/ const std::string &strChannel,
+										  /*[out]*/ MF_PIPE_COMPRESSION_INFO* _pCompressionInfo) = 0;
 	virtual MF_HRESULT PipeCreate( /*[in]*/ const std::string &strPipeID,
 								   /*[in]*/ const std::string &strHints) = 0;
 	virtual MF_HRESULT PipeOpen( /*[in]*/ const std::string &strPipeID,
@@ -1,13 +1,126 @@
 #include "MFPipeImpl.h"
 
+#include <algorithm>
+#include <cstdlib>
+#include <set>
+#include <thread>
+
+#include "PipeAlloc.hpp"
+#include "PipeConverter.hpp"
+#include "PipeHints.hpp"
+#include "PipeTrace.hpp"
+#include "PipeWire.hpp"
+
 #ifdef unix
 #include "pipe/UnixIoPipe.hpp"
+#include "tcp/UnixIoTcp.hpp"
 #include "udp/UnixIoUdp.hpp"
 #else
 #include "udp/WinIoUdp.hpp"
 #include "pipe/WinIoPipe.hpp"
+#include "tcp/WinIoTcp.hpp"
 #endif
 
+/**
+ * @brief Queues previews of the object put on the channel. They are dropped rather than wait for space.
+ */
+static void putPreviews(PipePreviews &previews, DataBuffer &dataBuffer, size_t maxBuffers, PipeCompressor *compressor,
+						const std::string &channel, const std::shared_ptr<MF_BASE_TYPE> &object)
+{
+	previews.make(channel, object, [&](const std::string &previewChannel, const std::shared_ptr<MF_BASE_TYPE> &preview) {
+		std::lock_guard<std::timed_mutex> lock(dataBuffer.mutex);
+		if (dataBuffer.data.size() >= maxBuffers)
+			return;
+
+		const auto traceId = PIPE_TRACE_ID();
+		PIPE_TRACE(PUT, traceId);
+		const auto now = PipeLatency::now();
+		PIPE_ALLOC_SCOPE(QUEUE);
+		dataBuffer.data.push_back({ dataBuffer.intern(previewChannel), preview, now, now,
+									compressor ? compressor->submit(previewChannel, preview) : nullptr, traceId });
+	});
+}
+
+/**
+ * @brief Hands previews of the object put on "mem://" pipe over to the reader. They are dropped rather than wait for space.
+ */
+static void putPreviews(PipePreviews &previews, PipeMemory &memory, const std::string &channel,
+						const std::shared_ptr<MF_BASE_TYPE> &object)
+{
+	previews.make(channel, object, [&memory](const std::string &previewChannel, const std::shared_ptr<MF_BASE_TYPE> &preview) {
+		const auto traceId = PIPE_TRACE_ID();
+		PIPE_TRACE(PUT, traceId);
+		memory.put(previewChannel, preview, traceId);
+	});
+}
+
+/**
+ * @brief Records queue residence and end-to-end latency of the object taken from read queue.
+ */
+static void recordGet(PipeLatency &latency, const DataBuffer &dataBuffer, const DataEntry &entry)
+{
+	const auto now = PipeLatency::now();
+	const auto &channel = dataBuffer.channelName(entry.first);
+	latency.record(PipeLatency::Kind::READ_QUEUE, channel, now - entry.queueTime);
+	if (entry.putTime != 0)
+		latency.record(PipeLatency::Kind::END_TO_END, channel, now - entry.putTime);
+}
+
+static void fillLatency(MFPipe::MF_PIPE_LATENCY &info, const PipeLatency::Summary &summary)
+{
+	info.nSamples = static_cast<long long>(summary.samples);
+	info.nMinNs = summary.minNs;
+	info.nMeanNs = summary.meanNs;
+	info.nP50Ns = summary.p50Ns;
+	info.nP90Ns = summary.p90Ns;
+	info.nP99Ns = summary.p99Ns;
+	info.nP999Ns = summary.p999Ns;
+	info.nMaxNs = summary.maxNs;
+}
+
+static std::shared_ptr<IoInterface> makeIo(const std::string &pipeId)
+{
+	if (pipeId.compare(0, 6, "tcp://") == 0)
+		return std::make_shared<IoTcp>();
+	if (pipeId.find("udp") != std::string::npos)
+		return std::make_shared<IoUdp>();
+
+	return std::make_shared<IoPipe>();
+}
+
+static void setLossRecovery(IoInterface &io, const std::string &hints)
+{
+	const auto reliable = hintValue(hints, "reliable", "off");
+	if (reliable != "off" && !io.setReliable(reliable == "on" ? 0 : std::atoi(reliable.c_str())))
+		std::cerr << "Pipe doesn't support reliable mode, hint is ignored." << std::endl;
+
+	const auto fec = hintValue(hints, "fec", "off");
+	if (fec != "off" && !io.setParity(std::atoi(fec.c_str())))
+		std::cerr << "Pipe doesn't support parity of " << fec << " datagrams, hint is ignored." << std::endl;
+}
+
+static void setSocketOptions(IoInterface &io, const std::string &hints)
+{
+	const auto sockbuf = hintValue(hints, "sockbuf");
+	if (!sockbuf.empty() && !io.setBuffers(static_cast<size_t>(std::atoll(sockbuf.c_str())) * 1024))
+		std::cerr << "Pipe has no socket buffers, hint is ignored." << std::endl;
+
+	if (!io.setZeroCopy(hintValue(hints, "zerocopy") == "on"))
+		std::cerr << "Pipe doesn't support zero copy, hint is ignored." << std::endl;
+}
+
+static void setMulticast(IoInterface &io, const std::string &hints)
+{
+	const auto ttl = hintValue(hints, "ttl");
+	const auto loop = hintValue(hints, "loop");
+	const auto iface = hintValue(hints, "iface");
+	if (ttl.empty() && loop.empty() && iface.empty())
+		return;
+
+	if (!io.setMulticast(ttl.empty() ? 1 : std::atoi(ttl.c_str()), loop != "off", iface))
+		std::cerr << "Pipe doesn't support multicast options, hints are ignored." << std::endl;
+}
+
 MFPipeImpl::~MFPipeImpl()
 {
 	PipeClose();
@@ -18,7 +131,79 @@ MF_HRESULT MFPipeImpl::PipeInfoGet(
 		/*[in]*/ const std::string &strChannel,
 		MF_PIPE_INFO *_pPipeInfo)
 {
-	return MF_HRESULT::NOTIMPL;
+	if (pStrPipeName)
+		*pStrPipeName = pipeId;
+
+	if (!_pPipeInfo)
+		return MF_HRESULT::RES_OK;
+
+	*_pPipeInfo = {};
+	_pPipeInfo->nPipeMode = (reader ? 0x1 : 0) | (writer ? 0x2 : 0);
+	_pPipeInfo->nPipesConnected = (reader ? 1 : 0) + (writer ? 1 : 0);
+	_pPipeInfo->nObjectsMax = static_cast<int>(maxBuffers);
+	_pPipeInfo->nMessagesMax = static_cast<int>(maxBuffers);
+	_pPipeInfo->nObjectsDropped = writer ? static_cast<int>(writer->getDroppedObjects()) : 0;
+
+	// Empty channel name gives totals over all channels.
+	std::set<std::string> channels;
+	for (const auto &dataBuffer : { readDataBuffer, writeDataBuffer })
+	{
+		if (!dataBuffer)
+			continue;
+
+		std::lock_guard<std::timed_mutex> lock(dataBuffer->mutex);
+		const auto channel = dataBuffer->find(strChannel);
+		for (const auto &entry : dataBuffer->data)
+		{
+			channels.insert(dataBuffer->channelName(entry.first));
+			if (strChannel.empty() || entry.first == channel)
+				_pPipeInfo->nObjectsHave++;
+		}
+		for (const auto &entry : dataBuffer->messages)
+		{
+			channels.insert(dataBuffer->channelName(entry.first));
+			if (strChannel.empty() || entry.first == channel)
+				_pPipeInfo->nMessagesHave++;
+		}
+	}
+	_pPipeInfo->nChannels = static_cast<int>(channels.size());
+
+	return MF_HRESULT::RES_OK;
+}
+
+MF_HRESULT MFPipeImpl::PipeLatencyGet(
+		/*[in]*/ const std::string &strChannel,
+		/*[out]*/ MF_PIPE_LATENCY_INFO *_pLatencyInfo)
+{
+	if (!_pLatencyInfo)
+		return MF_HRESULT::INVALIDARG;
+
+	*_pLatencyInfo = {};
+	fillLatency(_pLatencyInfo->writeQueue, latency->summary(PipeLatency::Kind::WRITE_QUEUE, strChannel));
+	fillLatency(_pLatencyInfo->readQueue, latency->summary(PipeLatency::Kind::READ_QUEUE, strChannel));
+	fillLatency(_pLatencyInfo->endToEnd, latency->summary(PipeLatency::Kind::END_TO_END, strChannel));
+
+	return MF_HRESULT::RES_OK;
+}
+
+MF_HRESULT MFPipeImpl::PipeCompressionGet(
+		/*[in]*/ const std::string &strChannel,
+		/*[out]*/ MF_PIPE_COMPRESSION_INFO *_pCompressionInfo)
+{
+	if (!_pCompressionInfo)
+		return MF_HRESULT::INVALIDARG;
+
+	*_pCompressionInfo = {};
+	if (!compressor)
+		return MF_HRESULT::RES_OK;
+
+	const auto stats = compressor->stats(strChannel);
+	_pCompressionInfo->nObjectsCompressed = static_cast<long long>(stats.compressed);
+	_pCompressionInfo->nObjectsBypassed = static_cast<long long>(stats.bypassed);
+	_pCompressionInfo->nBytesIn = static_cast<long long>(stats.bytesIn);
+	_pCompressionInfo->nBytesOut = static_cast<long long>(stats.bytesOut);
+
+	return MF_HRESULT::RES_OK;
 }
 
 MF_HRESULT MFPipeImpl::PipeCreate(
@@ -31,11 +216,14 @@ MF_HRESULT MFPipeImpl::PipeCreate(
 		return MF_HRESULT::INVALIDARG;
 	}
 
-	if (strPipeID.find("udp") != std::string::npos)
-		io = std::make_shared<IoUdp>();
-	else
-		io = std::make_shared<IoPipe>();
+	if (PipeMemory::isMemory(strPipeID))
+	{
+		memory = PipeMemory::link(strPipeID);
+		pipeId = strPipeID;
+		return MF_HRESULT::RES_OK;
+	}
 
+	io = makeIo(strPipeID);
 	if (!io->create(strPipeID))
 	{
 		std::cerr << "Failed to create pipe. ERRNO: " << errno << std::endl;
@@ -59,38 +247,135 @@ MF_HRESULT MFPipeImpl::PipeOpen(
 	}
 
 	pipeId = strPipeID;
+	maxBuffers = _nMaxBuffers;
+
+	if (PipeMemory::isMemory(strPipeID) && !memory)
+		memory = PipeMemory::link(strPipeID);
 
-	if (strHints.find("R") != std::string::npos)
+	if (hasHintMode(strHints, 'R'))
 	{
-		if (!io)
+		if (!io && !memory)
+			io = makeIo(strPipeID);
+
+		// Further sockets share the address with io, each with a reader thread of its own.
+		// More of them than cores or queue slots only add threads with no slots to grant.
+		auto sockets = io ? std::atoi(hintValue(strHints, "sockets", "1").c_str()) : 1;
+		const auto cores = static_cast<int>(std::thread::hardware_concurrency());
+		const auto maxSockets = std::max(1, std::min(cores > 0 ? cores : _nMaxBuffers, _nMaxBuffers));
+		if (sockets > maxSockets)
 		{
-			if (strPipeID.find("udp") != std::string::npos)
-				io = std::make_shared<IoUdp>();
-			else
-				io = std::make_shared<IoPipe>();
+			std::cerr << "Pipe takes up to " << maxSockets << " sockets, hint is clamped." << std::endl;
+			sockets = maxSockets;
+		}
+		if (sockets > 1 && !io->setReusePort())
+		{
+			std::cerr << "Pipe doesn't support several sockets, hint is ignored." << std::endl;
+			sockets = 1;
 		}
 
-		if (!io->open(pipeId, IoInterface::Mode::READ, _nMaxWaitMs))
+		if (io)
+		{
+			setLossRecovery(*io, strHints);
+			setMulticast(*io, strHints);
+			setSocketOptions(*io, strHints);
+		}
+		if (io && !io->open(pipeId, IoInterface::Mode::READ, _nMaxWaitMs))
 		{
 			std::cerr << "Failed to open pipe on read." << std::endl;
 			return MF_HRESULT::RES_FALSE;
 		}
 
 		readDataBuffer = std::make_shared<DataBuffer>();
-		reader = std::make_unique<PipeReader>(io, _nMaxBuffers, readDataBuffer);
-		reader->start();
+		for (const auto &priority : priorities)
+			readDataBuffer->setPriority(priority.first, priority.second);
+		for (const auto &format : formats)
+			readDataBuffer->setFormat(format.first, format.second);
+		for (const auto &jitter : jitters)
+			readDataBuffer->setJitter(jitter.first, jitter.second);
+		reader = std::make_unique<PipeReader>(io, _nMaxBuffers, readDataBuffer, subscribers, waiters, latency);
+		const auto creditShares = sockets > 1 ? std::make_shared<PipeReader::CreditShares>(sockets) : nullptr;
+		reader->setCreditShare(creditShares, 0);
+
+		for (auto i = 1; i < sockets; ++i)
+		{
+			auto shardIo = makeIo(strPipeID);
+			shardIo->setReusePort();
+			setLossRecovery(*shardIo, strHints);
+			setMulticast(*shardIo, strHints);
+			setSocketOptions(*shardIo, strHints);
+			if (!shardIo->open(pipeId, IoInterface::Mode::READ, _nMaxWaitMs))
+			{
+				std::cerr << "Failed to open socket " << i << " of pipe on read." << std::endl;
+				return MF_HRESULT::RES_FALSE;
+			}
+
+			shardReaders.push_back(
+					std::make_unique<PipeReader>(shardIo, _nMaxBuffers, readDataBuffer, subscribers, waiters, latency));
+			shardReaders.back()->setCreditShare(creditShares, i);
+			shardReaders.back()->start();
+			shardIos.push_back(std::move(shardIo));
+		}
+
+		// Reader of "mem://" pipe has no thread, writers hand objects to it.
+		if (memory)
+			memory->attach(reader.get());
+		else
+			reader->start();
 	}
-	if (strHints.find("W") != std::string::npos)
+	if (hasHintMode(strHints, 'W'))
 	{
+		// Objects go straight to the reader, so wire, credit and compression hints don't apply.
+		if (memory)
+		{
+			memory->addWriter(waiters);
+			return MF_HRESULT::RES_OK;
+		}
+
+		setLossRecovery(*io, strHints);
+		setMulticast(*io, strHints);
+		setSocketOptions(*io, strHints);
 		if (!io->open(pipeId, IoInterface::Mode::WRITE, _nMaxWaitMs))
 		{
 			std::cout << "Failed to open pipe on write." << std::endl;
 			return MF_HRESULT::RES_FALSE;
 		}
 
-		maxBuffers = _nMaxBuffers;
 		writeDataBuffer = std::make_shared<DataBuffer>();
-		writer = std::make_unique<PipeWriter>(io, writeDataBuffer);
+		for (const auto &priority : priorities)
+			writeDataBuffer->setPriority(priority.first, priority.second);
+		writer = std::make_unique<PipeWriter>(io, writeDataBuffer, waiters, latency);
+		writer->setTimestamps(hintValue(strHints, "timestamps") == "on");
+		writer->setPackVideo(hintValue(strHints, "video") == "packed");
+		writer->setDeltaVideo(hintValue(strHints, "delta"));
+
+		const auto compress = hintValue(strHints, "compress");
+		if (!compress.empty())
+			compressor = std::make_shared<PipeCompressor>(compress);
+
+		// Windows pipe and UDP transports have no way back from reader, credit never comes over them.
+		const auto credit = hintValue(strHints, "credit");
+		if (!credit.empty() && !io->hasFeedback())
+			std::cerr << "Pipe has no feedback path for credit, hint is ignored." << std::endl;
+		else if (credit == "block")
+			writer->setCreditPolicy(PipeWriter::CreditPolicy::BLOCK);
+		else if (credit == "drop")
+			writer->setCreditPolicy(PipeWriter::CreditPolicy::DROP);
+		else if (credit == "conflate")
+			writer->setCreditPolicy(PipeWriter::CreditPolicy::CONFLATE);
+
+		const auto pace = hintValue(strHints, "pace");
+		const bool isPaced = pace.empty() || (pace == "auto" ? writer->setPacing(0, true)
+				: writer->setPacing(static_cast<uint64_t>(std::atof(pace.c_str()) * 125000), false));
+		if (!isPaced)
+			std::cerr << "Pipe doesn't support pacing, hint is ignored." << std::endl;
+
+		const auto wire = hintValue(strHints, "wire", "auto");
+		if (wire == "1")
+			writer->setWireVersion(PipeWire::VERSION_1, false);
+		else if (wire == "2")
+			writer->setWireVersion(PipeWire::VERSION_2, false);
+		else
+			writer->setWireVersion(PipeWire::VERSION_MAX, true);
 		writer->start();
 	}
 
@@ -106,6 +391,25 @@ MF_HRESULT MFPipeImpl::PipePut(
 	const auto start = std::chrono::steady_clock::now();
 	const auto end = start + std::chrono::milliseconds(_nMaxWaitMs);
 
+	// Object of "mem://" pipe goes to the read queue as it is, space there is waited for as for the write queue.
+	if (memory)
+	{
+		const auto traceId = PIPE_TRACE_ID();
+		PIPE_TRACE(PUT, traceId);
+		while (!memory->put(strChannel, pBufferOrFrame, traceId))
+		{
+			if (std::chrono::steady_clock::now() >= end)
+			{
+				std::cerr << "Timeout on adding buffer to write queue" << std::endl;
+				return MF_HRESULT::RES_FALSE;
+			}
+			std::this_thread::yield();
+		}
+
+		putPreviews(*previews, *memory, strChannel, pBufferOrFrame);
+		return MF_HRESULT::RES_OK;
+	}
+
 	do
 	{
 		if (!writeDataBuffer->mutex.try_lock_until(end))
@@ -118,8 +422,18 @@ MF_HRESULT MFPipeImpl::PipePut(
 			continue;
 		}
 
-		writeDataBuffer->data.push_back({ strChannel, pBufferOrFrame });
+		const auto traceId = PIPE_TRACE_ID();
+		PIPE_TRACE(PUT, traceId);
+		const auto now = PipeLatency::now();
+		{
+			PIPE_ALLOC_SCOPE(QUEUE);
+			writeDataBuffer->data.push_back({ writeDataBuffer->intern(strChannel), pBufferOrFrame, now, now,
+											  compressor ? compressor->submit(strChannel, pBufferOrFrame) : nullptr,
+											  traceId });
+		}
 		writeDataBuffer->mutex.unlock();
+
+		putPreviews(*previews, *writeDataBuffer, maxBuffers, compressor.get(), strChannel, pBufferOrFrame);
 		return MF_HRESULT::RES_OK;
 	} while (std::chrono::steady_clock::now() < end);
 
@@ -141,10 +455,12 @@ MF_HRESULT MFPipeImpl::PipeGet(
 		if (!readDataBuffer->mutex.try_lock_until(end))
 			break;
 
+		// Name is looked up once, queued entries are matched by ID.
+		const auto channel = readDataBuffer->find(strChannel);
 		auto it = readDataBuffer->data.begin();
 		for (; it != readDataBuffer->data.end(); ++it)
 		{
-			if (it->first == strChannel)
+			if (it->first == channel)
 				break;
 		}
 
@@ -156,8 +472,13 @@ MF_HRESULT MFPipeImpl::PipeGet(
 		}
 
 		pBufferOrFrame = it->second;
+		const auto traceId = it->traceId;
+		recordGet(*latency, *readDataBuffer, *it);
 		readDataBuffer->data.erase(it);
 		readDataBuffer->mutex.unlock();
+		PIPE_TRACE(GET, traceId);
+		if (memory)
+			memory->notifyWriters();
 		return MF_HRESULT::RES_OK;
 	} while (std::chrono::steady_clock::now() < end);
 
@@ -180,11 +501,12 @@ MF_HRESULT MFPipeImpl::PipePeek(
 		if (!readDataBuffer->mutex.try_lock_until(end))
 			break;
 
+		const auto channel = readDataBuffer->find(strChannel);
 		auto it = readDataBuffer->data.begin();
 		auto count = 0;
 		for (; it != readDataBuffer->data.end() && count <= _nIndex; ++it, ++count)
 		{
-			if (it->first == strChannel && count == _nIndex)
+			if (it->first == channel && count == _nIndex)
 				break;
 		}
 
@@ -212,6 +534,27 @@ MF_HRESULT MFPipeImpl::PipeMessagePut(
 	const auto start = std::chrono::steady_clock::now();
 	const auto end = start + std::chrono::milliseconds(_nMaxWaitMs);
 
+	if (memory)
+	{
+		std::shared_ptr<Message> mes;
+		{
+			PIPE_ALLOC_SCOPE(MESSAGE);
+			mes = std::make_shared<Message>(Message { strEventName, strEventParam });
+		}
+
+		while (!memory->put(strChannel, mes))
+		{
+			if (std::chrono::steady_clock::now() >= end)
+			{
+				std::cerr << "Timeout on adding message to write queue" << std::endl;
+				return MF_HRESULT::RES_FALSE;
+			}
+			std::this_thread::yield();
+		}
+
+		return MF_HRESULT::RES_OK;
+	}
+
 	do
 	{
 		if (!writeDataBuffer->mutex.try_lock_until(end))
@@ -224,8 +567,9 @@ MF_HRESULT MFPipeImpl::PipeMessagePut(
 			continue;
 		}
 
+		PIPE_ALLOC_SCOPE(MESSAGE);
 		Message mes = { strEventName, strEventParam };
-		writeDataBuffer->messages.push_back({ strChannel, std::make_shared<Message>(mes) });
+		writeDataBuffer->messages.push_back({ writeDataBuffer->intern(strChannel), std::make_shared<Message>(mes) });
 		writeDataBuffer->mutex.unlock();
 		return MF_HRESULT::RES_OK;
 	} while (std::chrono::steady_clock::now() < end);
@@ -248,10 +592,11 @@ MF_HRESULT MFPipeImpl::PipeMessageGet(
 		if (!readDataBuffer->mutex.try_lock_until(end))
 			break;
 
+		const auto channel = readDataBuffer->find(strChannel);
 		auto it = readDataBuffer->messages.begin();
 		for (; it != readDataBuffer->messages.end(); ++it)
 		{
-			if (it->first == strChannel)
+			if (it->first == channel)
 				break;
 		}
 
@@ -269,6 +614,8 @@ MF_HRESULT MFPipeImpl::PipeMessageGet(
 		*pStrEventParam = mes->param;
 
 		readDataBuffer->mutex.unlock();
+		if (memory)
+			memory->notifyWriters();
 		return MF_HRESULT::RES_OK;
 	} while (std::chrono::steady_clock::now() < end);
 
@@ -281,12 +628,239 @@ MF_HRESULT MFPipeImpl::PipeFlush( /*[in]*/ const std::string &strChannel, /*[in]
 	return MF_HRESULT::NOTIMPL;
 }
 
+MF_HRESULT MFPipeImpl::PipeSubscribe(
+		/*[in]*/ const std::string &strChannel,
+		/*[in]*/ PipeCallback callback,
+		/*[out]*/ int *pnSubscriptionId)
+{
+	if (!callback)
+		return MF_HRESULT::INVALIDARG;
+
+	const auto id = subscribers->add(strChannel, callback);
+	if (pnSubscriptionId)
+		*pnSubscriptionId = id;
+
+	return MF_HRESULT::RES_OK;
+}
+
+MF_HRESULT MFPipeImpl::PipeUnsubscribe( /*[in]*/ int nSubscriptionId)
+{
+	return subscribers->remove(nSubscriptionId) ? MF_HRESULT::RES_OK : MF_HRESULT::INVALIDARG;
+}
+
+MF_HRESULT MFPipeImpl::PipeExecutorSet( /*[in]*/ PipeExecutor executor)
+{
+	subscribers->setExecutor(executor);
+	waiters->setExecutor(executor);
+	return MF_HRESULT::RES_OK;
+}
+
+MF_HRESULT MFPipeImpl::PipePrioritySet(
+		/*[in]*/ const std::string &strChannel,
+		/*[in]*/ eMFPriority ePriority)
+{
+	priorities[strChannel] = ePriority;
+
+	for (const auto &dataBuffer : { readDataBuffer, writeDataBuffer })
+	{
+		if (!dataBuffer)
+			continue;
+
+		std::lock_guard<std::timed_mutex> lock(dataBuffer->mutex);
+		dataBuffer->setPriority(strChannel, ePriority);
+	}
+
+	return MF_HRESULT::RES_OK;
+}
+
+MF_HRESULT MFPipeImpl::PipePreviewSet(
+		/*[in]*/ const std::string &strChannel,
+		/*[in]*/ const std::string &strSourceChannel,
+		/*[in]*/ int nWidth,
+		/*[in]*/ int nHeight)
+{
+	if (strChannel.empty() || strChannel == strSourceChannel)
+	{
+		std::cerr << "Preview needs a channel of its own." << std::endl;
+		return MF_HRESULT::INVALIDARG;
+	}
+
+	previews->set(strChannel, strSourceChannel, nWidth, nHeight);
+	return MF_HRESULT::RES_OK;
+}
+
+MF_HRESULT MFPipeImpl::PipeFormatSet(
+		/*[in]*/ const std::string &strChannel,
+		/*[in]*/ eMFCC fccType)
+{
+	if (fccType != eMFCC_Default && !PipeConverter::isSupported(fccType, fccType))
+	{
+		std::cerr << "Can't convert frames to format " << std::hex << fccType << std::dec << std::endl;
+		return MF_HRESULT::INVALIDARG;
+	}
+
+	formats[strChannel] = fccType;
+
+	if (readDataBuffer)
+	{
+		std::lock_guard<std::timed_mutex> lock(readDataBuffer->mutex);
+		readDataBuffer->setFormat(strChannel, fccType);
+	}
+
+	return MF_HRESULT::RES_OK;
+}
+
+MF_HRESULT MFPipeImpl::PipeJitterSet(
+		/*[in]*/ const std::string &strChannel,
+		/*[in]*/ int nMaxDelayMs)
+{
+	if (nMaxDelayMs < 0)
+		return MF_HRESULT::INVALIDARG;
+
+	jitters[strChannel] = nMaxDelayMs;
+
+	if (readDataBuffer)
+	{
+		std::lock_guard<std::timed_mutex> lock(readDataBuffer->mutex);
+		readDataBuffer->setJitter(strChannel, nMaxDelayMs);
+	}
+
+	return MF_HRESULT::RES_OK;
+}
+
+PipeAwaiter<std::shared_ptr<MF_BASE_TYPE>> MFPipeImpl::get(
+		/*[in]*/ const std::string &strChannel,
+		/*[in]*/ int _nMaxWaitMs,
+		/*[in]*/ std::shared_ptr<PipeCancelToken> token)
+{
+	auto dataBuffer = readDataBuffer;
+	auto attempt = [dataBuffer, latency = latency, memory = memory, strChannel](std::shared_ptr<MF_BASE_TYPE> &pBufferOrFrame) {
+		if (!dataBuffer)
+			return false;
+
+		std::lock_guard<std::timed_mutex> lock(dataBuffer->mutex);
+
+		const auto channel = dataBuffer->find(strChannel);
+		auto it = dataBuffer->data.begin();
+		for (; it != dataBuffer->data.end(); ++it)
+		{
+			if (it->first == channel)
+				break;
+		}
+
+		if (it == dataBuffer->data.end())
+			return false;
+
+		pBufferOrFrame = it->second;
+		const auto traceId = it->traceId;
+		recordGet(*latency, *dataBuffer, *it);
+		dataBuffer->data.erase(it);
+		PIPE_TRACE(GET, traceId);
+		if (memory)
+			memory->notifyWriters();
+		return true;
+	};
+
+	return PipeAwaiter<std::shared_ptr<MF_BASE_TYPE>>(waiters, attempt, _nMaxWaitMs, token);
+}
+
+PipeAwaiter<bool> MFPipeImpl::put(
+		/*[in]*/ const std::string &strChannel,
+		/*[in]*/ const std::shared_ptr<MF_BASE_TYPE> &pBufferOrFrame,
+		/*[in]*/ int _nMaxWaitMs,
+		/*[in]*/ std::shared_ptr<PipeCancelToken> token)
+{
+	auto dataBuffer = writeDataBuffer;
+	const auto limit = maxBuffers;
+	auto attempt = [dataBuffer, limit, compressor = compressor, previews = previews, memory = memory, strChannel,
+					pBufferOrFrame](bool &queued) {
+		if (memory)
+		{
+			const auto traceId = PIPE_TRACE_ID();
+			PIPE_TRACE(PUT, traceId);
+			if (!memory->put(strChannel, pBufferOrFrame, traceId))
+				return false;
+
+			putPreviews(*previews, *memory, strChannel, pBufferOrFrame);
+			queued = true;
+			return true;
+		}
+
+		if (!dataBuffer)
+			return false;
+
+		{
+			std::lock_guard<std::timed_mutex> lock(dataBuffer->mutex);
+
+			if (dataBuffer->data.size() >= limit)
+				return false;
+
+			const auto traceId = PIPE_TRACE_ID();
+			PIPE_TRACE(PUT, traceId);
+			const auto now = PipeLatency::now();
+			PIPE_ALLOC_SCOPE(QUEUE);
+			dataBuffer->data.push_back({ dataBuffer->intern(strChannel), pBufferOrFrame, now, now,
+										 compressor ? compressor->submit(strChannel, pBufferOrFrame) : nullptr,
+										 traceId });
+		}
+
+		putPreviews(*previews, *dataBuffer, limit, compressor.get(), strChannel, pBufferOrFrame);
+		queued = true;
+		return true;
+	};
+
+	return PipeAwaiter<bool>(waiters, attempt, _nMaxWaitMs, token);
+}
+
+PipeAwaiter<std::shared_ptr<Message>> MFPipeImpl::messageGet(
+		/*[in]*/ const std::string &strChannel,
+		/*[in]*/ int _nMaxWaitMs,
+		/*[in]*/ std::shared_ptr<PipeCancelToken> token)
+{
+	auto dataBuffer = readDataBuffer;
+	auto attempt = [dataBuffer, memory = memory, strChannel](std::shared_ptr<Message> &message) {
+		if (!dataBuffer)
+			return false;
+
+		std::lock_guard<std::timed_mutex> lock(dataBuffer->mutex);
+
+		const auto channel = dataBuffer->find(strChannel);
+		auto it = dataBuffer->messages.begin();
+		for (; it != dataBuffer->messages.end(); ++it)
+		{
+			if (it->first == channel)
+				break;
+		}
+
+		if (it == dataBuffer->messages.end())
+			return false;
+
+		message = it->second;
+		dataBuffer->messages.erase(it);
+		if (memory)
+			memory->notifyWriters();
+		return true;
+	};
+
+	return PipeAwaiter<std::shared_ptr<Message>>(waiters, attempt, _nMaxWaitMs, token);
+}
+
 MF_HRESULT MFPipeImpl::PipeClose()
 {
+	if (memory && reader)
+		memory->detach(reader.get());
 	if (reader)
 		reader->stop();
+	for (auto &shardReader : shardReaders)
+		shardReader->stop();
+	for (auto &shardIo : shardIos)
+		shardIo->close();
 	if (writer)
 		writer->stop();
 
+	waiters->abortAll();
+
+	if (!io)
+		return MF_HRESULT::RES_OK;
 	return io->close() ? MF_HRESULT::RES_OK : MF_HRESULT::RES_FALSE;
 }
@@ -5,15 +5,25 @@
 #include <deque>
 #include <string>
 #include <memory>
+#include <vector>
 
 #include "IoInterface.hpp"
 #include "MFPipe.h"
 #include "MFTypes.h"
+#include "PipeCompressor.hpp"
+#include "PipeLatency.hpp"
+#include "PipeMemory.hpp"
+#include "PipePreviews.hpp"
 #include "PipeReader.hpp"
+#include "PipeSubscribers.hpp"
+#include "PipeWaiters.hpp"
 #include "PipeWriter.hpp"
 class MFPipeImpl: public MFPipe
 {
 public:
+	typedef PipeSubscribers::Callback PipeCallback;
+	typedef PipeSubscribers::Executor PipeExecutor;
+
 	MFPipeImpl() = default;
 
 	~MFPipeImpl() override;
@@ -23,10 +33,72 @@ public:
 			/*[in]*/ const std::string &strChannel,
 			MF_PIPE_INFO* _pPipeInfo) override;
 
+	/**
+	 * @brief Latency percentiles of the channel, or of all channels if it is empty.
+	 *        End-to-end latency needs writer opened with timestamps=on and both ends on one host.
+	 */
+	MF_HRESULT PipeLatencyGet(
+			/*[in]*/ const std::string &strChannel,
+			/*[out]*/ MF_PIPE_LATENCY_INFO* _pLatencyInfo) override;
+
+	/**
+	 * @brief Compression stats of written objects of the channel, or of all channels if it is empty.
+	 *        Bytes saved are nBytesIn - nBytesOut.
+	 */
+	MF_HRESULT PipeCompressionGet(
+			/*[in]*/ const std::string &strChannel,
+			/*[out]*/ MF_PIPE_COMPRESSION_INFO* _pCompressionInfo) override;
+
+	/**
+	 * @brief Creates pipe. ID starting with "tcp://" makes TCP pipe, ID containing "udp" UDP pipe,
+	 *        ID starting with "mem://" in-process pipe that hands put objects over to the reader of the same ID
+	 *        as they are, anything else FIFO. Reader of "tcp://host:port" listens there, writer connects to it
+	 *        and connects again when the connection is lost. Object cut by a lost connection is lost.
+	 *        UDP pipe of multicast group address, e.g. "udp://239.1.1.1:5000", sends one copy of each datagram
+	 *        to all readers of the group.
+	 */
 	MF_HRESULT PipeCreate(
 			/*[in]*/ const std::string &strPipeID,
 			/*[in]*/ const std::string &strHints) override;
 
+	/**
+	 * @brief Opens pipe. Besides "R" and "W" hints may contain:
+	 *        credit=block|drop|conflate - writer obeys free slots advertised by reader.
+	 *        timestamps=on - writer sends put time of objects for end-to-end latency.
+	 *        wire=1|2|auto - wire format of writer, auto (default) starts with v1 and
+	 *                        switches to the newest one reader announces.
+	 *        video=packed - writer leaves row padding out of v2 frames, reader restores it zeroed.
+	 *        compress=<channels> - writer compresses video and buffer data of v2 objects of the channels
+	 *                              on a worker pool. Channels are separated by '|', "*" selects all,
+	 *                              name ending with "*" selects by prefix.
+	 *        delta=<channels> - writer sends only changed tiles of video of v2 frames of the channels,
+	 *                           full video goes about once a second. Channels are given as for compress.
+	 *        reliable=on|<deadline ms> - UDP pipe numbers datagrams, reader asks writer for lost ones again
+	 *                                    and gives them up after the deadline (100 ms for "on").
+	 *                                    Both ends need it, FIFO pipes don't lose data anyway.
+	 *        fec=<2..64> - UDP pipe sends XOR parity of each group of that many datagrams, reader rebuilds
+	 *                      one lost datagram per group without a round trip. Both ends need the same value.
+	 *                      Datagrams carry all channels, so channels that need other protection go
+	 *                      through pipes of their own. Works alone for one-way links or with reliable.
+	 *        pace=<Mbit/s>|auto - UDP writer spreads datagrams at the rate instead of sending objects as bursts.
+	 *                             auto derives it from size and dblRate of written frames.
+	 *        ttl=<0..255> - hop limit of datagrams writer sends to multicast group, 1 (default) keeps them
+	 *                       in the local network.
+	 *        loop=on|off - whether datagrams sent to multicast group reach readers on the same host, on by default.
+	 *        iface=<ip> - local address of interface multicast group is joined and sent on, e.g. 127.0.0.1.
+	 *                     Default interface is the one of the default route.
+	 *        Readers of multicast group all send feedback to the writer, so credit is meant for one reader.
+	 *        Reliable mode works with many of them, datagrams sent again reach the whole group.
+	 *        sockets=<n> - UDP reader opens n sockets on the address, each with a thread of its own, so receiving
+	 *                      from many writers scales with cores. Each socket takes one writer at a time,
+	 *                      the first one it hears from, until that writer is silent for 2 s, so up to n writers
+	 *                      are served at once. Needs SO_REUSEPORT, unicast only. n is clamped to the number
+	 *                      of cores and to _nMaxBuffers, free slots are split among sockets that have a writer.
+	 *        sockbuf=<KB> - send and receive buffers of TCP and UDP sockets. TCP leaves them to the system
+	 *                       by default, UDP uses 10 MB.
+	 *        zerocopy=on - TCP writer sends writes of 256 KB and more with MSG_ZEROCOPY, Linux only. Each of them
+	 *                      waits until the system is done with the data, so it pays off for large frames.
+	 */
 	MF_HRESULT PipeOpen(
 			/*[in]*/ const std::string &strPipeID,
 			/*[in]*/ int _nMaxBuffers,
@@ -68,17 +140,109 @@ public:
 
 	MF_HRESULT PipeClose() override;
 
+	/**
+	 * @brief Registers callback which receives objects of the channel as soon as they are read.
+	 *        Objects delivered to subscribers bypass the read queue and are not available for PipeGet.
+	 * @param strChannel Channel name, "*" for all channels or "prefix*" for channels starting with prefix.
+	 * @param pnSubscriptionId Id of the subscription for PipeUnsubscribe, may be nullptr.
+	 */
+	MF_HRESULT PipeSubscribe(
+			/*[in]*/ const std::string &strChannel,
+			/*[in]*/ PipeCallback callback,
+			/*[out]*/ int *pnSubscriptionId);
+
+	MF_HRESULT PipeUnsubscribe( /*[in]*/ int nSubscriptionId);
+
+	/**
+	 * @brief Sets executor for subscription callbacks and awaiting coroutines.
+	 *        By default they run on the reader/writer thread.
+	 */
+	MF_HRESULT PipeExecutorSet( /*[in]*/ PipeExecutor executor);
+
+	/**
+	 * @brief Sets priority class of the channel for both directions.
+	 *        Writer sends most urgent entries first, reader queues them ahead of less urgent ones.
+	 *        By default objects are eMFPR_Normal and messages are eMFPR_High.
+	 */
+	MF_HRESULT PipePrioritySet(
+			/*[in]*/ const std::string &strChannel,
+			/*[in]*/ eMFPriority ePriority);
+
+	/**
+	 * @brief Sets video format frames of the channel are converted to on receive, eMFCC_Default turns it off.
+	 *        I420, YV12, NV12, YUY2, YVYU and UYVY convert to I420, YV12 and NV12,
+	 *        frames of other formats are delivered as sent.
+	 */
+	MF_HRESULT PipeFormatSet(
+			/*[in]*/ const std::string &strChannel,
+			/*[in]*/ eMFCC fccType);
+
+	/**
+	 * @brief Sets max delay of jitter buffer of the channel, 0 turns it off. Received frames of the channel wait
+	 *        there and are released in order of time.rtStartTime, delayed just enough to absorb measured jitter
+	 *        of their arrival. Frame that comes after a later one was released is dropped.
+	 *        Objects of "mem://" pipes don't meet a network and are delivered as they come.
+	 */
+	MF_HRESULT PipeJitterSet(
+			/*[in]*/ const std::string &strChannel,
+			/*[in]*/ int nMaxDelayMs);
+
+	/**
+	 * @brief Declares channel as a preview of the source channel: every frame put on the source is also scaled
+	 *        to nWidth x nHeight and put on the channel, without audio. Previews don't wait for space
+	 *        in the write queue, they are dropped when it is full. Non-positive size removes the preview.
+	 */
+	MF_HRESULT PipePreviewSet(
+			/*[in]*/ const std::string &strChannel,
+			/*[in]*/ const std::string &strSourceChannel,
+			/*[in]*/ int nWidth,
+			/*[in]*/ int nHeight);
+
+	/**
+	 * @brief Awaitable versions of PipeGet, PipePut and PipeMessageGet.
+	 *        Coroutine is suspended without blocking a thread and resumed when data or space is available,
+	 *        _nMaxWaitMs expires (RES_FALSE) or token is cancelled (ABORT). Negative _nMaxWaitMs waits forever.
+	 */
+	PipeAwaiter<std::shared_ptr<MF_BASE_TYPE>> get(
+			/*[in]*/ const std::string &strChannel,
+			/*[in]*/ int _nMaxWaitMs = -1,
+			/*[in]*/ std::shared_ptr<PipeCancelToken> token = nullptr);
+
+	PipeAwaiter<bool> put(
+			/*[in]*/ const std::string &strChannel,
+			/*[in]*/ const std::shared_ptr<MF_BASE_TYPE> &pBufferOrFrame,
+			/*[in]*/ int _nMaxWaitMs = -1,
+			/*[in]*/ std::shared_ptr<PipeCancelToken> token = nullptr);
+
+	PipeAwaiter<std::shared_ptr<Message>> messageGet(
+			/*[in]*/ const std::string &strChannel,
+			/*[in]*/ int _nMaxWaitMs = -1,
+			/*[in]*/ std::shared_ptr<PipeCancelToken> token = nullptr);
+
 private:
 	std::string pipeId;
-	size_t maxBuffers;
+	size_t maxBuffers = 0;
 	MF_PIPE_INFO pipeInfo;
 
 	std::shared_ptr<IoInterface> io;
+	// Link of "mem://" pipe, which has no io, writer or write queue.
+	std::shared_ptr<PipeMemory> memory;
 
 	std::shared_ptr<DataBuffer> readDataBuffer;
 	std::shared_ptr<DataBuffer> writeDataBuffer;
+	std::map<std::string, eMFPriority> priorities;
+	std::map<std::string, eMFCC> formats;
+	std::map<std::string, int> jitters;
+	std::shared_ptr<PipeSubscribers> subscribers = std::make_shared<PipeSubscribers>();
+	std::shared_ptr<PipeWaiters> waiters = std::make_shared<PipeWaiters>();
+	std::shared_ptr<PipeLatency> latency = std::make_shared<PipeLatency>();
+	std::shared_ptr<PipeCompressor> compressor;
+	std::shared_ptr<PipePreviews> previews = std::make_shared<PipePreviews>();
 
 	std::unique_ptr<PipeReader> reader;
+	// Readers of further sockets of "sockets=" hint, they feed readDataBuffer as reader does.
+	std::vector<std::shared_ptr<IoInterface>> shardIos;
+	std::vector<std::unique_ptr<PipeReader>> shardReaders;
 	std::unique_ptr<PipeWriter> writer;
 };
 
@@ -3,11 +3,15 @@
 
 #include <cmath>
 #include <cstdint>
+#include <cstring>
 #include <deque>
 #include <iostream>
+#include <map>
 #include <memory>
+#include <memory_resource>
 #include <mutex>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 typedef long long int REFERENCE_TIME;
@@ -17,6 +21,7 @@ typedef	enum MF_HRESULT
 	RES_OK = 0,
 	RES_FALSE = 1,
 	NOTIMPL = 0x80004001L,
+	ABORT = 0x80004004L,
 	OUTOFMEMORY = 0x8007000EL,
 	INVALIDARG = 0x80070057L
 } MF_HRESULT;
@@ -27,9 +32,22 @@ enum class DataType
 	FRAME,
 	BUFFER,
 	MESSAGE,
+	CREDIT,
+	TIMESTAMP,
+	HELLO,
+	CHANNEL_ID,
 };
 
 static constexpr uint32_t DATA_SYNC = 0xFBFCFDFE;
+static constexpr uint32_t DATA_SYNC_V2 = 0xFAFCFDFE;
+
+/**
+ * @brief Channel interned into a small integer, see DataBuffer::intern.
+ */
+typedef uint32_t ChannelId;
+static constexpr ChannelId NO_CHANNEL_ID = UINT32_MAX;
+// Bounds dictionary a reader keeps per connection, writer sends channels beyond it by name.
+static constexpr ChannelId MAX_WIRE_CHANNEL_IDS = 1 << 16;
 
 typedef struct M_TIME
 {
@@ -75,12 +93,44 @@ typedef struct M_AV_PROPS
 	M_AUD_PROPS audProps;
 } 	M_AV_PROPS;
 
+/**
+ * @brief Appends size bytes at data to buf.
+ *        Same as inserting the range, which GCC 12 wrongly reports as overflow in optimized builds.
+ */
+inline void appendBytes(std::vector<uint8_t> &buf, const void *data, size_t size)
+{
+	if (size == 0)
+		return;
+
+	const auto offset = buf.size();
+	buf.resize(offset + size);
+	memcpy(buf.data() + offset, data, size);
+}
+
 typedef struct MF_BASE_TYPE
 {
 	virtual ~MF_BASE_TYPE() {}
 
 	virtual std::vector<uint8_t> serialize() const = 0;
 	virtual MF_BASE_TYPE* deserialize(const std::vector<uint8_t> &raw) = 0;
+
+	/**
+	 * @brief Appends serialized object to buf, so caller can reuse the buffer.
+	 */
+	virtual void serializeTo(std::vector<uint8_t> &buf) const
+	{
+		const auto bytes = serialize();
+		appendBytes(buf, bytes.data(), bytes.size());
+	}
+
+	/**
+	 * @brief Deserializes into this object reusing its storage.
+	 * @return false if type doesn't support it.
+	 */
+	virtual bool deserializeInPlace(const std::vector<uint8_t> &raw)
+	{
+		return false;
+	}
 } MF_BASE_TYPE;
 
 typedef struct MF_FRAME: public MF_BASE_TYPE
@@ -96,10 +146,17 @@ typedef struct MF_FRAME: public MF_BASE_TYPE
 	std::vector<uint8_t> serialize() const override
 	{
 		std::vector<uint8_t> buf;
+		serializeTo(buf);
+		return buf;
+	}
+
+	void serializeTo(std::vector<uint8_t> &buf) const override
+	{
+		buf.reserve(buf.size() + 1 + sizeof(time) + sizeof(av_props) + 3 * sizeof(size_t)
+					+ str_user_props.size() + vec_video_data.size() + vec_audio_data.size());
 
 		auto to_bytes = [&buf](auto data) {
-			const auto bytes = reinterpret_cast<const uint8_t *>(&data);
-			buf.insert(buf.end(), bytes, bytes + sizeof(data));
+			appendBytes(buf, &data, sizeof(data));
 		};
 
 		to_bytes(static_cast<uint8_t>(DataType::FRAME));
@@ -107,45 +164,47 @@ typedef struct MF_FRAME: public MF_BASE_TYPE
 		to_bytes(av_props);
 
 		to_bytes(str_user_props.size());
-		buf.insert(buf.end(), str_user_props.begin(), str_user_props.end());
+		appendBytes(buf, str_user_props.data(), str_user_props.size());
 
 		to_bytes(vec_video_data.size());
-		buf.insert(buf.end(), vec_video_data.begin(), vec_video_data.end());
+		appendBytes(buf, vec_video_data.data(), vec_video_data.size());
 
 		to_bytes(vec_audio_data.size());
-		buf.insert(buf.end(), vec_audio_data.begin(), vec_audio_data.end());
-
-		return buf;
+		appendBytes(buf, vec_audio_data.data(), vec_audio_data.size());
 	}
 
 	MF_BASE_TYPE* deserialize(const std::vector<uint8_t> &raw) override
 	{
 		auto frame = new MF_FRAME();
+		frame->deserializeInPlace(raw);
+		return frame;
+	}
 
+	bool deserializeInPlace(const std::vector<uint8_t> &raw) override
+	{
 		auto rawPtr = raw.data();
 
-		frame->time = *reinterpret_cast<const M_TIME *>(rawPtr);
-		rawPtr += sizeof(frame->time);
+		time = *reinterpret_cast<const M_TIME *>(rawPtr);
+		rawPtr += sizeof(time);
 
-		frame->av_props = *reinterpret_cast<const M_AV_PROPS *>(rawPtr);
-		rawPtr += sizeof(frame->av_props);
+		av_props = *reinterpret_cast<const M_AV_PROPS *>(rawPtr);
+		rawPtr += sizeof(av_props);
 
 		auto str_user_props_size = *reinterpret_cast<const size_t *>(rawPtr);
 		rawPtr += sizeof(str_user_props_size);
-		frame->str_user_props = std::string(reinterpret_cast<const char *>(rawPtr), str_user_props_size);
+		str_user_props.assign(reinterpret_cast<const char *>(rawPtr), str_user_props_size);
 		rawPtr += str_user_props_size;
 
 		auto vec_video_data_size = *reinterpret_cast<const size_t *>(rawPtr);
 		rawPtr += sizeof(vec_video_data_size);
-		frame->vec_video_data = std::vector<uint8_t>(rawPtr, rawPtr + vec_video_data_size);
+		vec_video_data.assign(rawPtr, rawPtr + vec_video_data_size);
 		rawPtr += vec_video_data_size;
 
 		auto vec_audio_data_size = *reinterpret_cast<const size_t *>(rawPtr);
 		rawPtr += sizeof(vec_audio_data_size);
-		frame->vec_audio_data = std::vector<uint8_t>(rawPtr, rawPtr + vec_audio_data_size);
-		rawPtr += sizeof(vec_audio_data_size);
+		vec_audio_data.assign(rawPtr, rawPtr + vec_audio_data_size);
 
-		return frame;
+		return true;
 	}
 } MF_FRAME;
 
@@ -171,36 +230,44 @@ typedef struct MF_BUFFER: public MF_BASE_TYPE
 	std::vector<uint8_t> serialize() const override
 	{
 		std::vector<uint8_t> buf;
+		serializeTo(buf);
+		return buf;
+	}
+
+	void serializeTo(std::vector<uint8_t> &buf) const override
+	{
+		buf.reserve(buf.size() + 1 + sizeof(flags) + sizeof(size_t) + data.size());
 
 		auto to_bytes = [&buf](auto data) {
-			const auto bytes = reinterpret_cast<const uint8_t *>(&data);
-			buf.insert(buf.end(), bytes, bytes + sizeof(data));
+			appendBytes(buf, &data, sizeof(data));
 		};
 
 		to_bytes(static_cast<uint8_t>(DataType::BUFFER));
 		to_bytes(flags);
 
 		to_bytes(data.size());
-		buf.insert(buf.end(), data.begin(), data.end());
-
-		return buf;
+		appendBytes(buf, data.data(), data.size());
 	}
 
 	MF_BASE_TYPE* deserialize(const std::vector<uint8_t> &raw) override
 	{
 		auto buffer = new MF_BUFFER();
+		buffer->deserializeInPlace(raw);
+		return buffer;
+	}
 
+	bool deserializeInPlace(const std::vector<uint8_t> &raw) override
+	{
 		auto rawPtr = raw.data();
 
-		buffer->flags = *reinterpret_cast<const eMFBufferFlags *>(rawPtr);
-		rawPtr += sizeof(buffer->flags);
+		flags = *reinterpret_cast<const eMFBufferFlags *>(rawPtr);
+		rawPtr += sizeof(flags);
 
 		auto data_size = *reinterpret_cast<const size_t *>(rawPtr);
 		rawPtr += sizeof(data_size);
-		buffer->data = std::vector<uint8_t>(rawPtr, rawPtr + data_size);
-		rawPtr += data_size;
+		data.assign(rawPtr, rawPtr + data_size);
 
-		return buffer;
+		return true;
 	}
 } MF_BUFFER;
 
@@ -212,21 +279,23 @@ struct Message
 	std::vector<uint8_t> serialize() const
 	{
 		std::vector<uint8_t> buf;
+		serializeTo(buf);
+		return buf;
+	}
 
+	void serializeTo(std::vector<uint8_t> &buf) const
+	{
 		auto to_bytes = [&buf](auto data) {
-			const auto bytes = reinterpret_cast<const uint8_t *>(&data);
-			buf.insert(buf.end(), bytes, bytes + sizeof(data));
+			appendBytes(buf, &data, sizeof(data));
 		};
 
 		to_bytes(static_cast<uint8_t>(DataType::MESSAGE));
 
 		to_bytes(name.size());
-		buf.insert(buf.end(), name.begin(), name.end());
+		appendBytes(buf, name.data(), name.size());
 
 		to_bytes(param.size());
-		buf.insert(buf.end(), param.begin(), param.end());
-
-		return buf;
+		appendBytes(buf, param.data(), param.size());
 	}
 
 	Message deserialize(const std::vector<uint8_t> &raw)
@@ -249,31 +318,227 @@ struct Message
 	}
 };
 
+/**
+ * @brief Flow control record sent by reader back to writer: number of objects it can accept.
+ */
+struct Credit
+{
+	uint64_t slots = 0;
+
+	std::vector<uint8_t> serialize() const
+	{
+		std::vector<uint8_t> buf;
+		serializeTo(buf);
+		return buf;
+	}
+
+	void serializeTo(std::vector<uint8_t> &buf) const
+	{
+		auto to_bytes = [&buf](auto data) {
+			appendBytes(buf, &data, sizeof(data));
+		};
+
+		to_bytes(static_cast<uint8_t>(DataType::CREDIT));
+		to_bytes(slots);
+	}
+
+	Credit deserialize(const std::vector<uint8_t> &raw)
+	{
+		Credit credit;
+		credit.slots = *reinterpret_cast<const uint64_t *>(raw.data());
+		return credit;
+	}
+};
+
+/**
+ * @brief Put time of the object which follows it, sent by writer opened with timestamps=on.
+ */
+struct Timestamp
+{
+	int64_t timeNs = 0;
+
+	std::vector<uint8_t> serialize() const
+	{
+		std::vector<uint8_t> buf;
+		serializeTo(buf);
+		return buf;
+	}
+
+	void serializeTo(std::vector<uint8_t> &buf) const
+	{
+		auto to_bytes = [&buf](auto data) {
+			appendBytes(buf, &data, sizeof(data));
+		};
+
+		to_bytes(static_cast<uint8_t>(DataType::TIMESTAMP));
+		to_bytes(timeNs);
+	}
+
+	Timestamp deserialize(const std::vector<uint8_t> &raw)
+	{
+		Timestamp timestamp;
+		timestamp.timeNs = *reinterpret_cast<const int64_t *>(raw.data());
+		return timestamp;
+	}
+};
+
+/**
+ * @brief Sent by reader back to writer: highest wire format version it can parse.
+ */
+struct Hello
+{
+	uint8_t version = 0;
+
+	std::vector<uint8_t> serialize() const
+	{
+		std::vector<uint8_t> buf;
+		serializeTo(buf);
+		return buf;
+	}
+
+	void serializeTo(std::vector<uint8_t> &buf) const
+	{
+		buf.push_back(static_cast<uint8_t>(DataType::HELLO));
+		buf.push_back(version);
+	}
+
+	Hello deserialize(const std::vector<uint8_t> &raw)
+	{
+		Hello hello;
+		hello.version = raw.empty() ? 0 : raw[0];
+		return hello;
+	}
+};
+
+typedef enum eMFPriority
+{
+	eMFPR_Low = 0,
+	eMFPR_Normal = 1,
+	eMFPR_High = 2,
+} 	eMFPriority;
+
+struct PipeCompressJob;
+
+/**
+ * @brief Queued object, first is interned channel and second is object as in std::pair.
+ *        Times are steady clock ns, putTime is 0 when unknown.
+ *        compressJob is set when the object is being compressed for sending, see PipeCompressor.
+ */
+struct DataEntry
+{
+	ChannelId first;
+	std::shared_ptr<MF_BASE_TYPE> second;
+	int64_t putTime = 0;
+	int64_t queueTime = 0;
+	std::shared_ptr<PipeCompressJob> compressJob;
+	// ID of the object in PipeTrace events, 0 if it isn't traced.
+	uint64_t traceId = 0;
+};
+
 struct DataBuffer
 {
 	std::timed_mutex mutex;
-	std::deque<std::pair<std::string, std::shared_ptr<MF_BASE_TYPE>>> data;
-	std::deque<std::pair<std::string, std::shared_ptr<Message>>> messages;
+	// Freed queue nodes are kept for reuse, so steady traffic doesn't allocate. Guarded by mutex as the queues.
+	std::pmr::unsynchronized_pool_resource pool;
+	std::pmr::deque<DataEntry> data { &pool };
+	std::pmr::deque<std::pair<ChannelId, std::shared_ptr<Message>>> messages { &pool };
+
+	struct Channel
+	{
+		std::string name;
+		bool hasPriority = false;
+		eMFPriority priority = eMFPR_Normal;
+		// Video format frames of the channel are converted to on receive, eMFCC_Default keeps them as sent.
+		eMFCC format = eMFCC_Default;
+		// Max delay of jitter buffer frames of the channel wait in on receive, 0 delivers them as they come.
+		int jitterMs = 0;
+	};
+
+	// Channels are interned on first use and never removed, so IDs and name references stay valid.
+	std::deque<Channel> channels;
+	std::unordered_map<std::string, ChannelId> channelIds;
+	bool hasPriorities = false;
+
+	/**
+	 * @brief ID of the channel, assigned on first use. Guarded by mutex.
+	 */
+	ChannelId intern(const std::string &ch)
+	{
+		const auto it = channelIds.find(ch);
+		if (it != channelIds.end())
+			return it->second;
+
+		const auto id = static_cast<ChannelId>(channels.size());
+		channels.push_back({ ch });
+		channelIds.emplace(ch, id);
+		return id;
+	}
+
+	/**
+	 * @brief ID of the channel or NO_CHANNEL_ID if nothing was queued on it yet. Guarded by mutex.
+	 */
+	ChannelId find(const std::string &ch) const
+	{
+		const auto it = channelIds.find(ch);
+		return it == channelIds.end() ? NO_CHANNEL_ID : it->second;
+	}
+
+	const std::string &channelName(ChannelId id) const
+	{
+		return channels[id].name;
+	}
+
+	void setPriority(const std::string &ch, eMFPriority priority)
+	{
+		auto &channel = channels[intern(ch)];
+		channel.hasPriority = true;
+		channel.priority = priority;
+		hasPriorities = true;
+	}
+
+	void setFormat(const std::string &ch, eMFCC format)
+	{
+		channels[intern(ch)].format = format;
+	}
+
+	void setJitter(const std::string &ch, int maxDelayMs)
+	{
+		channels[intern(ch)].jitterMs = maxDelayMs;
+	}
 };
 
-template <typename T>
-static std::vector<uint8_t> serialize(const std::string &ch, T &data)
+/**
+ * @brief Priority class of the channel. Objects default to eMFPR_Normal, messages to eMFPR_High.
+ */
+inline eMFPriority channelPriority(const DataBuffer &buffer, ChannelId ch, eMFPriority defaultPriority)
 {
-	std::vector<uint8_t> buf;
+	const auto &channel = buffer.channels[ch];
+	return channel.hasPriority ? channel.priority : defaultPriority;
+}
 
+/**
+ * @brief Appends record of the object to buf.
+ */
+template <typename T>
+static void serializeTo(std::vector<uint8_t> &buf, const std::string &ch, const T &data)
+{
 	auto to_bytes = [&buf](auto data) {
-		const auto bytes = reinterpret_cast<const uint8_t *>(&data);
-		buf.insert(buf.end(), bytes, bytes + sizeof(data));
+		appendBytes(buf, &data, sizeof(data));
 	};
 
 	to_bytes(DATA_SYNC);
 
 	to_bytes(ch.size());
-	buf.insert(buf.end(), ch.begin(), ch.end());
+	appendBytes(buf, ch.data(), ch.size());
 
-	const auto dataBytes = data->serialize();
-	buf.insert(buf.end(), dataBytes.begin(), dataBytes.end());
+	data->serializeTo(buf);
+}
 
+template <typename T>
+static std::vector<uint8_t> serialize(const std::string &ch, T &data)
+{
+	std::vector<uint8_t> buf;
+	serializeTo(buf, ch, data);
 	return buf;
 }
 
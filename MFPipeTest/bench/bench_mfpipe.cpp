@@ -0,0 +1,321 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <cstring>
+#include <future>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "MFPipeImpl.h"
+
+/**
+ * End-to-end throughput and latency benchmark of MFPipeImpl.
+ *
+ * Every combination of transports, payload sizes, channel counts, producer/consumer
+ * thread counts and queue sizes is run once and reported as one JSON object:
+ *
+ *   MFPipe_Bench [--transports fifo,udp,tcp,mem] [--sizes 1024,65536,1048576] [--channels 1,4]
+ *                [--producers 1,2] [--consumers 1,2] [--buffers 8,32]
+ *                [--count 10000] [--bytes 268435456]
+ *
+ * Each run sends min(count, bytes / size) objects (at least 100).
+ * Put-to-get latency is measured by stamping steady_clock time into the first bytes of the payload.
+ */
+
+struct BenchConfig
+{
+	std::string transport;
+	std::string pipeId;
+	size_t size;
+	size_t channels;
+	size_t producers;
+	size_t consumers;
+	size_t buffers;
+	size_t count;
+};
+
+struct BenchResult
+{
+	size_t received = 0;
+	size_t lost = 0;
+	double seconds = 0;
+	double cpuSeconds = 0;
+	std::vector<int64_t> latenciesNs;
+};
+
+static std::string argValue(char **begin, char **end, const std::string &arg, const std::string &defaultValue)
+{
+	auto it = std::find(begin, end, arg);
+	if (it == end || it + 1 == end)
+		return defaultValue;
+	return *(it + 1);
+}
+
+static std::vector<size_t> toList(const std::string &str)
+{
+	std::vector<size_t> res;
+	std::stringstream ss(str);
+	std::string item;
+	while (std::getline(ss, item, ','))
+		res.push_back(std::stoull(item));
+	return res;
+}
+
+static std::vector<std::string> toStrings(const std::string &str)
+{
+	std::vector<std::string> res;
+	std::stringstream ss(str);
+	std::string item;
+	while (std::getline(ss, item, ','))
+		res.push_back(item);
+	return res;
+}
+
+static std::string transportPipeId(const std::string &transport)
+{
+	if (transport == "udp")
+		return "udp://127.0.0.1:49200";
+	if (transport == "tcp")
+		return "tcp://127.0.0.1:49201";
+	if (transport == "mem")
+		return "mem://benchPipe";
+#ifdef unix
+	if (transport == "fifo")
+		return "./benchPipe";
+#else
+	if (transport == "fifo")
+		return "\\\\.\\pipe\\benchPipe";
+#endif
+	return transport;
+}
+
+static int64_t nowNs()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void produce(MFPipeImpl *pipe, const BenchConfig &config, size_t producer, size_t count)
+{
+	// Objects are reused once the pipe has released them, so the producer doesn't allocate in steady state.
+	std::vector<std::shared_ptr<MF_BUFFER>> pool;
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		std::shared_ptr<MF_BUFFER> buffer;
+		for (const auto &candidate : pool)
+		{
+			if (candidate.use_count() == 1)
+			{
+				buffer = candidate;
+				break;
+			}
+		}
+		if (!buffer)
+		{
+			buffer = std::make_shared<MF_BUFFER>();
+			buffer->flags = eMFBF_Buffer;
+			buffer->data.resize(config.size);
+			pool.push_back(buffer);
+		}
+
+		const auto stamp = nowNs();
+		memcpy(buffer->data.data(), &stamp, sizeof(stamp));
+
+		const auto channel = "ch" + std::to_string((producer + i) % config.channels);
+		if (pipe->PipePut(channel, buffer, 10000, "") != MF_HRESULT::RES_OK)
+			std::cerr << "Put " << i << " failed" << std::endl;
+	}
+}
+
+static void consume(MFPipeImpl *pipe,
+					const std::string &channel,
+					std::atomic<int64_t> *remaining,
+					const std::atomic<bool> *produced,
+					std::atomic<size_t> *lost,
+					std::vector<int64_t> *latencies)
+{
+	while (remaining->fetch_sub(1) > 0)
+	{
+		std::shared_ptr<MF_BASE_TYPE> out;
+		if (pipe->PipeGet(channel, out, 200, "") != MF_HRESULT::RES_OK)
+		{
+			// Once everything is sent a timeout means the rest of the channel was lost (UDP).
+			(*lost)++;
+			if (*produced)
+			{
+				const auto rest = remaining->exchange(0);
+				*lost += rest > 0 ? rest : 0;
+			}
+			continue;
+		}
+
+		const auto received = nowNs();
+		const auto buffer = dynamic_cast<MF_BUFFER *>(out.get());
+		if (buffer == nullptr || buffer->data.size() < sizeof(int64_t))
+			continue;
+
+		int64_t stamp;
+		memcpy(&stamp, buffer->data.data(), sizeof(stamp));
+		latencies->push_back(received - stamp);
+	}
+}
+
+static BenchResult runBench(const BenchConfig &config)
+{
+	BenchResult result;
+
+	MFPipeImpl writePipe;
+	MFPipeImpl readPipe;
+
+	auto writeOpen = std::async([&]() {
+		return writePipe.PipeCreate(config.pipeId, "") == MF_HRESULT::RES_OK
+				&& writePipe.PipeOpen(config.pipeId, static_cast<int>(config.buffers), "W") == MF_HRESULT::RES_OK;
+	});
+	auto readOpen = std::async([&]() {
+		return readPipe.PipeOpen(config.pipeId, static_cast<int>(config.buffers), "R") == MF_HRESULT::RES_OK;
+	});
+
+	if (!writeOpen.get() || !readOpen.get())
+	{
+		std::cerr << "Failed to open " << config.pipeId << std::endl;
+		result.lost = config.count;
+		return result;
+	}
+
+	// Objects of channel c go to consumers c, c + channels, ...; every channel has at least one consumer.
+	std::vector<size_t> channelCounts(config.channels, 0);
+	std::vector<size_t> producerCounts(config.producers, config.count / config.producers);
+	producerCounts[0] += config.count % config.producers;
+	for (size_t p = 0; p < config.producers; ++p)
+	{
+		for (size_t i = 0; i < producerCounts[p]; ++i)
+			channelCounts[(p + i) % config.channels]++;
+	}
+
+	std::vector<std::atomic<int64_t>> remaining(config.channels);
+	for (size_t c = 0; c < config.channels; ++c)
+		remaining[c] = static_cast<int64_t>(channelCounts[c]);
+
+	const auto consumers = std::max(config.consumers, config.channels);
+	std::vector<std::vector<int64_t>> latencies(consumers);
+	std::atomic<size_t> lost(0);
+	std::atomic<bool> produced(false);
+
+	const auto cpuStart = std::clock();
+	const auto start = std::chrono::steady_clock::now();
+
+	std::vector<std::thread> threads;
+	for (size_t c = 0; c < consumers; ++c)
+	{
+		latencies[c].reserve(config.count / consumers + 1);
+		threads.emplace_back(&consume, &readPipe, "ch" + std::to_string(c % config.channels),
+							 &remaining[c % config.channels], &produced, &lost, &latencies[c]);
+	}
+
+	std::vector<std::thread> producerThreads;
+	for (size_t p = 0; p < config.producers; ++p)
+		producerThreads.emplace_back(&produce, &writePipe, std::cref(config), p, producerCounts[p]);
+
+	for (auto &thread : producerThreads)
+		thread.join();
+	produced = true;
+
+	for (auto &thread : threads)
+		thread.join();
+
+	result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	result.cpuSeconds = static_cast<double>(std::clock() - cpuStart) / CLOCKS_PER_SEC;
+	result.lost = lost;
+	result.received = config.count - result.lost;
+
+	for (auto &lat : latencies)
+		result.latenciesNs.insert(result.latenciesNs.end(), lat.begin(), lat.end());
+
+	writePipe.PipeClose();
+	readPipe.PipeClose();
+
+	return result;
+}
+
+static double percentileUs(std::vector<int64_t> &sorted, double p)
+{
+	if (sorted.empty())
+		return 0;
+
+	const auto idx = std::min(sorted.size() - 1, static_cast<size_t>(p * sorted.size()));
+	return sorted[idx] / 1000.0;
+}
+
+static void printResult(const BenchConfig &config, BenchResult &result, bool last)
+{
+	std::sort(result.latenciesNs.begin(), result.latenciesNs.end());
+
+	const double bytes = static_cast<double>(result.received) * config.size;
+	const double gb = bytes / (1024.0 * 1024.0 * 1024.0);
+
+	std::cout << "  {"
+			  << "\"transport\": \"" << config.transport << "\", "
+			  << "\"size\": " << config.size << ", "
+			  << "\"channels\": " << config.channels << ", "
+			  << "\"producers\": " << config.producers << ", "
+			  << "\"consumers\": " << std::max(config.consumers, config.channels) << ", "
+			  << "\"max_buffers\": " << config.buffers << ", "
+			  << "\"objects\": " << config.count << ", "
+			  << "\"lost\": " << result.lost << ", "
+			  << "\"seconds\": " << result.seconds << ", "
+			  << "\"objects_per_sec\": " << (result.seconds > 0 ? result.received / result.seconds : 0) << ", "
+			  << "\"mb_per_sec\": " << (result.seconds > 0 ? bytes / (1024.0 * 1024.0) / result.seconds : 0) << ", "
+			  << "\"cpu_sec_per_gb\": " << (gb > 0 ? result.cpuSeconds / gb : 0) << ", "
+			  << "\"latency_us\": {"
+			  << "\"p50\": " << percentileUs(result.latenciesNs, 0.5) << ", "
+			  << "\"p99\": " << percentileUs(result.latenciesNs, 0.99) << ", "
+			  << "\"p999\": " << percentileUs(result.latenciesNs, 0.999) << ", "
+			  << "\"max\": " << (result.latenciesNs.empty() ? 0 : result.latenciesNs.back() / 1000.0)
+			  << "}}" << (last ? "" : ",") << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+	const auto transports = toStrings(argValue(argv, argv + argc, "--transports", "fifo,udp"));
+	const auto sizes = toList(argValue(argv, argv + argc, "--sizes", "1024,65536,1048576"));
+	const auto channels = toList(argValue(argv, argv + argc, "--channels", "1,4"));
+	const auto producers = toList(argValue(argv, argv + argc, "--producers", "1"));
+	const auto consumers = toList(argValue(argv, argv + argc, "--consumers", "1"));
+	const auto buffers = toList(argValue(argv, argv + argc, "--buffers", "32"));
+	const auto count = std::stoull(argValue(argv, argv + argc, "--count", "10000"));
+	const auto bytes = std::stoull(argValue(argv, argv + argc, "--bytes", "268435456"));
+
+	std::vector<BenchConfig> configs;
+	for (const auto &transport : transports)
+		for (auto size : sizes)
+			for (auto ch : channels)
+				for (auto prod : producers)
+					for (auto cons : consumers)
+						for (auto buf : buffers)
+						{
+							BenchConfig config;
+							config.transport = transport;
+							config.pipeId = transportPipeId(transport);
+							config.size = std::max<size_t>(size, sizeof(int64_t));
+							config.channels = std::max<size_t>(ch, 1);
+							config.producers = std::max<size_t>(prod, 1);
+							config.consumers = std::max<size_t>(cons, 1);
+							config.buffers = std::max<size_t>(buf, 1);
+							config.count = std::max<size_t>(100, std::min<size_t>(count, bytes / config.size));
+							configs.push_back(config);
+						}
+
+	std::cout << "[" << std::endl;
+	for (size_t i = 0; i < configs.size(); ++i)
+	{
+		auto result = runBench(configs[i]);
+		printResult(configs[i], result, i + 1 == configs.size());
+	}
+	std::cout << "]" << std::endl;
+
+	return 0;
+}
@@ -0,0 +1,289 @@
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include "MFTypes.h"
+#include "PipeConverter.hpp"
+#include "PipeLz.hpp"
+#include "PipeParser.hpp"
+#include "PipeScaler.hpp"
+#include "PipeWire.hpp"
+#include "UdpReliable.hpp"
+
+/**
+ * Component benchmarks of the serialization hot paths, separate from the end-to-end MFPipe_Bench:
+ * MF_FRAME, MF_BUFFER and Message serialize/deserialize, the free serialize() template and
+ * PipeParser::parse fed in fragments of 1, 1500, 65536 bytes and the whole record, for both wire versions,
+ * PipeLz on buffer data, PipeConverter on UYVY video of about the size and PipeScaler on its NV12 conversion.
+ *
+ *   MFPipe_MicroBench [--sizes 64,65536,1048576] [--seconds 0.2]
+ *
+ * Every case is repeated until it has run for the given time and printed as one JSON object
+ * with ns per object and GB/s of serialized bytes.
+ */
+
+static volatile size_t sink = 0;
+
+static std::string argValue(char **begin, char **end, const std::string &arg, const std::string &defaultValue)
+{
+	auto it = std::find(begin, end, arg);
+	if (it == end || it + 1 == end)
+		return defaultValue;
+	return *(it + 1);
+}
+
+static std::vector<size_t> toList(const std::string &str)
+{
+	std::vector<size_t> res;
+	std::stringstream ss(str);
+	std::string item;
+	while (std::getline(ss, item, ','))
+		res.push_back(std::stoull(item));
+	return res;
+}
+
+static std::shared_ptr<MF_FRAME> makeFrame(size_t size)
+{
+	auto frame = std::make_shared<MF_FRAME>();
+	frame->time.rtStartTime = 0;
+	frame->time.rtEndTime = 1;
+	frame->av_props.vidProps.fccType = eMFCC_I420;
+	frame->av_props.vidProps.nWidth = 1920;
+	frame->av_props.vidProps.nHeight = 1080;
+	frame->av_props.vidProps.nRowBytes = 1920;
+	frame->av_props.vidProps.dblRate = 25.0;
+	frame->av_props.audProps.nChannels = 2;
+	frame->av_props.audProps.nSamplesPerSec = 48000;
+	frame->av_props.audProps.nBitsPerSample = 16;
+	frame->str_user_props = "user_props";
+	frame->vec_video_data.resize(size);
+	frame->vec_audio_data.resize(size / 16);
+	for (size_t i = 0; i < frame->vec_video_data.size(); ++i)
+		frame->vec_video_data[i] = static_cast<uint8_t>(i);
+	return frame;
+}
+
+static std::shared_ptr<MF_BUFFER> makeBuffer(size_t size)
+{
+	auto buffer = std::make_shared<MF_BUFFER>();
+	buffer->flags = eMFBF_Buffer;
+	buffer->data.resize(size);
+	for (size_t i = 0; i < buffer->data.size(); ++i)
+		buffer->data[i] = static_cast<uint8_t>(i);
+	return buffer;
+}
+
+static std::shared_ptr<Message> makeMessage(size_t size)
+{
+	auto message = std::make_shared<Message>();
+	message->name = "event";
+	message->param = std::string(size, 'p');
+	return message;
+}
+
+/**
+ * @brief Runs body until minSeconds elapsed and prints the result.
+ * @param body Processes one object and returns the number of bytes it handled.
+ */
+static void run(const std::string &name, size_t size, double minSeconds, const std::function<size_t()> &body, bool &first)
+{
+	size_t iterations = 0;
+	size_t bytes = 0;
+
+	// Warm up allocator and caches.
+	for (auto i = 0; i < 3; ++i)
+		sink = sink + body();
+
+	const auto start = std::chrono::steady_clock::now();
+	double elapsed = 0;
+	do
+	{
+		for (auto i = 0; i < 8; ++i)
+		{
+			bytes += body();
+			iterations++;
+		}
+		elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	} while (elapsed < minSeconds);
+
+	sink = sink + bytes;
+
+	std::cout << (first ? "  " : ", \n  ")
+			  << "{\"case\": \"" << name << "\", "
+			  << "\"size\": " << size << ", "
+			  << "\"iterations\": " << iterations << ", "
+			  << "\"ns_per_object\": " << elapsed * 1e9 / iterations << ", "
+			  << "\"gb_per_sec\": " << bytes / elapsed / (1024.0 * 1024.0 * 1024.0) << "}";
+	first = false;
+}
+
+/**
+ * @brief Parses serialized record fed in fragments of given size.
+ */
+static size_t parseFragmented(PipeParser &parser, const std::vector<uint8_t> &bytes, size_t fragment)
+{
+	size_t pos = 0;
+	while (pos < bytes.size())
+	{
+		const auto chunk = std::min(fragment, bytes.size() - pos);
+		size_t parsed = 0;
+		while (parsed < chunk)
+		{
+			parsed += parser.parse(bytes.data() + pos + parsed, chunk - parsed);
+			const auto state = parser.getState();
+			if (state == PipeParser::State::FRAME_READY
+					|| state == PipeParser::State::BUFFER_READY
+					|| state == PipeParser::State::MESSAGE_READY)
+			{
+				sink = sink + parser.getData().size();
+				parser.reset();
+			}
+		}
+		pos += chunk;
+	}
+	return bytes.size();
+}
+
+int main(int argc, char *argv[])
+{
+	const auto sizes = toList(argValue(argv, argv + argc, "--sizes", "64,65536,1048576"));
+	const auto seconds = std::stod(argValue(argv, argv + argc, "--seconds", "0.2"));
+
+	bool first = true;
+	std::cout << "[" << std::endl;
+
+	for (auto size : sizes)
+	{
+		const auto frame = makeFrame(size);
+		const auto buffer = makeBuffer(size);
+		const auto message = makeMessage(size);
+
+		const auto frameBytes = frame->serialize();
+		const auto bufferBytes = buffer->serialize();
+		const auto messageBytes = message->serialize();
+
+		// Type byte is consumed by the parser before deserialize is called.
+		const std::vector<uint8_t> frameRaw(frameBytes.begin() + 1, frameBytes.end());
+		const std::vector<uint8_t> bufferRaw(bufferBytes.begin() + 1, bufferBytes.end());
+		const std::vector<uint8_t> messageRaw(messageBytes.begin() + 1, messageBytes.end());
+
+		run("MF_FRAME::serialize", size, seconds, [&]() {
+			return frame->serialize().size();
+		}, first);
+
+		run("MF_FRAME::deserialize", size, seconds, [&]() {
+			std::unique_ptr<MF_BASE_TYPE> res(MF_FRAME().deserialize(frameRaw));
+			return frameBytes.size();
+		}, first);
+
+		run("MF_BUFFER::serialize", size, seconds, [&]() {
+			return buffer->serialize().size();
+		}, first);
+
+		run("MF_BUFFER::deserialize", size, seconds, [&]() {
+			std::unique_ptr<MF_BASE_TYPE> res(MF_BUFFER().deserialize(bufferRaw));
+			return bufferBytes.size();
+		}, first);
+
+		run("Message::serialize", size, seconds, [&]() {
+			return message->serialize().size();
+		}, first);
+
+		run("Message::deserialize", size, seconds, [&]() {
+			sink = sink + Message().deserialize(messageRaw).param.size();
+			return messageBytes.size();
+		}, first);
+
+		run("serialize(channel, MF_FRAME)", size, seconds, [&]() {
+			return serialize("channel", frame).size();
+		}, first);
+
+		run("serialize(channel, MF_BUFFER)", size, seconds, [&]() {
+			return serialize("channel", buffer).size();
+		}, first);
+
+		std::vector<uint8_t> block(PipeLz::bound(buffer->data.size()));
+		run("PipeLz::compress(MF_BUFFER)", size, seconds, [&]() {
+			sink = sink + PipeLz::compress(buffer->data.data(), buffer->data.size(), block.data());
+			return buffer->data.size();
+		}, first);
+
+		block.resize(PipeLz::compress(buffer->data.data(), buffer->data.size(), block.data()));
+		std::vector<uint8_t> decompressed(buffer->data.size());
+		run("PipeLz::decompress(MF_BUFFER)", size, seconds, [&]() {
+			PipeLz::decompress(block.data(), block.size(), decompressed.data(), decompressed.size());
+			return buffer->data.size();
+		}, first);
+
+		MF_FRAME uyvy;
+		uyvy.av_props.vidProps.fccType = eMFCC_UYVY;
+		uyvy.av_props.vidProps.nWidth = 512;
+		uyvy.av_props.vidProps.nHeight = static_cast<int>(std::max<size_t>(size / 1024, 2));
+		uyvy.av_props.vidProps.nRowBytes = 1024;
+		uyvy.vec_video_data.assign(1024 * static_cast<size_t>(uyvy.av_props.vidProps.nHeight), 0x80);
+		MF_FRAME nv12;
+		PipeConverter converter;
+		run("PipeConverter::convert(UYVY to NV12)", size, seconds, [&]() {
+			converter.convert(uyvy, eMFCC_NV12, nv12);
+			return uyvy.vec_video_data.size();
+		}, first);
+
+		MF_FRAME preview;
+		PipeScaler scaler;
+		run("PipeScaler::downscale(NV12 to 1/4)", size, seconds, [&]() {
+			scaler.downscale(nv12, 128, std::max(nv12.av_props.vidProps.nHeight / 4, 1), preview);
+			return nv12.vec_video_data.size();
+		}, first);
+
+		std::vector<uint8_t> wireBuffer;
+		run("PipeWire::serializeTo(v2, MF_FRAME)", size, seconds, [&]() {
+			wireBuffer.clear();
+			PipeWire::serializeTo(wireBuffer, PipeWire::VERSION_2, "channel", *frame);
+			return wireBuffer.size();
+		}, first);
+
+		// Unchanged video after the reference, so tile compares take all the time.
+		PipeWire::FrameProps deltaProps;
+		PipeWire::Options deltaOptions;
+		deltaOptions.props = &deltaProps;
+		deltaOptions.deltaVideo = true;
+		run("PipeWire::serializeTo(v2 video delta, static MF_FRAME)", size, seconds, [&]() {
+			wireBuffer.clear();
+			PipeWire::serializeTo(wireBuffer, PipeWire::VERSION_2, "channel", *frame, deltaOptions);
+			return frame->vec_video_data.size();
+		}, first);
+
+		// Datagrams of 64 KiB with parity of each 8, socket left out.
+		UdpReliable parity(0, [](const uint8_t *data, size_t size) { sink = sink + size; });
+		parity.setParity(8);
+		parity.setRetransmit(false);
+		run("UdpReliable::send(fec=8)", size, seconds, [&]() {
+			const auto &data = frame->vec_video_data;
+			for (size_t offset = 0; offset < data.size();)
+				offset += parity.send(data.data() + offset, data.size() - offset, 65507);
+			return data.size();
+		}, first);
+
+		for (uint8_t version : { PipeWire::VERSION_1, PipeWire::VERSION_2 })
+		{
+			std::vector<uint8_t> record;
+			PipeWire::serializeTo(record, version, "channel", *frame);
+			for (size_t fragment : { static_cast<size_t>(1), static_cast<size_t>(1500), static_cast<size_t>(65536), record.size() })
+			{
+				PipeParser parser;
+				const auto name = "PipeParser::parse(v" + std::to_string(version) + " MF_FRAME, fragment="
+						+ (fragment == record.size() ? std::string("whole") : std::to_string(fragment)) + ")";
+				run(name, size, seconds, [&]() {
+					return parseFragmented(parser, record, fragment);
+				}, first);
+			}
+		}
+	}
+
+	std::cout << std::endl << "]" << std::endl;
+
+	return 0;
+}
@@ -0,0 +1,119 @@
+#include "PipeAlloc.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+static constexpr size_t STAGES = static_cast<size_t>(PipeAlloc::Stage::COUNT);
+
+static std::atomic<uint64_t> counts[STAGES];
+static std::atomic<uint64_t> sizes[STAGES];
+
+thread_local PipeAlloc::Stage PipeAlloc::stage = PipeAlloc::Stage::OTHER;
+
+bool PipeAlloc::isEnabled()
+{
+#ifdef MFPIPE_ALLOC_STATS
+	return true;
+#else
+	return false;
+#endif
+}
+
+uint64_t PipeAlloc::count(Stage stage)
+{
+	return counts[static_cast<size_t>(stage)].load(std::memory_order_relaxed);
+}
+
+uint64_t PipeAlloc::bytes(Stage stage)
+{
+	return sizes[static_cast<size_t>(stage)].load(std::memory_order_relaxed);
+}
+
+uint64_t PipeAlloc::total()
+{
+	uint64_t res = 0;
+	for (const auto &count : counts)
+		res += count.load(std::memory_order_relaxed);
+	return res;
+}
+
+void PipeAlloc::reset()
+{
+	for (size_t i = 0; i < STAGES; ++i)
+	{
+		counts[i] = 0;
+		sizes[i] = 0;
+	}
+}
+
+const char *PipeAlloc::stageName(Stage stage)
+{
+	switch (stage)
+	{
+		case Stage::OTHER:
+			return "other";
+		case Stage::SERIALIZE:
+			return "serialize";
+		case Stage::PARSER:
+			return "parser";
+		case Stage::DESERIALIZE:
+			return "deserialize";
+		case Stage::QUEUE:
+			return "queue";
+		case Stage::MESSAGE:
+			return "message";
+		case Stage::CHANNEL:
+			return "channel";
+		case Stage::CONVERT:
+			return "convert";
+		case Stage::COUNT:
+			break;
+	}
+	return "unknown";
+}
+
+void PipeAlloc::onAllocation(size_t size)
+{
+	const auto idx = static_cast<size_t>(stage);
+	counts[idx].fetch_add(1, std::memory_order_relaxed);
+	sizes[idx].fetch_add(size, std::memory_order_relaxed);
+}
+
+#ifdef MFPIPE_ALLOC_STATS
+
+// Replaced for the whole program, so allocations of the application are counted as OTHER.
+void *operator new(size_t size)
+{
+	PipeAlloc::onAllocation(size);
+	if (auto ptr = std::malloc(size != 0 ? size : 1))
+		return ptr;
+	throw std::bad_alloc();
+}
+
+void *operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void *ptr) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept
+{
+	std::free(ptr);
+}
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef PIPEALLOC_HPP
+#define PIPEALLOC_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Heap allocation accounting by pipe stage.
+ *        Built with MFPIPE_ALLOC_STATS global operator new counts every allocation
+ *        against the stage the allocating thread is in, set by PIPE_ALLOC_SCOPE.
+ *        Without it counters stay zero and scopes compile to nothing.
+ */
+class PipeAlloc
+{
+public:
+	enum class Stage
+	{
+		OTHER = 0x00,
+		SERIALIZE,
+		PARSER,
+		DESERIALIZE,
+		QUEUE,
+		MESSAGE,
+		CHANNEL,
+		CONVERT,
+		COUNT,
+	};
+
+	static bool isEnabled();
+
+	static uint64_t count(Stage stage);
+	static uint64_t bytes(Stage stage);
+	static uint64_t total();
+	static void reset();
+
+	static const char *stageName(Stage stage);
+
+	static void onAllocation(size_t size);
+
+	static thread_local Stage stage;
+};
+
+/**
+ * @brief Attributes allocations of the current thread to a stage until the end of scope.
+ */
+class PipeAllocScope
+{
+public:
+	explicit PipeAllocScope(PipeAlloc::Stage stage)
+		: previous(PipeAlloc::stage)
+	{
+		PipeAlloc::stage = stage;
+	}
+
+	~PipeAllocScope()
+	{
+		PipeAlloc::stage = previous;
+	}
+
+	PipeAllocScope(const PipeAllocScope &) = delete;
+	PipeAllocScope &operator=(const PipeAllocScope &) = delete;
+
+private:
+	PipeAlloc::Stage previous;
+};
+
+#ifdef MFPIPE_ALLOC_STATS
+#define PIPE_ALLOC_SCOPE(stage) PipeAllocScope pipeAllocScope(PipeAlloc::Stage::stage)
+#else
+#define PIPE_ALLOC_SCOPE(stage) do {} while (0)
+#endif
+
+#endif // PIPEALLOC_HPP
@@ -0,0 +1,155 @@
+#include "PipeCompressor.hpp"
+
+#include <algorithm>
+
+#include "PipeHints.hpp"
+#include "PipeLz.hpp"
+
+// Objects that shrink less than by 1/8 are sent as is, and their channel skips this many before trying again.
+static constexpr size_t POOR_RATIO_DIVISOR = 8;
+static constexpr size_t BYPASS_OBJECTS = 32;
+static constexpr size_t MAX_THREADS = 4;
+
+/**
+ * @brief Bytes of the object that are compressed: video of frames, data of buffers.
+ */
+static const std::vector<uint8_t> *payloadOf(const MF_BASE_TYPE &object)
+{
+	if (const auto frame = dynamic_cast<const MF_FRAME *>(&object))
+		return &frame->vec_video_data;
+	if (const auto buffer = dynamic_cast<const MF_BUFFER *>(&object))
+		return &buffer->data;
+	return nullptr;
+}
+
+void PipeCompressJob::wait()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	cv.wait(lock, [this]() { return isDone; });
+}
+
+PipeCompressor::PipeCompressor(const std::string &channels, size_t threads)
+	: patterns(hintChannels(channels)),
+	  isRunning(true)
+{
+	if (threads == 0)
+		threads = std::clamp<size_t>(std::thread::hardware_concurrency() / 2, 1, MAX_THREADS);
+
+	for (size_t i = 0; i < threads; ++i)
+		workers.emplace_back(&PipeCompressor::run, this);
+}
+
+PipeCompressor::~PipeCompressor()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		isRunning = false;
+	}
+	cv.notify_all();
+
+	for (auto &worker : workers)
+		worker.join();
+}
+
+std::shared_ptr<PipeCompressJob> PipeCompressor::submit(const std::string &channel,
+														const std::shared_ptr<MF_BASE_TYPE> &object)
+{
+	const auto payload = object ? payloadOf(*object) : nullptr;
+	if (payload == nullptr || payload->empty() || !isHintChannel(patterns, channel))
+		return nullptr;
+
+	auto job = std::make_shared<PipeCompressJob>();
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		auto &state = channels[channel];
+		if (state.bypassLeft > 0)
+		{
+			state.bypassLeft--;
+			state.stats.bypassed++;
+			state.stats.bytesIn += payload->size();
+			state.stats.bytesOut += payload->size();
+			return nullptr;
+		}
+
+		job->object = object;
+		job->channel = channel;
+		jobs.push_back(job);
+	}
+	cv.notify_one();
+
+	return job;
+}
+
+PipeCompressor::Stats PipeCompressor::stats(const std::string &channel) const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	Stats res;
+	for (const auto &state : channels)
+	{
+		if (!channel.empty() && state.first != channel)
+			continue;
+
+		res.compressed += state.second.stats.compressed;
+		res.bypassed += state.second.stats.bypassed;
+		res.bytesIn += state.second.stats.bytesIn;
+		res.bytesOut += state.second.stats.bytesOut;
+	}
+
+	return res;
+}
+
+void PipeCompressor::run()
+{
+	while (true)
+	{
+		std::shared_ptr<PipeCompressJob> job;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			cv.wait(lock, [this]() { return !isRunning || !jobs.empty(); });
+			if (jobs.empty())
+				return;
+
+			job = std::move(jobs.front());
+			jobs.pop_front();
+		}
+
+		compress(*job);
+
+		{
+			std::lock_guard<std::mutex> lock(job->mutex);
+			job->isDone = true;
+		}
+		job->cv.notify_all();
+	}
+}
+
+void PipeCompressor::compress(PipeCompressJob &job)
+{
+	const auto &payload = *payloadOf(*job.object);
+
+	job.rawSize = payload.size();
+	job.data.resize(PipeLz::bound(payload.size()));
+	job.data.resize(PipeLz::compress(payload.data(), payload.size(), job.data.data()));
+
+	const bool isPoor = job.data.size() > payload.size() - payload.size() / POOR_RATIO_DIVISOR;
+	if (isPoor)
+		job.data.clear();
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	auto &state = channels[job.channel];
+	state.stats.bytesIn += payload.size();
+	if (isPoor)
+	{
+		state.bypassLeft = BYPASS_OBJECTS;
+		state.stats.bypassed++;
+		state.stats.bytesOut += payload.size();
+	}
+	else
+	{
+		state.stats.compressed++;
+		state.stats.bytesOut += job.data.size();
+	}
+}
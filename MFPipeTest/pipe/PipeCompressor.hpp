@@ -0,0 +1,95 @@
+#ifndef PIPECOMPRESSOR_HPP
+#define PIPECOMPRESSOR_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "MFTypes.h"
+
+/**
+ * @brief Compression of one queued object. Started by PipePut, awaited by PipeWriter.
+ */
+struct PipeCompressJob
+{
+	std::shared_ptr<MF_BASE_TYPE> object;
+	std::string channel;
+
+	// Result: PipeLz block of video or buffer data, empty when the ratio was too poor to send it.
+	std::vector<uint8_t> data;
+	size_t rawSize = 0;
+
+	/**
+	 * @brief Blocks until the worker finished the job.
+	 */
+	void wait();
+
+private:
+	friend class PipeCompressor;
+
+	std::mutex mutex;
+	std::condition_variable cv;
+	bool isDone = false;
+};
+
+/**
+ * @brief Worker pool compressing video of frames and data of buffers of selected channels with PipeLz,
+ *        so compression runs ahead of PipeWriter instead of in line with it.
+ *        Channel whose objects don't compress well is bypassed for a while and probed again.
+ */
+class PipeCompressor
+{
+public:
+	struct Stats
+	{
+		uint64_t compressed = 0;
+		uint64_t bypassed = 0;
+		uint64_t bytesIn = 0;
+		uint64_t bytesOut = 0;
+	};
+
+	/**
+	 * @param channels Channels separated by '|', "*" selects all, name ending with "*" selects by prefix.
+	 * @param threads Workers, 0 picks by hardware concurrency.
+	 */
+	explicit PipeCompressor(const std::string &channels, size_t threads = 0);
+	~PipeCompressor();
+
+	/**
+	 * @brief Queues object for compression.
+	 * @return nullptr if channel isn't selected, currently bypassed or object has nothing to compress.
+	 */
+	std::shared_ptr<PipeCompressJob> submit(const std::string &channel, const std::shared_ptr<MF_BASE_TYPE> &object);
+
+	/**
+	 * @brief Stats of the channel, totals of all channels for empty name.
+	 */
+	Stats stats(const std::string &channel) const;
+
+private:
+	struct Channel
+	{
+		Stats stats;
+		size_t bypassLeft = 0;
+	};
+
+	void run();
+	void compress(PipeCompressJob &job);
+
+	std::vector<std::string> patterns;
+
+	mutable std::mutex mutex;
+	std::condition_variable cv;
+	std::deque<std::shared_ptr<PipeCompressJob>> jobs;
+	std::map<std::string, Channel> channels;
+	bool isRunning;
+	std::vector<std::thread> workers;
+};
+
+#endif // PIPECOMPRESSOR_HPP
@@ -0,0 +1,402 @@
+#include "PipeConverter.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define PIPE_CONVERTER_SSE2
+#include <emmintrin.h>
+#endif
+
+static constexpr size_t MAX_THREADS = 4;
+// Smaller bands cost more in wakeups than they gain.
+static constexpr size_t MIN_BAND_ROWS = 16;
+static constexpr int ROW_ALIGN = 32;
+// Pixel pairs of 4:2:2 rows split per step, their chroma goes through a stack buffer when it can't go to dst.
+static constexpr size_t CHUNK_PAIRS = 1024;
+
+#ifdef PIPE_CONVERTER_SSE2
+static __m128i load(const uint8_t *ptr)
+{
+	return _mm_loadu_si128(reinterpret_cast<const __m128i *>(ptr));
+}
+
+static void store(uint8_t *ptr, __m128i value)
+{
+	_mm_storeu_si128(reinterpret_cast<__m128i *>(ptr), value);
+}
+
+/**
+ * @brief Even bytes of a and b.
+ */
+static __m128i evenBytes(__m128i a, __m128i b)
+{
+	const auto mask = _mm_set1_epi16(0x00FF);
+	return _mm_packus_epi16(_mm_and_si128(a, mask), _mm_and_si128(b, mask));
+}
+
+/**
+ * @brief Odd bytes of a and b.
+ */
+static __m128i oddBytes(__m128i a, __m128i b)
+{
+	return _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+}
+#endif
+
+static void interleave(const uint8_t *u, const uint8_t *v, uint8_t *dst, size_t n)
+{
+	size_t i = 0;
+#ifdef PIPE_CONVERTER_SSE2
+	for (; i + 16 <= n; i += 16)
+	{
+		const auto a = load(u + i);
+		const auto b = load(v + i);
+		store(dst + 2 * i, _mm_unpacklo_epi8(a, b));
+		store(dst + 2 * i + 16, _mm_unpackhi_epi8(a, b));
+	}
+#endif
+	for (; i < n; ++i)
+	{
+		dst[2 * i] = u[i];
+		dst[2 * i + 1] = v[i];
+	}
+}
+
+static void deinterleave(const uint8_t *src, uint8_t *u, uint8_t *v, size_t n)
+{
+	size_t i = 0;
+#ifdef PIPE_CONVERTER_SSE2
+	for (; i + 16 <= n; i += 16)
+	{
+		const auto a = load(src + 2 * i);
+		const auto b = load(src + 2 * i + 16);
+		store(u + i, evenBytes(a, b));
+		store(v + i, oddBytes(a, b));
+	}
+#endif
+	for (; i < n; ++i)
+	{
+		u[i] = src[2 * i];
+		v[i] = src[2 * i + 1];
+	}
+}
+
+static void swapPairs(const uint8_t *src, uint8_t *dst, size_t n)
+{
+	size_t i = 0;
+#ifdef PIPE_CONVERTER_SSE2
+	for (; i + 8 <= n; i += 8)
+	{
+		const auto a = load(src + 2 * i);
+		store(dst + 2 * i, _mm_or_si128(_mm_slli_epi16(a, 8), _mm_srli_epi16(a, 8)));
+	}
+#endif
+	for (; i < n; ++i)
+	{
+		const auto first = src[2 * i];
+		dst[2 * i] = src[2 * i + 1];
+		dst[2 * i + 1] = first;
+	}
+}
+
+/**
+ * @brief Splits n pixel pairs of two 4:2:2 rows into luma of each row and chroma averaged over both,
+ *        interleaved in source order. yb may be nullptr, b is then the same row as a.
+ */
+static void splitPacked(const uint8_t *a, const uint8_t *b, size_t yOffset,
+						uint8_t *ya, uint8_t *yb, uint8_t *chroma, size_t n)
+{
+	size_t i = 0;
+#ifdef PIPE_CONVERTER_SSE2
+	for (; i + 8 <= n; i += 8)
+	{
+		const auto a0 = load(a + 4 * i);
+		const auto a1 = load(a + 4 * i + 16);
+		const auto b0 = load(b + 4 * i);
+		const auto b1 = load(b + 4 * i + 16);
+		const auto c0 = _mm_avg_epu8(a0, b0);
+		const auto c1 = _mm_avg_epu8(a1, b1);
+
+		if (yOffset == 0)
+		{
+			store(ya + 2 * i, evenBytes(a0, a1));
+			if (yb != nullptr)
+				store(yb + 2 * i, evenBytes(b0, b1));
+			store(chroma + 2 * i, oddBytes(c0, c1));
+		}
+		else
+		{
+			store(ya + 2 * i, oddBytes(a0, a1));
+			if (yb != nullptr)
+				store(yb + 2 * i, oddBytes(b0, b1));
+			store(chroma + 2 * i, evenBytes(c0, c1));
+		}
+	}
+#endif
+	const size_t cOffset = 1 - yOffset;
+	for (; i < n; ++i)
+	{
+		ya[2 * i] = a[4 * i + yOffset];
+		ya[2 * i + 1] = a[4 * i + 2 + yOffset];
+		if (yb != nullptr)
+		{
+			yb[2 * i] = b[4 * i + yOffset];
+			yb[2 * i + 1] = b[4 * i + 2 + yOffset];
+		}
+		// Rounds as _mm_avg_epu8.
+		chroma[2 * i] = static_cast<uint8_t>((a[4 * i + cOffset] + b[4 * i + cOffset] + 1) >> 1);
+		chroma[2 * i + 1] = static_cast<uint8_t>((a[4 * i + 2 + cOffset] + b[4 * i + 2 + cOffset] + 1) >> 1);
+	}
+}
+
+/**
+ * @brief Chroma row given either as planes u and v or as interleaved pairs, swapped for V first.
+ */
+struct ChromaRow
+{
+	uint8_t *u = nullptr;
+	uint8_t *v = nullptr;
+	uint8_t *uv = nullptr;
+	bool isSwapped = false;
+};
+
+static void copyChroma(const ChromaRow &src, const ChromaRow &dst, size_t n)
+{
+	if (src.uv != nullptr)
+	{
+		if (dst.uv != nullptr && src.isSwapped)
+			swapPairs(src.uv, dst.uv, n);
+		else if (dst.uv != nullptr)
+			memcpy(dst.uv, src.uv, 2 * n);
+		else if (src.isSwapped)
+			deinterleave(src.uv, dst.v, dst.u, n);
+		else
+			deinterleave(src.uv, dst.u, dst.v, n);
+	}
+	else if (dst.uv != nullptr)
+	{
+		interleave(src.u, src.v, dst.uv, n);
+	}
+	else
+	{
+		memcpy(dst.u, src.u, n);
+		memcpy(dst.v, src.v, n);
+	}
+}
+
+static uint8_t *rowOf(const uint8_t *data, const PipeVideo::Layout &layout, int plane, size_t row)
+{
+	return const_cast<uint8_t *>(data) + layout.plane[plane].offset + row * layout.plane[plane].stride;
+}
+
+/**
+ * @brief Chroma row of 4:2:0 video in any of the supported formats.
+ */
+static ChromaRow chromaRowOf(const uint8_t *data, eMFCC type, const PipeVideo::Layout &layout, size_t row)
+{
+	ChromaRow res;
+	if (type == eMFCC_NV12)
+	{
+		res.uv = rowOf(data, layout, 1, row);
+	}
+	else
+	{
+		// YV12 has V plane first.
+		res.u = rowOf(data, layout, type == eMFCC_YV12 ? 2 : 1, row);
+		res.v = rowOf(data, layout, type == eMFCC_YV12 ? 1 : 2, row);
+	}
+	return res;
+}
+
+static void zeroPadding(uint8_t *row, const PipeVideo::Plane &plane)
+{
+	memset(row + plane.rowBytes, 0, plane.stride - plane.rowBytes);
+}
+
+static bool isPacked(eMFCC type)
+{
+	return type == eMFCC_YUY2 || type == eMFCC_YVYU || type == eMFCC_UYVY;
+}
+
+PipeConverter::PipeConverter(size_t threads)
+	: generation(0),
+	  nextBand(0),
+	  bandsLeft(0),
+	  isRunning(true)
+{
+	if (threads == 0)
+		threads = std::clamp<size_t>(std::thread::hardware_concurrency() / 2, 1, MAX_THREADS);
+
+	for (size_t i = 0; i < threads; ++i)
+		workers.emplace_back(&PipeConverter::run, this);
+}
+
+PipeConverter::~PipeConverter()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		isRunning = false;
+	}
+	cv.notify_all();
+
+	for (auto &worker : workers)
+		worker.join();
+}
+
+bool PipeConverter::isSupported(eMFCC from, eMFCC to)
+{
+	const bool isSource = from == eMFCC_I420 || from == eMFCC_YV12 || from == eMFCC_NV12 || isPacked(from);
+	const bool isTarget = to == eMFCC_I420 || to == eMFCC_YV12 || to == eMFCC_NV12;
+	return isSource && isTarget;
+}
+
+bool PipeConverter::convert(const MF_FRAME &src, eMFCC fccType, MF_FRAME &dst)
+{
+	const auto &props = src.av_props.vidProps;
+	if (!isSupported(props.fccType, fccType))
+		return false;
+
+	Task next;
+	if (!PipeVideo::layout(props, next.srcLayout) || src.vec_video_data.size() < next.srcLayout.size)
+		return false;
+
+	dst.time = src.time;
+	dst.av_props = src.av_props;
+	dst.av_props.vidProps.fccType = fccType;
+	dst.av_props.vidProps.nRowBytes = (props.nWidth + ROW_ALIGN - 1) / ROW_ALIGN * ROW_ALIGN;
+	dst.str_user_props = src.str_user_props;
+	dst.vec_audio_data = src.vec_audio_data;
+
+	if (!PipeVideo::layout(dst.av_props.vidProps, next.dstLayout))
+		return false;
+	dst.vec_video_data.resize(next.dstLayout.size);
+
+	next.src = src.vec_video_data.data();
+	next.srcType = props.fccType;
+	next.dst = dst.vec_video_data.data();
+	next.dstType = fccType;
+	next.width = static_cast<size_t>(props.nWidth);
+	next.height = static_cast<size_t>(props.nHeight);
+
+	const size_t chromaRows = (next.height + 1) / 2;
+	next.bands = std::clamp<size_t>(chromaRows / MIN_BAND_ROWS, 1, workers.size() + 1);
+	if (next.bands == 1)
+	{
+		convertBand(next, 0);
+		return true;
+	}
+
+	std::unique_lock<std::mutex> lock(mutex);
+	task = next;
+	nextBand = 0;
+	bandsLeft = task.bands;
+	generation++;
+	cv.notify_all();
+
+	work(lock);
+	doneCv.wait(lock, [this]() { return bandsLeft == 0; });
+
+	return true;
+}
+
+/**
+ * @brief Converts chroma rows of the band and the luma row pairs they cover.
+ */
+void PipeConverter::convertBand(const Task &task, size_t band)
+{
+	const size_t chromaRows = (task.height + 1) / 2;
+	const size_t chromaWidth = (task.width + 1) / 2;
+	const size_t first = chromaRows * band / task.bands;
+	const size_t last = chromaRows * (band + 1) / task.bands;
+
+	const auto &dstLuma = task.dstLayout.plane[0];
+	const bool isSrcPacked = isPacked(task.srcType);
+	const size_t yOffset = task.srcType == eMFCC_UYVY ? 1 : 0;
+
+	uint8_t buffer[2 * CHUNK_PAIRS];
+
+	for (size_t row = first; row < last; ++row)
+	{
+		const size_t y = 2 * row;
+		const bool hasSecond = y + 1 < task.height;
+		uint8_t *y0 = rowOf(task.dst, task.dstLayout, 0, y);
+		uint8_t *y1 = hasSecond ? rowOf(task.dst, task.dstLayout, 0, y + 1) : nullptr;
+		const auto dstChroma = chromaRowOf(task.dst, task.dstType, task.dstLayout, row);
+
+		if (!isSrcPacked)
+		{
+			memcpy(y0, rowOf(task.src, task.srcLayout, 0, y), task.width);
+			if (hasSecond)
+				memcpy(y1, rowOf(task.src, task.srcLayout, 0, y + 1), task.width);
+			copyChroma(chromaRowOf(task.src, task.srcType, task.srcLayout, row), dstChroma, chromaWidth);
+		}
+		else
+		{
+			const uint8_t *a = rowOf(task.src, task.srcLayout, 0, y);
+			const uint8_t *b = hasSecond ? rowOf(task.src, task.srcLayout, 0, y + 1) : a;
+
+			ChromaRow srcChroma;
+			srcChroma.isSwapped = task.srcType == eMFCC_YVYU;
+
+			// Luma of odd widths takes one byte of padding of the aligned dst row, which is zeroed below.
+			for (size_t pos = 0; pos < chromaWidth; pos += CHUNK_PAIRS)
+			{
+				const size_t n = std::min(CHUNK_PAIRS, chromaWidth - pos);
+				const bool isDirect = dstChroma.uv != nullptr && !srcChroma.isSwapped;
+				srcChroma.uv = isDirect ? dstChroma.uv + 2 * pos : buffer;
+
+				splitPacked(a + 4 * pos, b + 4 * pos, yOffset, y0 + 2 * pos, hasSecond ? y1 + 2 * pos : nullptr,
+							srcChroma.uv, n);
+				if (isDirect)
+					continue;
+
+				ChromaRow dstPart;
+				dstPart.uv = dstChroma.uv != nullptr ? dstChroma.uv + 2 * pos : nullptr;
+				dstPart.u = dstChroma.u != nullptr ? dstChroma.u + pos : nullptr;
+				dstPart.v = dstChroma.v != nullptr ? dstChroma.v + pos : nullptr;
+				copyChroma(srcChroma, dstPart, n);
+			}
+		}
+
+		zeroPadding(y0, dstLuma);
+		if (hasSecond)
+			zeroPadding(y1, dstLuma);
+		for (auto i = 1; i < task.dstLayout.planes; ++i)
+			zeroPadding(rowOf(task.dst, task.dstLayout, i, row), task.dstLayout.plane[i]);
+	}
+}
+
+void PipeConverter::run()
+{
+	uint64_t seen = 0;
+
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true)
+	{
+		cv.wait(lock, [this, seen]() { return !isRunning || generation != seen; });
+		if (!isRunning)
+			return;
+
+		seen = generation;
+		work(lock);
+	}
+}
+
+/**
+ * @brief Takes bands of the current task until none is left. Called with lock held.
+ */
+void PipeConverter::work(std::unique_lock<std::mutex> &lock)
+{
+	while (nextBand < task.bands)
+	{
+		const auto band = nextBand++;
+
+		lock.unlock();
+		convertBand(task, band);
+		lock.lock();
+
+		if (--bandsLeft == 0)
+			doneCv.notify_all();
+	}
+}
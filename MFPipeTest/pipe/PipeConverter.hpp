@@ -0,0 +1,67 @@
+#ifndef PIPECONVERTER_HPP
+#define PIPECONVERTER_HPP
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "MFTypes.h"
+#include "PipeVideo.hpp"
+
+/**
+ * @brief Converts video of received frames between YUV formats with SSE2 kernels where available.
+ *        Frame is split into bands of rows converted by a worker pool, calling thread takes a band too.
+ *        I420, YV12, NV12, YUY2, YVYU and UYVY convert into I420, YV12 and NV12,
+ *        chroma of 4:2:2 formats is averaged over row pairs.
+ */
+class PipeConverter
+{
+public:
+	/**
+	 * @param threads Workers besides the calling thread, 0 picks by hardware concurrency.
+	 */
+	explicit PipeConverter(size_t threads = 0);
+	~PipeConverter();
+
+	static bool isSupported(eMFCC from, eMFCC to);
+
+	/**
+	 * @brief Converts src into dst of given format. dst gets times, props and audio of src,
+	 *        its video rows are aligned to 32 bytes with zeroed padding. Called from one thread at a time.
+	 * @return false if conversion isn't supported or video of src doesn't match its props.
+	 */
+	bool convert(const MF_FRAME &src, eMFCC fccType, MF_FRAME &dst);
+
+private:
+	struct Task
+	{
+		const uint8_t *src = nullptr;
+		eMFCC srcType = eMFCC_Default;
+		PipeVideo::Layout srcLayout;
+		uint8_t *dst = nullptr;
+		eMFCC dstType = eMFCC_Default;
+		PipeVideo::Layout dstLayout;
+		size_t width = 0;
+		size_t height = 0;
+		size_t bands = 0;
+	};
+
+	static void convertBand(const Task &task, size_t band);
+
+	void run();
+	void work(std::unique_lock<std::mutex> &lock);
+
+	std::mutex mutex;
+	std::condition_variable cv;
+	std::condition_variable doneCv;
+	Task task;
+	uint64_t generation;
+	size_t nextBand;
+	size_t bandsLeft;
+	bool isRunning;
+	std::vector<std::thread> workers;
+};
+
+#endif // PIPECONVERTER_HPP
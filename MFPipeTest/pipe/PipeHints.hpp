@@ -0,0 +1,90 @@
+#ifndef PIPEHINTS_HPP
+#define PIPEHINTS_HPP
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Returns value of "key=value" token from hints string.
+ *        Tokens are separated by spaces, commas or semicolons.
+ */
+inline std::string hintValue(const std::string &hints, const std::string &key, const std::string &defaultValue = "")
+{
+	static constexpr auto separators = " ,;";
+
+	size_t pos = hints.find_first_not_of(separators);
+	while (pos != std::string::npos)
+	{
+		const auto end = hints.find_first_of(separators, pos);
+		const auto token = hints.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+
+		const auto eq = token.find('=');
+		if (eq != std::string::npos && token.compare(0, eq, key) == 0)
+			return token.substr(eq + 1);
+
+		pos = end == std::string::npos ? end : hints.find_first_not_of(separators, end);
+	}
+
+	return defaultValue;
+}
+
+/**
+ * @brief Checks whether hints open the pipe in mode 'R' or 'W'. Mode is a token of its own, "R", "W" or both
+ *        as "RW", so letters of other tokens ("compress=Raw*") don't count.
+ */
+inline bool hasHintMode(const std::string &hints, char mode)
+{
+	static constexpr auto separators = " ,;";
+
+	size_t pos = hints.find_first_not_of(separators);
+	while (pos != std::string::npos)
+	{
+		const auto end = hints.find_first_of(separators, pos);
+		const auto token = hints.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+
+		if (token.find_first_not_of("RW") == std::string::npos && token.find(mode) != std::string::npos)
+			return true;
+
+		pos = end == std::string::npos ? end : hints.find_first_not_of(separators, end);
+	}
+
+	return false;
+}
+
+/**
+ * @brief Splits hint value listing channels separated by '|'.
+ */
+inline std::vector<std::string> hintChannels(const std::string &value)
+{
+	std::vector<std::string> res;
+	size_t pos = 0;
+	while (pos <= value.size())
+	{
+		const auto end = std::min(value.find('|', pos), value.size());
+		if (end > pos)
+			res.push_back(value.substr(pos, end - pos));
+		pos = end + 1;
+	}
+
+	return res;
+}
+
+/**
+ * @brief Checks channel against patterns of hintChannels(): "*" selects all,
+ *        name ending with "*" selects by prefix.
+ */
+inline bool isHintChannel(const std::vector<std::string> &patterns, const std::string &channel)
+{
+	for (const auto &pattern : patterns)
+	{
+		if (pattern == "*" || pattern == channel)
+			return true;
+		if (pattern.back() == '*' && channel.compare(0, pattern.size() - 1, pattern, 0, pattern.size() - 1) == 0)
+			return true;
+	}
+
+	return false;
+}
+
+#endif // PIPEHINTS_HPP
@@ -0,0 +1,114 @@
+#include "PipeJitter.hpp"
+
+#include <algorithm>
+
+// Minimum transit is taken over two windows, so it follows drift of the clocks.
+static constexpr int64_t BASE_WINDOW_NS = 2000 * 1000 * 1000LL;
+// Larger change of transit is a jump of media time rather than jitter.
+static constexpr int64_t DISCONTINUITY_NS = 2000 * 1000 * 1000LL;
+static constexpr int64_t DELAY_MARGIN_NS = 1000 * 1000;
+// Jitter estimate starts at the max delay, jumps up with late arrivals and decays by 1/64 of the difference
+// with each frame, so the delay comes down to what the network needs in a few seconds of video.
+static constexpr int64_t JITTER_DECAY = 64;
+
+PipeJitter::PipeJitter()
+	: pendingCount(0),
+	  late(0)
+{}
+
+bool PipeJitter::push(Entry entry, REFERENCE_TIME start, int64_t maxDelayNs, int64_t nowNs)
+{
+	if (entry.channel >= channels.size())
+		channels.resize(entry.channel + 1);
+
+	auto &channel = channels[entry.channel];
+	channel.maxDelay = maxDelayNs;
+
+	// Media time is in 100 ns units.
+	const int64_t transit = nowNs - start * 100;
+	if (channel.hasBase && (transit - channel.base > DISCONTINUITY_NS || channel.base - transit > DISCONTINUITY_NS))
+	{
+		channel.isFlushing = !channel.pending.empty();
+		channel.hasBase = false;
+		channel.hasReleased = false;
+	}
+
+	if (!channel.hasBase)
+	{
+		channel.hasBase = true;
+		channel.jitter = maxDelayNs;
+		channel.windowMin = transit;
+		channel.previousMin = transit;
+		channel.windowStart = nowNs;
+	}
+	if (nowNs - channel.windowStart >= BASE_WINDOW_NS)
+	{
+		channel.previousMin = channel.windowMin;
+		channel.windowMin = transit;
+		channel.windowStart = nowNs;
+	}
+	channel.windowMin = std::min(channel.windowMin, transit);
+	channel.base = std::min(channel.previousMin, channel.windowMin);
+
+	const int64_t sample = transit - channel.base;
+	channel.jitter = sample > channel.jitter ? sample : channel.jitter + (sample - channel.jitter) / JITTER_DECAY;
+
+	if (channel.hasReleased && start < channel.lastReleased)
+	{
+		late++;
+		return false;
+	}
+
+	// Frames mostly come in order, so the place is searched from the back. New timeline goes after the old one.
+	auto it = channel.pending.end();
+	while (!channel.isFlushing && it != channel.pending.begin() && std::prev(it)->start > start)
+		--it;
+	channel.pending.insert(it, { start, std::move(entry) });
+	pendingCount++;
+	return true;
+}
+
+void PipeJitter::release(int64_t nowNs, std::vector<Entry> &out)
+{
+	if (pendingCount == 0)
+		return;
+
+	for (auto &channel : channels)
+	{
+		const int64_t target = delay(channel);
+		while (!channel.pending.empty())
+		{
+			auto &front = channel.pending.front();
+			if (!channel.isFlushing && front.start * 100 + channel.base + target > nowNs)
+				break;
+
+			if (!channel.isFlushing)
+			{
+				channel.hasReleased = true;
+				channel.lastReleased = front.start;
+			}
+			out.push_back(std::move(front.entry));
+			channel.pending.pop_front();
+			pendingCount--;
+		}
+		channel.isFlushing = false;
+	}
+}
+
+int64_t PipeJitter::getDelay(ChannelId channel) const
+{
+	return channel < channels.size() ? delay(channels[channel]) : 0;
+}
+
+uint64_t PipeJitter::getLate() const
+{
+	return late;
+}
+
+/**
+ * @brief Target delay, a quarter over the jitter estimate.
+ */
+int64_t PipeJitter::delay(const Channel &channel) const
+{
+	return std::min(channel.jitter + channel.jitter / 4 + DELAY_MARGIN_NS, channel.maxDelay);
+}
@@ -0,0 +1,84 @@
+#ifndef PIPEJITTER_HPP
+#define PIPEJITTER_HPP
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "MFTypes.h"
+
+/**
+ * @brief Jitter buffer of the read path. Frames of a channel wait in order of time.rtStartTime and are released
+ *        when their media time plus the smallest transit seen plus target delay comes. Target delay follows
+ *        the measured jitter of arrivals, up to the max delay of the channel.
+ *        Times are steady clock ns. Used by one thread.
+ */
+class PipeJitter
+{
+public:
+	struct Entry
+	{
+		ChannelId channel = NO_CHANNEL_ID;
+		// Name of the channel, kept valid by DataBuffer.
+		const std::string *channelName = nullptr;
+		std::shared_ptr<MF_BASE_TYPE> object;
+		int64_t putTime = 0;
+		uint64_t traceId = 0;
+	};
+
+	PipeJitter();
+
+	/**
+	 * @brief Buffers frame that arrived at nowNs. Frame earlier than one released already is dropped as late.
+	 * @return false if frame was dropped.
+	 */
+	bool push(Entry entry, REFERENCE_TIME start, int64_t maxDelayNs, int64_t nowNs);
+
+	/**
+	 * @brief Appends frames due at nowNs to out, each channel in order of start times.
+	 */
+	void release(int64_t nowNs, std::vector<Entry> &out);
+
+	/**
+	 * @brief Target delay of the channel.
+	 */
+	int64_t getDelay(ChannelId channel) const;
+
+	/**
+	 * @brief Frames dropped as late so far.
+	 */
+	uint64_t getLate() const;
+
+private:
+	struct Pending
+	{
+		REFERENCE_TIME start;
+		Entry entry;
+	};
+
+	struct Channel
+	{
+		std::deque<Pending> pending;
+		int64_t maxDelay = 0;
+		// Transit is arrival time minus media time, base is its minimum over the last windows.
+		bool hasBase = false;
+		int64_t base = 0;
+		int64_t windowMin = 0;
+		int64_t previousMin = 0;
+		int64_t windowStart = 0;
+		int64_t jitter = 0;
+		bool hasReleased = false;
+		REFERENCE_TIME lastReleased = 0;
+		// Media time jumped, frames of the old timeline go at once.
+		bool isFlushing = false;
+	};
+
+	int64_t delay(const Channel &channel) const;
+
+	std::vector<Channel> channels;
+	size_t pendingCount;
+	uint64_t late;
+};
+
+#endif // PIPEJITTER_HPP
@@ -0,0 +1,183 @@
+#include "PipeLatency.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <unordered_map>
+
+static constexpr int SUB_BITS = 5;
+static constexpr uint64_t SUB_BUCKETS = 1 << SUB_BITS;
+static constexpr int MAX_EXPONENT = 47; // ~39 hours, larger values go to the last bucket.
+static constexpr size_t BUCKETS = (MAX_EXPONENT - SUB_BITS + 2) * SUB_BUCKETS;
+static constexpr size_t KINDS = 3;
+
+static size_t bucketIndex(uint64_t ns)
+{
+	if (ns < SUB_BUCKETS)
+		return ns;
+
+	const int exponent = std::bit_width(ns) - 1;
+	if (exponent > MAX_EXPONENT)
+		return BUCKETS - 1;
+
+	return (exponent - SUB_BITS + 1) * SUB_BUCKETS + ((ns >> (exponent - SUB_BITS)) & (SUB_BUCKETS - 1));
+}
+
+static int64_t bucketValue(size_t index)
+{
+	if (index < SUB_BUCKETS)
+		return static_cast<int64_t>(index);
+
+	const int shift = static_cast<int>(index / SUB_BUCKETS) - 1;
+	const uint64_t low = (SUB_BUCKETS + index % SUB_BUCKETS) << shift;
+	return static_cast<int64_t>(low + ((uint64_t(1) << shift) >> 1));
+}
+
+/**
+ * @brief Histogram of one channel and kind, written by a single thread.
+ *        Relaxed load/store is enough for the writer, readers may see a sample partially applied.
+ */
+struct LatencyHistogram
+{
+	std::string channel;
+	PipeLatency::Kind kind;
+	std::atomic<uint64_t> count { 0 };
+	std::atomic<uint64_t> sum { 0 };
+	std::atomic<int64_t> min { std::numeric_limits<int64_t>::max() };
+	std::atomic<int64_t> max { 0 };
+	std::array<std::atomic<uint64_t>, BUCKETS> buckets {};
+
+	void add(int64_t ns)
+	{
+		auto &bucket = buckets[bucketIndex(static_cast<uint64_t>(ns))];
+		bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		sum.store(sum.load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+		if (ns < min.load(std::memory_order_relaxed))
+			min.store(ns, std::memory_order_relaxed);
+		if (ns > max.load(std::memory_order_relaxed))
+			max.store(ns, std::memory_order_relaxed);
+		count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+};
+
+/**
+ * @brief Histograms the thread records into, per pipe. Entries of closed pipes are pruned lazily.
+ */
+struct ThreadHistograms
+{
+	std::weak_ptr<int> alive;
+	std::unordered_map<std::string, std::array<LatencyHistogram *, KINDS>> channels;
+};
+
+static thread_local std::unordered_map<uint64_t, ThreadHistograms> threadHistograms;
+static std::atomic<uint64_t> nextId(1);
+
+PipeLatency::PipeLatency()
+	: id(nextId++),
+	  alive(std::make_shared<int>(0))
+{}
+
+PipeLatency::~PipeLatency() = default;
+
+int64_t PipeLatency::now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void PipeLatency::record(Kind kind, const std::string &channel, int64_t ns)
+{
+	// Clocks of different hosts may go backwards relative to each other.
+	threadHistogram(kind, channel)->add(ns > 0 ? ns : 0);
+}
+
+LatencyHistogram *PipeLatency::threadHistogram(Kind kind, const std::string &channel)
+{
+	auto it = threadHistograms.find(id);
+	if (it == threadHistograms.end())
+	{
+		for (auto old = threadHistograms.begin(); old != threadHistograms.end();)
+		{
+			if (old->second.alive.expired())
+				old = threadHistograms.erase(old);
+			else
+				++old;
+		}
+		it = threadHistograms.emplace(id, ThreadHistograms { alive, {} }).first;
+	}
+
+	auto channelIt = it->second.channels.find(channel);
+	if (channelIt == it->second.channels.end())
+		channelIt = it->second.channels.emplace(channel, std::array<LatencyHistogram *, KINDS> {}).first;
+
+	auto &slot = channelIt->second[static_cast<size_t>(kind)];
+	if (slot == nullptr)
+	{
+		auto histogram = std::make_unique<LatencyHistogram>();
+		histogram->channel = channel;
+		histogram->kind = kind;
+		slot = histogram.get();
+
+		std::lock_guard<std::mutex> lock(mutex);
+		histograms.push_back(std::move(histogram));
+	}
+
+	return slot;
+}
+
+PipeLatency::Summary PipeLatency::summary(Kind kind, const std::string &channel) const
+{
+	Summary res;
+	std::vector<uint64_t> merged(BUCKETS, 0);
+	uint64_t sum = 0;
+	int64_t min = std::numeric_limits<int64_t>::max();
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (const auto &histogram : histograms)
+		{
+			if (histogram->kind != kind || (!channel.empty() && histogram->channel != channel))
+				continue;
+
+			if (histogram->count.load(std::memory_order_acquire) == 0)
+				continue;
+
+			for (size_t i = 0; i < BUCKETS; ++i)
+				merged[i] += histogram->buckets[i].load(std::memory_order_relaxed);
+			sum += histogram->sum.load(std::memory_order_relaxed);
+			min = std::min(min, histogram->min.load(std::memory_order_relaxed));
+			res.maxNs = std::max(res.maxNs, histogram->max.load(std::memory_order_relaxed));
+		}
+	}
+
+	for (auto count : merged)
+		res.samples += count;
+
+	if (res.samples == 0)
+		return res;
+
+	res.minNs = min;
+	res.meanNs = static_cast<int64_t>(sum / res.samples);
+
+	auto percentile = [&](double p) {
+		const auto rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(p * res.samples)));
+		uint64_t seen = 0;
+		for (size_t i = 0; i < BUCKETS; ++i)
+		{
+			seen += merged[i];
+			if (seen >= rank)
+				return std::clamp(bucketValue(i), res.minNs, res.maxNs);
+		}
+		return res.maxNs;
+	};
+
+	res.p50Ns = percentile(0.5);
+	res.p90Ns = percentile(0.9);
+	res.p99Ns = percentile(0.99);
+	res.p999Ns = percentile(0.999);
+
+	return res;
+}
@@ -0,0 +1,65 @@
+#ifndef PIPELATENCY_HPP
+#define PIPELATENCY_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct LatencyHistogram;
+
+/**
+ * @brief Per-channel latency histograms of one pipe.
+ *        Buckets are log-linear (32 sub-buckets per power of two, ~3% error) like HDR histogram.
+ *        Every thread records into its own histograms without locks, they are merged on read.
+ */
+class PipeLatency
+{
+public:
+	enum class Kind
+	{
+		WRITE_QUEUE = 0x00, // PipePut to writer dequeue.
+		READ_QUEUE,         // Reader enqueue to PipeGet.
+		END_TO_END,         // PipePut to PipeGet, needs put time sent by writer and a shared clock.
+	};
+
+	struct Summary
+	{
+		uint64_t samples = 0;
+		int64_t minNs = 0;
+		int64_t meanNs = 0;
+		int64_t p50Ns = 0;
+		int64_t p90Ns = 0;
+		int64_t p99Ns = 0;
+		int64_t p999Ns = 0;
+		int64_t maxNs = 0;
+	};
+
+	PipeLatency();
+	~PipeLatency();
+
+	/**
+	 * @brief Steady clock time in ns, the same clock on both ends of a pipe on one host.
+	 */
+	static int64_t now();
+
+	void record(Kind kind, const std::string &channel, int64_t ns);
+
+	/**
+	 * @brief Merges histograms of all threads. Empty channel merges all channels.
+	 */
+	Summary summary(Kind kind, const std::string &channel) const;
+
+private:
+	LatencyHistogram *threadHistogram(Kind kind, const std::string &channel);
+
+	const uint64_t id;
+	std::shared_ptr<int> alive;
+
+	mutable std::mutex mutex;
+	std::vector<std::unique_ptr<LatencyHistogram>> histograms;
+};
+
+#endif // PIPELATENCY_HPP
@@ -0,0 +1,196 @@
+#include "PipeLz.hpp"
+
+#include <cstring>
+
+static constexpr int HASH_BITS = 12;
+static constexpr size_t MIN_MATCH = 4;
+static constexpr size_t MAX_OFFSET = 0xFFFF;
+// Last bytes are always literals and matches don't start too close to the end, as in LZ4.
+static constexpr size_t LAST_LITERALS = 5;
+static constexpr size_t MATCH_LIMIT = 12;
+
+static uint32_t read32(const uint8_t *ptr)
+{
+	uint32_t value;
+	memcpy(&value, ptr, sizeof(value));
+	return value;
+}
+
+static uint64_t read64(const uint8_t *ptr)
+{
+	uint64_t value;
+	memcpy(&value, ptr, sizeof(value));
+	return value;
+}
+
+/**
+ * @brief Length of common prefix of a and b, not reaching beyond end of b.
+ */
+static size_t commonLength(const uint8_t *a, const uint8_t *b, const uint8_t *end)
+{
+	const uint8_t *start = b;
+
+	// Word at a time, then the differing word byte by byte.
+	while (end - b >= 8 && read64(a) == read64(b))
+	{
+		a += 8;
+		b += 8;
+	}
+
+	while (b < end && *a == *b)
+	{
+		a++;
+		b++;
+	}
+
+	return static_cast<size_t>(b - start);
+}
+
+static uint32_t hash(uint32_t value)
+{
+	return (value * 2654435761U) >> (32 - HASH_BITS);
+}
+
+static uint8_t *putLength(uint8_t *dst, size_t length)
+{
+	for (; length >= 255; length -= 255)
+		*dst++ = 255;
+	*dst++ = static_cast<uint8_t>(length);
+	return dst;
+}
+
+static uint8_t *putSequence(uint8_t *dst, const uint8_t *literals, size_t literalLength, size_t offset, size_t matchLength)
+{
+	uint8_t *token = dst++;
+	*token = static_cast<uint8_t>((literalLength < 15 ? literalLength : 15) << 4);
+	if (literalLength >= 15)
+		dst = putLength(dst, literalLength - 15);
+
+	memcpy(dst, literals, literalLength);
+	dst += literalLength;
+
+	// Sequence without match ends the block.
+	if (matchLength == 0)
+		return dst;
+
+	*dst++ = static_cast<uint8_t>(offset);
+	*dst++ = static_cast<uint8_t>(offset >> 8);
+
+	const auto length = matchLength - MIN_MATCH;
+	*token |= static_cast<uint8_t>(length < 15 ? length : 15);
+	if (length >= 15)
+		dst = putLength(dst, length - 15);
+
+	return dst;
+}
+
+size_t PipeLz::bound(size_t size)
+{
+	return size + size / 255 + 16;
+}
+
+size_t PipeLz::compress(const uint8_t *src, size_t size, uint8_t *dst)
+{
+	uint8_t *out = dst;
+	size_t anchor = 0;
+
+	if (size > MATCH_LIMIT)
+	{
+		uint32_t table[1 << HASH_BITS];
+		memset(table, 0, sizeof(table));
+
+		const size_t limit = size - MATCH_LIMIT;
+		const size_t matchEnd = size - LAST_LITERALS;
+		size_t pos = 1;
+
+		while (pos < limit)
+		{
+			const auto value = read32(src + pos);
+			const auto h = hash(value);
+			const size_t ref = table[h];
+			table[h] = static_cast<uint32_t>(pos);
+
+			if (pos - ref > MAX_OFFSET || read32(src + ref) != value)
+			{
+				// Incompressible data is skipped faster the longer no match is found.
+				pos += 1 + ((pos - anchor) >> 6);
+				continue;
+			}
+
+			const size_t length = MIN_MATCH + commonLength(src + ref + MIN_MATCH, src + pos + MIN_MATCH, src + matchEnd);
+
+			out = putSequence(out, src + anchor, pos - anchor, pos - ref, length);
+			pos += length;
+			anchor = pos;
+		}
+	}
+
+	out = putSequence(out, src + anchor, size - anchor, 0, 0);
+	return static_cast<size_t>(out - dst);
+}
+
+static bool getLength(const uint8_t *&src, const uint8_t *end, size_t &length)
+{
+	uint8_t byte;
+	do
+	{
+		if (src == end)
+			return false;
+		byte = *src++;
+		length += byte;
+	} while (byte == 255);
+
+	return true;
+}
+
+bool PipeLz::decompress(const uint8_t *src, size_t size, uint8_t *dst, size_t dstSize)
+{
+	const uint8_t *end = src + size;
+	size_t pos = 0;
+
+	while (src < end)
+	{
+		const auto token = *src++;
+
+		size_t literalLength = token >> 4;
+		if (literalLength == 15 && !getLength(src, end, literalLength))
+			return false;
+		if (literalLength > static_cast<size_t>(end - src) || literalLength > dstSize - pos)
+			return false;
+
+		memcpy(dst + pos, src, literalLength);
+		src += literalLength;
+		pos += literalLength;
+
+		if (src == end)
+			break;
+
+		if (end - src < 2)
+			return false;
+		const size_t offset = src[0] | (static_cast<size_t>(src[1]) << 8);
+		src += 2;
+
+		size_t matchLength = token & 0x0F;
+		if (matchLength == 15 && !getLength(src, end, matchLength))
+			return false;
+		matchLength += MIN_MATCH;
+
+		if (offset == 0 || offset > pos || matchLength > dstSize - pos)
+			return false;
+
+		// Match may overlap its own output, which repeats the last offset bytes.
+		const uint8_t *ref = dst + pos - offset;
+		if (offset >= matchLength)
+		{
+			memcpy(dst + pos, ref, matchLength);
+		}
+		else
+		{
+			for (size_t i = 0; i < matchLength; ++i)
+				dst[pos + i] = ref[i];
+		}
+		pos += matchLength;
+	}
+
+	return pos == dstSize;
+}
@@ -0,0 +1,33 @@
+#ifndef PIPELZ_HPP
+#define PIPELZ_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Fast lossless LZ77 block codec in the LZ4 block layout: sequences of a token
+ *        (literal length << 4 | match length - 4), extra length bytes, literals and a 16-bit offset.
+ *        Block doesn't carry its decompressed size, callers send it alongside.
+ */
+class PipeLz
+{
+public:
+	/**
+	 * @brief Largest compressed size of size bytes.
+	 */
+	static size_t bound(size_t size);
+
+	/**
+	 * @brief Compresses src into dst of at least bound(size) bytes.
+	 * @return Compressed size.
+	 */
+	static size_t compress(const uint8_t *src, size_t size, uint8_t *dst);
+
+	/**
+	 * @brief Decompresses block into exactly dstSize bytes.
+	 * @return false if block is malformed or doesn't decompress to dstSize.
+	 */
+	static bool decompress(const uint8_t *src, size_t size, uint8_t *dst, size_t dstSize);
+};
+
+#endif // PIPELZ_HPP
@@ -0,0 +1,180 @@
+#include "PipeMemory.hpp"
+
+#include <algorithm>
+#include <map>
+
+#include "PipeLatency.hpp"
+
+static const std::string PREFIX = "mem://";
+
+PipeMemory::PipeMemory()
+	: reader(nullptr),
+	  readerUsers(0),
+	  state(std::make_shared<Notifier>())
+{}
+
+PipeMemory::~PipeMemory()
+{
+	{
+		std::lock_guard<std::mutex> lock(state->mutex);
+		state->isRunning = false;
+	}
+	state->cv.notify_all();
+
+	if (notifier)
+	{
+		// The last reference may be dropped by a coroutine resumed on the notifier thread itself,
+		// the thread keeps the state and leaves the loop on its own.
+		if (notifier->get_id() == std::this_thread::get_id())
+			notifier->detach();
+		else if (notifier->joinable())
+			notifier->join();
+	}
+}
+
+bool PipeMemory::isMemory(const std::string &pipeId)
+{
+	return pipeId.compare(0, PREFIX.size(), PREFIX) == 0;
+}
+
+std::shared_ptr<PipeMemory> PipeMemory::link(const std::string &pipeId)
+{
+	static std::mutex registryMutex;
+	static std::map<std::string, std::weak_ptr<PipeMemory>> registry;
+
+	std::lock_guard<std::mutex> lock(registryMutex);
+
+	// Links nobody holds any more are forgotten on the way.
+	for (auto it = registry.begin(); it != registry.end();)
+		it = it->second.expired() ? registry.erase(it) : std::next(it);
+
+	auto &entry = registry[pipeId];
+	auto res = entry.lock();
+	if (!res)
+	{
+		res = std::make_shared<PipeMemory>();
+		entry = res;
+	}
+
+	return res;
+}
+
+void PipeMemory::attach(PipeReader *reader)
+{
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		cv.wait(lock, [this]() { return readerUsers == 0; });
+		this->reader = reader;
+	}
+
+	// Writers waiting for a reader may go on now.
+	notifyWriters();
+}
+
+void PipeMemory::detach(PipeReader *reader)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	cv.wait(lock, [this]() { return readerUsers == 0; });
+	if (this->reader == reader)
+		this->reader = nullptr;
+}
+
+void PipeMemory::addWriter(const std::shared_ptr<PipeWaiters> &waiters)
+{
+	std::lock_guard<std::mutex> lock(state->mutex);
+
+	// Writers closed since are forgotten on the way.
+	auto &writers = state->writers;
+	writers.erase(std::remove_if(writers.begin(), writers.end(),
+								 [](const std::weak_ptr<PipeWaiters> &writer) { return writer.expired(); }),
+				  writers.end());
+	writers.push_back(waiters);
+}
+
+bool PipeMemory::put(const std::string &channel, const std::shared_ptr<MF_BASE_TYPE> &object, uint64_t traceId)
+{
+	const auto target = acquireReader();
+	if (target == nullptr)
+		return false;
+
+	const bool res = target->receive(channel, object, PipeLatency::now(), traceId);
+	releaseReader();
+	return res;
+}
+
+bool PipeMemory::put(const std::string &channel, const std::shared_ptr<Message> &message)
+{
+	const auto target = acquireReader();
+	if (target == nullptr)
+		return false;
+
+	const bool res = target->receive(channel, message);
+	releaseReader();
+	return res;
+}
+
+void PipeMemory::notifyWriters()
+{
+	std::lock_guard<std::mutex> lock(state->mutex);
+
+	bool isWaiting = false;
+	for (const auto &writer : state->writers)
+	{
+		const auto waiters = writer.lock();
+		isWaiting = isWaiting || (waiters && waiters->isWaiting());
+	}
+
+	// Nothing to do unless a coroutine waits for space, blocking puts retry on their own.
+	if (!isWaiting)
+		return;
+
+	state->isNotifyPending = true;
+	if (!notifier)
+		notifier.reset(new std::thread(&PipeMemory::notifyLoop, state));
+	state->cv.notify_all();
+}
+
+/**
+ * @brief Attached reader, nullptr if there is none. Lock isn't held during the hand-over,
+ *        as it may come back to the link through waiters and subscribers of the reader.
+ */
+PipeReader *PipeMemory::acquireReader()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (reader != nullptr)
+		readerUsers++;
+	return reader;
+}
+
+void PipeMemory::releaseReader()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (--readerUsers == 0)
+		cv.notify_all();
+}
+
+void PipeMemory::notifyLoop(std::shared_ptr<Notifier> state)
+{
+	std::unique_lock<std::mutex> lock(state->mutex);
+
+	while (true)
+	{
+		state->cv.wait(lock, [&state]() { return state->isNotifyPending || !state->isRunning; });
+		if (!state->isRunning)
+			break;
+
+		state->isNotifyPending = false;
+		for (const auto &writer : state->writers)
+		{
+			if (auto waiters = writer.lock())
+				state->notified.push_back(waiters);
+		}
+
+		lock.unlock();
+		for (const auto &waiters : state->notified)
+			waiters->notify();
+		lock.lock();
+
+		state->notified.clear();
+	}
+}
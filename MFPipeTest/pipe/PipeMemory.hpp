@@ -0,0 +1,90 @@
+#ifndef PIPEMEMORY_HPP
+#define PIPEMEMORY_HPP
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "MFTypes.h"
+#include "PipeReader.hpp"
+#include "PipeWaiters.hpp"
+
+/**
+ * @brief In-process link of a "mem://" pipe. Reader of the pipe attaches its PipeReader, writers in the same
+ *        process hand objects over to it as they are, without serialization or copies of their data.
+ *        Links are kept by name in a process-wide registry while either side holds them.
+ */
+class PipeMemory
+{
+public:
+	PipeMemory();
+	~PipeMemory();
+
+	static bool isMemory(const std::string &pipeId);
+
+	/**
+	 * @brief Link of the pipe, created on first use.
+	 */
+	static std::shared_ptr<PipeMemory> link(const std::string &pipeId);
+
+	/**
+	 * @brief Sets reader that gets objects put on the link, one at a time.
+	 */
+	void attach(PipeReader *reader);
+
+	/**
+	 * @brief Detaches the reader if it is attached, waiting for hand-overs in progress to finish.
+	 */
+	void detach(PipeReader *reader);
+
+	/**
+	 * @brief Registers waiters of a writer, they are notified when reader takes objects.
+	 */
+	void addWriter(const std::shared_ptr<PipeWaiters> &waiters);
+
+	/**
+	 * @brief Hands object over to the reader. Subscribers of the channel are called on this thread
+	 *        unless they have an executor.
+	 * @return false if there is no reader or its queue is full.
+	 */
+	bool put(const std::string &channel, const std::shared_ptr<MF_BASE_TYPE> &object, uint64_t traceId = 0);
+	bool put(const std::string &channel, const std::shared_ptr<Message> &message);
+
+	/**
+	 * @brief Resumes writers waiting for space, called by reader side after it takes objects.
+	 */
+	void notifyWriters();
+
+private:
+	/**
+	 * @brief Writers and what the notifier thread works on. Thread keeps it, as the link may go away
+	 *        with a coroutine the thread resumes.
+	 */
+	struct Notifier
+	{
+		std::mutex mutex;
+		std::condition_variable cv;
+		std::vector<std::weak_ptr<PipeWaiters>> writers;
+		std::vector<std::shared_ptr<PipeWaiters>> notified;
+		bool isNotifyPending = false;
+		bool isRunning = true;
+	};
+
+	PipeReader *acquireReader();
+	void releaseReader();
+	static void notifyLoop(std::shared_ptr<Notifier> state);
+
+	std::mutex mutex;
+	std::condition_variable cv;
+	PipeReader *reader;
+	// Hand-overs in progress, reader isn't detached until they finish.
+	size_t readerUsers;
+	// Writers are notified from a thread of the link, as their put attempts notify the reader in turn.
+	std::shared_ptr<Notifier> state;
+	std::unique_ptr<std::thread> notifier;
+};
+
+#endif // PIPEMEMORY_HPP
@@ -1,11 +1,16 @@
 #include "PipeParser.hpp"
 
+#include <algorithm>
+
 PipeParser::PipeParser()
+	: dictionaryEpoch(0)
 {
 	syncBytes[0] = static_cast<uint8_t>(DATA_SYNC);
 	syncBytes[1] = static_cast<uint8_t>(DATA_SYNC >> 8);
 	syncBytes[2] = static_cast<uint8_t>(DATA_SYNC >> (8 * 2));
 	syncBytes[3] = static_cast<uint8_t>(DATA_SYNC >> (8 * 3));
+	for (auto i = 0; i < 4; ++i)
+		syncBytesV2[i] = static_cast<uint8_t>(DATA_SYNC_V2 >> (8 * i));
 	reset();
 }
 
@@ -13,21 +18,42 @@ void PipeParser::reset()
 {
 	state = State::IDLE;
 	type = DataType::NONE;
+	version = 0;
 	syncCount = 0;
+	varint = 0;
+	varintShift = 0;
 	chunkSize = 0;
 	channel.clear();
+	channelId = NO_CHANNEL_ID;
 	channelSize.clear();
 	data.clear();
 }
 
-std::vector<uint8_t> PipeParser::getData() const
+void PipeParser::restart()
+{
+	reset();
+	dictionary.clear();
+	dictionaryEpoch++;
+}
+
+const std::vector<uint8_t> &PipeParser::getData() const
 {
 	return data;
 }
 
-std::string PipeParser::getChannel() const
+const std::string &PipeParser::getChannel() const
 {
-	return channel;
+	return channelId == NO_CHANNEL_ID ? channel : *dictionary[channelId];
+}
+
+ChannelId PipeParser::getChannelId() const
+{
+	return channelId;
+}
+
+uint32_t PipeParser::getDictionaryEpoch() const
+{
+	return dictionaryEpoch;
 }
 
 PipeParser::State PipeParser::getState() const
@@ -35,25 +61,144 @@ PipeParser::State PipeParser::getState() const
 	return state;
 }
 
+uint8_t PipeParser::getVersion() const
+{
+	return version;
+}
+
+bool PipeParser::readVarint(uint8_t byte)
+{
+	varint |= static_cast<uint64_t>(byte & 0x7F) << varintShift;
+	varintShift += 7;
+	if (byte & 0x80)
+		return false;
+
+	chunkSize = static_cast<size_t>(varint);
+	varint = 0;
+	varintShift = 0;
+	return true;
+}
+
+bool PipeParser::completePayload()
+{
+	if (type == DataType::CHANNEL_ID)
+	{
+		// Dictionary records are consumed here, their channel is always given by name.
+		uint64_t id = 0;
+		int shift = 0;
+		for (auto byte : data)
+		{
+			if (shift >= 64)
+				break;
+			id |= static_cast<uint64_t>(byte & 0x7F) << shift;
+			shift += 7;
+			if ((byte & 0x80) == 0)
+				break;
+		}
+
+		if (channelId == NO_CHANNEL_ID && !data.empty() && id < MAX_WIRE_CHANNEL_IDS)
+		{
+			if (id >= dictionary.size())
+				dictionary.resize(id + 1);
+			if (!dictionary[id] || *dictionary[id] != channel)
+			{
+				dictionary[id] = channel;
+				dictionaryEpoch++;
+			}
+		}
+
+		reset();
+		return false;
+	}
+
+	// Record of an ID whose dictionary record was missed can't be attributed, it is skipped.
+	if (channelId != NO_CHANNEL_ID && (channelId >= dictionary.size() || !dictionary[channelId]))
+	{
+		reset();
+		return false;
+	}
+
+	state = readyState();
+	return true;
+}
+
+/**
+ * @brief Goes to the field of the size just parsed. Empty field has no bytes to wait for,
+ *        so parser goes on to next right away: size of the following field or end of the record.
+ * @return true if the record is complete.
+ */
+bool PipeParser::startField(State field, State next)
+{
+	chunkSize = *reinterpret_cast<const size_t *>(data.data() + data.size() - sizeof(size_t));
+	if (chunkSize != 0)
+	{
+		state = field;
+		return false;
+	}
+
+	state = next;
+	if (next == readyState())
+		return true;
+
+	chunkSize = sizeof(size_t);
+	return false;
+}
+
+PipeParser::State PipeParser::readyState() const
+{
+	switch (type)
+	{
+		case DataType::FRAME:
+			return State::FRAME_READY;
+		case DataType::BUFFER:
+			return State::BUFFER_READY;
+		case DataType::MESSAGE:
+			return State::MESSAGE_READY;
+		case DataType::CREDIT:
+			return State::CREDIT_READY;
+		case DataType::TIMESTAMP:
+			return State::TIMESTAMP_READY;
+		case DataType::HELLO:
+			return State::HELLO_READY;
+		default:
+			return State::IDLE;
+	}
+}
+
 size_t PipeParser::parse(const uint8_t *rawData, size_t size)
 {
 	size_t pos = 0;
 
 	while (pos < size)
 	{
+		// v2 payload has known length, so it is copied at once instead of byte by byte.
+		if (state == State::PAYLOAD)
+		{
+			const auto count = std::min(chunkSize, size - pos);
+			data.insert(data.end(), rawData + pos, rawData + pos + count);
+			pos += count;
+			chunkSize -= count;
+			if (chunkSize == 0 && completePayload())
+				return pos;
+			continue;
+		}
+
 		const uint8_t byte = rawData[pos++];
 
 		switch (state)
 		{
 			case State::IDLE:
 			{
-				if (byte == syncBytes[syncCount])
+				// Sync words of both versions differ only in the last byte.
+				const bool isV2 = syncCount == 3 && byte == syncBytesV2[3];
+				if (byte == syncBytes[syncCount] || isV2)
 					syncCount++;
 				else
 					syncCount = 0;
 
 				if (syncCount == 4)
 				{
+					version = isV2 ? 2 : 1;
 					state = State::CHANNEL_SIZE;
 					chunkSize = sizeof(size_t);
 				}
@@ -63,6 +208,36 @@ size_t PipeParser::parse(const uint8_t *rawData, size_t size)
 
 			case State::CHANNEL_SIZE:
 			{
+				if (version >= 2)
+				{
+					if (varintShift >= 64)
+					{
+						reset();
+						break;
+					}
+					if (!readVarint(byte))
+						break;
+
+					// Low bit tells wire ID from name length.
+					if (chunkSize & 1)
+					{
+						chunkSize >>= 1;
+						if (chunkSize >= MAX_WIRE_CHANNEL_IDS)
+						{
+							reset();
+							break;
+						}
+						channelId = static_cast<ChannelId>(chunkSize);
+						chunkSize = 0;
+					}
+					else
+					{
+						chunkSize >>= 1;
+					}
+					state = chunkSize == 0 ? State::DATA_TYPE : State::CHANNEL;
+					break;
+				}
+
 				channelSize.push_back(byte);
 				chunkSize--;
 				if (chunkSize == 0)
@@ -84,6 +259,16 @@ size_t PipeParser::parse(const uint8_t *rawData, size_t size)
 
 			case State::DATA_TYPE:
 			{
+				if (version >= 2)
+				{
+					type = static_cast<DataType>(byte);
+					if (readyState() == State::IDLE && type != DataType::CHANNEL_ID)
+						reset();
+					else
+						state = State::PAYLOAD_SIZE;
+					break;
+				}
+
 				switch (static_cast<DataType>(byte))
 				{
 					case DataType::FRAME:
@@ -101,15 +286,46 @@ size_t PipeParser::parse(const uint8_t *rawData, size_t size)
 						state = State::MESSAGE_EVENT_NAME_SIZE;
 						chunkSize = sizeof(size_t);
 						break;
+					case DataType::CREDIT:
+						type = DataType::CREDIT;
+						state = State::CREDIT_SLOTS;
+						chunkSize = sizeof(uint64_t);
+						break;
+					case DataType::TIMESTAMP:
+						type = DataType::TIMESTAMP;
+						state = State::TIMESTAMP_TIME;
+						chunkSize = sizeof(int64_t);
+						break;
+					case DataType::HELLO:
+						type = DataType::HELLO;
+						state = State::HELLO_VERSION;
+						chunkSize = sizeof(uint8_t);
+						break;
 					default:
-						type = DataType::NONE;
-						state = State::IDLE;
+						reset();
 						break;
 				}
 
 				break;
 			}
 
+			case State::PAYLOAD_SIZE:
+			{
+				if (varintShift >= 64)
+				{
+					reset();
+					break;
+				}
+				if (readVarint(byte))
+				{
+					if (chunkSize != 0)
+						state = State::PAYLOAD;
+					else if (completePayload())
+						return pos;
+				}
+				break;
+			}
+
 			case State::FRAME_TIME:
 			{
 				data.push_back(byte);
@@ -140,8 +356,8 @@ size_t PipeParser::parse(const uint8_t *rawData, size_t size)
 				chunkSize--;
 				if (chunkSize == 0)
 				{
-					state = State::FRAME_USER_PROPS;
-					chunkSize = *reinterpret_cast<const size_t *>(data.data() + data.size() - sizeof(size_t));
+					if (startField(State::FRAME_USER_PROPS, State::FRAME_VIDEO_DATA_SIZE))
+						return pos;
 				}
 				break;
 			}
@@ -164,8 +380,8 @@ size_t PipeParser::parse(const uint8_t *rawData, size_t size)
 				chunkSize--;
 				if (chunkSize == 0)
 				{
-					state = State::FRAME_VIDEO_DATA;
-					chunkSize = *reinterpret_cast<const size_t *>(data.data() + data.size() - sizeof(size_t));
+					if (startField(State::FRAME_VIDEO_DATA, State::FRAME_AUDIO_DATA_SIZE))
+						return pos;
 				}
 				break;
 			}
@@ -188,8 +404,8 @@ size_t PipeParser::parse(const uint8_t *rawData, size_t size)
 				chunkSize--;
 				if (chunkSize == 0)
 				{
-					state = State::FRAME_AUDIO_DATA;
-					chunkSize = *reinterpret_cast<const size_t *>(data.data() + data.size() - sizeof(size_t));
+					if (startField(State::FRAME_AUDIO_DATA, State::FRAME_READY))
+						return pos;
 				}
 				break;
 			}
@@ -224,8 +440,8 @@ size_t PipeParser::parse(const uint8_t *rawData, size_t size)
 				chunkSize--;
 				if (chunkSize == 0)
 				{
-					state = State::BUFFER_DATA;
-					chunkSize = *reinterpret_cast<const size_t *>(data.data() + data.size() - sizeof(size_t));
+					if (startField(State::BUFFER_DATA, State::BUFFER_READY))
+						return pos;
 				}
 				break;
 			}
@@ -248,8 +464,8 @@ size_t PipeParser::parse(const uint8_t *rawData, size_t size)
 				chunkSize--;
 				if (chunkSize == 0)
 				{
-					state = State::MESSAGE_EVENT_NAME;
-					chunkSize = *reinterpret_cast<const size_t *>(data.data() + data.size() - sizeof(size_t));
+					if (startField(State::MESSAGE_EVENT_NAME, State::MESSAGE_EVENT_PARAM_SIZE))
+						return pos;
 				}
 				break;
 			}
@@ -272,8 +488,8 @@ size_t PipeParser::parse(const uint8_t *rawData, size_t size)
 				chunkSize--;
 				if (chunkSize == 0)
 				{
-					state = State::MESSAGE_EVENT_PARAM;
-					chunkSize = *reinterpret_cast<const size_t *>(data.data() + data.size() - sizeof(size_t));
+					if (startField(State::MESSAGE_EVENT_PARAM, State::MESSAGE_READY))
+						return pos;
 				}
 				break;
 			}
@@ -290,6 +506,42 @@ size_t PipeParser::parse(const uint8_t *rawData, size_t size)
 				break;
 			}
 
+			case State::CREDIT_SLOTS:
+			{
+				data.push_back(byte);
+				chunkSize--;
+				if (chunkSize == 0)
+				{
+					state = State::CREDIT_READY;
+					return pos;
+				}
+				break;
+			}
+
+			case State::TIMESTAMP_TIME:
+			{
+				data.push_back(byte);
+				chunkSize--;
+				if (chunkSize == 0)
+				{
+					state = State::TIMESTAMP_READY;
+					return pos;
+				}
+				break;
+			}
+
+			case State::HELLO_VERSION:
+			{
+				data.push_back(byte);
+				chunkSize--;
+				if (chunkSize == 0)
+				{
+					state = State::HELLO_READY;
+					return pos;
+				}
+				break;
+			}
+
 			default:
 				return pos;
 		}
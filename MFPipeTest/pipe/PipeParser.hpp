@@ -1,6 +1,8 @@
 #ifndef PIPEPARSER_HPP
 #define PIPEPARSER_HPP
 
+#include <optional>
+
 #include "../MFTypes.h"
 
 class PipeParser
@@ -14,6 +16,9 @@ public:
 		CHANNEL,
 		DATA_TYPE,
 
+		PAYLOAD_SIZE,
+		PAYLOAD,
+
 		FRAME_TIME,
 		FRAME_AV_PROPS,
 		FRAME_USER_PROPS_SIZE,
@@ -35,24 +40,67 @@ public:
 		MESSAGE_EVENT_PARAM,
 		MESSAGE_READY,
 
+		CREDIT_SLOTS,
+		CREDIT_READY,
+
+		TIMESTAMP_TIME,
+		TIMESTAMP_READY,
+
+		HELLO_VERSION,
+		HELLO_READY,
+
 		DONE,
 	};
 
 	PipeParser();
 
 	void reset();
-	std::vector<uint8_t> getData() const;
-	std::string getChannel() const;
+
+	/**
+	 * @brief Drops the partial record and the channel dictionary, for a stream that starts over.
+	 */
+	void restart();
+	const std::vector<uint8_t> &getData() const;
+	const std::string &getChannel() const;
 	State getState() const;
+
+	/**
+	 * @brief Wire format version of the current record, see PipeWire.
+	 */
+	uint8_t getVersion() const;
+
+	/**
+	 * @brief Wire ID the current record refers to its channel by, NO_CHANNEL_ID if it carries the name.
+	 *        getChannel() resolves both from the dictionary of the connection.
+	 */
+	ChannelId getChannelId() const;
+
+	/**
+	 * @brief Changes whenever a wire ID gets bound to a different name, so cached mappings can be dropped.
+	 */
+	uint32_t getDictionaryEpoch() const;
+
 	size_t parse(const uint8_t *rawData, size_t size);
 
 private:
+	bool readVarint(uint8_t byte);
+	bool startField(State field, State next);
+	State readyState() const;
+	bool completePayload();
+
 	State state;
 	DataType type;
+	uint8_t version;
 	uint8_t syncBytes[4];
+	uint8_t syncBytesV2[4];
 	uint8_t syncCount;
+	uint64_t varint;
+	int varintShift;
 	size_t chunkSize;
 	std::string channel;
+	ChannelId channelId;
+	std::vector<std::optional<std::string>> dictionary;
+	uint32_t dictionaryEpoch;
 	std::vector<uint8_t> channelSize;
 	std::vector<uint8_t> data;
 };
@@ -0,0 +1,120 @@
+#ifndef PIPEPOOL_HPP
+#define PIPEPOOL_HPP
+
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <vector>
+
+/**
+ * @brief Objects of type T handed out as shared_ptr, which return to the pool when their last owner releases them.
+ *        Release takes the pool lock, so the next acquire sees everything the last owner did to the object.
+ *        Control blocks come from the pool too, acquire allocates nothing once the pool is warm.
+ */
+template <typename T>
+class PipePool
+{
+public:
+	/**
+	 * @brief Pool keeps up to maxPooled released objects, others are deleted.
+	 */
+	explicit PipePool(size_t maxPooled)
+		: state(std::make_shared<State>())
+	{
+		state->maxPooled = maxPooled;
+		state->released.reserve(maxPooled);
+	}
+
+	/**
+	 * @brief Released object of the pool with its contents of the last use, or a new one.
+	 */
+	std::shared_ptr<T> acquire()
+	{
+		std::unique_ptr<T> object;
+		{
+			std::lock_guard<std::mutex> lock(state->mutex);
+			if (!state->released.empty())
+			{
+				object = std::move(state->released.back());
+				state->released.pop_back();
+			}
+		}
+
+		if (!object)
+			object = std::make_unique<T>();
+
+		return std::shared_ptr<T>(object.release(), Release { state }, Blocks<T>(state));
+	}
+
+private:
+	// Outlives the pool while its objects are in use.
+	struct State
+	{
+		std::mutex mutex;
+		size_t maxPooled = 0;
+		std::vector<std::unique_ptr<T>> released;
+		std::pmr::unsynchronized_pool_resource blocks;
+	};
+
+	/**
+	 * @brief Allocator of control blocks, it keeps the state alive until its block is freed.
+	 */
+	template <typename U>
+	struct Blocks
+	{
+		typedef U value_type;
+
+		std::shared_ptr<State> state;
+
+		explicit Blocks(std::shared_ptr<State> state)
+			: state(std::move(state))
+		{}
+
+		template <typename V>
+		Blocks(const Blocks<V> &other)
+			: state(other.state)
+		{}
+
+		U *allocate(size_t count)
+		{
+			std::lock_guard<std::mutex> lock(state->mutex);
+			return static_cast<U *>(state->blocks.allocate(count * sizeof(U), alignof(U)));
+		}
+
+		void deallocate(U *p, size_t count)
+		{
+			std::lock_guard<std::mutex> lock(state->mutex);
+			state->blocks.deallocate(p, count * sizeof(U), alignof(U));
+		}
+
+		template <typename V>
+		bool operator==(const Blocks<V> &other) const
+		{
+			return state == other.state;
+		}
+
+		template <typename V>
+		bool operator!=(const Blocks<V> &other) const
+		{
+			return state != other.state;
+		}
+	};
+
+	struct Release
+	{
+		std::shared_ptr<State> state;
+
+		void operator()(T *object) const
+		{
+			std::unique_ptr<T> owned(object);
+
+			std::lock_guard<std::mutex> lock(state->mutex);
+			if (state->released.size() < state->maxPooled)
+				state->released.push_back(std::move(owned));
+		}
+	};
+
+	std::shared_ptr<State> state;
+};
+
+#endif // PIPEPOOL_HPP
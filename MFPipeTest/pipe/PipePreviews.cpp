@@ -0,0 +1,41 @@
+#include "PipePreviews.hpp"
+
+#include <iostream>
+
+void PipePreviews::set(const std::string &channel, const std::string &source, int width, int height)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	for (auto it = previews.begin(); it != previews.end();)
+	{
+		if (it->second.channel == channel)
+			it = previews.erase(it);
+		else
+			++it;
+	}
+
+	if (width <= 0 || height <= 0)
+		return;
+
+	auto &preview = previews.emplace(std::piecewise_construct, std::forward_as_tuple(source), std::forward_as_tuple())->second;
+	preview.channel = channel;
+	preview.width = width;
+	preview.height = height;
+}
+
+/**
+ * @brief Preview of the frame in a pooled frame, nullptr if it can't be made.
+ */
+std::shared_ptr<MF_FRAME> PipePreviews::scale(Preview &preview, const std::string &source, const MF_FRAME &frame)
+{
+	// Sent previews are reused once writer and readers of the same process released them.
+	auto out = preview.pool.acquire();
+
+	if (!preview.scaler.downscale(frame, preview.width, preview.height, *out))
+	{
+		std::cerr << "Failed to make preview " << preview.channel << " of channel " << source << std::endl;
+		return nullptr;
+	}
+
+	return out;
+}
@@ -0,0 +1,73 @@
+#ifndef PIPEPREVIEWS_HPP
+#define PIPEPREVIEWS_HPP
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "MFTypes.h"
+#include "PipePool.hpp"
+#include "PipeScaler.hpp"
+
+/**
+ * @brief Derived channels carrying downscaled frames of their source channels.
+ *        Writer makes previews once per put frame and sends them as objects of their own channels.
+ */
+class PipePreviews
+{
+public:
+	/**
+	 * @brief Declares channel as a preview of source scaled to width x height,
+	 *        non-positive size removes it. Channel is a preview of one source at a time.
+	 */
+	void set(const std::string &channel, const std::string &source, int width, int height);
+
+	/**
+	 * @brief Makes previews of the frame put on the channel and passes each of them to
+	 *        callback(const std::string &previewChannel, const std::shared_ptr<MF_BASE_TYPE> &preview).
+	 *        Frames of formats PipeScaler doesn't support get no previews.
+	 */
+	template <typename Callback>
+	void make(const std::string &channel, const std::shared_ptr<MF_BASE_TYPE> &object, Callback &&callback)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if (previews.empty())
+			return;
+
+		const auto frame = dynamic_cast<const MF_FRAME *>(object.get());
+		if (frame == nullptr || !PipeScaler::isSupported(frame->av_props.vidProps.fccType))
+			return;
+
+		const auto range = previews.equal_range(channel);
+		for (auto it = range.first; it != range.second; ++it)
+		{
+			auto preview = scale(it->second, channel, *frame);
+			if (preview)
+				callback(it->second.channel, preview);
+		}
+	}
+
+private:
+	// Previews in flight per channel: queued, being written and one being made.
+	static constexpr size_t MAX_POOLED = 8;
+
+	struct Preview
+	{
+		std::string channel;
+		int width = 0;
+		int height = 0;
+		PipeScaler scaler;
+		PipePool<MF_FRAME> pool { MAX_POOLED };
+	};
+
+	std::shared_ptr<MF_FRAME> scale(Preview &preview, const std::string &source, const MF_FRAME &frame);
+
+	// Previews are made under the lock, puts of different threads take turns on them.
+	std::mutex mutex;
+	std::multimap<std::string, Preview> previews;
+};
+
+#endif // PIPEPREVIEWS_HPP
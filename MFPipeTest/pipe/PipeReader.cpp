@@ -1,15 +1,45 @@
 #include "PipeReader.hpp"
 
+#include <algorithm>
+#include <type_traits>
+
 #include "fcntl.h"
 #include "unistd.h"
 
+#include "PipeAlloc.hpp"
+#include "PipeTrace.hpp"
+#include "PipeWire.hpp"
+
+static constexpr auto CREDIT_INTERVAL = std::chrono::milliseconds(10);
+static constexpr auto CREDIT_MIN_INTERVAL = std::chrono::milliseconds(1);
+
+// Released objects kept for reuse beyond what fits into the read queue: one being parsed, a few held by consumers.
+static constexpr size_t POOL_EXTRA_OBJECTS = 4;
+
 PipeReader::PipeReader(std::shared_ptr<IoInterface> io,
 					   size_t maxBuffers,
-					   std::shared_ptr<DataBuffer> dataBuffer)
+					   std::shared_ptr<DataBuffer> dataBuffer,
+					   std::shared_ptr<PipeSubscribers> subscribers,
+					   std::shared_ptr<PipeWaiters> waiters,
+					   std::shared_ptr<PipeLatency> latency)
 	: isRunning(false),
 	  maxBuffers(maxBuffers),
 	  io(io),
-	  dataBuffer(dataBuffer)
+	  dataBuffer(dataBuffer),
+	  subscribers(subscribers),
+	  waiters(waiters),
+	  latency(latency),
+	  connection(0),
+	  wireChannelsEpoch(0),
+	  putTime(0),
+	  isV2Seen(false),
+	  creditIndex(0),
+	  lastFreeSlots(0),
+	  hasFeedback(false),
+	  readTime(0),
+	  firstByteTime(0),
+	  bufferPool(maxBuffers + POOL_EXTRA_OBJECTS),
+	  framePool(maxBuffers + POOL_EXTRA_OBJECTS)
 {}
 
 PipeReader::~PipeReader()
@@ -27,10 +57,16 @@ void PipeReader::start()
 void PipeReader::stop()
 {
 	isRunning = false;
-	if (thread->joinable())
+	if (thread && thread->joinable())
 		thread->join();
 }
 
+void PipeReader::setCreditShare(std::shared_ptr<CreditShares> shares, size_t index)
+{
+	creditShares = shares;
+	creditIndex = index;
+}
+
 void PipeReader::run(std::shared_ptr<DataBuffer> dataBuffer)
 {
 	uint8_t buffer[512 * 1024] = { 0 };
@@ -39,55 +75,105 @@ void PipeReader::run(std::shared_ptr<DataBuffer> dataBuffer)
 
 	while (isRunning)
 	{
+		releaseJitter();
+
 		if (!dataBuffer->mutex.try_lock_for(std::chrono::milliseconds(10)))
 			continue;
 
-		if (dataBuffer->data.size() >= maxBuffers || dataBuffer->messages.size() >= maxBuffers)
+		const bool isFull = dataBuffer->data.size() >= maxBuffers || dataBuffer->messages.size() >= maxBuffers;
+		const size_t freeSlots = dataBuffer->data.size() >= maxBuffers ? 0 : maxBuffers - dataBuffer->data.size();
+		dataBuffer->mutex.unlock();
+
+		advertiseCredit(freeSlots);
+
+		if (isFull)
 		{
-			dataBuffer->mutex.unlock();
 			std::this_thread::yield();
 			continue;
 		}
 
+		// Read and parse without holding the queue lock, it is taken only to push ready objects.
 		while (true)
 		{
 			if (readBytes <= 0)
+			{
 				readBytes = io->read(buffer, 512 * 1024);
+				readTime = PIPE_TRACE_NOW();
+
+				if (io->getConnection() != connection)
+					restartStream();
+			}
 
 			if (readBytes <= 0)
+			{
+				std::this_thread::yield();
 				break;
+			}
 
-			parsedBytes += parser.parse(buffer + parsedBytes, readBytes - parsedBytes);
+			// Record starts in the chunk where parser leaves idle state, object is not known until it is parsed.
+			const bool isIdle = parser.getState() == PipeParser::State::IDLE;
+			{
+				PIPE_ALLOC_SCOPE(PARSER);
+				parsedBytes += parser.parse(buffer + parsedBytes, readBytes - parsedBytes);
+			}
+			if (isIdle && parser.getState() != PipeParser::State::IDLE)
+				firstByteTime = readTime;
+			if (parser.getVersion() >= PipeWire::VERSION_2)
+				isV2Seen = true;
 
 			switch (parser.getState())
 			{
 				case PipeParser::State::BUFFER_READY:
 				{
-					const auto ch = parser.getChannel();
-					const auto data = parser.getData();
-
-					MF_BUFFER buf;
-					dataBuffer->data.push_back({ ch, std::shared_ptr<MF_BASE_TYPE>(buf.deserialize(data)) });
+					const auto channel = localChannel();
+					deliver(channel, deserialize<MF_BUFFER>(parser.getData(), channel));
 					parser.reset();
 					break;
 				}
 				case PipeParser::State::FRAME_READY:
 				{
-					const auto ch = parser.getChannel();
-					const auto data = parser.getData();
-
-					MF_FRAME frame;
-					dataBuffer->data.push_back({ ch, std::shared_ptr<MF_BASE_TYPE>(frame.deserialize(data)) });
+					const auto channel = localChannel();
+					deliver(channel, convert(channel, deserialize<MF_FRAME>(parser.getData(), channel)));
 					parser.reset();
 					break;
 				}
 				case PipeParser::State::MESSAGE_READY:
 				{
-					const auto ch = parser.getChannel();
-					const auto data = parser.getData();
+					std::shared_ptr<Message> mes;
+					{
+						PIPE_ALLOC_SCOPE(MESSAGE);
+						mes = std::make_shared<Message>();
+					}
+					if (!PipeWire::deserialize(parser.getData(), parser.getVersion(), *mes))
+					{
+						std::cerr << "Malformed message on channel " << parser.getChannel() << std::endl;
+						parser.reset();
+						break;
+					}
 
-					Message message;
-					dataBuffer->messages.push_back({ ch, std::make_shared<Message>(message.deserialize(data)) });
+					const auto channel = localChannel();
+					{
+						std::lock_guard<std::timed_mutex> lock(dataBuffer->mutex);
+						PIPE_ALLOC_SCOPE(QUEUE);
+						insertByPriority(dataBuffer->messages, { channel, mes }, eMFPR_High);
+					}
+					if (waiters)
+						waiters->notify();
+					parser.reset();
+					break;
+				}
+				case PipeParser::State::TIMESTAMP_READY:
+				{
+					Timestamp timestamp;
+					if (PipeWire::deserialize(parser.getData(), parser.getVersion(), timestamp))
+						putTime = timestamp.timeNs;
+					parser.reset();
+					break;
+				}
+				case PipeParser::State::CREDIT_READY:
+				case PipeParser::State::HELLO_READY:
+				{
+					// Credits and hellos only travel writer-ward, nothing to do with them on the data path.
 					parser.reset();
 					break;
 				}
@@ -102,7 +188,298 @@ void PipeReader::run(std::shared_ptr<DataBuffer> dataBuffer)
 				break;
 			}
 		}
+	}
+}
 
-		dataBuffer->mutex.unlock();
+template <typename Queue>
+void PipeReader::insertByPriority(Queue &queue, typename Queue::value_type entry, eMFPriority defaultPriority)
+{
+	auto it = queue.end();
+
+	// Urgent channels are placed ahead of queued entries of lower priority.
+	if (dataBuffer->hasPriorities)
+	{
+		const auto priority = channelPriority(*dataBuffer, entry.first, defaultPriority);
+		while (it != queue.begin() && channelPriority(*dataBuffer, (it - 1)->first, defaultPriority) < priority)
+			--it;
+	}
+
+	queue.insert(it, std::move(entry));
+}
+
+/**
+ * @brief Object of type T released by its consumers, or a new one.
+ */
+template <typename T>
+std::shared_ptr<MF_BASE_TYPE> PipeReader::acquire()
+{
+	if constexpr (std::is_same_v<T, MF_FRAME>)
+		return framePool.acquire();
+	else
+		return bufferPool.acquire();
+}
+
+template <typename T>
+std::shared_ptr<MF_BASE_TYPE> PipeReader::deserialize(const std::vector<uint8_t> &raw, ChannelId channel)
+{
+	PIPE_ALLOC_SCOPE(DESERIALIZE);
+
+	auto object = acquire<T>();
+
+	if (channel >= channelProps.size())
+		channelProps.resize(channel + 1);
+
+	if (!PipeWire::deserialize(raw, parser.getVersion(), *object, &channelProps[channel]))
+	{
+		std::cerr << "Dropped object on channel " << parser.getChannel() << ": malformed or props not received yet" << std::endl;
+		return nullptr;
+	}
+
+	return object;
+}
+
+/**
+ * @brief Frame converted to the format its channel asked for, the frame itself if it needs no conversion.
+ *        Source frame goes back to the pool right away.
+ */
+std::shared_ptr<MF_BASE_TYPE> PipeReader::convert(ChannelId channel, const std::shared_ptr<MF_BASE_TYPE> &object)
+{
+	if (!object)
+		return object;
+
+	eMFCC format;
+	{
+		std::lock_guard<std::timed_mutex> lock(dataBuffer->mutex);
+		format = dataBuffer->channels[channel].format;
+	}
+
+	const auto &frame = static_cast<const MF_FRAME &>(*object);
+	const auto type = frame.av_props.vidProps.fccType;
+	if (format == eMFCC_Default || format == type || !PipeConverter::isSupported(type, format))
+		return object;
+
+	PIPE_ALLOC_SCOPE(CONVERT);
+
+	if (!converter)
+		converter = std::make_unique<PipeConverter>();
+
+	auto converted = acquire<MF_FRAME>();
+	if (!converter->convert(frame, format, static_cast<MF_FRAME &>(*converted)))
+	{
+		std::lock_guard<std::timed_mutex> lock(dataBuffer->mutex);
+		std::cerr << "Dropped frame on channel " << dataBuffer->channelName(channel) << ": video doesn't match its props"
+				  << std::endl;
+		return nullptr;
+	}
+
+	return converted;
+}
+
+void PipeReader::advertiseCredit(size_t freeSlots)
+{
+	// Slots are split among readers that have a writer, reader without one counts as the next of them.
+	// Slots left over by an even split go to the first readers, shares add up to the free slots.
+	if (creditShares)
+	{
+		auto &hasPeer = creditShares->hasPeer;
+		hasPeer[creditIndex].store(io->hasPeer(), std::memory_order_relaxed);
+
+		size_t count = 1;
+		size_t rank = 0;
+		for (size_t i = 0; i < hasPeer.size(); ++i)
+		{
+			if (i == creditIndex || !hasPeer[i].load(std::memory_order_relaxed))
+				continue;
+			++count;
+			if (i < creditIndex)
+				++rank;
+		}
+		freeSlots = freeSlots / count + (rank < freeSlots % count ? 1 : 0);
+	}
+
+	// Free slots are re-sent periodically, so a lost record only delays the writer.
+	// Changes go out sooner, but only while feedback path works.
+	const auto now = std::chrono::steady_clock::now();
+	const auto elapsed = now - lastCreditTime;
+	if (elapsed < CREDIT_INTERVAL
+			&& (elapsed < CREDIT_MIN_INTERVAL || freeSlots == lastFreeSlots || !hasFeedback))
+		return;
+
+	// Credits and hellos go as v1, which writers of any version parse.
+	Credit credit;
+	credit.slots = freeSlots;
+	creditBuffer.clear();
+	serializeTo(creditBuffer, "", &credit);
+
+	// Writer keeps v1 until it learns reader parses v2.
+	if (!isV2Seen)
+	{
+		Hello hello;
+		hello.version = PipeWire::VERSION_MAX;
+		serializeTo(creditBuffer, "", &hello);
+	}
+
+	hasFeedback = io->writeFeedback(creditBuffer.data(), creditBuffer.size()) == static_cast<ssize_t>(creditBuffer.size());
+	lastFreeSlots = freeSlots;
+	lastCreditTime = now;
+}
+
+/**
+ * @brief Forgets the stream of the previous connection: its partial record, channel IDs and frame props.
+ *        Writer on the new connection starts with v1 and learns reader version again.
+ */
+void PipeReader::restartStream()
+{
+	connection = io->getConnection();
+	parser.restart();
+	wireChannels.clear();
+	channelProps.clear();
+	putTime = 0;
+	isV2Seen = false;
+	// Writer waits for the first credit to trust the connection.
+	lastCreditTime = std::chrono::steady_clock::time_point();
+}
+
+/**
+ * @brief Local ID of the channel of the parsed record. Interned wire IDs known already skip the queue lock
+ *        and the lookup by name.
+ */
+ChannelId PipeReader::localChannel()
+{
+	PIPE_ALLOC_SCOPE(CHANNEL);
+
+	const auto wireId = parser.getChannelId();
+	if (wireId == NO_CHANNEL_ID)
+	{
+		std::lock_guard<std::timed_mutex> lock(dataBuffer->mutex);
+		return dataBuffer->intern(parser.getChannel());
+	}
+
+	if (wireChannelsEpoch != parser.getDictionaryEpoch())
+	{
+		wireChannels.clear();
+		wireChannelsEpoch = parser.getDictionaryEpoch();
+	}
+
+	if (wireId >= wireChannels.size())
+		wireChannels.resize(wireId + 1, NO_CHANNEL_ID);
+	if (wireChannels[wireId] == NO_CHANNEL_ID)
+	{
+		std::lock_guard<std::timed_mutex> lock(dataBuffer->mutex);
+		wireChannels[wireId] = dataBuffer->intern(parser.getChannel());
 	}
+
+	return wireChannels[wireId];
+}
+
+void PipeReader::deliver(ChannelId channelId, const std::shared_ptr<MF_BASE_TYPE> &object)
+{
+	if (!object)
+		return;
+
+	const auto traceId = PIPE_TRACE_ID();
+	PIPE_TRACE_AT(FIRST_BYTE_READ, traceId, firstByteTime);
+	PIPE_TRACE(PARSE_COMPLETE, traceId);
+
+	// Put time applies only to the object right after it.
+	const auto time = putTime;
+	putTime = 0;
+
+	// Frames of channels with jitter buffer wait there for their turn.
+	if (const auto frame = dynamic_cast<const MF_FRAME *>(object.get()))
+	{
+		int jitterMs;
+		const std::string *name;
+		{
+			std::lock_guard<std::timed_mutex> lock(dataBuffer->mutex);
+			jitterMs = dataBuffer->channels[channelId].jitterMs;
+			name = &dataBuffer->channels[channelId].name;
+		}
+
+		if (jitterMs > 0)
+		{
+			const int64_t maxDelay = jitterMs * 1000000LL;
+			jitter.push({ channelId, name, object, time, traceId }, frame->time.rtStartTime, maxDelay, PipeLatency::now());
+			return;
+		}
+	}
+
+	enqueue(channelId, parser.getChannel(), object, time, traceId);
+}
+
+void PipeReader::releaseJitter()
+{
+	jitter.release(PipeLatency::now(), released);
+	for (auto &entry : released)
+		enqueue(entry.channel, *entry.channelName, entry.object, entry.putTime, entry.traceId);
+	released.clear();
+}
+
+/**
+ * @brief Hands object to subscribers of the channel, or queues it for PipeGet.
+ */
+void PipeReader::enqueue(ChannelId channelId, const std::string &channel, const std::shared_ptr<MF_BASE_TYPE> &object,
+						 int64_t time, uint64_t traceId)
+{
+	DataEntry entry = { channelId, object, time, PipeLatency::now(), nullptr, traceId };
+
+	// Subscribed objects are handed over right here.
+	if (subscribers && subscribers->deliver(channel, object))
+	{
+		PIPE_TRACE(GET, traceId);
+		if (latency && entry.putTime != 0)
+			latency->record(PipeLatency::Kind::END_TO_END, channel, entry.queueTime - entry.putTime);
+		return;
+	}
+
+	{
+		std::lock_guard<std::timed_mutex> lock(dataBuffer->mutex);
+		PIPE_ALLOC_SCOPE(QUEUE);
+		insertByPriority(dataBuffer->data, std::move(entry), eMFPR_Normal);
+	}
+
+	if (waiters)
+		waiters->notify();
+}
+
+bool PipeReader::receive(const std::string &channel, const std::shared_ptr<MF_BASE_TYPE> &object, int64_t time,
+						 uint64_t traceId)
+{
+	ChannelId channelId;
+	{
+		std::lock_guard<std::timed_mutex> lock(dataBuffer->mutex);
+		if (dataBuffer->data.size() >= maxBuffers)
+			return false;
+
+		PIPE_ALLOC_SCOPE(CHANNEL);
+		channelId = dataBuffer->intern(channel);
+	}
+
+	// Frame that needs conversion goes to a pooled one, object of the writer is never changed.
+	auto delivered = object;
+	if (dynamic_cast<const MF_FRAME *>(object.get()) != nullptr)
+	{
+		std::lock_guard<std::mutex> lock(receiveMutex);
+		delivered = convert(channelId, object);
+	}
+
+	if (delivered)
+		enqueue(channelId, channel, delivered, time, traceId);
+	return true;
+}
+
+bool PipeReader::receive(const std::string &channel, const std::shared_ptr<Message> &message)
+{
+	{
+		std::lock_guard<std::timed_mutex> lock(dataBuffer->mutex);
+		if (dataBuffer->messages.size() >= maxBuffers)
+			return false;
+
+		PIPE_ALLOC_SCOPE(QUEUE);
+		insertByPriority(dataBuffer->messages, { dataBuffer->intern(channel), message }, eMFPR_High);
+	}
+
+	if (waiters)
+		waiters->notify();
+	return true;
 }
@@ -1,6 +1,7 @@
 #ifndef PIPEREADER_HPP
 #define PIPEREADER_HPP
 
+#include <atomic>
 #include <deque>
 #include <memory>
 #include <mutex>
@@ -8,14 +9,24 @@
 
 #include "IoInterface.hpp"
 #include "MFTypes.h"
+#include "pipe/PipeConverter.hpp"
+#include "pipe/PipeJitter.hpp"
+#include "pipe/PipeLatency.hpp"
 #include "pipe/PipeParser.hpp"
+#include "pipe/PipePool.hpp"
+#include "pipe/PipeSubscribers.hpp"
+#include "pipe/PipeWire.hpp"
+#include "pipe/PipeWaiters.hpp"
 
 class PipeReader
 {
 public:
 	PipeReader(std::shared_ptr<IoInterface> io,
 			   size_t maxBuffers,
-			   std::shared_ptr<DataBuffer> dataBuffer);
+			   std::shared_ptr<DataBuffer> dataBuffer,
+			   std::shared_ptr<PipeSubscribers> subscribers = nullptr,
+			   std::shared_ptr<PipeWaiters> waiters = nullptr,
+			   std::shared_ptr<PipeLatency> latency = nullptr);
 
 	~PipeReader();
 
@@ -24,13 +35,88 @@ public:
 
 	void run(std::shared_ptr<DataBuffer> dataBuffer);
 
+	/**
+	 * @brief Takes object put on the channel in this process, as if it were read from io.
+	 *        Used instead of the reading thread, may be called from several threads.
+	 * @return false if read queue is full.
+	 */
+	bool receive(const std::string &channel, const std::shared_ptr<MF_BASE_TYPE> &object, int64_t time,
+				 uint64_t traceId = 0);
+	bool receive(const std::string &channel, const std::shared_ptr<Message> &message);
+
+	/**
+	 * @brief Readers filling the same queue, each advertises its share of free slots, so their writers together
+	 *        are never granted more than the queue takes. Slots are split among readers that have a writer.
+	 */
+	struct CreditShares
+	{
+		explicit CreditShares(size_t count)
+			: hasPeer(count)
+		{}
+
+		std::vector<std::atomic<bool>> hasPeer;
+	};
+
+	/**
+	 * @brief Reader is the index-th of readers sharing free slots of the queue.
+	 */
+	void setCreditShare(std::shared_ptr<CreditShares> shares, size_t index);
+
 private:
+	void deliver(ChannelId channelId, const std::shared_ptr<MF_BASE_TYPE> &object);
+	void releaseJitter();
+	void enqueue(ChannelId channelId, const std::string &channel, const std::shared_ptr<MF_BASE_TYPE> &object,
+				 int64_t time, uint64_t traceId);
+	ChannelId localChannel();
+	void advertiseCredit(size_t freeSlots);
+	void restartStream();
+
+	template <typename Queue>
+	void insertByPriority(Queue &queue, typename Queue::value_type entry, eMFPriority defaultPriority);
+
+	template <typename T>
+	std::shared_ptr<MF_BASE_TYPE> acquire();
+
+	std::shared_ptr<MF_BASE_TYPE> convert(ChannelId channel, const std::shared_ptr<MF_BASE_TYPE> &object);
+
+	template <typename T>
+	std::shared_ptr<MF_BASE_TYPE> deserialize(const std::vector<uint8_t> &raw, ChannelId channel);
+
 	volatile bool isRunning;
 	size_t maxBuffers;
 	std::unique_ptr<std::thread> thread;
 	std::shared_ptr<IoInterface> io;
 	std::shared_ptr<DataBuffer> dataBuffer;
+	std::shared_ptr<PipeSubscribers> subscribers;
+	std::shared_ptr<PipeWaiters> waiters;
+	std::shared_ptr<PipeLatency> latency;
 	PipeParser parser;
+	// Connection of io the parsed stream came over.
+	uint32_t connection;
+	// Local channel IDs by wire ID of the parser dictionary, valid for one dictionary epoch.
+	std::vector<ChannelId> wireChannels;
+	uint32_t wireChannelsEpoch;
+	// Props of the previous frame of each local channel for v2 delta.
+	std::vector<PipeWire::FrameProps> channelProps;
+	int64_t putTime;
+	// Created with the first frame that needs conversion.
+	std::unique_ptr<PipeConverter> converter;
+	// Guards converter for receive() callers.
+	std::mutex receiveMutex;
+	std::vector<uint8_t> creditBuffer;
+	bool isV2Seen;
+	std::shared_ptr<CreditShares> creditShares;
+	size_t creditIndex;
+	size_t lastFreeSlots;
+	bool hasFeedback;
+	std::chrono::steady_clock::time_point lastCreditTime;
+	int64_t readTime;
+	int64_t firstByteTime;
+	PipeJitter jitter;
+	std::vector<PipeJitter::Entry> released;
+	// Objects return to their pool once consumers of this process released them.
+	PipePool<MF_BUFFER> bufferPool;
+	PipePool<MF_FRAME> framePool;
 };
 
 #endif // PIPEREADER_HPP
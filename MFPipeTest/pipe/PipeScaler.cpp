@@ -0,0 +1,239 @@
+#include "PipeScaler.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include "PipeVideo.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define PIPE_SCALER_SSE2
+#include <emmintrin.h>
+#endif
+
+static constexpr int ROW_ALIGN = 32;
+
+#ifdef PIPE_SCALER_SSE2
+static __m128i load(const uint8_t *ptr)
+{
+	return _mm_loadu_si128(reinterpret_cast<const __m128i *>(ptr));
+}
+
+/**
+ * @brief Average of even and odd pixels of a and b, two registers of 16 bytes each into one.
+ */
+static __m128i averagePairs(__m128i a, __m128i b, size_t bpp)
+{
+	__m128i even;
+	__m128i odd;
+	if (bpp == 1)
+	{
+		const auto mask = _mm_set1_epi16(0x00FF);
+		even = _mm_packus_epi16(_mm_and_si128(a, mask), _mm_and_si128(b, mask));
+		odd = _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+	}
+	else if (bpp == 2)
+	{
+		// Even words to the low half, odd ones to the high half.
+		const auto sortedA = _mm_shuffle_epi32(_mm_shufflehi_epi16(_mm_shufflelo_epi16(a, 0xD8), 0xD8), 0xD8);
+		const auto sortedB = _mm_shuffle_epi32(_mm_shufflehi_epi16(_mm_shufflelo_epi16(b, 0xD8), 0xD8), 0xD8);
+		even = _mm_unpacklo_epi64(sortedA, sortedB);
+		odd = _mm_unpackhi_epi64(sortedA, sortedB);
+	}
+	else
+	{
+		even = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b), _MM_SHUFFLE(2, 0, 2, 0)));
+		odd = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b), _MM_SHUFFLE(3, 1, 3, 1)));
+	}
+	return _mm_avg_epu8(even, odd);
+}
+#endif
+
+/**
+ * @brief Box filters rows a and b of srcWidth pixels into a row of half width, rounded up.
+ *        Pixel past the right edge repeats the last one, b is the same row as a past the bottom edge.
+ */
+static void halveRow(const uint8_t *a, const uint8_t *b, uint8_t *dst, size_t srcWidth, size_t bpp)
+{
+	const size_t width = (srcWidth + 1) / 2;
+	size_t i = 0;
+#ifdef PIPE_SCALER_SSE2
+	if (bpp == 1 || bpp == 2 || bpp == 4)
+	{
+		// 32 source bytes make 16 destination bytes.
+		const size_t step = 16 / bpp;
+		for (; i + step <= srcWidth / 2; i += step)
+		{
+			const auto row0 = _mm_avg_epu8(load(a + 2 * i * bpp), load(b + 2 * i * bpp));
+			const auto row1 = _mm_avg_epu8(load(a + 2 * i * bpp + 16), load(b + 2 * i * bpp + 16));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i * bpp), averagePairs(row0, row1, bpp));
+		}
+	}
+#endif
+	// Rounds as _mm_avg_epu8 over rows and then pixels.
+	for (; i < width; ++i)
+	{
+		const size_t left = 2 * i * bpp;
+		const size_t right = std::min(2 * i + 1, srcWidth - 1) * bpp;
+		for (size_t k = 0; k < bpp; ++k)
+		{
+			const int first = (a[left + k] + b[left + k] + 1) >> 1;
+			const int second = (a[right + k] + b[right + k] + 1) >> 1;
+			dst[i * bpp + k] = static_cast<uint8_t>((first + second + 1) >> 1);
+		}
+	}
+}
+
+/**
+ * @brief Source position of destination pixel in 1/256 of a pixel, centers of pixels aligned.
+ */
+static uint32_t sourcePosition(size_t pos, size_t srcSize, size_t dstSize)
+{
+	const int64_t value = static_cast<int64_t>((2 * pos + 1) * srcSize * 256 / (2 * dstSize)) - 128;
+	const int64_t limit = static_cast<int64_t>(srcSize - 1) * 256;
+	return static_cast<uint32_t>(std::clamp<int64_t>(value, 0, limit));
+}
+
+static size_t bytesPerPixel(eMFCC type, int plane)
+{
+	switch (type)
+	{
+		case eMFCC_NV12:
+			return plane == 0 ? 1 : 2;
+		case eMFCC_RGB24:
+			return 3;
+		case eMFCC_RGB32:
+			return 4;
+		default:
+			return 1;
+	}
+}
+
+bool PipeScaler::isSupported(eMFCC type)
+{
+	switch (type)
+	{
+		case eMFCC_I420:
+		case eMFCC_YV12:
+		case eMFCC_NV12:
+		case eMFCC_RGB24:
+		case eMFCC_RGB32:
+			return true;
+		default:
+			return PipeConverter::isSupported(type, eMFCC_I420);
+	}
+}
+
+bool PipeScaler::downscale(const MF_FRAME &src, int width, int height, MF_FRAME &dst)
+{
+	const auto type = src.av_props.vidProps.fccType;
+	if (width <= 0 || height <= 0 || !isSupported(type))
+		return false;
+
+	const MF_FRAME *frame = &src;
+	if (type == eMFCC_YUY2 || type == eMFCC_YVYU || type == eMFCC_UYVY)
+	{
+		// Conversion is a small part of the work here, one worker is enough.
+		if (!converter)
+			converter = std::make_unique<PipeConverter>(1);
+		if (!converter->convert(src, eMFCC_I420, converted))
+			return false;
+		frame = &converted;
+	}
+
+	const auto &props = frame->av_props.vidProps;
+	PipeVideo::Layout srcLayout;
+	if (!PipeVideo::layout(props, srcLayout) || frame->vec_video_data.size() < srcLayout.size)
+		return false;
+
+	dst.time = src.time;
+	dst.av_props.vidProps = props;
+	dst.av_props.vidProps.nWidth = width;
+	dst.av_props.vidProps.nHeight = height;
+	dst.av_props.vidProps.nRowBytes = (width * static_cast<int>(bytesPerPixel(props.fccType, 0)) + ROW_ALIGN - 1)
+			/ ROW_ALIGN * ROW_ALIGN;
+	dst.av_props.audProps = {};
+	dst.str_user_props = src.str_user_props;
+	dst.vec_audio_data.clear();
+
+	PipeVideo::Layout dstLayout;
+	if (!PipeVideo::layout(dst.av_props.vidProps, dstLayout))
+		return false;
+	dst.vec_video_data.resize(dstLayout.size);
+
+	for (auto i = 0; i < srcLayout.planes; ++i)
+	{
+		const auto &srcPlane = srcLayout.plane[i];
+		const auto &dstPlane = dstLayout.plane[i];
+		const size_t bpp = bytesPerPixel(props.fccType, i);
+
+		Image image;
+		image.data = frame->vec_video_data.data() + srcPlane.offset;
+		image.stride = srcPlane.stride;
+		image.width = srcPlane.rowBytes / bpp;
+		image.height = srcPlane.rows;
+
+		uint8_t *out = dst.vec_video_data.data() + dstPlane.offset;
+		scalePlane(image, bpp, out, dstPlane.stride, dstPlane.rowBytes / bpp, dstPlane.rows);
+
+		for (size_t y = 0; y < dstPlane.rows; ++y)
+			memset(out + y * dstPlane.stride + dstPlane.rowBytes, 0, dstPlane.stride - dstPlane.rowBytes);
+	}
+
+	return true;
+}
+
+void PipeScaler::scalePlane(Image src, size_t bpp, uint8_t *dst, size_t dstStride, size_t width, size_t height)
+{
+	for (auto level = 0; src.width >= 2 * width && src.height >= 2 * height; level = 1 - level)
+	{
+		Image half;
+		half.width = (src.width + 1) / 2;
+		half.height = (src.height + 1) / 2;
+		half.stride = half.width * bpp;
+
+		auto &buffer = levels[level];
+		buffer.resize(half.stride * half.height);
+		for (size_t y = 0; y < half.height; ++y)
+		{
+			const uint8_t *a = src.data + 2 * y * src.stride;
+			const uint8_t *b = 2 * y + 1 < src.height ? a + src.stride : a;
+			halveRow(a, b, buffer.data() + y * half.stride, src.width, bpp);
+		}
+
+		half.data = buffer.data();
+		src = half;
+	}
+
+	if (src.width == width && src.height == height)
+	{
+		for (size_t y = 0; y < height; ++y)
+			memcpy(dst + y * dstStride, src.data + y * src.stride, width * bpp);
+		return;
+	}
+
+	columns.resize(width);
+	for (size_t x = 0; x < width; ++x)
+		columns[x] = sourcePosition(x, src.width, width);
+
+	for (size_t y = 0; y < height; ++y)
+	{
+		const auto row = sourcePosition(y, src.height, height);
+		const uint32_t fy = row & 0xFF;
+		const uint8_t *top = src.data + (row >> 8) * src.stride;
+		const uint8_t *bottom = fy != 0 ? top + src.stride : top;
+		uint8_t *out = dst + y * dstStride;
+
+		for (size_t x = 0; x < width; ++x)
+		{
+			const uint32_t fx = columns[x] & 0xFF;
+			const size_t left = (columns[x] >> 8) * bpp;
+			const size_t right = fx != 0 ? left + bpp : left;
+			for (size_t k = 0; k < bpp; ++k)
+			{
+				const uint32_t upper = top[left + k] * (256 - fx) + top[right + k] * fx;
+				const uint32_t lower = bottom[left + k] * (256 - fx) + bottom[right + k] * fx;
+				out[x * bpp + k] = static_cast<uint8_t>((upper * (256 - fy) + lower * fy + 32768) >> 16);
+			}
+		}
+	}
+}
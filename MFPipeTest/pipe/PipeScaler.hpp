@@ -0,0 +1,46 @@
+#ifndef PIPESCALER_HPP
+#define PIPESCALER_HPP
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "MFTypes.h"
+#include "PipeConverter.hpp"
+
+/**
+ * @brief Scales video down for previews. Box filter with SSE2 kernels halves the picture while it stays
+ *        at least twice the target size, bilinear filter takes the rest of the way.
+ *        Scales I420, YV12, NV12, RGB24 and RGB32, 4:2:2 video is converted to I420 first.
+ *        Keeps scratch buffers between calls, so one instance serves one thread at a time.
+ */
+class PipeScaler
+{
+public:
+	static bool isSupported(eMFCC type);
+
+	/**
+	 * @brief Scales video of src to width x height into dst, which gets times, props and user props
+	 *        of src but no audio. Video rows of dst are aligned to 32 bytes.
+	 * @return false if format isn't supported or video of src doesn't match its props.
+	 */
+	bool downscale(const MF_FRAME &src, int width, int height, MF_FRAME &dst);
+
+private:
+	struct Image
+	{
+		const uint8_t *data = nullptr;
+		size_t stride = 0;
+		size_t width = 0;
+		size_t height = 0;
+	};
+
+	void scalePlane(Image src, size_t bpp, uint8_t *dst, size_t dstStride, size_t width, size_t height);
+
+	std::unique_ptr<PipeConverter> converter;
+	MF_FRAME converted;
+	std::vector<uint8_t> levels[2];
+	std::vector<uint32_t> columns;
+};
+
+#endif // PIPESCALER_HPP
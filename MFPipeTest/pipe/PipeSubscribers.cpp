@@ -0,0 +1,66 @@
+#include "PipeSubscribers.hpp"
+
+#include <vector>
+
+PipeSubscribers::PipeSubscribers()
+	: lastId(0)
+{}
+
+int32_t PipeSubscribers::add(const std::string &channel, Callback callback)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	const auto id = ++lastId;
+	callbacks[id] = { channel, callback };
+	return id;
+}
+
+bool PipeSubscribers::remove(int32_t id)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return callbacks.erase(id) != 0;
+}
+
+void PipeSubscribers::setExecutor(Executor executor)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	this->executor = executor;
+}
+
+bool PipeSubscribers::deliver(const std::string &channel, const std::shared_ptr<MF_BASE_TYPE> &object)
+{
+	std::vector<Callback> matched;
+	Executor exec;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (callbacks.empty())
+			return false;
+
+		for (const auto &cb : callbacks)
+		{
+			if (matches(cb.second.first, channel))
+				matched.push_back(cb.second.second);
+		}
+		exec = executor;
+	}
+
+	// Callbacks are invoked without lock, so they are free to (un)subscribe.
+	for (const auto &cb : matched)
+	{
+		if (exec)
+			exec([cb, channel, object]() { cb(channel, object); });
+		else
+			cb(channel, object);
+	}
+
+	return !matched.empty();
+}
+
+bool PipeSubscribers::matches(const std::string &pattern, const std::string &channel)
+{
+	if (pattern.empty() || pattern.back() != '*')
+		return pattern == channel;
+
+	return channel.compare(0, pattern.size() - 1, pattern, 0, pattern.size() - 1) == 0;
+}
@@ -0,0 +1,43 @@
+#ifndef PIPESUBSCRIBERS_HPP
+#define PIPESUBSCRIBERS_HPP
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "MFTypes.h"
+
+/**
+ * @brief Set of per-channel callbacks which receive objects directly from PipeReader.
+ *        Channel "*" subscribes to all channels, channel ending with "*" subscribes by prefix.
+ */
+class PipeSubscribers
+{
+public:
+	typedef std::function<void(const std::string &, const std::shared_ptr<MF_BASE_TYPE> &)> Callback;
+	typedef std::function<void(std::function<void()>)> Executor;
+
+	PipeSubscribers();
+
+	int32_t add(const std::string &channel, Callback callback);
+	bool remove(int32_t id);
+	void setExecutor(Executor executor);
+
+	/**
+	 * @brief Passes object to all matching subscribers.
+	 * @return true if object was consumed by at least one subscriber.
+	 */
+	bool deliver(const std::string &channel, const std::shared_ptr<MF_BASE_TYPE> &object);
+
+private:
+	static bool matches(const std::string &pattern, const std::string &channel);
+
+	std::mutex mutex;
+	int32_t lastId;
+	std::map<int32_t, std::pair<std::string, Callback>> callbacks;
+	Executor executor;
+};
+
+#endif // PIPESUBSCRIBERS_HPP
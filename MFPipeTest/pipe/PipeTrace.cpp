@@ -0,0 +1,234 @@
+#include "PipeTrace.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <mutex>
+
+static constexpr size_t RING_SIZE = 64 * 1024;
+
+/**
+ * @brief Event of the ring. Stamp is the ring position + 1 of the event, 0 while it is written,
+ *        so reader takes the fields only if the stamp is the same before and after it copies them.
+ */
+struct TraceSlot
+{
+	std::atomic<uint64_t> stamp { 0 };
+	std::atomic<uint64_t> id { 0 };
+	std::atomic<int64_t> timeNs { 0 };
+	std::atomic<PipeTrace::Stage> stage { PipeTrace::Stage::PUT };
+};
+
+/**
+ * @brief Single-producer ring of one thread. Oldest events are overwritten.
+ */
+struct TraceRing
+{
+	uint32_t thread;
+	std::atomic<uint64_t> head { 0 };
+	TraceSlot slots[RING_SIZE];
+};
+
+static std::mutex ringsMutex;
+static std::vector<std::shared_ptr<TraceRing>> rings;
+
+static TraceRing *threadRing()
+{
+	// Rings are owned by the registry, so events survive their threads.
+	thread_local TraceRing *ring = nullptr;
+	if (ring == nullptr)
+	{
+		auto newRing = std::make_shared<TraceRing>();
+		std::lock_guard<std::mutex> lock(ringsMutex);
+		newRing->thread = static_cast<uint32_t>(rings.size());
+		rings.push_back(newRing);
+		ring = newRing.get();
+	}
+	return ring;
+}
+
+static bool enabledByEnvironment()
+{
+	const auto env = std::getenv("MFPIPE_TRACE");
+	return env != nullptr && std::strcmp(env, "0") != 0;
+}
+
+std::atomic<bool> PipeTrace::enabled(enabledByEnvironment());
+std::atomic<uint64_t> PipeTrace::lastId(0);
+
+void PipeTrace::enable(bool enabled)
+{
+	PipeTrace::enabled = enabled;
+}
+
+int64_t PipeTrace::now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+uint64_t PipeTrace::nextId()
+{
+	return lastId.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
+void PipeTrace::stamp(Stage stage, uint64_t id, int64_t timeNs)
+{
+	// Object was put or parsed before tracing was enabled.
+	if (id == 0)
+		return;
+
+	auto ring = threadRing();
+	const auto head = ring->head.load(std::memory_order_relaxed);
+
+	auto &slot = ring->slots[head % RING_SIZE];
+	slot.stamp.store(0, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	slot.id.store(id, std::memory_order_relaxed);
+	slot.timeNs.store(timeNs != 0 ? timeNs : now(), std::memory_order_relaxed);
+	slot.stage.store(stage, std::memory_order_relaxed);
+	slot.stamp.store(head + 1, std::memory_order_release);
+
+	ring->head.store(head + 1, std::memory_order_release);
+}
+
+std::vector<PipeTrace::Event> PipeTrace::collect()
+{
+	std::vector<Event> res;
+
+	std::lock_guard<std::mutex> lock(ringsMutex);
+	for (const auto &ring : rings)
+	{
+		const auto head = ring->head.load(std::memory_order_acquire);
+		const auto first = head > RING_SIZE ? head - RING_SIZE : 0;
+		for (auto i = first; i < head; ++i)
+		{
+			// Slot overwritten by a newer event, or being overwritten, is skipped.
+			const auto &slot = ring->slots[i % RING_SIZE];
+			const auto stamp = slot.stamp.load(std::memory_order_acquire);
+			if (stamp != i + 1)
+				continue;
+
+			Event event;
+			event.id = slot.id.load(std::memory_order_relaxed);
+			event.timeNs = slot.timeNs.load(std::memory_order_relaxed);
+			event.thread = ring->thread;
+			event.stage = slot.stage.load(std::memory_order_relaxed);
+
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (slot.stamp.load(std::memory_order_relaxed) == stamp)
+				res.push_back(event);
+		}
+	}
+
+	std::sort(res.begin(), res.end(), [](const Event &lh, const Event &rh) {
+		return lh.timeNs < rh.timeNs;
+	});
+
+	return res;
+}
+
+void PipeTrace::clear()
+{
+	std::lock_guard<std::mutex> lock(ringsMutex);
+	for (const auto &ring : rings)
+		ring->head = 0;
+}
+
+bool PipeTrace::exportChromeTrace(const std::string &path)
+{
+	std::ofstream out(path);
+	if (!out)
+		return false;
+
+	const auto events = collect();
+
+	// Every stage is an instant event, time since the previous stage of the same object is a complete event.
+	static const std::map<Stage, std::pair<Stage, const char *>> spans = {
+		{ Stage::WRITER_DEQUEUE, { Stage::PUT, "write queue" } },
+		{ Stage::WRITE_COMPLETE, { Stage::WRITER_DEQUEUE, "serialize+write" } },
+		{ Stage::PARSE_COMPLETE, { Stage::FIRST_BYTE_READ, "read+parse" } },
+		{ Stage::GET, { Stage::PARSE_COMPLETE, "read queue" } },
+	};
+	std::map<uint64_t, std::map<Stage, int64_t>> lastStages;
+
+	out << std::fixed << std::setprecision(3) << "{\"traceEvents\": [" << std::endl;
+	bool first = true;
+	for (const auto &event : events)
+	{
+		out << (first ? "" : ",\n")
+			<< "{\"name\": \"" << stageName(event.stage) << "\", \"ph\": \"i\", \"s\": \"t\", \"pid\": 0, "
+			<< "\"tid\": " << event.thread << ", \"ts\": " << event.timeNs / 1000.0 << ", "
+			<< "\"args\": {\"id\": " << event.id << "}}";
+		first = false;
+
+		auto &stages = lastStages[event.id];
+		const auto span = spans.find(event.stage);
+		if (span != spans.end())
+		{
+			const auto prev = stages.find(span->second.first);
+			if (prev != stages.end())
+			{
+				out << ",\n{\"name\": \"" << span->second.second << "\", \"ph\": \"X\", \"pid\": 0, "
+					<< "\"tid\": " << event.thread << ", \"ts\": " << prev->second / 1000.0 << ", "
+					<< "\"dur\": " << (event.timeNs - prev->second) / 1000.0 << ", "
+					<< "\"args\": {\"id\": " << event.id << "}}";
+			}
+		}
+		stages[event.stage] = event.timeNs;
+	}
+	out << std::endl << "]}" << std::endl;
+
+	return static_cast<bool>(out);
+}
+
+bool PipeTrace::exportBinary(const std::string &path)
+{
+	std::ofstream out(path, std::ios::binary);
+	if (!out)
+		return false;
+
+	const auto events = collect();
+
+	// "MFTR", format version, event count, then packed little-endian records of 21 bytes.
+	const uint32_t version = 1;
+	const uint64_t count = events.size();
+	out.write("MFTR", 4);
+	out.write(reinterpret_cast<const char *>(&version), sizeof(version));
+	out.write(reinterpret_cast<const char *>(&count), sizeof(count));
+
+	for (const auto &event : events)
+	{
+		out.write(reinterpret_cast<const char *>(&event.id), sizeof(event.id));
+		out.write(reinterpret_cast<const char *>(&event.timeNs), sizeof(event.timeNs));
+		out.write(reinterpret_cast<const char *>(&event.thread), sizeof(event.thread));
+		out.write(reinterpret_cast<const char *>(&event.stage), sizeof(event.stage));
+	}
+
+	return static_cast<bool>(out);
+}
+
+const char *PipeTrace::stageName(Stage stage)
+{
+	switch (stage)
+	{
+		case Stage::PUT:
+			return "put";
+		case Stage::WRITER_DEQUEUE:
+			return "writer dequeue";
+		case Stage::WRITE_COMPLETE:
+			return "write complete";
+		case Stage::FIRST_BYTE_READ:
+			return "first byte read";
+		case Stage::PARSE_COMPLETE:
+			return "parse complete";
+		case Stage::GET:
+			return "get";
+	}
+	return "unknown";
+}
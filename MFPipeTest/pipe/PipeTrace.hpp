@@ -0,0 +1,83 @@
+#ifndef PIPETRACE_HPP
+#define PIPETRACE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Optional per-object stage tracing.
+ *        Every thread stamps into its own lock-free ring, rings are merged only on export.
+ *        Objects are identified by trace ID taken when they are put or parsed, it goes with their queue entry,
+ *        so objects of a pool reusing the same address are told apart.
+ *        Compiled in with MFPIPE_TRACE, switched on at runtime with enable() or MFPIPE_TRACE=1 environment variable.
+ */
+class PipeTrace
+{
+public:
+	enum class Stage : uint8_t
+	{
+		PUT = 0x00,
+		WRITER_DEQUEUE,
+		WRITE_COMPLETE,
+		FIRST_BYTE_READ,
+		PARSE_COMPLETE,
+		GET,
+	};
+
+	struct Event
+	{
+		uint64_t id;
+		int64_t timeNs;
+		uint32_t thread;
+		Stage stage;
+	};
+
+	static void enable(bool enabled);
+
+	static bool isEnabled()
+	{
+		return enabled.load(std::memory_order_relaxed);
+	}
+
+	static int64_t now();
+
+	/**
+	 * @brief Trace ID for a new object, unique in the process. 0 is for objects not traced.
+	 */
+	static uint64_t nextId();
+	static void stamp(Stage stage, uint64_t id, int64_t timeNs = 0);
+
+	/**
+	 * @brief Copies events of all threads ordered by time.
+	 *        Events stamped concurrently with collection may be missing.
+	 */
+	static std::vector<Event> collect();
+	static void clear();
+
+	static bool exportChromeTrace(const std::string &path);
+	static bool exportBinary(const std::string &path);
+
+	static const char *stageName(Stage stage);
+
+private:
+	static std::atomic<bool> enabled;
+	static std::atomic<uint64_t> lastId;
+};
+
+#ifdef MFPIPE_TRACE
+#define PIPE_TRACE(stage, id) \
+	do { if (PipeTrace::isEnabled()) PipeTrace::stamp(PipeTrace::Stage::stage, (id)); } while (0)
+#define PIPE_TRACE_AT(stage, id, timeNs) \
+	do { if (PipeTrace::isEnabled()) PipeTrace::stamp(PipeTrace::Stage::stage, (id), (timeNs)); } while (0)
+#define PIPE_TRACE_NOW() (PipeTrace::isEnabled() ? PipeTrace::now() : 0)
+#define PIPE_TRACE_ID() (PipeTrace::isEnabled() ? PipeTrace::nextId() : 0)
+#else
+#define PIPE_TRACE(stage, id) do {} while (0)
+#define PIPE_TRACE_AT(stage, id, timeNs) do {} while (0)
+#define PIPE_TRACE_NOW() (0)
+#define PIPE_TRACE_ID() (uint64_t(0))
+#endif
+
+#endif // PIPETRACE_HPP
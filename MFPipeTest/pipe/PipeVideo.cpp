@@ -0,0 +1,183 @@
+#include "PipeVideo.hpp"
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define PIPE_VIDEO_SSE2
+#include <emmintrin.h>
+#endif
+
+/**
+ * @brief Appends plane to the layout.
+ * @return false if its size doesn't fit into size_t.
+ */
+static bool addPlane(PipeVideo::Layout &layout, size_t stride, size_t rowBytes, size_t rows)
+{
+	// Props come from the wire, sizes are checked before they are trusted with allocations.
+	if (stride > SIZE_MAX / rows || stride * rows > SIZE_MAX - layout.size
+		|| rowBytes > SIZE_MAX / rows || rowBytes * rows > SIZE_MAX - layout.packedSize)
+		return false;
+
+	auto &plane = layout.plane[layout.planes++];
+	plane.offset = layout.size;
+	plane.stride = stride;
+	plane.rowBytes = rowBytes;
+	plane.rows = rows;
+
+	layout.size += stride * rows;
+	layout.packedSize += rowBytes * rows;
+	return true;
+}
+
+bool PipeVideo::layout(const M_VID_PROPS &props, Layout &layout)
+{
+	layout = {};
+
+	if (props.nWidth <= 0 || props.nHeight <= 0 || props.nRowBytes <= 0)
+		return false;
+
+	const size_t width = static_cast<size_t>(props.nWidth);
+	const size_t height = static_cast<size_t>(props.nHeight);
+	const size_t stride = static_cast<size_t>(props.nRowBytes);
+
+	// Chroma is subsampled by two with odd sizes rounded up.
+	const size_t chromaWidth = (width + 1) / 2;
+	const size_t chromaHeight = (height + 1) / 2;
+
+	// Widths come from int, so bytes of a row fit into size_t.
+	bool isValid = false;
+	switch (props.fccType)
+	{
+		case eMFCC_I420:
+		case eMFCC_YV12:
+			isValid = addPlane(layout, stride, width, height)
+					&& addPlane(layout, stride / 2, chromaWidth, chromaHeight)
+					&& addPlane(layout, stride / 2, chromaWidth, chromaHeight);
+			break;
+		case eMFCC_NV12:
+			isValid = addPlane(layout, stride, width, height)
+					&& addPlane(layout, stride, chromaWidth * 2, chromaHeight);
+			break;
+		case eMFCC_YUY2:
+		case eMFCC_YVYU:
+		case eMFCC_UYVY:
+			isValid = addPlane(layout, stride, chromaWidth * 4, height);
+			break;
+		case eMFCC_RGB24:
+			isValid = addPlane(layout, stride, width * 3, height);
+			break;
+		case eMFCC_RGB32:
+			isValid = addPlane(layout, stride, width * 4, height);
+			break;
+		default:
+			break;
+	}
+
+	if (!isValid)
+		return false;
+
+	for (auto i = 0; i < layout.planes; ++i)
+	{
+		if (layout.plane[i].stride < layout.plane[i].rowBytes)
+			return false;
+	}
+
+	return true;
+}
+
+void PipeVideo::pack(const uint8_t *src, const Layout &layout, uint8_t *dst)
+{
+	for (auto i = 0; i < layout.planes; ++i)
+	{
+		const auto &plane = layout.plane[i];
+		const uint8_t *row = src + plane.offset;
+		for (size_t y = 0; y < plane.rows; ++y, row += plane.stride, dst += plane.rowBytes)
+			memcpy(dst, row, plane.rowBytes);
+	}
+}
+
+void PipeVideo::unpack(const uint8_t *src, const Layout &layout, uint8_t *dst)
+{
+	for (auto i = 0; i < layout.planes; ++i)
+	{
+		const auto &plane = layout.plane[i];
+		uint8_t *row = dst + plane.offset;
+		for (size_t y = 0; y < plane.rows; ++y, row += plane.stride, src += plane.rowBytes)
+		{
+			memcpy(row, src, plane.rowBytes);
+			memset(row + plane.rowBytes, 0, plane.stride - plane.rowBytes);
+		}
+	}
+}
+
+PipeVideo::Tiles PipeVideo::tiles(size_t size, size_t stride)
+{
+	Tiles res;
+	res.size = size;
+	res.stride = std::max<size_t>(stride, 1);
+	res.rows = (size + res.stride - 1) / res.stride;
+	res.columns = (std::min(res.stride, size) + TILE_BYTES - 1) / TILE_BYTES;
+	res.count = res.columns * ((res.rows + TILE_ROWS - 1) / TILE_ROWS);
+	return res;
+}
+
+static bool isEqual(const uint8_t *a, const uint8_t *b, size_t length)
+{
+	size_t i = 0;
+#ifdef PIPE_VIDEO_SSE2
+	// Compare results are combined, one branch per call.
+	auto same = _mm_set1_epi8(-1);
+	for (; i + 16 <= length; i += 16)
+	{
+		const auto x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+		const auto y = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i));
+		same = _mm_and_si128(same, _mm_cmpeq_epi8(x, y));
+	}
+	if (_mm_movemask_epi8(same) != 0xFFFF)
+		return false;
+#endif
+	return i == length || memcmp(a + i, b + i, length - i) == 0;
+}
+
+bool PipeVideo::changedTiles(const uint8_t *a, const uint8_t *b, const Tiles &tiles, size_t limit,
+							 std::vector<uint32_t> &changed)
+{
+	changed.clear();
+	for (size_t first = 0; first < tiles.rows; first += TILE_ROWS)
+	{
+		// Flags of the band's columns sit at the end of changed while its rows are scanned in memory order,
+		// then they are squeezed into tile numbers in place.
+		const size_t start = changed.size();
+		changed.resize(start + tiles.columns, 0);
+		uint32_t *flags = changed.data() + start;
+
+		const size_t last = std::min(first + TILE_ROWS, tiles.rows);
+		for (size_t y = first; y < last; ++y)
+		{
+			const size_t rowBytes = std::min(tiles.stride, tiles.size - y * tiles.stride);
+			const size_t offset = y * tiles.stride;
+			// Whole tiles with constant length, so the compare is unrolled.
+			size_t x = 0;
+			size_t column = 0;
+			for (; x + TILE_BYTES <= rowBytes; x += TILE_BYTES, ++column)
+				flags[column] |= !isEqual(a + offset + x, b + offset + x, TILE_BYTES);
+			if (x < rowBytes)
+				flags[column] |= !isEqual(a + offset + x, b + offset + x, rowBytes - x);
+		}
+
+		size_t count = start;
+		const size_t band = first / TILE_ROWS * tiles.columns;
+		for (size_t column = 0; column < tiles.columns; ++column)
+		{
+			if (changed[start + column] != 0)
+				changed[count++] = static_cast<uint32_t>(band + column);
+		}
+		changed.resize(count);
+
+		if (count > limit)
+			return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,96 @@
+#ifndef PIPEVIDEO_HPP
+#define PIPEVIDEO_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "../MFTypes.h"
+
+/**
+ * @brief Plane layout of video described by M_VID_PROPS.
+ *        nRowBytes is the stride of the first plane, chroma planes of I420 and YV12 have half of it,
+ *        the interleaved chroma plane of NV12 the full one.
+ */
+class PipeVideo
+{
+public:
+	static constexpr int MAX_PLANES = 3;
+	static constexpr size_t TILE_BYTES = 64;
+	static constexpr size_t TILE_ROWS = 16;
+
+	struct Plane
+	{
+		size_t offset = 0;
+		size_t stride = 0;
+		size_t rowBytes = 0; // Bytes of visible pixels in a row.
+		size_t rows = 0;
+	};
+
+	struct Layout
+	{
+		int planes = 0;
+		Plane plane[MAX_PLANES];
+		size_t size = 0;       // With row padding, as in vec_video_data.
+		size_t packedSize = 0; // Visible pixels only.
+	};
+
+	/**
+	 * @brief Tiles of TILE_BYTES x TILE_ROWS over video bytes seen as rows of stride bytes, whatever the format.
+	 *        Tiles are numbered row by row, the ones at the right and bottom edges are cut.
+	 */
+	struct Tiles
+	{
+		size_t size = 0;
+		size_t stride = 0;
+		size_t rows = 0;
+		size_t columns = 0;
+		size_t count = 0;
+	};
+
+	static Tiles tiles(size_t size, size_t stride);
+
+	/**
+	 * @brief Calls fn(offset, length) for each row of the tile.
+	 */
+	template <typename Fn>
+	static void forTileRows(const Tiles &tiles, size_t tile, Fn &&fn)
+	{
+		const size_t x = tile % tiles.columns * TILE_BYTES;
+		const size_t firstRow = tile / tiles.columns * TILE_ROWS;
+		const size_t lastRow = std::min(firstRow + TILE_ROWS, tiles.rows);
+		for (size_t y = firstRow; y < lastRow; ++y)
+		{
+			const size_t rowBytes = std::min(tiles.stride, tiles.size - y * tiles.stride);
+			if (x < rowBytes)
+				fn(y * tiles.stride + x, std::min(TILE_BYTES, rowBytes - x));
+		}
+	}
+
+	/**
+	 * @brief Fills changed with increasing numbers of tiles that differ between video a and b.
+	 *        Rows are scanned front to back, 16 bytes at a time with SSE2 where available.
+	 * @return false once more than limit tiles differ, changed is incomplete then.
+	 */
+	static bool changedTiles(const uint8_t *a, const uint8_t *b, const Tiles &tiles, size_t limit,
+							 std::vector<uint32_t> &changed);
+
+	/**
+	 * @brief Layout of given props.
+	 * @return false for unknown formats and props that don't describe a valid picture.
+	 */
+	static bool layout(const M_VID_PROPS &props, Layout &layout);
+
+	/**
+	 * @brief Copies visible rows of all planes back to back. dst takes layout.packedSize bytes.
+	 */
+	static void pack(const uint8_t *src, const Layout &layout, uint8_t *dst);
+
+	/**
+	 * @brief Restores strides of packed video. dst takes layout.size bytes, row padding is zeroed.
+	 */
+	static void unpack(const uint8_t *src, const Layout &layout, uint8_t *dst);
+};
+
+#endif // PIPEVIDEO_HPP
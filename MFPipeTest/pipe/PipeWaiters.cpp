@@ -0,0 +1,247 @@
+#include "PipeWaiters.hpp"
+
+#include <algorithm>
+
+void PipeCancelToken::cancel()
+{
+	std::vector<std::weak_ptr<PipeWaiters>> toNotify;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		cancelled = true;
+		toNotify.swap(registries);
+	}
+
+	for (const auto &weak : toNotify)
+	{
+		if (auto waiters = weak.lock())
+			waiters->sweepCancelled();
+	}
+}
+
+bool PipeCancelToken::isCancelled() const
+{
+	return cancelled;
+}
+
+bool PipeCancelToken::attach(const std::weak_ptr<PipeWaiters> &waiters)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	// Registries are swapped out by cancel() under the same lock, a later attach would never be swept.
+	if (cancelled)
+		return false;
+
+	for (const auto &weak : registries)
+	{
+		if (!weak.owner_before(waiters) && !waiters.owner_before(weak))
+			return true;
+	}
+	registries.push_back(waiters);
+	return true;
+}
+
+PipeWaiters::PipeWaiters()
+	: state(std::make_shared<State>())
+{}
+
+PipeWaiters::~PipeWaiters()
+{
+	{
+		std::lock_guard<std::mutex> lock(state->mutex);
+		state->isRunning = false;
+	}
+	state->timerCv.notify_all();
+
+	if (timer)
+	{
+		// The last reference may be dropped by a coroutine resumed on the timer thread itself,
+		// the thread keeps the state and leaves the loop on its own.
+		if (timer->get_id() == std::this_thread::get_id())
+			timer->detach();
+		else if (timer->joinable())
+			timer->join();
+	}
+}
+
+void PipeWaiters::setExecutor(Executor executor)
+{
+	std::lock_guard<std::mutex> lock(state->mutex);
+	state->executor = executor;
+}
+
+bool PipeWaiters::wait(PipeWaiter *waiter)
+{
+	std::unique_lock<std::mutex> lock(state->mutex);
+
+	// Waiter is published before the last retry: producer that changed queues after the retry
+	// sees non-zero count and completes it in notify() once the lock is released.
+	state->waiters.push_back(waiter);
+	state->count = state->waiters.size();
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	// Token cancelled after attach sweeps the waiter once the lock is released.
+	if (waiter->token && !waiter->token->attach(weak_from_this()))
+	{
+		state->waiters.pop_back();
+		state->count = state->waiters.size();
+		waiter->fail(MF_HRESULT::ABORT);
+		return false;
+	}
+
+	if (waiter->tryComplete() || waiter->deadline <= std::chrono::steady_clock::now())
+	{
+		state->waiters.pop_back();
+		state->count = state->waiters.size();
+		return false;
+	}
+
+	if (waiter->deadline != std::chrono::steady_clock::time_point::max())
+	{
+		if (!timer)
+			timer.reset(new std::thread(&PipeWaiters::timerLoop, state));
+		state->timerCv.notify_all();
+	}
+
+	return true;
+}
+
+void PipeWaiters::notify()
+{
+	// Pairs with the fence in wait(): either the waiter sees the change or this sees the waiter.
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (state->count == 0)
+		return;
+
+	std::vector<PipeWaiter *> ready;
+
+	{
+		std::lock_guard<std::mutex> lock(state->mutex);
+		for (auto it = state->waiters.begin(); it != state->waiters.end();)
+		{
+			if ((*it)->tryComplete())
+			{
+				ready.push_back(*it);
+				it = state->waiters.erase(it);
+			}
+			else
+			{
+				++it;
+			}
+		}
+		state->count = state->waiters.size();
+	}
+
+	resume(*state, ready);
+}
+
+bool PipeWaiters::isWaiting() const
+{
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	return state->count != 0;
+}
+
+void PipeWaiters::sweepCancelled()
+{
+	std::vector<PipeWaiter *> ready;
+
+	{
+		std::lock_guard<std::mutex> lock(state->mutex);
+		for (auto it = state->waiters.begin(); it != state->waiters.end();)
+		{
+			if ((*it)->token && (*it)->token->isCancelled())
+			{
+				(*it)->fail(MF_HRESULT::ABORT);
+				ready.push_back(*it);
+				it = state->waiters.erase(it);
+			}
+			else
+			{
+				++it;
+			}
+		}
+		state->count = state->waiters.size();
+	}
+
+	resume(*state, ready);
+}
+
+void PipeWaiters::abortAll()
+{
+	std::vector<PipeWaiter *> ready;
+
+	{
+		std::lock_guard<std::mutex> lock(state->mutex);
+		for (auto waiter : state->waiters)
+		{
+			waiter->fail(MF_HRESULT::ABORT);
+			ready.push_back(waiter);
+		}
+		state->waiters.clear();
+		state->count = 0;
+	}
+
+	resume(*state, ready);
+}
+
+void PipeWaiters::timerLoop(std::shared_ptr<State> state)
+{
+	std::unique_lock<std::mutex> lock(state->mutex);
+
+	while (state->isRunning)
+	{
+		auto next = std::chrono::steady_clock::time_point::max();
+		for (auto waiter : state->waiters)
+			next = std::min(next, waiter->deadline);
+
+		if (next == std::chrono::steady_clock::time_point::max())
+			state->timerCv.wait(lock);
+		else
+			state->timerCv.wait_until(lock, next);
+
+		const auto now = std::chrono::steady_clock::now();
+		std::vector<PipeWaiter *> expired;
+		for (auto it = state->waiters.begin(); it != state->waiters.end();)
+		{
+			if ((*it)->deadline <= now)
+			{
+				expired.push_back(*it);
+				it = state->waiters.erase(it);
+			}
+			else
+			{
+				++it;
+			}
+		}
+		state->count = state->waiters.size();
+
+		if (expired.empty())
+			continue;
+
+		lock.unlock();
+		resume(*state, expired);
+		lock.lock();
+	}
+}
+
+void PipeWaiters::resume(State &state, const std::vector<PipeWaiter *> &ready)
+{
+	if (ready.empty())
+		return;
+
+	Executor exec;
+	{
+		std::lock_guard<std::mutex> lock(state.mutex);
+		exec = state.executor;
+	}
+
+	for (auto waiter : ready)
+	{
+		// Waiter lives in the coroutine frame and is gone after resume.
+		const auto handle = waiter->handle;
+		if (exec)
+			exec([handle]() { handle.resume(); });
+		else
+			handle.resume();
+	}
+}
@@ -0,0 +1,183 @@
+#ifndef PIPEWAITERS_HPP
+#define PIPEWAITERS_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "MFTypes.h"
+
+class PipeWaiters;
+
+/**
+ * @brief Cancels all pipe operations awaited with this token.
+ */
+class PipeCancelToken
+{
+public:
+	void cancel();
+	bool isCancelled() const;
+
+private:
+	friend class PipeWaiters;
+
+	/**
+	 * @brief Registers waiters to sweep on cancel.
+	 * @return false if token is cancelled already.
+	 */
+	bool attach(const std::weak_ptr<PipeWaiters> &waiters);
+
+	std::mutex mutex;
+	std::atomic<bool> cancelled { false };
+	std::vector<std::weak_ptr<PipeWaiters>> registries;
+};
+
+/**
+ * @brief Suspended pipe operation. Completed by PipeWaiters when queue state changes.
+ */
+class PipeWaiter
+{
+public:
+	virtual ~PipeWaiter() = default;
+
+	/**
+	 * @brief Tries to finish operation, stores result on success.
+	 */
+	virtual bool tryComplete() = 0;
+	virtual void fail(MF_HRESULT hr) = 0;
+
+	std::coroutine_handle<> handle;
+	std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+	std::shared_ptr<PipeCancelToken> token;
+};
+
+/**
+ * @brief Registry of suspended coroutines of one pipe.
+ *        PipeReader and PipeWriter call notify() after they change queues, waiters are
+ *        retried and resumed on the executor (or inline) once they complete, expire or are cancelled.
+ */
+class PipeWaiters : public std::enable_shared_from_this<PipeWaiters>
+{
+public:
+	typedef std::function<void(std::function<void()>)> Executor;
+
+	PipeWaiters();
+	~PipeWaiters();
+
+	void setExecutor(Executor executor);
+
+	/**
+	 * @brief Registers waiter.
+	 * @return false if waiter finished immediately and must not be suspended.
+	 */
+	bool wait(PipeWaiter *waiter);
+	void notify();
+
+	/**
+	 * @brief Some operation is suspended, so notify() has work to do.
+	 */
+	bool isWaiting() const;
+	void sweepCancelled();
+	void abortAll();
+
+private:
+	/**
+	 * @brief Everything timer thread touches. It owns the state too, so a coroutine it resumes may drop
+	 *        the last reference to PipeWaiters without freeing what the thread uses next.
+	 */
+	struct State
+	{
+		std::mutex mutex;
+		std::condition_variable timerCv;
+		std::list<PipeWaiter *> waiters;
+		std::atomic<size_t> count { 0 };
+		bool isRunning = true;
+		Executor executor;
+	};
+
+	static void timerLoop(std::shared_ptr<State> state);
+	static void resume(State &state, const std::vector<PipeWaiter *> &ready);
+
+	std::shared_ptr<State> state;
+	std::unique_ptr<std::thread> timer;
+};
+
+template <typename T>
+struct PipeResult
+{
+	MF_HRESULT hr;
+	T value;
+};
+
+/**
+ * @brief Awaitable pipe operation. Attempt is retried until it succeeds, deadline expires or token is cancelled.
+ */
+template <typename T>
+class PipeAwaiter : public PipeWaiter
+{
+public:
+	typedef std::function<bool(T &)> Attempt;
+
+	PipeAwaiter(std::shared_ptr<PipeWaiters> waiters,
+				Attempt attempt,
+				int maxWaitMs,
+				std::shared_ptr<PipeCancelToken> cancelToken)
+		: waiters(waiters),
+		  attempt(attempt)
+	{
+		result.hr = MF_HRESULT::RES_FALSE;
+		result.value = T();
+		if (maxWaitMs >= 0)
+			deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(maxWaitMs);
+		token = cancelToken;
+	}
+
+	bool await_ready()
+	{
+		if (token && token->isCancelled())
+		{
+			fail(MF_HRESULT::ABORT);
+			return true;
+		}
+		return tryComplete();
+	}
+
+	bool await_suspend(std::coroutine_handle<> h)
+	{
+		handle = h;
+		return waiters->wait(this);
+	}
+
+	PipeResult<T> await_resume()
+	{
+		return result;
+	}
+
+	bool tryComplete() override
+	{
+		if (!attempt(result.value))
+			return false;
+
+		result.hr = MF_HRESULT::RES_OK;
+		return true;
+	}
+
+	void fail(MF_HRESULT hr) override
+	{
+		result.hr = hr;
+	}
+
+private:
+	std::shared_ptr<PipeWaiters> waiters;
+	Attempt attempt;
+	PipeResult<T> result;
+};
+
+#endif // PIPEWAITERS_HPP
@@ -0,0 +1,722 @@
+#include "PipeWire.hpp"
+
+#include <cstring>
+
+#include "PipeLz.hpp"
+
+/**
+ * @brief Counts bytes of a payload, so its length can precede it.
+ */
+struct SizeSink
+{
+	size_t size = 0;
+
+	void byte(uint8_t)
+	{
+		size++;
+	}
+
+	void bytes(const uint8_t *, size_t count)
+	{
+		size += count;
+	}
+};
+
+struct BufferSink
+{
+	std::vector<uint8_t> &buf;
+
+	void byte(uint8_t value)
+	{
+		buf.push_back(value);
+	}
+
+	void bytes(const uint8_t *data, size_t count)
+	{
+		buf.insert(buf.end(), data, data + count);
+	}
+};
+
+template <typename Sink>
+static void putVarint(Sink &sink, uint64_t value)
+{
+	while (value >= 0x80)
+	{
+		sink.byte(static_cast<uint8_t>(value) | 0x80);
+		value >>= 7;
+	}
+	sink.byte(static_cast<uint8_t>(value));
+}
+
+template <typename Sink>
+static void putSigned(Sink &sink, int64_t value)
+{
+	putVarint(sink, (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+}
+
+template <typename Sink>
+static void putFixed(Sink &sink, uint64_t value, size_t size)
+{
+	for (size_t i = 0; i < size; ++i)
+		sink.byte(static_cast<uint8_t>(value >> (8 * i)));
+}
+
+template <typename Sink>
+static void putBytes(Sink &sink, const void *data, size_t size)
+{
+	putVarint(sink, size);
+	sink.bytes(static_cast<const uint8_t *>(data), size);
+}
+
+// Frame flags: which props the record carries.
+static constexpr uint64_t FRAME_AV_PROPS = 0x1;
+static constexpr uint64_t FRAME_USER_PROPS = 0x2;
+static constexpr uint64_t FRAME_PACKED_VIDEO = 0x4;
+static constexpr uint64_t FRAME_COMPRESSED_VIDEO = 0x8;
+static constexpr uint64_t FRAME_REFERENCE_VIDEO = 0x10;
+static constexpr uint64_t FRAME_DELTA_VIDEO = 0x20;
+
+// Delta carrying more than this part of the video goes as a new reference instead.
+static constexpr size_t MAX_DELTA_DIVISOR = 4;
+
+// Buffer flags.
+static constexpr uint64_t BUFFER_COMPRESSED = 0x1;
+
+// LZ block can't expand more than about 255 times, larger claimed sizes are malformed.
+static constexpr size_t MAX_LZ_RATIO = 256;
+// Row padding restored for packed video is bounded alike, strides are aligned to far less than that.
+static constexpr size_t MAX_PADDING_RATIO = 256;
+
+struct FrameRecord
+{
+	const MF_FRAME &frame;
+	uint64_t flags;
+	const PipeVideo::Layout *layout = nullptr;            // Set with FRAME_PACKED_VIDEO.
+	const PipeWire::Compressed *compressed = nullptr;     // Set with FRAME_COMPRESSED_VIDEO.
+	uint64_t sequence = 0;                                // Set with FRAME_REFERENCE_VIDEO and FRAME_DELTA_VIDEO.
+	const std::vector<uint32_t> *tiles = nullptr;         // Set with FRAME_DELTA_VIDEO, as grid.
+	PipeVideo::Tiles grid;
+};
+
+struct BufferRecord
+{
+	const MF_BUFFER &buffer;
+	const PipeWire::Compressed *compressed;
+};
+
+template <typename Sink>
+static void encode(Sink &sink, const FrameRecord &record)
+{
+	const auto &frame = record.frame;
+	const auto &vid = frame.av_props.vidProps;
+	const auto &aud = frame.av_props.audProps;
+
+	putVarint(sink, record.flags);
+	putSigned(sink, frame.time.rtStartTime);
+	putSigned(sink, frame.time.rtEndTime);
+
+	if (record.flags & FRAME_AV_PROPS)
+	{
+		uint64_t rate;
+		memcpy(&rate, &vid.dblRate, sizeof(rate));
+
+		putFixed(sink, static_cast<uint32_t>(vid.fccType), sizeof(uint32_t));
+		putSigned(sink, vid.nWidth);
+		putSigned(sink, vid.nHeight);
+		putSigned(sink, vid.nRowBytes);
+		putSigned(sink, vid.nAspectX);
+		putSigned(sink, vid.nAspectY);
+		putFixed(sink, rate, sizeof(rate));
+		putSigned(sink, aud.nChannels);
+		putSigned(sink, aud.nSamplesPerSec);
+		putSigned(sink, aud.nBitsPerSample);
+		putSigned(sink, aud.nTrackSplitBits);
+	}
+
+	if (record.flags & FRAME_USER_PROPS)
+		putBytes(sink, frame.str_user_props.data(), frame.str_user_props.size());
+
+	if (record.flags & (FRAME_REFERENCE_VIDEO | FRAME_DELTA_VIDEO))
+		putVarint(sink, record.sequence);
+
+	if (record.flags & FRAME_DELTA_VIDEO)
+	{
+		// Changed tiles by gap from the previous one, with their rows back to back.
+		putVarint(sink, record.grid.stride);
+		putVarint(sink, record.tiles->size());
+		size_t next = 0;
+		for (const auto tile : *record.tiles)
+		{
+			putVarint(sink, tile - next);
+			next = tile + 1;
+			PipeVideo::forTileRows(record.grid, tile, [&sink, &frame](size_t offset, size_t length) {
+				sink.bytes(frame.vec_video_data.data() + offset, length);
+			});
+		}
+	}
+	else if (record.flags & FRAME_COMPRESSED_VIDEO)
+	{
+		putVarint(sink, record.compressed->rawSize);
+		putBytes(sink, record.compressed->data, record.compressed->size);
+	}
+	else if (record.flags & FRAME_PACKED_VIDEO)
+	{
+		// Visible part of each row, straight from the frame without an intermediate copy.
+		const auto &layout = *record.layout;
+		putVarint(sink, layout.packedSize);
+		for (auto i = 0; i < layout.planes; ++i)
+		{
+			const auto &plane = layout.plane[i];
+			const uint8_t *row = frame.vec_video_data.data() + plane.offset;
+			for (size_t y = 0; y < plane.rows; ++y, row += plane.stride)
+				sink.bytes(row, plane.rowBytes);
+		}
+	}
+	else
+	{
+		putBytes(sink, frame.vec_video_data.data(), frame.vec_video_data.size());
+	}
+
+	putBytes(sink, frame.vec_audio_data.data(), frame.vec_audio_data.size());
+}
+
+template <typename Sink>
+static void encode(Sink &sink, const BufferRecord &record)
+{
+	putVarint(sink, record.compressed ? BUFFER_COMPRESSED : 0);
+	putVarint(sink, static_cast<uint32_t>(record.buffer.flags));
+	if (record.compressed)
+	{
+		putVarint(sink, record.compressed->rawSize);
+		putBytes(sink, record.compressed->data, record.compressed->size);
+	}
+	else
+	{
+		putBytes(sink, record.buffer.data.data(), record.buffer.data.size());
+	}
+}
+
+template <typename Sink>
+static void encode(Sink &sink, const Message &message)
+{
+	putBytes(sink, message.name.data(), message.name.size());
+	putBytes(sink, message.param.data(), message.param.size());
+}
+
+template <typename Sink>
+static void encode(Sink &sink, const Credit &credit)
+{
+	putVarint(sink, credit.slots);
+}
+
+template <typename Sink>
+static void encode(Sink &sink, const Timestamp &timestamp)
+{
+	putSigned(sink, timestamp.timeNs);
+}
+
+template <typename Sink>
+static void encode(Sink &sink, const ChannelId &channelId)
+{
+	putVarint(sink, channelId);
+}
+
+/**
+ * @brief Appends v2 record: sync, channel, type, payload length and payload.
+ */
+template <typename T>
+static void record(std::vector<uint8_t> &buf, const std::string &ch, ChannelId channelId, DataType type, const T &value)
+{
+	SizeSink size;
+	encode(size, value);
+
+	const bool isInterned = channelId != NO_CHANNEL_ID;
+	buf.reserve(buf.size() + sizeof(DATA_SYNC_V2) + 10 + (isInterned ? 0 : ch.size()) + 1 + 10 + size.size);
+
+	BufferSink sink { buf };
+	putFixed(sink, DATA_SYNC_V2, sizeof(DATA_SYNC_V2));
+	if (isInterned)
+	{
+		putVarint(sink, (static_cast<uint64_t>(channelId) << 1) | 1);
+	}
+	else
+	{
+		putVarint(sink, static_cast<uint64_t>(ch.size()) << 1);
+		sink.bytes(reinterpret_cast<const uint8_t *>(ch.data()), ch.size());
+	}
+	sink.byte(static_cast<uint8_t>(type));
+	putVarint(sink, size.size);
+	encode(sink, value);
+}
+
+/**
+ * @brief Bounds-checked reader of v2 payload. Any overrun marks it failed.
+ */
+class Source
+{
+public:
+	explicit Source(const std::vector<uint8_t> &raw)
+		: pos(raw.data()),
+		  end(raw.data() + raw.size()),
+		  ok(true)
+	{}
+
+	uint64_t varint()
+	{
+		uint64_t value = 0;
+		for (int shift = 0; shift < 64; shift += 7)
+		{
+			if (pos == end)
+				break;
+
+			const auto byte = *pos++;
+			value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+			if ((byte & 0x80) == 0)
+				return value;
+		}
+
+		ok = false;
+		return 0;
+	}
+
+	int64_t signedVarint()
+	{
+		const auto value = varint();
+		return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+	}
+
+	uint64_t fixed(size_t size)
+	{
+		if (static_cast<size_t>(end - pos) < size)
+		{
+			ok = false;
+			return 0;
+		}
+
+		uint64_t value = 0;
+		for (size_t i = 0; i < size; ++i)
+			value |= static_cast<uint64_t>(*pos++) << (8 * i);
+		return value;
+	}
+
+	/**
+	 * @brief Next size bytes, nullptr if they don't fit.
+	 */
+	const uint8_t *take(size_t size)
+	{
+		if (!ok || static_cast<size_t>(end - pos) < size)
+		{
+			ok = false;
+			return nullptr;
+		}
+
+		const auto res = pos;
+		pos += size;
+		return res;
+	}
+
+	/**
+	 * @brief Length-prefixed bytes, nullptr if they don't fit.
+	 */
+	const uint8_t *bytes(size_t &size)
+	{
+		size = varint();
+		if (!ok || static_cast<size_t>(end - pos) < size)
+		{
+			ok = false;
+			size = 0;
+			return nullptr;
+		}
+
+		const auto res = pos;
+		pos += size;
+		return res;
+	}
+
+	bool isOk() const
+	{
+		return ok;
+	}
+
+private:
+	const uint8_t *pos;
+	const uint8_t *end;
+	bool ok;
+};
+
+/**
+ * @brief Reads decompressed size and PipeLz block, decompresses it into data.
+ */
+static bool decompress(Source &source, std::vector<uint8_t> &data)
+{
+	const auto rawSize = source.varint();
+	size_t size;
+	const auto block = source.bytes(size);
+	if (!source.isOk() || rawSize / MAX_LZ_RATIO > size)
+		return false;
+
+	data.resize(rawSize);
+	return PipeLz::decompress(block, size, data.data(), data.size());
+}
+
+/**
+ * @brief Applies changed tiles to the reference video kept in props.
+ */
+static bool decodeDelta(Source &source, PipeWire::FrameProps &props)
+{
+	const auto stride = source.varint();
+	const auto count = source.varint();
+	if (!source.isOk() || stride == 0)
+		return false;
+
+	const auto grid = PipeVideo::tiles(props.video.size(), stride);
+	if (count > grid.count)
+		return false;
+
+	size_t next = 0;
+	for (uint64_t i = 0; i < count; ++i)
+	{
+		const auto gap = source.varint();
+		if (!source.isOk() || gap >= grid.count - next)
+			return false;
+
+		const size_t tile = next + gap;
+		next = tile + 1;
+		PipeVideo::forTileRows(grid, tile, [&source, &props](size_t offset, size_t length) {
+			const auto data = source.take(length);
+			if (data != nullptr)
+				memcpy(props.video.data() + offset, data, length);
+		});
+	}
+
+	return source.isOk();
+}
+
+static bool decode(Source &source, MF_FRAME &frame, PipeWire::FrameProps *props)
+{
+	auto &vid = frame.av_props.vidProps;
+	auto &aud = frame.av_props.audProps;
+
+	const auto flags = source.varint();
+	frame.time.rtStartTime = source.signedVarint();
+	frame.time.rtEndTime = source.signedVarint();
+
+	// Props left out are those of the previous frame, which a reader that joined late doesn't have.
+	const auto omitted = ~flags & (FRAME_AV_PROPS | FRAME_USER_PROPS);
+	if (omitted != 0 && (props == nullptr || !props->isKnown))
+		return false;
+
+	if (flags & FRAME_AV_PROPS)
+	{
+		vid.fccType = static_cast<eMFCC>(source.fixed(sizeof(uint32_t)));
+		vid.nWidth = static_cast<int>(source.signedVarint());
+		vid.nHeight = static_cast<int>(source.signedVarint());
+		vid.nRowBytes = static_cast<int>(source.signedVarint());
+		vid.nAspectX = static_cast<short>(source.signedVarint());
+		vid.nAspectY = static_cast<short>(source.signedVarint());
+		const auto rate = source.fixed(sizeof(uint64_t));
+		memcpy(&vid.dblRate, &rate, sizeof(rate));
+		aud.nChannels = static_cast<int>(source.signedVarint());
+		aud.nSamplesPerSec = static_cast<int>(source.signedVarint());
+		aud.nBitsPerSample = static_cast<int>(source.signedVarint());
+		aud.nTrackSplitBits = static_cast<int>(source.signedVarint());
+	}
+	else
+	{
+		frame.av_props = props->avProps;
+	}
+
+	size_t size;
+	const uint8_t *data;
+	if (flags & FRAME_USER_PROPS)
+	{
+		data = source.bytes(size);
+		frame.str_user_props.assign(reinterpret_cast<const char *>(data), size);
+	}
+	else
+	{
+		frame.str_user_props = props->userProps;
+	}
+
+	// Delta applies to the reference right before it, which is dropped when anything is amiss.
+	uint64_t sequence = 0;
+	if (flags & (FRAME_REFERENCE_VIDEO | FRAME_DELTA_VIDEO))
+	{
+		sequence = source.varint();
+		if (props == nullptr)
+			return false;
+	}
+
+	if (flags & FRAME_DELTA_VIDEO)
+	{
+		const bool isApplicable = !props->video.empty() && sequence == props->videoSequence + 1;
+		if (!isApplicable || !decodeDelta(source, *props))
+		{
+			props->video.clear();
+			return false;
+		}
+		frame.vec_video_data.assign(props->video.begin(), props->video.end());
+	}
+	else if (flags & FRAME_COMPRESSED_VIDEO)
+	{
+		if (!decompress(source, frame.vec_video_data))
+			return false;
+	}
+	else if (flags & FRAME_PACKED_VIDEO)
+	{
+		data = source.bytes(size);
+		PipeVideo::Layout layout;
+		if (!PipeVideo::layout(frame.av_props.vidProps, layout) || size != layout.packedSize
+			|| layout.size / MAX_PADDING_RATIO > layout.packedSize)
+			return false;
+
+		frame.vec_video_data.resize(layout.size);
+		PipeVideo::unpack(data, layout, frame.vec_video_data.data());
+	}
+	else
+	{
+		data = source.bytes(size);
+		frame.vec_video_data.assign(data, data + size);
+	}
+	data = source.bytes(size);
+	frame.vec_audio_data.assign(data, data + size);
+
+	if (!source.isOk())
+	{
+		if (props != nullptr && (flags & FRAME_DELTA_VIDEO))
+			props->video.clear();
+		return false;
+	}
+
+	if (props != nullptr)
+	{
+		if (flags & FRAME_REFERENCE_VIDEO)
+			props->video.assign(frame.vec_video_data.begin(), frame.vec_video_data.end());
+		if (flags & (FRAME_REFERENCE_VIDEO | FRAME_DELTA_VIDEO))
+			props->videoSequence = sequence;
+		if (flags & FRAME_AV_PROPS)
+			props->avProps = frame.av_props;
+		if (flags & FRAME_USER_PROPS)
+			props->userProps = frame.str_user_props;
+		props->isKnown = props->isKnown || omitted == 0;
+	}
+
+	return true;
+}
+
+/**
+ * @brief Flags of the frame record: props that differ from the previous frame, all of them when not known.
+ */
+static uint64_t frameFlags(const MF_FRAME &frame, PipeWire::FrameProps *props)
+{
+	if (props == nullptr || !props->isKnown)
+	{
+		if (props != nullptr)
+		{
+			props->avProps = frame.av_props;
+			props->userProps = frame.str_user_props;
+			props->isKnown = true;
+		}
+		return FRAME_AV_PROPS | FRAME_USER_PROPS;
+	}
+
+	uint64_t flags = 0;
+	if (props->avProps != frame.av_props)
+	{
+		props->avProps = frame.av_props;
+		flags |= FRAME_AV_PROPS;
+	}
+	if (props->userProps != frame.str_user_props)
+	{
+		props->userProps = frame.str_user_props;
+		flags |= FRAME_USER_PROPS;
+	}
+	return flags;
+}
+
+/**
+ * @brief Collects tiles of the frame that differ from the reference video.
+ * @return false if there is no usable reference or too much has changed for a delta to pay off.
+ */
+static bool isDeltaWorth(const MF_FRAME &frame, PipeWire::FrameProps &props, PipeVideo::Tiles &grid)
+{
+	const auto &video = frame.vec_video_data;
+	if (video.empty() || props.video.size() != video.size())
+		return false;
+
+	const auto stride = frame.av_props.vidProps.nRowBytes;
+	grid = PipeVideo::tiles(video.size(), stride > 0 ? static_cast<size_t>(stride) : PipeVideo::TILE_BYTES);
+
+	return PipeVideo::changedTiles(video.data(), props.video.data(), grid, grid.count / MAX_DELTA_DIVISOR,
+								   props.changedTiles);
+}
+
+static bool decode(Source &source, MF_BUFFER &buffer)
+{
+	const auto flags = source.varint();
+	buffer.flags = static_cast<eMFBufferFlags>(source.varint());
+
+	if (flags & BUFFER_COMPRESSED)
+		return decompress(source, buffer.data) && source.isOk();
+
+	size_t size;
+	const auto data = source.bytes(size);
+	buffer.data.assign(data, data + size);
+
+	return source.isOk();
+}
+
+void PipeWire::serializeTo(std::vector<uint8_t> &buf, uint8_t version, const std::string &ch, const MF_BASE_TYPE &object,
+						   const Options &options)
+{
+	if (version >= VERSION_2)
+	{
+		const auto channelId = options.channelId;
+		if (const auto frame = dynamic_cast<const MF_FRAME *>(&object))
+		{
+			FrameRecord frameRecord { *frame, frameFlags(*frame, options.props) };
+
+			if (options.deltaVideo && options.props != nullptr)
+			{
+				auto &props = *options.props;
+				frameRecord.sequence = ++props.videoSequence;
+				if (isDeltaWorth(*frame, props, frameRecord.grid))
+				{
+					frameRecord.flags |= FRAME_DELTA_VIDEO;
+					frameRecord.tiles = &props.changedTiles;
+					record(buf, ch, channelId, DataType::FRAME, frameRecord);
+
+					// Reference follows what reader rebuilds.
+					for (const auto tile : props.changedTiles)
+					{
+						PipeVideo::forTileRows(frameRecord.grid, tile, [&props, frame](size_t offset, size_t length) {
+							memcpy(props.video.data() + offset, frame->vec_video_data.data() + offset, length);
+						});
+					}
+					return;
+				}
+
+				frameRecord.flags |= FRAME_REFERENCE_VIDEO;
+				props.video.assign(frame->vec_video_data.begin(), frame->vec_video_data.end());
+			}
+
+			// Compressed video has its padding squeezed anyway. Packed only when there is padding
+			// to leave out and video matches its props.
+			PipeVideo::Layout layout;
+			if (options.compressed)
+			{
+				frameRecord.flags |= FRAME_COMPRESSED_VIDEO;
+				frameRecord.compressed = options.compressed;
+			}
+			else if (options.packVideo
+				&& PipeVideo::layout(frame->av_props.vidProps, layout)
+				&& layout.size == frame->vec_video_data.size()
+				&& layout.packedSize < layout.size)
+			{
+				frameRecord.flags |= FRAME_PACKED_VIDEO;
+				frameRecord.layout = &layout;
+			}
+
+			return record(buf, ch, channelId, DataType::FRAME, frameRecord);
+		}
+		if (const auto buffer = dynamic_cast<const MF_BUFFER *>(&object))
+			return record(buf, ch, channelId, DataType::BUFFER, BufferRecord { *buffer, options.compressed });
+	}
+
+	::serializeTo(buf, ch, &object);
+}
+
+void PipeWire::serializeTo(std::vector<uint8_t> &buf, uint8_t version, const std::string &ch, const MF_BASE_TYPE &object)
+{
+	serializeTo(buf, version, ch, object, Options());
+}
+
+void PipeWire::serializeTo(std::vector<uint8_t> &buf, uint8_t version, const std::string &ch, const Message &message,
+						   ChannelId channelId)
+{
+	if (version >= VERSION_2)
+		return record(buf, ch, channelId, DataType::MESSAGE, message);
+
+	::serializeTo(buf, ch, &message);
+}
+
+void PipeWire::serializeTo(std::vector<uint8_t> &buf, uint8_t version, const std::string &ch, const Credit &credit,
+						   ChannelId channelId)
+{
+	if (version >= VERSION_2)
+		return record(buf, ch, channelId, DataType::CREDIT, credit);
+
+	::serializeTo(buf, ch, &credit);
+}
+
+void PipeWire::serializeTo(std::vector<uint8_t> &buf, uint8_t version, const std::string &ch, const Timestamp &timestamp,
+						   ChannelId channelId)
+{
+	if (version >= VERSION_2)
+		return record(buf, ch, channelId, DataType::TIMESTAMP, timestamp);
+
+	::serializeTo(buf, ch, &timestamp);
+}
+
+void PipeWire::serializeChannelId(std::vector<uint8_t> &buf, const std::string &ch, ChannelId channelId)
+{
+	record(buf, ch, NO_CHANNEL_ID, DataType::CHANNEL_ID, channelId);
+}
+
+bool PipeWire::deserialize(const std::vector<uint8_t> &raw, uint8_t version, MF_BASE_TYPE &object, FrameProps *props)
+{
+	if (version < VERSION_2)
+		return object.deserializeInPlace(raw);
+
+	Source source(raw);
+	if (const auto frame = dynamic_cast<MF_FRAME *>(&object))
+		return decode(source, *frame, props);
+	if (const auto buffer = dynamic_cast<MF_BUFFER *>(&object))
+		return decode(source, *buffer);
+
+	return false;
+}
+
+bool PipeWire::deserialize(const std::vector<uint8_t> &raw, uint8_t version, Message &message)
+{
+	if (version < VERSION_2)
+	{
+		message = Message().deserialize(raw);
+		return true;
+	}
+
+	Source source(raw);
+	size_t size;
+	auto data = source.bytes(size);
+	message.name.assign(reinterpret_cast<const char *>(data), size);
+	data = source.bytes(size);
+	message.param.assign(reinterpret_cast<const char *>(data), size);
+
+	return source.isOk();
+}
+
+bool PipeWire::deserialize(const std::vector<uint8_t> &raw, uint8_t version, Credit &credit)
+{
+	if (version < VERSION_2)
+	{
+		credit = Credit().deserialize(raw);
+		return true;
+	}
+
+	Source source(raw);
+	credit.slots = source.varint();
+	return source.isOk();
+}
+
+bool PipeWire::deserialize(const std::vector<uint8_t> &raw, uint8_t version, Timestamp &timestamp)
+{
+	if (version < VERSION_2)
+	{
+		timestamp = Timestamp().deserialize(raw);
+		return true;
+	}
+
+	Source source(raw);
+	timestamp.timeNs = source.signedVarint();
+	return source.isOk();
+}
@@ -0,0 +1,106 @@
+#ifndef PIPEWIRE_HPP
+#define PIPEWIRE_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "../MFTypes.h"
+#include "PipeVideo.hpp"
+
+/**
+ * @brief Versioned wire format of pipe records.
+ *        v1: DATA_SYNC, size_t channel length, channel, type and host-layout payload (serialize() of MFTypes.h).
+ *        v2: DATA_SYNC_V2, channel, type, varint payload length and payload of varints (zigzag for signed)
+ *            and fixed little-endian fields, independent of host layout. Channel is varint (length << 1)
+ *            followed by the name, or varint (id << 1) | 1 referring to a CHANNEL_ID record sent before.
+ *        v2 frame starts with flags telling which props follow, the rest are those of the previous frame,
+ *        and whether video is packed to visible pixels (see PipeVideo) or compressed (see PipeLz).
+ *        Frames of delta channels are either references, whose video both ends keep, or deltas carrying
+ *        only tiles changed since (see PipeVideo::Tiles). Both are numbered, so a lost one stops deltas
+ *        until the next reference.
+ *        Buffer starts with flags telling whether its data is compressed.
+ *        Reader parses both. Writer starts with v1 and switches to v2 once reader announces it with Hello.
+ */
+class PipeWire
+{
+public:
+	static constexpr uint8_t VERSION_1 = 1;
+	static constexpr uint8_t VERSION_2 = 2;
+	static constexpr uint8_t VERSION_MAX = VERSION_2;
+
+	/**
+	 * @brief Props of the last frame of a channel on one connection. v2 frames omit props equal to them.
+	 */
+	struct FrameProps
+	{
+		bool isKnown = false;
+		// Writer side: when props were last sent in full.
+		int64_t refreshTime = 0;
+		M_AV_PROPS avProps = {};
+		std::string userProps;
+		// Video of the last frame of a delta channel, empty when the next one has to be a reference.
+		std::vector<uint8_t> video;
+		uint64_t videoSequence = 0;
+		// Writer side: tiles of the frame being sent that differ from video.
+		std::vector<uint32_t> changedTiles;
+	};
+
+	/**
+	 * @brief PipeLz block of frame video or buffer data, sent instead of it.
+	 */
+	struct Compressed
+	{
+		const uint8_t *data = nullptr;
+		size_t size = 0;
+		size_t rawSize = 0;
+	};
+
+	/**
+	 * @brief How an object goes on v2 wire, v1 ignores all of it.
+	 */
+	struct Options
+	{
+		// Refers to channel by ID announced with serializeChannelId unless NO_CHANNEL_ID.
+		ChannelId channelId = NO_CHANNEL_ID;
+		// Frame props left out when equal to these, which are updated.
+		FrameProps *props = nullptr;
+		// Row padding of known formats left out of frame video, reader restores it zeroed.
+		bool packVideo = false;
+		const Compressed *compressed = nullptr;
+		// Video goes as tiles changed since the previous frame kept in props, or as a new reference.
+		bool deltaVideo = false;
+	};
+
+	/**
+	 * @brief Appends record to buf. Objects other than MF_FRAME and MF_BUFFER always go as v1.
+	 *        v2 record refers to channel by channelId unless it is NO_CHANNEL_ID, v1 always by name.
+	 */
+	static void serializeTo(std::vector<uint8_t> &buf, uint8_t version, const std::string &ch, const MF_BASE_TYPE &object,
+							const Options &options);
+	static void serializeTo(std::vector<uint8_t> &buf, uint8_t version, const std::string &ch, const MF_BASE_TYPE &object);
+	static void serializeTo(std::vector<uint8_t> &buf, uint8_t version, const std::string &ch, const Message &message,
+							ChannelId channelId = NO_CHANNEL_ID);
+	static void serializeTo(std::vector<uint8_t> &buf, uint8_t version, const std::string &ch, const Credit &credit,
+							ChannelId channelId = NO_CHANNEL_ID);
+	static void serializeTo(std::vector<uint8_t> &buf, uint8_t version, const std::string &ch, const Timestamp &timestamp,
+							ChannelId channelId = NO_CHANNEL_ID);
+
+	/**
+	 * @brief Appends v2 dictionary record binding channelId to the channel name for the rest of the connection.
+	 */
+	static void serializeChannelId(std::vector<uint8_t> &buf, const std::string &ch, ChannelId channelId);
+
+	/**
+	 * @brief Decodes payload collected by PipeParser of given version.
+	 *        Omitted frame props are taken from props, which is updated with the decoded ones.
+	 * @return false if payload is malformed or refers to props not known yet.
+	 */
+	static bool deserialize(const std::vector<uint8_t> &raw, uint8_t version, MF_BASE_TYPE &object,
+							FrameProps *props = nullptr);
+	static bool deserialize(const std::vector<uint8_t> &raw, uint8_t version, Message &message);
+	static bool deserialize(const std::vector<uint8_t> &raw, uint8_t version, Credit &credit);
+	static bool deserialize(const std::vector<uint8_t> &raw, uint8_t version, Timestamp &timestamp);
+};
+
+#endif // PIPEWIRE_HPP
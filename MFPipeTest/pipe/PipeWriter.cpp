@@ -1,13 +1,74 @@
 #include "PipeWriter.hpp"
 
+#include <algorithm>
+#include <set>
+
 #include "fcntl.h"
 #include "unistd.h"
 
+#include "PipeAlloc.hpp"
+#include "PipeCompressor.hpp"
+#include "PipeHints.hpp"
+#include "PipeTrace.hpp"
+
+// Dictionary records and full frame props are repeated, so reader that missed them (lost datagram, late start) recovers.
+static constexpr int64_t REFRESH_INTERVAL_NS = 1000 * 1000 * 1000;
+// Derived pacing sends a frame in 2/3 of its interval, the rest is left for other traffic.
+static constexpr double PACING_HEADROOM = 1.5;
+// Close waits for the queue to drain while objects keep leaving it, writer out of credit may never send them.
+static constexpr auto DRAIN_TIMEOUT = std::chrono::milliseconds(1000);
+
+/**
+ * @brief Finds first entry of the highest priority class.
+ */
+template <typename Queue>
+static typename Queue::iterator mostUrgent(DataBuffer &dataBuffer,
+										   Queue &queue,
+										   eMFPriority defaultPriority,
+										   eMFPriority &priority)
+{
+	auto res = queue.begin();
+	if (res == queue.end() || !dataBuffer.hasPriorities)
+	{
+		priority = defaultPriority;
+		return res;
+	}
+
+	priority = channelPriority(dataBuffer, res->first, defaultPriority);
+	for (auto it = res + 1; it != queue.end() && priority != eMFPR_High; ++it)
+	{
+		const auto itPriority = channelPriority(dataBuffer, it->first, defaultPriority);
+		if (itPriority > priority)
+		{
+			priority = itPriority;
+			res = it;
+		}
+	}
+
+	return res;
+}
+
 PipeWriter::PipeWriter(std::shared_ptr<IoInterface> io,
-                       std::shared_ptr<DataBuffer> dataBuffer)
+                       std::shared_ptr<DataBuffer> dataBuffer,
+                       std::shared_ptr<PipeWaiters> waiters,
+                       std::shared_ptr<PipeLatency> latency)
 	: isRunning(false),
 	  io(io),
-	  dataBuffer(dataBuffer)
+	  dataBuffer(dataBuffer),
+	  waiters(waiters),
+	  latency(latency),
+	  sendTimestamps(false),
+	  wireVersion(PipeWire::VERSION_1),
+	  negotiateWire(false),
+	  isWireNegotiated(false),
+	  packVideo(false),
+	  derivePacing(false),
+	  pacingRate(0),
+	  creditPolicy(CreditPolicy::NONE),
+	  isCreditKnown(false),
+	  credit(0),
+	  droppedObjects(0),
+	  connection(0)
 {}
 
 PipeWriter::~PipeWriter()
@@ -18,31 +79,96 @@ PipeWriter::~PipeWriter()
 
 void PipeWriter::start()
 {
+	connection = io->getConnection();
 	isRunning = true;
 	thread.reset(new std::thread(&PipeWriter::run, this, dataBuffer));
 }
 
 void PipeWriter::stop()
 {
+	size_t lastSize = SIZE_MAX;
+	auto lastProgress = std::chrono::steady_clock::now();
 	while (true)
 	{
-		if (dataBuffer->mutex.try_lock())
 		{
-			if (dataBuffer->data.empty() && dataBuffer->messages.empty())
+			std::lock_guard<std::timed_mutex> lock(dataBuffer->mutex);
+			const auto size = dataBuffer->data.size() + dataBuffer->messages.size();
+			if (size == 0)
+				break;
+
+			const auto now = std::chrono::steady_clock::now();
+			if (size != lastSize)
+			{
+				lastSize = size;
+				lastProgress = now;
+			}
+			else if (now - lastProgress >= DRAIN_TIMEOUT)
+			{
+				// Nothing has left the queue for a while (no credit, dead peer), the rest is dropped.
+				droppedObjects += dataBuffer->data.size();
+				dataBuffer->data.clear();
+				dataBuffer->messages.clear();
 				break;
+			}
 		}
-		dataBuffer->mutex.unlock();
 		std::this_thread::yield();
 	}
+	if (waiters)
+		waiters->notify();
+
 	isRunning = false;
 	if (thread->joinable())
 		thread->join();
 }
 
+void PipeWriter::setCreditPolicy(CreditPolicy policy)
+{
+	creditPolicy = policy;
+}
+
+size_t PipeWriter::getDroppedObjects() const
+{
+	return droppedObjects;
+}
+
+void PipeWriter::setTimestamps(bool enabled)
+{
+	sendTimestamps = enabled;
+}
+
+void PipeWriter::setWireVersion(uint8_t version, bool negotiate)
+{
+	wireVersion = negotiate ? PipeWire::VERSION_1 : version;
+	negotiateWire = negotiate;
+	isWireNegotiated = negotiate;
+}
+
+void PipeWriter::setPackVideo(bool enabled)
+{
+	packVideo = enabled;
+}
+
+void PipeWriter::setDeltaVideo(const std::string &channels)
+{
+	deltaChannels = hintChannels(channels);
+}
+
+bool PipeWriter::setPacing(uint64_t bytesPerSecond, bool derive)
+{
+	if (!io->setPacing(bytesPerSecond))
+		return false;
+
+	derivePacing = derive;
+	pacingRate = bytesPerSecond;
+	return true;
+}
+
 void PipeWriter::run(std::shared_ptr<DataBuffer> dataBuffer)
 {
 	while (isRunning)
 	{
+		readFeedback();
+
 		if (!dataBuffer->mutex.try_lock())
 		{
 			std::this_thread::yield();
@@ -56,42 +182,314 @@ void PipeWriter::run(std::shared_ptr<DataBuffer> dataBuffer)
 			continue;
 		}
 
-		if (!dataBuffer->data.empty())
+		// Most urgent entry goes first, messages win ties so control events never wait behind queued media.
+		eMFPriority dataPriority;
+		eMFPriority messagePriority;
+		auto dataIt = mostUrgent(*dataBuffer, dataBuffer->data, eMFPR_Normal, dataPriority);
+		auto messageIt = mostUrgent(*dataBuffer, dataBuffer->messages, eMFPR_High, messagePriority);
+
+		bool sendMessage = messageIt != dataBuffer->messages.end()
+				&& (dataIt == dataBuffer->data.end() || messagePriority >= dataPriority);
+
+		// Out of credit: apply policy at the source instead of sending what reader would not accept.
+		if (!sendMessage && !hasCredit())
 		{
-			size_t bytesWritten = 0;
-			const auto dataPair = dataBuffer->data.front();
-			dataBuffer->data.pop_front();
+			if (creditPolicy == CreditPolicy::DROP)
+			{
+				dataBuffer->data.erase(dataIt);
+				droppedObjects++;
+				dataBuffer->mutex.unlock();
+				if (waiters)
+					waiters->notify();
+				continue;
+			}
 
-			const auto data = serialize(dataPair.first, dataPair.second);
+			if (creditPolicy == CreditPolicy::CONFLATE)
+				conflate();
 
-			do
+			if (messageIt == dataBuffer->messages.end())
 			{
-				auto bytes = io->write(data.data() + bytesWritten, data.size() - bytesWritten);
-				if (bytes != -1)
-					bytesWritten += bytes;
-			} while (bytesWritten < data.size());
+				dataBuffer->mutex.unlock();
+				if (waiters && creditPolicy == CreditPolicy::CONFLATE)
+					waiters->notify();
+				std::this_thread::yield();
+				continue;
+			}
 
-			dataBuffer->mutex.unlock();
-			continue;
+			sendMessage = true;
 		}
 
-		if (!dataBuffer->messages.empty())
+		// Queue is unlocked while writing, so puts of urgent entries are not blocked by a large object.
+		// Record cut by a new connection is serialized again against the restarted wire state.
+		if (sendMessage)
+		{
+			const auto dataPair = std::move(*messageIt);
+			const auto &channel = dataBuffer->channelName(dataPair.first);
+			dataBuffer->messages.erase(messageIt);
+			dataBuffer->mutex.unlock();
+
+			if (waiters)
+				waiters->notify();
+
+			do
+				serializeMessage(dataPair.first, channel, *dataPair.second);
+			while (!writeAll(writeBuffer));
+		}
+		else
 		{
-			size_t bytesWritten = 0;
-			const auto dataPair = dataBuffer->messages.front();
-			dataBuffer->messages.pop_front();
+			const auto dataPair = std::move(*dataIt);
+			const auto &channel = dataBuffer->channelName(dataPair.first);
+			dataBuffer->data.erase(dataIt);
+			dataBuffer->mutex.unlock();
+
+			if (waiters)
+				waiters->notify();
+
+			if (isCreditKnown && credit > 0)
+				credit--;
 
-			const auto data = serialize(dataPair.first, dataPair.second);
+			PIPE_TRACE(WRITER_DEQUEUE, dataPair.traceId);
+
+			if (latency)
+				latency->record(PipeLatency::Kind::WRITE_QUEUE, channel, PipeLatency::now() - dataPair.queueTime);
 
 			do
+				serializeObject(dataPair, channel);
+			while (!writeAll(writeBuffer));
+
+			PIPE_TRACE(WRITE_COMPLETE, dataPair.traceId);
+		}
+	}
+}
+
+void PipeWriter::serializeMessage(ChannelId channel, const std::string &name, const Message &message)
+{
+	PIPE_ALLOC_SCOPE(SERIALIZE);
+
+	// Buffer keeps its capacity between records, so steady traffic is serialized without allocations.
+	writeBuffer.clear();
+	const auto channelId = wireChannel(channel, name);
+	PipeWire::serializeTo(writeBuffer, wireVersion, name, message, channelId);
+}
+
+void PipeWriter::serializeObject(const DataEntry &entry, const std::string &name)
+{
+	PIPE_ALLOC_SCOPE(SERIALIZE);
+
+	writeBuffer.clear();
+	const auto channelId = wireChannel(entry.first, name);
+	if (sendTimestamps)
+	{
+		Timestamp timestamp;
+		timestamp.timeNs = entry.putTime;
+		PipeWire::serializeTo(writeBuffer, wireVersion, "", timestamp);
+	}
+
+	PipeWire::Options options;
+	options.channelId = channelId;
+	options.props = frameProps(entry.first);
+	options.packVideo = packVideo;
+	options.deltaVideo = isHintChannel(deltaChannels, name);
+
+	// Compression started at put time, usually done by now. Poorly compressed data goes as is.
+	PipeWire::Compressed compressed;
+	if (entry.compressJob)
+	{
+		entry.compressJob->wait();
+		if (!entry.compressJob->data.empty())
+		{
+			compressed.data = entry.compressJob->data.data();
+			compressed.size = entry.compressJob->data.size();
+			compressed.rawSize = entry.compressJob->rawSize;
+			options.compressed = &compressed;
+		}
+	}
+
+	PipeWire::serializeTo(writeBuffer, wireVersion, name, *entry.second, options);
+
+	if (derivePacing)
+		updatePacing(entry.first, *entry.second, writeBuffer.size());
+}
+
+void PipeWriter::readFeedback()
+{
+	if (creditPolicy == CreditPolicy::NONE && !negotiateWire)
+		return;
+
+	uint8_t buffer[4 * 1024];
+	ssize_t readBytes = 0;
+
+	while ((readBytes = io->readFeedback(buffer, sizeof(buffer))) > 0)
+	{
+		size_t parsedBytes = 0;
+		while (parsedBytes < static_cast<size_t>(readBytes))
+		{
+			parsedBytes += feedbackParser.parse(buffer + parsedBytes, readBytes - parsedBytes);
+
+			if (feedbackParser.getState() == PipeParser::State::CREDIT_READY)
+			{
+				// Each record carries reader's current free slots and replaces the window. Reader queue is bounded
+				// by object count across all channels, so the window is one per pipe rather than per channel.
+				Credit record;
+				if (PipeWire::deserialize(feedbackParser.getData(), feedbackParser.getVersion(), record))
+				{
+					credit = record.slots;
+					isCreditKnown = true;
+				}
+				feedbackParser.reset();
+			}
+			else if (feedbackParser.getState() == PipeParser::State::HELLO_READY)
+			{
+				// Records are switched between objects, reader parses either version.
+				if (negotiateWire)
+				{
+					const auto version = Hello().deserialize(feedbackParser.getData()).version;
+					wireVersion = std::clamp(version, PipeWire::VERSION_1, PipeWire::VERSION_MAX);
+					negotiateWire = false;
+				}
+				feedbackParser.reset();
+			}
+			else if (feedbackParser.getState() == PipeParser::State::FRAME_READY
+					 || feedbackParser.getState() == PipeParser::State::BUFFER_READY
+					 || feedbackParser.getState() == PipeParser::State::MESSAGE_READY
+					 || feedbackParser.getState() == PipeParser::State::TIMESTAMP_READY)
 			{
-				auto bytes = io->write(data.data() + bytesWritten, data.size() - bytesWritten);
-				if (bytes != -1)
-					bytesWritten += bytes;
-			} while (bytesWritten < data.size());
+				feedbackParser.reset();
+			}
+		}
+	}
+}
 
-			dataBuffer->mutex.unlock();
-			continue;
+bool PipeWriter::hasCredit() const
+{
+	return creditPolicy == CreditPolicy::NONE || !isCreditKnown || credit > 0;
+}
+
+void PipeWriter::conflate()
+{
+	// Keep the newest object of each channel, walking from the back.
+	std::set<ChannelId> seen;
+	auto &data = dataBuffer->data;
+
+	for (auto it = data.end(); it != data.begin();)
+	{
+		--it;
+		if (!seen.insert(it->first).second)
+		{
+			it = data.erase(it);
+			droppedObjects++;
+		}
+	}
+}
+
+/**
+ * @brief Wire ID of the channel for v2 records, preceded by its dictionary record when reader may not know it.
+ *        NO_CHANNEL_ID sends the name instead.
+ */
+ChannelId PipeWriter::wireChannel(ChannelId channel, const std::string &name)
+{
+	if (wireVersion < PipeWire::VERSION_2 || channel >= MAX_WIRE_CHANNEL_IDS)
+		return NO_CHANNEL_ID;
+
+	if (channel >= announceTimes.size())
+		announceTimes.resize(channel + 1, 0);
+
+	const auto now = PipeLatency::now();
+	if (announceTimes[channel] == 0 || now - announceTimes[channel] >= REFRESH_INTERVAL_NS)
+	{
+		PipeWire::serializeChannelId(writeBuffer, name, channel);
+		announceTimes[channel] = now;
+	}
+
+	return channel;
+}
+
+/**
+ * @brief Props of the previous frame of the channel for v2 delta, nullptr for v1.
+ */
+PipeWire::FrameProps *PipeWriter::frameProps(ChannelId channel)
+{
+	if (wireVersion < PipeWire::VERSION_2)
+		return nullptr;
+
+	if (channel >= channelProps.size())
+		channelProps.resize(channel + 1);
+
+	// Forgotten props and reference video go in full with the next frame.
+	auto &props = channelProps[channel];
+	const auto now = PipeLatency::now();
+	if (!props.isKnown || now - props.refreshTime >= REFRESH_INTERVAL_NS)
+	{
+		props.isKnown = false;
+		props.video.clear();
+		props.refreshTime = now;
+	}
+
+	return &props;
+}
+
+/**
+ * @brief Derives pacing rate from the written frame: bytes of the last frame of each channel
+ *        times its frame rate, summed over channels. Small changes keep the rate as it is.
+ */
+void PipeWriter::updatePacing(ChannelId channel, const MF_BASE_TYPE &object, size_t bytes)
+{
+	const auto frame = dynamic_cast<const MF_FRAME *>(&object);
+	if (frame == nullptr || frame->av_props.vidProps.dblRate <= 0)
+		return;
+
+	if (channel >= channelRates.size())
+		channelRates.resize(channel + 1, 0);
+	channelRates[channel] = static_cast<uint64_t>(bytes * frame->av_props.vidProps.dblRate * PACING_HEADROOM);
+
+	uint64_t rate = 0;
+	for (const auto channelRate : channelRates)
+		rate += channelRate;
+
+	if (rate > pacingRate + pacingRate / 10 || rate < pacingRate - pacingRate / 10)
+	{
+		pacingRate = rate;
+		io->setPacing(rate);
+	}
+}
+
+/**
+ * @brief Writes the record whole.
+ * @return false if io connected again meanwhile, the record must be serialized again for the new stream.
+ */
+bool PipeWriter::writeAll(const std::vector<uint8_t> &data)
+{
+	size_t bytesWritten = 0;
+	do
+	{
+		auto bytes = io->write(data.data() + bytesWritten, data.size() - bytesWritten);
+		if (io->getConnection() != connection)
+		{
+			restartStream();
+			return false;
 		}
+		if (bytes != -1)
+			bytesWritten += bytes;
+	} while (bytesWritten < data.size());
+
+	return true;
+}
+
+/**
+ * @brief Forgets what the reader of the previous connection knew: channel IDs, frame props and delta reference,
+ *        its credit and wire version.
+ */
+void PipeWriter::restartStream()
+{
+	connection = io->getConnection();
+	announceTimes.clear();
+	channelProps.clear();
+	isCreditKnown = false;
+	credit = 0;
+	feedbackParser.reset();
+	if (isWireNegotiated)
+	{
+		wireVersion = PipeWire::VERSION_1;
+		negotiateWire = true;
 	}
 }
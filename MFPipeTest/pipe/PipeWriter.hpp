@@ -1,6 +1,7 @@
 #ifndef PIPEWRITER_HPP
 #define PIPEWRITER_HPP
 
+#include <atomic>
 #include <deque>
 #include <memory>
 #include <mutex>
@@ -8,12 +9,30 @@
 
 #include "IoInterface.hpp"
 #include "MFTypes.h"
+#include "pipe/PipeLatency.hpp"
+#include "pipe/PipeParser.hpp"
+#include "pipe/PipeWire.hpp"
+#include "pipe/PipeWaiters.hpp"
 
 class PipeWriter
 {
 public:
+	/**
+	 * @brief What writer does with objects when reader has advertised no free slots.
+	 *        Until the first credit record arrives writer sends freely.
+	 */
+	enum class CreditPolicy
+	{
+		NONE = 0x00, // Credits are ignored.
+		BLOCK,       // Objects wait in the write queue.
+		DROP,        // Objects are discarded.
+		CONFLATE,    // Only the latest object of each channel is kept.
+	};
+
 	PipeWriter(std::shared_ptr<IoInterface> io,
-			   std::shared_ptr<DataBuffer> dataBuffer);
+			   std::shared_ptr<DataBuffer> dataBuffer,
+			   std::shared_ptr<PipeWaiters> waiters = nullptr,
+			   std::shared_ptr<PipeLatency> latency = nullptr);
 
 	~PipeWriter();
 
@@ -21,11 +40,79 @@ public:
 	void stop();
 	void run(std::shared_ptr<DataBuffer> dataBuffer);
 
+	void setCreditPolicy(CreditPolicy policy);
+	size_t getDroppedObjects() const;
+
+	/**
+	 * @brief Sends put time before every object, so reader can measure end-to-end latency.
+	 */
+	void setTimestamps(bool enabled);
+
+	/**
+	 * @brief Sets wire format version. With negotiate writer starts with v1
+	 *        and switches to the version reader announces over feedback path.
+	 */
+	void setWireVersion(uint8_t version, bool negotiate);
+
+	/**
+	 * @brief Leaves row padding out of v2 frames of known formats, reader restores strides with zeroed padding.
+	 */
+	void setPackVideo(bool enabled);
+
+	/**
+	 * @brief Sends v2 frames of the channels as changed tiles of video against the previous frame,
+	 *        with the full video once per props refresh. Channels are given as in hintChannels().
+	 */
+	void setDeltaVideo(const std::string &channels);
+
+	/**
+	 * @brief Spreads writes at bytesPerSecond, 0 turns pacing off. With derive the rate follows written frames,
+	 *        the last frame of each channel is sent within 2/3 of its interval by dblRate.
+	 * @return false if transport can't pace writes.
+	 */
+	bool setPacing(uint64_t bytesPerSecond, bool derive);
+
 private:
+	void readFeedback();
+	bool hasCredit() const;
+	void conflate();
+	void serializeMessage(ChannelId channel, const std::string &name, const Message &message);
+	void serializeObject(const DataEntry &entry, const std::string &name);
+	bool writeAll(const std::vector<uint8_t> &data);
+	void restartStream();
+	ChannelId wireChannel(ChannelId channel, const std::string &name);
+	PipeWire::FrameProps *frameProps(ChannelId channel);
+	void updatePacing(ChannelId channel, const MF_BASE_TYPE &object, size_t bytes);
+
 	volatile bool isRunning;
 	std::shared_ptr<IoInterface> io;
 	std::shared_ptr<DataBuffer> dataBuffer;
+	std::shared_ptr<PipeWaiters> waiters;
+	std::shared_ptr<PipeLatency> latency;
 	std::unique_ptr<std::thread> thread;
+	bool sendTimestamps;
+	std::vector<uint8_t> writeBuffer;
+	uint8_t wireVersion;
+	bool negotiateWire;
+	// Wire version is negotiated again on every connection.
+	bool isWireNegotiated;
+	bool packVideo;
+	std::vector<std::string> deltaChannels;
+	// Steady clock ns of the last dictionary record of each channel, 0 if never sent.
+	std::vector<int64_t> announceTimes;
+	std::vector<PipeWire::FrameProps> channelProps;
+	bool derivePacing;
+	uint64_t pacingRate;
+	// Derived pacing rate of each channel, bytes per second.
+	std::vector<uint64_t> channelRates;
+
+	CreditPolicy creditPolicy;
+	bool isCreditKnown;
+	uint64_t credit;
+	std::atomic<size_t> droppedObjects;
+	PipeParser feedbackParser;
+	// Connection of io the wire state above belongs to.
+	uint32_t connection;
 };
 
 #endif // PIPEWRITER_HPP
@@ -4,12 +4,14 @@
 #include <iostream>
 #include <thread>
 #include "fcntl.h"
+#include "signal.h"
 #include <string.h>
 #include "sys/stat.h"
 #include "unistd.h"
 
 IoPipe::IoPipe()
-	: fd(-1)
+	: fd(-1),
+	  feedbackFd(-1)
 {}
 
 IoPipe::~IoPipe()
@@ -28,6 +30,11 @@ bool IoPipe::create(const std::string &pipeId)
 	if (res != 0 && errno != EEXIST)
 		return false;
 
+	// Companion FIFO carries feedback records from reader to writer.
+	res = mkfifo(feedbackId(pipeId).c_str(), 0777);
+	if (res != 0 && errno != EEXIST)
+		std::cerr << "Failed to create feedback pipe. ERRNO: " << errno << std::endl;
+
 	return true;
 }
 
@@ -47,7 +54,12 @@ bool IoPipe::open(const std::string &pipeId, Mode mode, int32_t timeoutMs /* = 1
 			fd = ::open(pipeId.c_str(), O_WRONLY | O_NONBLOCK);
 
 		if (fd != -1)
+		{
+			this->pipeId = pipeId;
+			if (mode == Mode::WRITE)
+				feedbackFd = ::open(feedbackId(pipeId).c_str(), O_RDONLY | O_NONBLOCK);
 			return true;
+		}
 
 		std::this_thread::yield();
 	} while (std::chrono::steady_clock::now() < end);
@@ -57,6 +69,12 @@ bool IoPipe::open(const std::string &pipeId, Mode mode, int32_t timeoutMs /* = 1
 
 bool IoPipe::close()
 {
+	if (feedbackFd != -1)
+	{
+		::close(feedbackFd);
+		feedbackFd = -1;
+	}
+
 	if (fd == -1)
 		return true;
 
@@ -79,3 +97,48 @@ ssize_t IoPipe::write(const uint8_t *buf, size_t size)
 	return ::write(fd, buf, size);
 }
 
+bool IoPipe::hasFeedback() const
+{
+	return true;
+}
+
+ssize_t IoPipe::readFeedback(uint8_t *buf, size_t size)
+{
+	if (feedbackFd == -1)
+		return -1;
+
+	return ::read(feedbackFd, buf, size);
+}
+
+ssize_t IoPipe::writeFeedback(const uint8_t *buf, size_t size)
+{
+	// Writer end is opened lazily, it fails until writer has opened its side.
+	if (feedbackFd == -1 && !pipeId.empty())
+	{
+		feedbackFd = ::open(feedbackId(pipeId).c_str(), O_WRONLY | O_NONBLOCK);
+
+		// Writer may go away at any time, it must not kill reader with SIGPIPE.
+		sigset_t set;
+		sigemptyset(&set);
+		sigaddset(&set, SIGPIPE);
+		pthread_sigmask(SIG_BLOCK, &set, nullptr);
+	}
+
+	if (feedbackFd == -1)
+		return -1;
+
+	const auto res = ::write(feedbackFd, buf, size);
+	if (res == -1 && errno == EPIPE)
+	{
+		::close(feedbackFd);
+		feedbackFd = -1;
+	}
+
+	return res;
+}
+
+std::string IoPipe::feedbackId(const std::string &pipeId)
+{
+	return pipeId + ".fb";
+}
+
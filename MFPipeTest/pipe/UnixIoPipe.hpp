@@ -14,9 +14,16 @@ public:
 	bool close() override;
 	ssize_t read(uint8_t *buf, size_t size) override;
 	ssize_t write(const uint8_t *buf, size_t size) override;
+	ssize_t readFeedback(uint8_t *buf, size_t size) override;
+	ssize_t writeFeedback(const uint8_t *buf, size_t size) override;
+	bool hasFeedback() const override;
 
 private:
+	static std::string feedbackId(const std::string &pipeId);
+
 	int32_t fd;
+	int32_t feedbackFd;
+	std::string pipeId;
 };
 
 #endif // UNIXIOPIPE_HPP
@@ -0,0 +1,391 @@
+#include "UnixIoTcp.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <iostream>
+#include <thread>
+#include "fcntl.h"
+#include "memory.h"
+#include "netinet/tcp.h"
+#include "poll.h"
+#include "unistd.h"
+
+#if defined(MSG_ZEROCOPY) && defined(SO_ZEROCOPY) && defined(__linux__)
+#define IOTCP_ZEROCOPY
+#include "linux/errqueue.h"
+#endif
+
+static constexpr int LISTEN_BACKLOG = 4;
+// Writer without connection tries again no more often than that, each attempt waits RECONNECT_TIMEOUT_MS.
+static constexpr auto RECONNECT_INTERVAL = std::chrono::milliseconds(100);
+static constexpr int32_t RECONNECT_TIMEOUT_MS = 100;
+// Writer waits that long for the first feedback of reader, which shows that reader took the connection.
+static constexpr int ACCEPT_TIMEOUT_MS = 500;
+// Writer waits for reader to take the rest of the stream before closing.
+static constexpr int CLOSE_TIMEOUT_MS = 1000;
+// Smaller writes are copied anyway, pinning pages and waiting for completion costs more than a copy.
+static constexpr size_t ZEROCOPY_MIN_SIZE = 256 * 1024;
+static constexpr int ZEROCOPY_TIMEOUT_MS = 1000;
+
+IoTcp::IoTcp()
+	: addrLen(0),
+	  listenFd(-1),
+	  fd(-1),
+	  isWriter(false),
+	  connections(0),
+	  bufferSize(0),
+	  isZeroCopy(false),
+	  zeroCopySent(0),
+	  zeroCopyDone(0)
+{}
+
+IoTcp::~IoTcp()
+{
+	close();
+}
+
+bool IoTcp::create(const std::string &id)
+{
+	if (id.empty())
+		return false;
+
+	const std::string ip_addr = id.substr(id.find_last_of("/") + 1, id.find_last_of(":") - id.find_last_of("/") - 1);
+	const std::string port = id.substr(id.find_last_of(":") + 1);
+
+	if (ip_addr.empty() || port.empty())
+		return false;
+
+	struct addrinfo hints;
+	memset(&hints, 0x00, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_protocol = IPPROTO_TCP;
+
+	struct addrinfo *addrinfo = nullptr;
+	auto res = getaddrinfo(ip_addr.c_str(), port.c_str(), &hints, &addrinfo);
+	if (res != 0 || addrinfo == nullptr)
+	{
+		std::cerr << gai_strerror(res) << std::endl;
+		return false;
+	}
+
+	memcpy(&addr, addrinfo->ai_addr, addrinfo->ai_addrlen);
+	addrLen = addrinfo->ai_addrlen;
+	freeaddrinfo(addrinfo);
+
+	return true;
+}
+
+bool IoTcp::open(const std::string &id, Mode mode, int32_t timeoutMs)
+{
+	if (addrLen == 0 && !create(id))
+		return false;
+
+	const auto start = std::chrono::steady_clock::now();
+	const auto end = start + std::chrono::milliseconds(timeoutMs);
+
+	if (mode == Mode::READ)
+	{
+		isWriter = false;
+		do
+		{
+			listenFd = socket(addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK, IPPROTO_TCP);
+			if (listenFd == -1)
+				return false;
+
+			// Accepted connections take buffers of the listening socket.
+			const int32_t reuse = 1;
+			setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+			setOptions(listenFd);
+
+			if (bind(listenFd, reinterpret_cast<const sockaddr *>(&addr), addrLen) == 0
+				&& listen(listenFd, LISTEN_BACKLOG) == 0)
+				return true;
+
+			::close(listenFd);
+			listenFd = -1;
+			std::this_thread::yield();
+		} while (std::chrono::steady_clock::now() < end);
+	}
+	else if (mode == Mode::WRITE)
+	{
+		// Reader may not listen yet.
+		isWriter = true;
+		do
+		{
+			const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+					end - std::chrono::steady_clock::now()).count();
+			if (connectPeer(static_cast<int32_t>(std::max<int64_t>(left, 1))))
+				return true;
+
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		} while (std::chrono::steady_clock::now() < end);
+	}
+
+	return false;
+}
+
+bool IoTcp::close()
+{
+	// Writer half-closes and reads the rest of feedback, so its socket doesn't reset the stream reader hasn't read.
+	if (fd != -1 && isWriter && shutdown(fd, SHUT_WR) == 0)
+	{
+		uint8_t buffer[4 * 1024];
+		pollfd request = {fd, POLLIN, 0};
+		while (poll(&request, 1, CLOSE_TIMEOUT_MS) > 0 && recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT) > 0)
+			;
+	}
+	dropConnection();
+
+	if (listenFd != -1)
+	{
+		::close(listenFd);
+		listenFd = -1;
+	}
+
+	return true;
+}
+
+ssize_t IoTcp::read(uint8_t *buf, size_t size)
+{
+	if (fd == -1)
+	{
+		// Next writer is accepted once the previous one has gone.
+		if (listenFd == -1)
+			return -1;
+
+		const auto connection = accept(listenFd, nullptr, nullptr);
+		if (connection == -1)
+			return -1;
+
+		setOptions(connection);
+		fd = connection;
+		connections++;
+	}
+
+	const auto res = recv(fd, buf, size, MSG_DONTWAIT);
+	if (res == 0 || (res == -1 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+		dropConnection();
+
+	return res;
+}
+
+ssize_t IoTcp::write(const uint8_t *buf, size_t size)
+{
+	if (fd == -1)
+	{
+		if (!isWriter)
+			return -1;
+
+		const auto next = lastConnectTime + RECONNECT_INTERVAL;
+		if (std::chrono::steady_clock::now() < next)
+			std::this_thread::sleep_until(next);
+		if (!connectPeer(RECONNECT_TIMEOUT_MS))
+			return -1;
+
+		// Caller starts the stream over on the new connection.
+		std::cerr << "Pipe reconnected" << std::endl;
+		return 0;
+	}
+
+	int32_t flags = MSG_NOSIGNAL;
+#ifdef IOTCP_ZEROCOPY
+	if (isZeroCopy && size >= ZEROCOPY_MIN_SIZE)
+		flags |= MSG_ZEROCOPY;
+#endif
+
+	auto res = send(fd, buf, size, flags);
+	// Pinned pages are limited by optmem, the data goes as a copy then.
+	if (res == -1 && errno == ENOBUFS && flags != MSG_NOSIGNAL)
+	{
+		flags = MSG_NOSIGNAL;
+		res = send(fd, buf, size, flags);
+	}
+
+	if (res == -1)
+	{
+		if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+			dropConnection();
+		return -1;
+	}
+
+	// Caller reuses the buffer as soon as the write returns, so kernel must be done with it by then.
+	if (flags != MSG_NOSIGNAL)
+		waitZeroCopy(++zeroCopySent);
+
+	return res;
+}
+
+bool IoTcp::hasFeedback() const
+{
+	return true;
+}
+
+ssize_t IoTcp::readFeedback(uint8_t *buf, size_t size)
+{
+	if (fd == -1)
+		return -1;
+
+	const auto res = recv(fd, buf, size, MSG_DONTWAIT);
+	if (res == 0 || (res == -1 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+		dropConnection();
+
+	return res;
+}
+
+ssize_t IoTcp::writeFeedback(const uint8_t *buf, size_t size)
+{
+	if (fd == -1)
+		return -1;
+
+	const auto res = send(fd, buf, size, MSG_DONTWAIT | MSG_NOSIGNAL);
+	if (res == -1 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+		dropConnection();
+
+	return res;
+}
+
+uint32_t IoTcp::getConnection() const
+{
+	return connections;
+}
+
+bool IoTcp::setBuffers(size_t bytes)
+{
+	bufferSize = bytes;
+	return true;
+}
+
+bool IoTcp::setZeroCopy(bool isZeroCopy)
+{
+#ifdef IOTCP_ZEROCOPY
+	this->isZeroCopy = isZeroCopy;
+	return true;
+#else
+	return !isZeroCopy;
+#endif
+}
+
+/**
+ * @brief Writer: connects a new socket to reader, waiting for at most timeoutMs.
+ */
+bool IoTcp::connectPeer(int32_t timeoutMs)
+{
+	lastConnectTime = std::chrono::steady_clock::now();
+
+	const auto connection = socket(addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK, IPPROTO_TCP);
+	if (connection == -1)
+		return false;
+
+	// Buffers must be set before connecting to take part in window scaling.
+	setOptions(connection);
+
+	if (connect(connection, reinterpret_cast<const sockaddr *>(&addr), addrLen) != 0)
+	{
+		int32_t error = errno;
+		pollfd request = {connection, POLLOUT, 0};
+		socklen_t len = sizeof(error);
+		if (error != EINPROGRESS || poll(&request, 1, timeoutMs) <= 0
+			|| getsockopt(connection, SOL_SOCKET, SO_ERROR, &error, &len) != 0 || error != 0)
+		{
+			::close(connection);
+			return false;
+		}
+	}
+
+	// Listener of reader that is closing completes the connection and resets it after that,
+	// data written meanwhile would be lost. Reader that stays sends credit soon, slow one is trusted anyway.
+	uint8_t byte;
+	pollfd request = {connection, POLLIN, 0};
+	if (poll(&request, 1, ACCEPT_TIMEOUT_MS) > 0 && recv(connection, &byte, 1, MSG_PEEK) <= 0)
+	{
+		::close(connection);
+		return false;
+	}
+
+	// Writes block until there is space in the socket, feedback is read without waiting.
+	fcntl(connection, F_SETFL, fcntl(connection, F_GETFL) & ~O_NONBLOCK);
+	fd = connection;
+	connections++;
+	zeroCopySent = 0;
+	zeroCopyDone = 0;
+	return true;
+}
+
+void IoTcp::setOptions(int32_t socket)
+{
+	// Records are small and go out at once, feedback and short messages must not wait for more data.
+	const int32_t noDelay = 1;
+	setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+	// Without explicit size kernel tunes buffers itself.
+	if (bufferSize != 0)
+	{
+		const int32_t size = static_cast<int32_t>(std::min<size_t>(bufferSize, INT32_MAX));
+		if (setsockopt(socket, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size)) != 0
+			|| setsockopt(socket, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size)) != 0)
+			std::cerr << "Failed to set socket buffers" << std::endl;
+	}
+
+#ifdef IOTCP_ZEROCOPY
+	const int32_t zeroCopy = 1;
+	if (isWriter && isZeroCopy && setsockopt(socket, SOL_SOCKET, SO_ZEROCOPY, &zeroCopy, sizeof(zeroCopy)) != 0)
+	{
+		std::cerr << "Failed to set SO_ZEROCOPY, data is copied" << std::endl;
+		isZeroCopy = false;
+	}
+#endif
+}
+
+void IoTcp::dropConnection()
+{
+	if (fd == -1)
+		return;
+
+	::close(fd);
+	fd = -1;
+}
+
+/**
+ * @brief Writer: waits until kernel reports MSG_ZEROCOPY sends up to the sent one complete,
+ *        at most ZEROCOPY_TIMEOUT_MS for each report.
+ */
+void IoTcp::waitZeroCopy(uint32_t sent)
+{
+#ifdef IOTCP_ZEROCOPY
+	while (fd != -1 && static_cast<int32_t>(sent - zeroCopyDone) > 0)
+	{
+		// Error queue readiness is reported as POLLERR whatever events are asked for.
+		pollfd request = {fd, 0, 0};
+		if (poll(&request, 1, ZEROCOPY_TIMEOUT_MS) <= 0)
+		{
+			std::cerr << "Timeout on waiting for zero copy send" << std::endl;
+			return;
+		}
+
+		uint8_t control[CMSG_SPACE(sizeof(sock_extended_err))];
+		msghdr message;
+		memset(&message, 0x00, sizeof(message));
+		message.msg_control = control;
+		message.msg_controllen = sizeof(control);
+		if (recvmsg(fd, &message, MSG_ERRQUEUE) == -1)
+		{
+			if (errno == EAGAIN || errno == EINTR)
+				continue;
+			return;
+		}
+
+		for (auto cmsg = CMSG_FIRSTHDR(&message); cmsg != nullptr; cmsg = CMSG_NXTHDR(&message, cmsg))
+		{
+			if (cmsg->cmsg_level != SOL_IP || cmsg->cmsg_type != IP_RECVERR)
+				continue;
+
+			// Report covers sends ee_info to ee_data, numbered from 0 on the connection.
+			sock_extended_err error;
+			memcpy(&error, CMSG_DATA(cmsg), sizeof(error));
+			if (error.ee_errno == 0 && error.ee_origin == SO_EE_ORIGIN_ZEROCOPY)
+				zeroCopyDone = error.ee_data + 1;
+		}
+	}
+#endif
+}
@@ -0,0 +1,60 @@
+#ifndef UNIXIOTCP_HPP
+#define UNIXIOTCP_HPP
+
+#include <chrono>
+#include <cstdint>
+
+#include "arpa/inet.h"
+#include "netdb.h"
+#include "sys/socket.h"
+
+#include "IoInterface.hpp"
+
+/**
+ * @brief TCP transport. Reader listens on the address and takes one writer at a time, writer connects to it.
+ *        Feedback records go back over the same connection. Writer that lost the connection connects again,
+ *        reader accepts the next writer once the current one is gone.
+ */
+class IoTcp : public IoInterface
+{
+public:
+	IoTcp();
+	~IoTcp() override;
+
+	bool create(const std::string &id) override;
+	bool open(const std::string &id, Mode mode, int32_t timeoutMs = 1000) override;
+	bool close() override;
+	ssize_t read(uint8_t *buf, size_t size) override;
+	ssize_t write(const uint8_t *buf, size_t size) override;
+	ssize_t readFeedback(uint8_t *buf, size_t size) override;
+	ssize_t writeFeedback(const uint8_t *buf, size_t size) override;
+	bool hasFeedback() const override;
+	uint32_t getConnection() const override;
+	bool setBuffers(size_t bytes) override;
+	bool setZeroCopy(bool isZeroCopy) override;
+
+private:
+	bool connectPeer(int32_t timeoutMs);
+	void setOptions(int32_t socket);
+	void dropConnection();
+	void waitZeroCopy(uint32_t sent);
+
+	sockaddr_storage addr;
+	socklen_t addrLen;
+	// Listening socket of reader.
+	int32_t listenFd;
+	// Connection to the other end, -1 while there is none.
+	int32_t fd;
+	bool isWriter;
+	// Connections made so far, the last one is the current one.
+	uint32_t connections;
+	std::chrono::steady_clock::time_point lastConnectTime;
+
+	size_t bufferSize;
+	bool isZeroCopy;
+	// MSG_ZEROCOPY sends done and completed by kernel on the current connection.
+	uint32_t zeroCopySent;
+	uint32_t zeroCopyDone;
+};
+
+#endif // UNIXIOTCP_HPP
@@ -0,0 +1,312 @@
+#include "WinIoTcp.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <thread>
+
+static constexpr int LISTEN_BACKLOG = 4;
+// Writer without connection tries again no more often than that, each attempt waits RECONNECT_TIMEOUT_MS.
+static constexpr auto RECONNECT_INTERVAL = std::chrono::milliseconds(100);
+static constexpr int32_t RECONNECT_TIMEOUT_MS = 100;
+// Writer waits that long for the first feedback of reader, which shows that reader took the connection.
+static constexpr int32_t ACCEPT_TIMEOUT_MS = 500;
+// Writer waits for reader to take the rest of the stream before closing.
+static constexpr int32_t CLOSE_TIMEOUT_MS = 1000;
+
+IoTcp::IoTcp()
+	: isStarted(false),
+	  listenFd(INVALID_SOCKET),
+	  fd(INVALID_SOCKET),
+	  isWriter(false),
+	  connections(0),
+	  bufferSize(0)
+{}
+
+IoTcp::~IoTcp()
+{
+	close();
+}
+
+bool IoTcp::create(const std::string &id)
+{
+	if (id.empty())
+		return false;
+
+	if (!isStarted)
+	{
+		WSADATA wsaData;
+		int32_t res = WSAStartup(MAKEWORD(2, 2), &wsaData);
+		if (res != NO_ERROR)
+		{
+			std::cerr << "WSA Startup failed " << res << std::endl;
+			return false;
+		}
+		isStarted = true;
+	}
+
+	const std::string ip_addr = id.substr(id.find_last_of("/") + 1, id.find_last_of(":") - id.find_last_of("/") - 1);
+	const std::string port = id.substr(id.find_last_of(":") + 1);
+
+	if (ip_addr.empty() || port.empty())
+		return false;
+
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(std::stoi(port));
+	addr.sin_addr.s_addr = inet_addr(ip_addr.c_str());
+
+	return true;
+}
+
+bool IoTcp::open(const std::string &id, Mode mode, int32_t timeoutMs)
+{
+	if (!isStarted && !create(id))
+		return false;
+
+	const auto start = std::chrono::steady_clock::now();
+	const auto end = start + std::chrono::milliseconds(timeoutMs);
+
+	if (mode == Mode::READ)
+	{
+		isWriter = false;
+		do
+		{
+			listenFd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+			if (listenFd == INVALID_SOCKET)
+				return false;
+
+			// Accepted connections take buffers of the listening socket, accept doesn't wait for writer.
+			u_long isNonBlocking = 1;
+			ioctlsocket(listenFd, FIONBIO, &isNonBlocking);
+			setOptions(listenFd);
+
+			if (bind(listenFd, reinterpret_cast<SOCKADDR *>(&addr), sizeof(addr)) == 0
+				&& listen(listenFd, LISTEN_BACKLOG) == 0)
+				return true;
+
+			closesocket(listenFd);
+			listenFd = INVALID_SOCKET;
+			std::this_thread::yield();
+		} while (std::chrono::steady_clock::now() < end);
+	}
+	else if (mode == Mode::WRITE)
+	{
+		// Reader may not listen yet.
+		isWriter = true;
+		do
+		{
+			const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+					end - std::chrono::steady_clock::now()).count();
+			if (connectPeer(static_cast<int32_t>(std::max<int64_t>(left, 1))))
+				return true;
+
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		} while (std::chrono::steady_clock::now() < end);
+	}
+
+	return false;
+}
+
+bool IoTcp::close()
+{
+	// Writer half-closes and reads the rest of feedback, so its socket doesn't reset the stream reader hasn't read.
+	if (fd != INVALID_SOCKET && isWriter && shutdown(fd, SD_SEND) == 0)
+	{
+		char buffer[4 * 1024];
+		while (waitSocket(fd, false, CLOSE_TIMEOUT_MS) && recv(fd, buffer, sizeof(buffer), 0) > 0)
+			;
+	}
+	dropConnection();
+
+	if (listenFd != INVALID_SOCKET)
+	{
+		closesocket(listenFd);
+		listenFd = INVALID_SOCKET;
+	}
+
+	if (isStarted)
+	{
+		WSACleanup();
+		isStarted = false;
+	}
+
+	return true;
+}
+
+ssize_t IoTcp::read(uint8_t *buf, size_t size)
+{
+	if (fd == INVALID_SOCKET)
+	{
+		// Next writer is accepted once the previous one has gone.
+		if (listenFd == INVALID_SOCKET)
+			return -1;
+
+		const auto connection = accept(listenFd, nullptr, nullptr);
+		if (connection == INVALID_SOCKET)
+			return -1;
+
+		u_long isNonBlocking = 1;
+		ioctlsocket(connection, FIONBIO, &isNonBlocking);
+		setOptions(connection);
+		fd = connection;
+		connections++;
+	}
+
+	const auto res = recv(fd, reinterpret_cast<char *>(buf), static_cast<int>(size), 0);
+	if (res == 0 || (res == SOCKET_ERROR && WSAGetLastError() != WSAEWOULDBLOCK))
+		dropConnection();
+
+	return res;
+}
+
+ssize_t IoTcp::write(const uint8_t *buf, size_t size)
+{
+	if (fd == INVALID_SOCKET)
+	{
+		if (!isWriter)
+			return -1;
+
+		const auto next = lastConnectTime + RECONNECT_INTERVAL;
+		if (std::chrono::steady_clock::now() < next)
+			std::this_thread::sleep_until(next);
+		if (!connectPeer(RECONNECT_TIMEOUT_MS))
+			return -1;
+
+		// Caller starts the stream over on the new connection.
+		std::cerr << "Pipe reconnected" << std::endl;
+		return 0;
+	}
+
+	const auto res = send(fd, reinterpret_cast<const char *>(buf), static_cast<int>(size), 0);
+	if (res == SOCKET_ERROR)
+	{
+		dropConnection();
+		return -1;
+	}
+
+	return res;
+}
+
+bool IoTcp::hasFeedback() const
+{
+	return true;
+}
+
+ssize_t IoTcp::readFeedback(uint8_t *buf, size_t size)
+{
+	// Writer socket blocks, so feedback is read only when some has come.
+	if (fd == INVALID_SOCKET || !waitSocket(fd, false, 0))
+		return -1;
+
+	const auto res = recv(fd, reinterpret_cast<char *>(buf), static_cast<int>(size), 0);
+	if (res <= 0)
+		dropConnection();
+
+	return res;
+}
+
+ssize_t IoTcp::writeFeedback(const uint8_t *buf, size_t size)
+{
+	if (fd == INVALID_SOCKET)
+		return -1;
+
+	const auto res = send(fd, reinterpret_cast<const char *>(buf), static_cast<int>(size), 0);
+	if (res == SOCKET_ERROR && WSAGetLastError() != WSAEWOULDBLOCK)
+		dropConnection();
+
+	return res;
+}
+
+uint32_t IoTcp::getConnection() const
+{
+	return connections;
+}
+
+bool IoTcp::setBuffers(size_t bytes)
+{
+	bufferSize = bytes;
+	return true;
+}
+
+/**
+ * @brief Writer: connects a new socket to reader, waiting for at most timeoutMs.
+ */
+bool IoTcp::connectPeer(int32_t timeoutMs)
+{
+	lastConnectTime = std::chrono::steady_clock::now();
+
+	const auto connection = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (connection == INVALID_SOCKET)
+		return false;
+
+	// Buffers must be set before connecting to take part in window scaling.
+	setOptions(connection);
+
+	u_long isNonBlocking = 1;
+	ioctlsocket(connection, FIONBIO, &isNonBlocking);
+	if (connect(connection, reinterpret_cast<SOCKADDR *>(&addr), sizeof(addr)) != 0)
+	{
+		int32_t error = 0;
+		int32_t len = sizeof(error);
+		if (WSAGetLastError() != WSAEWOULDBLOCK || !waitSocket(connection, true, timeoutMs)
+			|| getsockopt(connection, SOL_SOCKET, SO_ERROR, reinterpret_cast<char *>(&error), &len) != 0
+			|| error != 0)
+		{
+			closesocket(connection);
+			return false;
+		}
+	}
+
+	// Listener of reader that is closing completes the connection and resets it after that,
+	// data written meanwhile would be lost. Reader that stays sends credit soon, slow one is trusted anyway.
+	char byte;
+	if (waitSocket(connection, false, ACCEPT_TIMEOUT_MS) && recv(connection, &byte, 1, MSG_PEEK) <= 0)
+	{
+		closesocket(connection);
+		return false;
+	}
+
+	// Writes block until there is space in the socket.
+	isNonBlocking = 0;
+	ioctlsocket(connection, FIONBIO, &isNonBlocking);
+	fd = connection;
+	connections++;
+	return true;
+}
+
+void IoTcp::setOptions(SOCKET socket)
+{
+	// Records are small and go out at once, feedback and short messages must not wait for more data.
+	const BOOL noDelay = TRUE;
+	setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char *>(&noDelay), sizeof(noDelay));
+
+	// Without explicit size system tunes buffers itself.
+	if (bufferSize != 0)
+	{
+		const int32_t size = static_cast<int32_t>(std::min<size_t>(bufferSize, INT32_MAX));
+		if (setsockopt(socket, SOL_SOCKET, SO_SNDBUF, reinterpret_cast<const char *>(&size), sizeof(size)) != 0
+			|| setsockopt(socket, SOL_SOCKET, SO_RCVBUF, reinterpret_cast<const char *>(&size), sizeof(size)) != 0)
+			std::cerr << "Failed to set socket buffers" << std::endl;
+	}
+}
+
+void IoTcp::dropConnection()
+{
+	if (fd == INVALID_SOCKET)
+		return;
+
+	closesocket(fd);
+	fd = INVALID_SOCKET;
+}
+
+/**
+ * @brief Waits for at most timeoutMs until socket can be read or written.
+ */
+bool IoTcp::waitSocket(SOCKET socket, bool isWrite, int32_t timeoutMs)
+{
+	fd_set set;
+	FD_ZERO(&set);
+	FD_SET(socket, &set);
+	timeval timeout = {timeoutMs / 1000, (timeoutMs % 1000) * 1000};
+
+	return select(0, isWrite ? nullptr : &set, isWrite ? &set : nullptr, nullptr, &timeout) > 0;
+}
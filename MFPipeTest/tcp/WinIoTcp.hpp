@@ -0,0 +1,52 @@
+#ifndef WINIOTCP_HPP
+#define WINIOTCP_HPP
+
+#include <chrono>
+
+#include "winsock2.h"
+#include "ws2tcpip.h"
+
+#include "IoInterface.hpp"
+
+/**
+ * @brief TCP transport. Reader listens on the address and takes one writer at a time, writer connects to it.
+ *        Feedback records go back over the same connection. Writer that lost the connection connects again,
+ *        reader accepts the next writer once the current one is gone.
+ */
+class IoTcp : public IoInterface
+{
+public:
+	IoTcp();
+	~IoTcp() override;
+
+	bool create(const std::string &id) override;
+	bool open(const std::string &id, Mode mode, int32_t timeoutMs = 1000) override;
+	bool close() override;
+	ssize_t read(uint8_t *buf, size_t size) override;
+	ssize_t write(const uint8_t *buf, size_t size) override;
+	ssize_t readFeedback(uint8_t *buf, size_t size) override;
+	ssize_t writeFeedback(const uint8_t *buf, size_t size) override;
+	bool hasFeedback() const override;
+	uint32_t getConnection() const override;
+	bool setBuffers(size_t bytes) override;
+
+private:
+	bool connectPeer(int32_t timeoutMs);
+	void setOptions(SOCKET socket);
+	void dropConnection();
+	static bool waitSocket(SOCKET socket, bool isWrite, int32_t timeoutMs);
+
+	struct sockaddr_in addr;
+	bool isStarted;
+	// Listening socket of reader.
+	SOCKET listenFd;
+	// Connection to the other end, INVALID_SOCKET while there is none.
+	SOCKET fd;
+	bool isWriter;
+	// Connections made so far, the last one is the current one.
+	uint32_t connections;
+	std::chrono::steady_clock::time_point lastConnectTime;
+	size_t bufferSize;
+};
+
+#endif // WINIOTCP_HPP
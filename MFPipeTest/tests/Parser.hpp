@@ -1,11 +1,23 @@
 #ifndef PARSER_HPP
 #define PARSER_HPP
 
+#include <algorithm>
+#include <cmath>
 #include <iomanip>
 #include <iostream>
+#include <thread>
 
 #include "../MFTypes.h"
+#include "PipeConverter.hpp"
+#include "PipeHints.hpp"
+#include "PipeJitter.hpp"
+#include "PipeLz.hpp"
 #include "PipeParser.hpp"
+#include "PipePool.hpp"
+#include "PipeScaler.hpp"
+#include "PipeWire.hpp"
+#include "UdpPacer.hpp"
+#include "UdpReliable.hpp"
 
 bool testParserFrame()
 {
@@ -208,6 +220,1003 @@ bool testParserMessage()
 	return true;
 }
 
+/**
+ * @brief Test v1 records with empty fields end where they should, the next record is parsed whole.
+ * @return true if successful, otherwise false.
+ */
+bool testParserEmptyFields()
+{
+	std::shared_ptr<MF_FRAME> frame = std::make_shared<MF_FRAME>();
+	std::shared_ptr<MF_BUFFER> emptyBuffer = std::make_shared<MF_BUFFER>();
+	emptyBuffer->flags = eMFBF_Buffer;
+	std::shared_ptr<Message> message = std::make_shared<Message>();
+	std::shared_ptr<MF_BUFFER> buffer = std::make_shared<MF_BUFFER>();
+	buffer->flags = eMFBF_Buffer;
+	buffer->data.assign(10, 7);
+
+	const std::vector<std::pair<std::vector<uint8_t>, PipeParser::State>> records = {
+		{ serialize("", frame), PipeParser::State::FRAME_READY },
+		{ serialize("", emptyBuffer), PipeParser::State::BUFFER_READY },
+		{ serialize("", message), PipeParser::State::MESSAGE_READY },
+		{ serialize("", buffer), PipeParser::State::BUFFER_READY },
+	};
+
+	std::vector<uint8_t> bytes;
+	for (const auto &record : records)
+		bytes.insert(bytes.end(), record.first.begin(), record.first.end());
+
+	// Records come in one chunk and byte by byte.
+	for (const size_t chunk : { bytes.size(), size_t(1) })
+	{
+		PipeParser parser;
+		size_t pos = 0;
+		for (size_t i = 0; i < records.size(); ++i)
+		{
+			while (parser.getState() != records[i].second && pos < bytes.size())
+			{
+				const auto parsed = parser.parse(bytes.data() + pos, std::min(chunk, bytes.size() - pos));
+				if (parsed == 0)
+					break;
+				pos += parsed;
+			}
+
+			// DATA_SYNC, data type byte and channel are not in the data.
+			const std::vector<uint8_t> expected(records[i].first.begin() + 13, records[i].first.end());
+			if (parser.getState() != records[i].second || parser.getData() != expected)
+			{
+				std::cout << "Record " << i << " with empty fields parsed wrong in chunks of " << chunk << std::endl;
+				return false;
+			}
+			parser.reset();
+		}
+	}
+
+	return true;
+}
+
+/**
+ * @brief Parses v2 record whole and byte by byte, returns payload if parser reached expected state.
+ */
+bool parseV2(const std::vector<uint8_t> &bytes, PipeParser::State expected, std::vector<uint8_t> &payload)
+{
+	PipeParser whole;
+	if (whole.parse(bytes.data(), bytes.size()) != bytes.size() || whole.getState() != expected || whole.getVersion() != 2)
+		return false;
+
+	PipeParser fragmented;
+	for (size_t i = 0; i < bytes.size(); ++i)
+		fragmented.parse(bytes.data() + i, 1);
+	if (fragmented.getState() != expected || fragmented.getData() != whole.getData())
+		return false;
+
+	payload = whole.getData();
+	return true;
+}
+
+bool testParserV2()
+{
+	MF_FRAME frame;
+	frame.time.rtStartTime = -1;
+	frame.time.rtEndTime = 400000;
+	frame.av_props.vidProps.fccType = eMFCC_I420;
+	frame.av_props.vidProps.nWidth = 1920;
+	frame.av_props.vidProps.nHeight = 1080;
+	frame.av_props.vidProps.nRowBytes = 1920;
+	frame.av_props.vidProps.dblRate = 25.0;
+	frame.av_props.audProps.nChannels = 2;
+	frame.av_props.audProps.nSamplesPerSec = 48000;
+	frame.str_user_props = "user_props";
+	for (size_t i = 0; i < 300; ++i)
+		frame.vec_video_data.push_back(static_cast<uint8_t>(i));
+	frame.vec_audio_data.assign(10, 1);
+
+	std::vector<uint8_t> bytes;
+	std::vector<uint8_t> payload;
+	PipeWire::serializeTo(bytes, PipeWire::VERSION_2, "ch", frame);
+
+	MF_FRAME frameOut;
+	if (!parseV2(bytes, PipeParser::State::FRAME_READY, payload)
+		|| !PipeWire::deserialize(payload, PipeWire::VERSION_2, frameOut)
+		|| !(frame == frameOut))
+	{
+		std::cout << "V2 frame round trip failed" << std::endl;
+		return false;
+	}
+
+	MF_BUFFER buffer;
+	buffer.flags = eMFBF_Packet;
+	buffer.data.assign(200, 7);
+
+	bytes.clear();
+	PipeWire::serializeTo(bytes, PipeWire::VERSION_2, "ch", buffer);
+
+	MF_BUFFER bufferOut;
+	if (!parseV2(bytes, PipeParser::State::BUFFER_READY, payload)
+		|| !PipeWire::deserialize(payload, PipeWire::VERSION_2, bufferOut)
+		|| !(buffer == bufferOut))
+	{
+		std::cout << "V2 buffer round trip failed" << std::endl;
+		return false;
+	}
+
+	Message message;
+	message.name = "name";
+	message.param = "param";
+
+	bytes.clear();
+	PipeWire::serializeTo(bytes, PipeWire::VERSION_2, "ch", message);
+
+	Message messageOut;
+	if (!parseV2(bytes, PipeParser::State::MESSAGE_READY, payload)
+		|| !PipeWire::deserialize(payload, PipeWire::VERSION_2, messageOut)
+		|| messageOut.name != message.name
+		|| messageOut.param != message.param)
+	{
+		std::cout << "V2 message round trip failed" << std::endl;
+		return false;
+	}
+
+	std::vector<uint8_t> bytesV1;
+	PipeWire::serializeTo(bytesV1, PipeWire::VERSION_1, "ch", message);
+	if (bytes.size() >= bytesV1.size())
+	{
+		std::cout << "V2 message takes " << bytes.size() << " bytes, v1 " << bytesV1.size() << std::endl;
+		return false;
+	}
+
+	// Truncated payload must be rejected, not read past its end.
+	payload.pop_back();
+	if (PipeWire::deserialize(payload, PipeWire::VERSION_2, messageOut))
+	{
+		std::cout << "Truncated v2 message accepted" << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+bool testParserFrameDelta()
+{
+	MF_FRAME frame;
+	frame.av_props.vidProps.fccType = eMFCC_I420;
+	frame.av_props.vidProps.nWidth = 320;
+	frame.av_props.vidProps.nHeight = 240;
+	frame.av_props.vidProps.dblRate = 60.0;
+	frame.av_props.audProps.nChannels = 2;
+	frame.av_props.audProps.nSamplesPerSec = 48000;
+	frame.str_user_props = "<props camera='main'/>";
+	frame.vec_video_data.assign(64, 1);
+
+	PipeWire::FrameProps writerProps;
+	PipeWire::FrameProps readerProps;
+	PipeWire::Options options;
+	options.props = &writerProps;
+	PipeWire::FrameProps lateReaderProps;
+	std::vector<uint8_t> payload;
+	size_t fullSize = 0;
+
+	for (auto i = 0; i < 3; ++i)
+	{
+		// Third frame changes only user props.
+		frame.time.rtStartTime = i * 100;
+		if (i == 2)
+			frame.str_user_props = "<props camera='backup'/>";
+
+		std::vector<uint8_t> bytes;
+		PipeWire::serializeTo(bytes, PipeWire::VERSION_2, "ch", frame, options);
+
+		MF_FRAME frameOut;
+		if (!parseV2(bytes, PipeParser::State::FRAME_READY, payload)
+			|| !PipeWire::deserialize(payload, PipeWire::VERSION_2, frameOut, &readerProps)
+			|| !(frame == frameOut))
+		{
+			std::cout << "Delta frame " << i << " round trip failed" << std::endl;
+			return false;
+		}
+
+		if (i == 0)
+		{
+			fullSize = bytes.size();
+		}
+		else if (bytes.size() + (i == 1 ? frame.str_user_props.size() : 0) >= fullSize)
+		{
+			std::cout << "Delta frame " << i << " takes " << bytes.size() << " bytes, full " << fullSize << std::endl;
+			return false;
+		}
+
+		// Reader that missed the full frame can't rebuild the delta ones.
+		MF_FRAME lateOut;
+		if (i > 0 && PipeWire::deserialize(payload, PipeWire::VERSION_2, lateOut, &lateReaderProps))
+		{
+			std::cout << "Delta frame " << i << " accepted without props" << std::endl;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool testParserPackedVideo()
+{
+	for (auto fcc : { eMFCC_I420, eMFCC_NV12, eMFCC_UYVY, eMFCC_RGB24 })
+	{
+		MF_FRAME frame;
+		frame.av_props.vidProps.fccType = fcc;
+		frame.av_props.vidProps.nWidth = 45;
+		frame.av_props.vidProps.nHeight = 17;
+		frame.av_props.vidProps.nRowBytes = 192;
+
+		// Visible pixels get a pattern, padding stays zero as the reader restores it.
+		PipeVideo::Layout layout;
+		if (!PipeVideo::layout(frame.av_props.vidProps, layout))
+		{
+			std::cout << "No layout of " << std::hex << fcc << std::dec << std::endl;
+			return false;
+		}
+
+		frame.vec_video_data.assign(layout.size, 0);
+		for (auto i = 0; i < layout.planes; ++i)
+		{
+			const auto &plane = layout.plane[i];
+			for (size_t y = 0; y < plane.rows; ++y)
+			{
+				for (size_t x = 0; x < plane.rowBytes; ++x)
+					frame.vec_video_data[plane.offset + y * plane.stride + x] = static_cast<uint8_t>(x + y + i);
+			}
+		}
+
+		std::vector<uint8_t> packed;
+		std::vector<uint8_t> unpacked;
+		PipeWire::Options options;
+		options.packVideo = true;
+		PipeWire::serializeTo(packed, PipeWire::VERSION_2, "ch", frame, options);
+		PipeWire::serializeTo(unpacked, PipeWire::VERSION_2, "ch", frame);
+
+		std::vector<uint8_t> payload;
+		MF_FRAME frameOut;
+		if (!parseV2(packed, PipeParser::State::FRAME_READY, payload)
+			|| !PipeWire::deserialize(payload, PipeWire::VERSION_2, frameOut)
+			|| !(frame == frameOut))
+		{
+			std::cout << "Packed video of " << std::hex << fcc << std::dec << " round trip failed" << std::endl;
+			return false;
+		}
+
+		if (unpacked.size() - packed.size() < layout.size - layout.packedSize - 4)
+		{
+			std::cout << "Packed video of " << std::hex << fcc << std::dec << " takes " << packed.size()
+					  << " bytes, unpacked " << unpacked.size() << std::endl;
+			return false;
+		}
+	}
+
+	// Stride of known props far beyond the packed rows must not make reader allocate for the padding.
+	MF_FRAME frame;
+	frame.av_props.vidProps.fccType = eMFCC_RGB24;
+	frame.av_props.vidProps.nWidth = 45;
+	frame.av_props.vidProps.nHeight = 17;
+	frame.av_props.vidProps.nRowBytes = 192;
+	frame.vec_video_data.assign(192 * 17, 1);
+
+	PipeWire::FrameProps writerProps;
+	PipeWire::FrameProps readerProps;
+	PipeWire::Options options;
+	options.packVideo = true;
+	options.props = &writerProps;
+	for (auto i = 0; i < 2; ++i)
+	{
+		std::vector<uint8_t> record;
+		std::vector<uint8_t> payload;
+		MF_FRAME frameOut;
+		PipeWire::serializeTo(record, PipeWire::VERSION_2, "ch", frame, options);
+		if (!parseV2(record, PipeParser::State::FRAME_READY, payload))
+			return false;
+
+		const bool isDecoded = PipeWire::deserialize(payload, PipeWire::VERSION_2, frameOut, &readerProps);
+		if (isDecoded != (i == 0))
+		{
+			std::cout << "Packed video with stride " << readerProps.avProps.vidProps.nRowBytes
+					  << (isDecoded ? " decoded" : " rejected") << std::endl;
+			return false;
+		}
+		readerProps.avProps.vidProps.nRowBytes = INT32_MAX;
+	}
+
+	return true;
+}
+
+bool testParserLz()
+{
+	std::vector<std::vector<uint8_t>> inputs;
+	inputs.emplace_back();
+	inputs.emplace_back(1, 7);
+	inputs.emplace_back(13, 0);
+	inputs.emplace_back(64 * 1024, 0);
+
+	std::vector<uint8_t> text;
+	const std::string line = "<tr><td class='cell'>value</td></tr>\n";
+	for (auto i = 0; i < 500; ++i)
+		text.insert(text.end(), line.begin(), line.end());
+	inputs.push_back(text);
+
+	std::vector<uint8_t> noise(10000);
+	uint32_t seed = 1;
+	for (auto &byte : noise)
+	{
+		seed = seed * 1103515245 + 12345;
+		byte = static_cast<uint8_t>(seed >> 16);
+	}
+	inputs.push_back(noise);
+
+	for (const auto &input : inputs)
+	{
+		std::vector<uint8_t> block(PipeLz::bound(input.size()));
+		block.resize(PipeLz::compress(input.data(), input.size(), block.data()));
+
+		std::vector<uint8_t> output(input.size());
+		if (!PipeLz::decompress(block.data(), block.size(), output.data(), output.size()) || output != input)
+		{
+			std::cout << "LZ round trip of " << input.size() << " bytes failed" << std::endl;
+			return false;
+		}
+
+		// Truncated block must be rejected, not read or written out of bounds.
+		if (!block.empty() && input.size() > 1
+			&& PipeLz::decompress(block.data(), block.size() - 1, output.data(), output.size()))
+		{
+			std::cout << "Truncated LZ block of " << input.size() << " bytes accepted" << std::endl;
+			return false;
+		}
+	}
+
+	std::vector<uint8_t> block(PipeLz::bound(text.size()));
+	block.resize(PipeLz::compress(text.data(), text.size(), block.data()));
+	if (block.size() * 10 > text.size())
+	{
+		std::cout << "Repetitive text compressed to " << block.size() << " of " << text.size() << " bytes" << std::endl;
+		return false;
+	}
+
+	// Compressed buffer data goes through the wire format.
+	MF_BUFFER buffer;
+	buffer.flags = eMFBF_Buffer;
+	buffer.data = text;
+
+	PipeWire::Compressed compressed;
+	compressed.data = block.data();
+	compressed.size = block.size();
+	compressed.rawSize = text.size();
+	PipeWire::Options options;
+	options.compressed = &compressed;
+
+	std::vector<uint8_t> bytes;
+	std::vector<uint8_t> payload;
+	PipeWire::serializeTo(bytes, PipeWire::VERSION_2, "ch", buffer, options);
+
+	MF_BUFFER bufferOut;
+	if (!parseV2(bytes, PipeParser::State::BUFFER_READY, payload)
+		|| !PipeWire::deserialize(payload, PipeWire::VERSION_2, bufferOut)
+		|| !(buffer == bufferOut))
+	{
+		std::cout << "Compressed buffer round trip failed" << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+bool testParserChannelId()
+{
+	const std::string name = "studio/cameras/main/program";
+
+	MF_BUFFER buffer;
+	buffer.flags = eMFBF_Packet;
+	buffer.data.assign(16, 3);
+
+	// Record of an ID not announced yet is skipped, the announced one resolves to the name.
+	PipeWire::Options options;
+	options.channelId = 7;
+	std::vector<uint8_t> bytes;
+	PipeWire::serializeTo(bytes, PipeWire::VERSION_2, name, buffer, options);
+	PipeWire::serializeChannelId(bytes, name, 7);
+	const auto announcedAt = bytes.size();
+	PipeWire::serializeTo(bytes, PipeWire::VERSION_2, name, buffer, options);
+
+	PipeParser parser;
+	size_t pos = 0;
+	while (pos < bytes.size() && parser.getState() != PipeParser::State::BUFFER_READY)
+		pos += parser.parse(bytes.data() + pos, bytes.size() - pos);
+
+	if (pos != bytes.size() || parser.getState() != PipeParser::State::BUFFER_READY)
+	{
+		std::cout << "Interned record not parsed" << std::endl;
+		return false;
+	}
+
+	if (parser.getChannelId() != 7 || parser.getChannel() != name)
+	{
+		std::cout << "Interned channel " << parser.getChannelId() << " resolved to " << parser.getChannel() << std::endl;
+		return false;
+	}
+
+	std::vector<uint8_t> literal;
+	PipeWire::serializeTo(literal, PipeWire::VERSION_2, name, buffer);
+	if (bytes.size() - announcedAt + name.size() != literal.size())
+	{
+		std::cout << "Interned record takes " << bytes.size() - announcedAt << " bytes, literal " << literal.size() << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * @brief Sample of component 0 (Y), 1 (U) or 2 (V) at pixel x, y of the luma grid, chroma of 4:2:2 video
+ *        averaged over the row pair as the converter does.
+ */
+static int videoSample(const MF_FRAME &frame, const PipeVideo::Layout &layout, int component, size_t x, size_t y)
+{
+	const auto type = frame.av_props.vidProps.fccType;
+	const auto height = static_cast<size_t>(frame.av_props.vidProps.nHeight);
+	const auto at = [&frame, &layout](int plane, size_t col, size_t row) {
+		return static_cast<int>(frame.vec_video_data[layout.plane[plane].offset + row * layout.plane[plane].stride + col]);
+	};
+
+	if (type == eMFCC_YUY2 || type == eMFCC_YVYU || type == eMFCC_UYVY)
+	{
+		const size_t offsets[3][3] = { { 0, 1, 3 }, { 0, 3, 1 }, { 1, 0, 2 } };
+		const auto &offset = offsets[type == eMFCC_YUY2 ? 0 : type == eMFCC_YVYU ? 1 : 2];
+		if (component == 0)
+			return at(0, x / 2 * 4 + (x % 2) * 2 + offset[0], y);
+
+		const size_t row = y / 2 * 2;
+		const size_t col = x / 2 * 4 + offset[component];
+		return (at(0, col, row) + at(0, col, std::min(row + 1, height - 1)) + 1) / 2;
+	}
+
+	if (component == 0)
+		return at(0, x, y);
+	if (type == eMFCC_NV12)
+		return at(1, x / 2 * 2 + component - 1, y / 2);
+	return at(type == eMFCC_YV12 ? 3 - component : component, x / 2, y / 2);
+}
+
+bool testParserConvert()
+{
+	PipeConverter converter(3);
+
+	// Odd sizes leave chroma and SIMD tails, the wide one takes several chunks and bands.
+	const int sizes[2][2] = { { 45, 17 }, { 2101, 67 } };
+
+	for (const auto &size : sizes)
+	{
+		for (auto from : { eMFCC_I420, eMFCC_YV12, eMFCC_NV12, eMFCC_YUY2, eMFCC_YVYU, eMFCC_UYVY })
+		{
+			MF_FRAME frame;
+			frame.av_props.vidProps.fccType = from;
+			frame.av_props.vidProps.nWidth = size[0];
+			frame.av_props.vidProps.nHeight = size[1];
+			frame.av_props.vidProps.nRowBytes = size[0] * 2 + 10;
+			frame.str_user_props = "props";
+			frame.vec_audio_data = { 1, 2, 3 };
+
+			PipeVideo::Layout layout;
+			PipeVideo::layout(frame.av_props.vidProps, layout);
+			frame.vec_video_data.resize(layout.size);
+			for (size_t i = 0; i < frame.vec_video_data.size(); ++i)
+				frame.vec_video_data[i] = static_cast<uint8_t>(i * 7 + i / 13);
+
+			for (auto to : { eMFCC_I420, eMFCC_YV12, eMFCC_NV12 })
+			{
+				MF_FRAME converted;
+				PipeVideo::Layout convertedLayout;
+				if (!converter.convert(frame, to, converted)
+					|| converted.av_props.vidProps.fccType != to
+					|| converted.str_user_props != frame.str_user_props
+					|| converted.vec_audio_data != frame.vec_audio_data
+					|| !PipeVideo::layout(converted.av_props.vidProps, convertedLayout)
+					|| converted.vec_video_data.size() != convertedLayout.size)
+				{
+					std::cout << "Conversion " << std::hex << from << " to " << to << std::dec << " failed" << std::endl;
+					return false;
+				}
+
+				for (size_t y = 0; y < static_cast<size_t>(size[1]); ++y)
+				{
+					for (size_t x = 0; x < static_cast<size_t>(size[0]); ++x)
+					{
+						for (auto component = 0; component < 3; ++component)
+						{
+							if (component > 0 && (x % 2 != 0 || y % 2 != 0))
+								continue;
+
+							if (videoSample(frame, layout, component, x, y)
+								!= videoSample(converted, convertedLayout, component, x, y))
+							{
+								std::cout << "Conversion " << std::hex << from << " to " << to << std::dec
+										  << " differs at " << x << "x" << y << " in component " << component << std::endl;
+								return false;
+							}
+						}
+					}
+				}
+			}
+		}
+	}
+
+	return true;
+}
+
+bool testParserScale()
+{
+	PipeScaler scaler;
+
+	// Box and bilinear filters keep a linear pattern linear, up to rounding of each step.
+	for (auto fcc : { eMFCC_I420, eMFCC_NV12, eMFCC_RGB24, eMFCC_RGB32 })
+	{
+		MF_FRAME frame;
+		frame.av_props.vidProps.fccType = fcc;
+		frame.av_props.vidProps.nWidth = 256;
+		frame.av_props.vidProps.nHeight = 128;
+		frame.av_props.vidProps.nRowBytes = fcc == eMFCC_RGB24 ? 256 * 3 : fcc == eMFCC_RGB32 ? 256 * 4 : 256;
+		frame.vec_audio_data = { 1, 2, 3 };
+
+		PipeVideo::Layout layout;
+		PipeVideo::layout(frame.av_props.vidProps, layout);
+		frame.vec_video_data.resize(layout.size);
+
+		MF_FRAME preview;
+		PipeVideo::Layout previewLayout;
+		for (auto pass = 0; pass < 2; ++pass)
+		{
+			for (auto i = 0; i < layout.planes; ++i)
+			{
+				const auto &plane = (pass == 0 ? layout : previewLayout).plane[i];
+				const size_t width = i == 0 ? (pass == 0 ? 256 : 48) : (pass == 0 ? 128 : 24);
+				const size_t bpp = plane.rowBytes / width;
+				const double scale = pass == 0 ? 1 : (i == 0 ? 256.0 / 48 : 128.0 / 24);
+				const double scaleY = pass == 0 ? 1 : (i == 0 ? 128.0 / 20 : 64.0 / 10);
+
+				for (size_t y = 0; y < plane.rows; ++y)
+				{
+					for (size_t x = 0; x < width * bpp; ++x)
+					{
+						const double value = ((x / bpp + 0.5) * scale - 0.5) / 2 + ((y + 0.5) * scaleY - 0.5);
+						if (pass == 0)
+						{
+							frame.vec_video_data[plane.offset + y * plane.stride + x] = static_cast<uint8_t>(value);
+						}
+						else if (std::abs(preview.vec_video_data[plane.offset + y * plane.stride + x] - value) > 3)
+						{
+							std::cout << "Preview of " << std::hex << fcc << std::dec << " has "
+									  << static_cast<int>(preview.vec_video_data[plane.offset + y * plane.stride + x])
+									  << " at " << x << "x" << y << " of plane " << i << ", expected " << value << std::endl;
+							return false;
+						}
+					}
+				}
+			}
+
+			if (pass == 0 && (!scaler.downscale(frame, 48, 20, preview)
+							  || preview.av_props.vidProps.nWidth != 48 || preview.av_props.vidProps.nHeight != 20
+							  || !preview.vec_audio_data.empty()
+							  || !PipeVideo::layout(preview.av_props.vidProps, previewLayout)
+							  || preview.vec_video_data.size() != previewLayout.size))
+			{
+				std::cout << "Downscale of " << std::hex << fcc << std::dec << " failed" << std::endl;
+				return false;
+			}
+		}
+	}
+
+	// 4:2:2 is scaled as I420.
+	MF_FRAME uyvy;
+	uyvy.av_props.vidProps.fccType = eMFCC_UYVY;
+	uyvy.av_props.vidProps.nWidth = 101;
+	uyvy.av_props.vidProps.nHeight = 51;
+	uyvy.av_props.vidProps.nRowBytes = 51 * 4;
+	for (auto i = 0; i < 51 * 51; ++i)
+		uyvy.vec_video_data.insert(uyvy.vec_video_data.end(), { 50, 100, 200, 100 });
+
+	MF_FRAME preview;
+	if (!scaler.downscale(uyvy, 25, 13, preview) || preview.av_props.vidProps.fccType != eMFCC_I420)
+	{
+		std::cout << "Downscale of UYVY failed" << std::endl;
+		return false;
+	}
+
+	PipeVideo::Layout layout;
+	PipeVideo::layout(preview.av_props.vidProps, layout);
+	for (auto i = 0; i < layout.planes; ++i)
+	{
+		const auto &plane = layout.plane[i];
+		for (size_t y = 0; y < plane.rows; ++y)
+		{
+			for (size_t x = 0; x < plane.rowBytes; ++x)
+			{
+				if (preview.vec_video_data[plane.offset + y * plane.stride + x] != (i == 0 ? 100 : i == 1 ? 50 : 200))
+				{
+					std::cout << "Preview of UYVY differs at " << x << "x" << y << " of plane " << i << std::endl;
+					return false;
+				}
+			}
+		}
+	}
+
+	return true;
+}
+
+bool testParserVideoDelta()
+{
+	MF_FRAME frame;
+	frame.av_props.vidProps.fccType = eMFCC_UYVY;
+	frame.av_props.vidProps.nWidth = 640;
+	frame.av_props.vidProps.nHeight = 360;
+	frame.av_props.vidProps.nRowBytes = 1280;
+	frame.vec_video_data.resize(1280 * 360);
+	for (size_t i = 0; i < frame.vec_video_data.size(); ++i)
+		frame.vec_video_data[i] = static_cast<uint8_t>(i * 7 + i / 1280);
+
+	PipeWire::FrameProps writerProps;
+	PipeWire::FrameProps readerProps;
+	PipeWire::Options options;
+	options.props = &writerProps;
+	options.deltaVideo = true;
+	std::vector<uint8_t> payload;
+
+	// Reference, then frames with a moving cursor, one of which the reader misses, then everything changes.
+	for (auto i = 0; i < 6; ++i)
+	{
+		for (size_t y = 100; y < 120; ++y)
+			std::fill_n(frame.vec_video_data.begin() + y * 1280 + 40 * i, 30, 0xF0 + i);
+		if (i == 5)
+			std::fill(frame.vec_video_data.begin(), frame.vec_video_data.end(), 0x80);
+
+		std::vector<uint8_t> bytes;
+		PipeWire::serializeTo(bytes, PipeWire::VERSION_2, "ch", frame, options);
+		if (i == 2)
+			continue;
+
+		const bool isDelta = i > 0 && i < 5;
+		if (isDelta && bytes.size() > frame.vec_video_data.size() / 16)
+		{
+			std::cout << "Video delta " << i << " takes " << bytes.size() << " bytes" << std::endl;
+			return false;
+		}
+
+		// Delta after the missed one is rejected until the next reference.
+		MF_FRAME frameOut;
+		const bool isExpected = i < 3 || i == 5;
+		const bool isOk = parseV2(bytes, PipeParser::State::FRAME_READY, payload)
+			&& PipeWire::deserialize(payload, PipeWire::VERSION_2, frameOut, &readerProps);
+		if (isOk != isExpected || (isOk && !(frame == frameOut)))
+		{
+			std::cout << "Video delta " << i << " round trip " << (isOk ? "passed" : "failed") << std::endl;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool testParserReliable()
+{
+	typedef std::vector<std::vector<uint8_t>> Datagrams;
+	Datagrams toReceiver;
+	Datagrams toSender;
+	auto collect = [](Datagrams &datagrams) {
+		return [&datagrams](const uint8_t *data, size_t size) { datagrams.emplace_back(data, data + size); };
+	};
+
+	UdpReliable sender(50, collect(toReceiver));
+	UdpReliable receiver(50, collect(toSender));
+
+	auto deliver = [&](std::vector<uint8_t> datagram, std::vector<uint8_t> &out) {
+		const auto size = receiver.receive(datagram.data(), datagram.size());
+		out.insert(out.end(), datagram.begin(), datagram.begin() + size);
+
+		uint8_t buf[16];
+		for (size_t payload; (payload = receiver.next(buf, sizeof(buf))) != 0;)
+			out.insert(out.end(), buf, buf + payload);
+	};
+
+	// Datagram 1 is lost, receiver asks for it and gets it before 2 and 3.
+	for (uint8_t i = 0; i < 4; ++i)
+		sender.send(&i, 1, 64);
+
+	std::vector<uint8_t> out;
+	for (size_t i = 0; i < toReceiver.size(); ++i)
+	{
+		if (i != 1)
+			deliver(toReceiver[i], out);
+	}
+	if (toSender.size() != 1 || out != std::vector<uint8_t>{0})
+	{
+		std::cout << "Reliable NACKs " << toSender.size() << ", received " << out.size() << std::endl;
+		return false;
+	}
+
+	toReceiver.clear();
+	sender.onFeedback(toSender[0].data(), toSender[0].size());
+	if (toReceiver.size() != 1)
+		return false;
+	deliver(toReceiver[0], out);
+	if (out != std::vector<uint8_t>{0, 1, 2, 3} || receiver.getAbandoned() != 0)
+	{
+		std::cout << "Reliable retransmission received " << out.size() << std::endl;
+		return false;
+	}
+
+	// Lost tail datagram shows in status, it is given up after the deadline.
+	toReceiver.clear();
+	toSender.clear();
+	uint8_t value = 4;
+	sender.send(&value, 1, 64);
+	sender.tick();
+	if (toReceiver.size() != 2)
+		return false;
+	deliver(toReceiver[1], out);
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(60));
+	uint8_t buf[16];
+	if (receiver.next(buf, sizeof(buf)) != 0 || toSender.size() != 1 || receiver.getAbandoned() != 1)
+	{
+		std::cout << "Reliable lost tail: NACKs " << toSender.size() << ", given up " << receiver.getAbandoned()
+				  << std::endl;
+		return false;
+	}
+
+	// Feedback gets through sender's handler as it is.
+	const uint8_t record[3] = {7, 8, 9};
+	toSender.clear();
+	receiver.sendFeedback(record, sizeof(record));
+	return toSender.size() == 1 && sender.onFeedback(toSender[0].data(), toSender[0].size()) == sizeof(record)
+		&& std::equal(record, record + sizeof(record), toSender[0].begin());
+}
+
+/**
+ * @brief Test pooled object comes back only after its last owner released it, also on another thread.
+ * @return true if successful, otherwise false.
+ */
+bool testParserPool()
+{
+	std::shared_ptr<MF_BUFFER> held;
+	{
+		PipePool<MF_BUFFER> pool(1);
+		auto first = pool.acquire();
+		auto second = pool.acquire();
+		if (first == second)
+			return false;
+
+		first->data.assign(16, 1);
+		const auto *released = first.get();
+		std::thread([object = std::move(first)]() mutable { object.reset(); }).join();
+
+		// Only one released object is kept, the other one is deleted.
+		second.reset();
+		auto reused = pool.acquire();
+		if (reused.get() != released || reused->data.size() != 16 || pool.acquire().get() == released)
+		{
+			std::cout << "Pooled object not reused" << std::endl;
+			return false;
+		}
+
+		held = std::move(reused);
+	}
+
+	// Object outlives its pool and is deleted with its last owner.
+	held->data.clear();
+	held.reset();
+	return true;
+}
+
+/**
+ * @brief Test reliable receiver takes the stream of a writer that comes after another one.
+ * @return true if successful, otherwise false.
+ */
+bool testParserReliableWriters()
+{
+	typedef std::vector<std::vector<uint8_t>> Datagrams;
+	Datagrams toReceiver;
+	Datagrams toSender;
+	auto collect = [](Datagrams &datagrams) {
+		return [&datagrams](const uint8_t *data, size_t size) { datagrams.emplace_back(data, data + size); };
+	};
+
+	UdpReliable receiver(50, collect(toSender));
+	std::vector<uint8_t> out;
+	auto deliver = [&]() {
+		for (auto &datagram : toReceiver)
+		{
+			const auto size = receiver.receive(datagram.data(), datagram.size());
+			out.insert(out.end(), datagram.begin(), datagram.begin() + size);
+
+			uint8_t buf[16];
+			for (size_t payload; (payload = receiver.next(buf, sizeof(buf))) != 0;)
+				out.insert(out.end(), buf, buf + payload);
+		}
+		toReceiver.clear();
+	};
+
+	// Second writer numbers its datagrams from the start again, as a restarted process does.
+	UdpReliable first(50, collect(toReceiver));
+	for (uint8_t i = 0; i < 8; ++i)
+		first.send(&i, 1, 64);
+	first.tick();
+	const auto status = toReceiver.back();
+	deliver();
+
+	UdpReliable second(50, collect(toReceiver));
+	for (uint8_t i = 10; i < 13; ++i)
+		second.send(&i, 1, 64);
+	deliver();
+	if (out != std::vector<uint8_t>{0, 1, 2, 3, 4, 5, 6, 7, 10, 11, 12})
+	{
+		std::cout << "Reliable writers received " << out.size() << std::endl;
+		return false;
+	}
+
+	// Late status of the first writer neither stalls nor asks the second one for its datagrams.
+	toReceiver.push_back(status);
+	uint8_t value = 14;
+	second.send(&value, 1, 64);
+	deliver();
+	std::this_thread::sleep_for(std::chrono::milliseconds(60));
+	uint8_t buf[16];
+	receiver.next(buf, sizeof(buf));
+	for (auto &datagram : toSender)
+	{
+		if (first.onFeedback(datagram.data(), datagram.size()) != 0)
+			return false;
+	}
+	return out.back() == 14 && toSender.empty() && receiver.getAbandoned() == 0;
+}
+
+bool testParserParity()
+{
+	std::vector<std::vector<uint8_t>> datagrams;
+	size_t nacks = 0;
+	UdpReliable sender(50, [&](const uint8_t *data, size_t size) { datagrams.emplace_back(data, data + size); });
+	UdpReliable receiver(50, [&](const uint8_t *data, size_t size) { nacks++; });
+	for (auto side : {&sender, &receiver})
+	{
+		side->setParity(4);
+		side->setRetransmit(false);
+	}
+
+	// Two groups of four with parity each, and two more covered by parity sent in the pause after them.
+	std::vector<std::vector<uint8_t>> payloads;
+	for (size_t i = 0; i < 10; ++i)
+	{
+		payloads.emplace_back(100 + 37 * i);
+		for (size_t j = 0; j < payloads[i].size(); ++j)
+			payloads[i][j] = static_cast<uint8_t>(i * 31 + j);
+		sender.send(payloads[i].data(), payloads[i].size(), 1500);
+	}
+	std::this_thread::sleep_for(std::chrono::milliseconds(15));
+	sender.tick();
+	if (datagrams.size() != 14)
+	{
+		std::cout << "Parity sent " << datagrams.size() << " datagrams" << std::endl;
+		return false;
+	}
+
+	// Second DATA of every group is lost.
+	std::vector<std::vector<uint8_t>> out;
+	uint8_t buf[1500];
+	for (size_t i = 0; i < datagrams.size(); ++i)
+	{
+		if (i == 1 || i == 6 || i == 11)
+			continue;
+
+		auto datagram = datagrams[i];
+		if (const auto size = receiver.receive(datagram.data(), datagram.size()))
+			out.emplace_back(datagram.begin(), datagram.begin() + size);
+		for (size_t size; (size = receiver.next(buf, sizeof(buf))) != 0;)
+			out.emplace_back(buf, buf + size);
+	}
+
+	if (out != payloads || receiver.getRecovered() != 3 || nacks != 0)
+	{
+		std::cout << "Parity received " << out.size() << ", rebuilt " << receiver.getRecovered() << ", NACKs "
+				  << nacks << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+bool testParserPacing()
+{
+	UdpPacer pacer;
+	const auto time = [&pacer]() {
+		const auto start = std::chrono::steady_clock::now();
+		for (auto i = 0; i < 16; ++i)
+			pacer.wait(65507);
+		return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+	};
+
+	if (time() > 5)
+		return false;
+
+	// Two datagrams go at once, the rest at 10 MB/s.
+	pacer.setRate(10 * 1000 * 1000);
+	const auto elapsed = time();
+	if (elapsed < 80 || elapsed > 200)
+	{
+		std::cout << "Paced 1 MB at 10 MB/s in " << elapsed << " ms" << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+bool testParserJitter()
+{
+	// Frames every 40 ms arrive up to 12 ms late, frame 7 is 50 ms late and comes after frame 8.
+	static constexpr int64_t MS = 1000 * 1000;
+	static constexpr int64_t FRAMES = 300;
+	const auto lateness = [](int64_t i) { return (i == 7 ? 50 : i * 7 % 13) * MS; };
+	const int64_t start = 1000 * MS;
+
+	PipeJitter jitter;
+	std::vector<PipeJitter::Entry> out;
+	std::vector<int64_t> releaseTimes;
+	for (int64_t now = start; out.size() < FRAMES && now < start + (FRAMES * 40 + 200) * MS; now += MS)
+	{
+		// No frame is 80 ms late.
+		const int64_t last = (now - start) / (40 * MS);
+		for (int64_t i = std::max<int64_t>(last - 2, 0); i <= std::min(last, FRAMES - 1); ++i)
+		{
+			if (start + i * 40 * MS + lateness(i) != now)
+				continue;
+
+			PipeJitter::Entry entry;
+			entry.channel = 0;
+			entry.putTime = i;
+			if (!jitter.push(entry, i * 40 * 10000, 100 * MS, now))
+				return false;
+		}
+
+		jitter.release(now, out);
+		releaseTimes.resize(out.size(), now);
+	}
+
+	for (size_t i = 0; i < out.size(); ++i)
+	{
+		// Each frame waits out its lateness, but not more than the max delay.
+		const int64_t delay = releaseTimes[i] - start - static_cast<int64_t>(i) * 40 * MS;
+		if (out[i].putTime != static_cast<int64_t>(i) || delay < lateness(i) || delay > 100 * MS)
+		{
+			std::cout << "Jitter released frame " << out[i].putTime << " as " << i << " after " << delay / MS
+					  << " ms" << std::endl;
+			return false;
+		}
+	}
+
+	// Delay comes down from the max to what the jitter needs.
+	if (out.size() != FRAMES || jitter.getDelay(0) > 20 * MS)
+	{
+		std::cout << "Jitter released " << out.size() << " frames, delay " << jitter.getDelay(0) / MS << " ms"
+				  << std::endl;
+		return false;
+	}
+
+	PipeJitter::Entry stale;
+	stale.channel = 0;
+	return !jitter.push(stale, 0, 100 * MS, start) && jitter.getLate() == 1;
+}
+
+bool testParserHintMode()
+{
+	// Mode is a token of its own, letters of other hints don't open the pipe.
+	return hasHintMode("R", 'R') && !hasHintMode("R", 'W')
+			&& hasHintMode("W wire=2", 'W') && hasHintMode("credit=block,W", 'W')
+			&& hasHintMode("RW", 'R') && hasHintMode("RW", 'W')
+			&& !hasHintMode("compress=Raw*", 'R') && !hasHintMode("compress=Raw*|Wide", 'W')
+			&& !hasHintMode("Wire", 'W') && !hasHintMode("", 'R');
+}
+
 bool testParser()
 {
 	auto bool_to_str = [](bool res) {
@@ -234,6 +1243,102 @@ bool testParser()
 		res = res && inRes;
 	}
 
+	{
+		bool inRes = testParserEmptyFields();
+		std::cout << "\ttestParserEmptyFields(): " << bool_to_str(inRes) << std::endl;
+		res = res && inRes;
+	}
+
+	{
+		bool inRes = testParserV2();
+		std::cout << "\ttestParserV2(): " << bool_to_str(inRes) << std::endl;
+		res = res && inRes;
+	}
+
+	{
+		bool inRes = testParserFrameDelta();
+		std::cout << "\ttestParserFrameDelta(): " << bool_to_str(inRes) << std::endl;
+		res = res && inRes;
+	}
+
+	{
+		bool inRes = testParserPackedVideo();
+		std::cout << "\ttestParserPackedVideo(): " << bool_to_str(inRes) << std::endl;
+		res = res && inRes;
+	}
+
+	{
+		bool inRes = testParserLz();
+		std::cout << "\ttestParserLz(): " << bool_to_str(inRes) << std::endl;
+		res = res && inRes;
+	}
+
+	{
+		bool inRes = testParserChannelId();
+		std::cout << "\ttestParserChannelId(): " << bool_to_str(inRes) << std::endl;
+		res = res && inRes;
+	}
+
+	{
+		bool inRes = testParserConvert();
+		std::cout << "\ttestParserConvert(): " << bool_to_str(inRes) << std::endl;
+		res = res && inRes;
+	}
+
+	{
+		bool inRes = testParserScale();
+		std::cout << "\ttestParserScale(): " << bool_to_str(inRes) << std::endl;
+		res = res && inRes;
+	}
+
+	{
+		bool inRes = testParserVideoDelta();
+		std::cout << "\ttestParserVideoDelta(): " << bool_to_str(inRes) << std::endl;
+		res = res && inRes;
+	}
+
+	{
+		bool inRes = testParserPool();
+		std::cout << "\ttestParserPool(): " << bool_to_str(inRes) << std::endl;
+		res = res && inRes;
+	}
+
+	{
+		bool inRes = testParserReliable();
+		std::cout << "\ttestParserReliable(): " << bool_to_str(inRes) << std::endl;
+		res = res && inRes;
+	}
+
+	{
+		bool inRes = testParserReliableWriters();
+		std::cout << "\ttestParserReliableWriters(): " << bool_to_str(inRes) << std::endl;
+		res = res && inRes;
+	}
+
+	{
+		bool inRes = testParserParity();
+		std::cout << "\ttestParserParity(): " << bool_to_str(inRes) << std::endl;
+		res = res && inRes;
+	}
+
+	{
+		bool inRes = testParserPacing();
+		std::cout << "\ttestParserPacing(): " << bool_to_str(inRes) << std::endl;
+		res = res && inRes;
+	}
+
+	{
+		bool inRes = testParserJitter();
+		std::cout << "\ttestParserJitter(): " << bool_to_str(inRes) << std::endl;
+		res = res && inRes;
+	}
+
+	{
+		bool inRes = testParserHintMode();
+		std::cout << "\ttestParserHintMode(): " << bool_to_str(inRes) << std::endl;
+		res = res && inRes;
+	}
+
 	return res;
 }
 
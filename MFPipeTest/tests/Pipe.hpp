@@ -2,10 +2,15 @@
 #define PIPEPROCESS_HPP
 
 #include <chrono>
+#include <coroutine>
+#include <filesystem>
 #include <future>
+#include <map>
 
 #include "../MFPipeImpl.h"
 #include "../MFTypes.h"
+#include "../pipe/PipeAlloc.hpp"
+#include "../pipe/PipeTrace.hpp"
 
 #define PACKETS_COUNT	(8)
 
@@ -710,14 +715,14 @@ bool testBufferMultithreadedRead(MFPipeImpl *pipe, std::shared_ptr<MF_BUFFER> bu
 	return true;
 }
 
-bool testBufferMultithreadedOpenWrite(const std::string &pipeName, MFPipeImpl *pipe)
+bool testBufferMultithreadedOpenWrite(const std::string &pipeName, MFPipeImpl *pipe, const std::string &hints)
 {
 	if (pipe->PipeCreate(pipeName, "") != MF_HRESULT::RES_OK)
 	{
 		std::cerr << "Failed to create write pipe" << std::endl;
 		return false;
 	}
-	if (pipe->PipeOpen(pipeName, 32, "W") != MF_HRESULT::RES_OK)
+	if (pipe->PipeOpen(pipeName, 32, hints) != MF_HRESULT::RES_OK)
 	{
 		std::cerr << "Failed to open write pipe" << std::endl;
 		return false;
@@ -726,9 +731,9 @@ bool testBufferMultithreadedOpenWrite(const std::string &pipeName, MFPipeImpl *p
 	return true;
 }
 
-bool testBufferMultithreadedOpenRead(const std::string &pipeName, MFPipeImpl *pipe)
+bool testBufferMultithreadedOpenRead(const std::string &pipeName, MFPipeImpl *pipe, int maxBuffers, const std::string &hints)
 {
-	if (pipe->PipeOpen(pipeName, 32, "R") != MF_HRESULT::RES_OK)
+	if (pipe->PipeOpen(pipeName, maxBuffers, hints) != MF_HRESULT::RES_OK)
 	{
 		std::cerr << "Failed to open read pipe" << std::endl;
 		return false;
@@ -747,8 +752,8 @@ bool testBufferMultithreaded(const std::string &pipeName)
 	MFPipeImpl writePipe;
 	MFPipeImpl readPipe;
 
-	auto writeOpenFut = std::async(&testBufferMultithreadedOpenWrite, pipeName, &writePipe);
-	auto readOpenFut = std::async(&testBufferMultithreadedOpenRead, pipeName, &readPipe);
+	auto writeOpenFut = std::async(&testBufferMultithreadedOpenWrite, pipeName, &writePipe, "W");
+	auto readOpenFut = std::async(&testBufferMultithreadedOpenRead, pipeName, &readPipe, 32, "R");
 
 	if (!writeOpenFut.get() || !readOpenFut.get())
 		return false;
@@ -761,6 +766,1135 @@ bool testBufferMultithreaded(const std::string &pipeName)
 	return writeFut0.get() && writeFut1.get() && readFut0.get() && readFut1.get();
 }
 
+/**
+ * @brief Tests delivery of buffers to channel subscribers instead of read queue.
+ * @return true if successful, otherwise false.
+ */
+bool testBufferSubscribe(const std::string &pipeName)
+{
+	std::shared_ptr<MF_BUFFER> buffer = std::make_shared<MF_BUFFER>();
+	buffer->flags = eMFBF_Buffer;
+	for (auto i = 0; i < 64 * 1024; ++i)
+		buffer->data.push_back(i);
+
+	MFPipeImpl writePipe;
+	MFPipeImpl readPipe;
+
+	std::mutex mutex;
+	size_t received = 0;
+	size_t invalid = 0;
+
+	int subscriptionId = 0;
+	readPipe.PipeSubscribe("sub*", [&](const std::string &ch, const std::shared_ptr<MF_BASE_TYPE> &obj) {
+		const auto bp = dynamic_cast<MF_BUFFER *>(obj.get());
+		std::lock_guard<std::mutex> lock(mutex);
+		if (ch != "sub1" || bp == nullptr || *bp != *buffer)
+			invalid++;
+		received++;
+	}, &subscriptionId);
+
+	auto writeOpenFut = std::async(&testBufferMultithreadedOpenWrite, pipeName, &writePipe, "W");
+	auto readOpenFut = std::async(&testBufferMultithreadedOpenRead, pipeName, &readPipe, 32, "R");
+
+	if (!writeOpenFut.get() || !readOpenFut.get())
+		return false;
+
+	for (auto i = 0; i < PACKETS_COUNT; ++i)
+	{
+		if (writePipe.PipePut("sub1", buffer, 1000, "") != MF_HRESULT::RES_OK
+				|| writePipe.PipePut("other", buffer, 1000, "") != MF_HRESULT::RES_OK)
+		{
+			std::cerr << "Write " << i << " failed" << std::endl;
+			return false;
+		}
+	}
+
+	for (auto i = 0; i < PACKETS_COUNT; ++i)
+	{
+		std::shared_ptr<MF_BASE_TYPE> out;
+		if (readPipe.PipeGet("other", out, 1000, "") != MF_HRESULT::RES_OK)
+		{
+			std::cerr << "Read " << i << " failed" << std::endl;
+			return false;
+		}
+	}
+
+	std::shared_ptr<MF_BASE_TYPE> out;
+	if (readPipe.PipeGet("sub1", out, 10, "") == MF_HRESULT::RES_OK)
+	{
+		std::cerr << "Subscribed channel was delivered to read queue" << std::endl;
+		return false;
+	}
+
+	readPipe.PipeUnsubscribe(subscriptionId);
+
+	std::lock_guard<std::mutex> lock(mutex);
+	if (received != PACKETS_COUNT || invalid != 0)
+	{
+		std::cerr << "Subscriber received " << received << " buffers, " << invalid << " invalid" << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * @brief Minimal eagerly started coroutine for awaitable pipe tests.
+ */
+struct TestTask
+{
+	struct promise_type
+	{
+		TestTask get_return_object() { return {}; }
+		std::suspend_never initial_suspend() { return {}; }
+		std::suspend_never final_suspend() noexcept { return {}; }
+		void return_void() {}
+		void unhandled_exception() { std::terminate(); }
+	};
+};
+
+TestTask testBufferCoroutineWrite(MFPipeImpl *pipe, std::shared_ptr<MF_BUFFER> buffer, std::promise<bool> *result)
+{
+	for (auto i = 0; i < 128; ++i)
+	{
+		const auto res = co_await pipe->put("", buffer, 1000);
+		if (res.hr != MF_HRESULT::RES_OK)
+		{
+			std::cerr << "Write " << i << " failed: " << res.hr << std::endl;
+			result->set_value(false);
+			co_return;
+		}
+	}
+
+	result->set_value(true);
+}
+
+TestTask testBufferCoroutineRead(MFPipeImpl *pipe, std::shared_ptr<MF_BUFFER> buffer, std::promise<bool> *result)
+{
+	for (auto i = 0; i < 128; ++i)
+	{
+		const auto res = co_await pipe->get("", 1000);
+		const auto bp = dynamic_cast<MF_BUFFER *>(res.value.get());
+		if (res.hr != MF_HRESULT::RES_OK || bp == nullptr || *bp != *buffer)
+		{
+			std::cerr << "Read " << i << " failed: " << res.hr << std::endl;
+			result->set_value(false);
+			co_return;
+		}
+	}
+
+	const auto timeout = co_await pipe->get("none", 10);
+	if (timeout.hr != MF_HRESULT::RES_FALSE)
+	{
+		std::cerr << "Read of empty channel didn't time out" << std::endl;
+		result->set_value(false);
+		co_return;
+	}
+
+	auto token = std::make_shared<PipeCancelToken>();
+	std::thread([token]() {
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		token->cancel();
+	}).detach();
+
+	const auto cancelled = co_await pipe->messageGet("none", -1, token);
+	if (cancelled.hr != MF_HRESULT::ABORT)
+	{
+		std::cerr << "Message read wasn't cancelled" << std::endl;
+		result->set_value(false);
+		co_return;
+	}
+
+	result->set_value(true);
+}
+
+/**
+ * @brief Tests awaitable get/put/messageGet including deadline and cancellation.
+ * @return true if successful, otherwise false.
+ */
+bool testBufferCoroutine(const std::string &pipeName)
+{
+	std::shared_ptr<MF_BUFFER> buffer = std::make_shared<MF_BUFFER>();
+	buffer->flags = eMFBF_Buffer;
+	for (auto i = 0; i < 64 * 1024; ++i)
+		buffer->data.push_back(i);
+
+	MFPipeImpl writePipe;
+	MFPipeImpl readPipe;
+
+	auto writeOpenFut = std::async(&testBufferMultithreadedOpenWrite, pipeName, &writePipe, "W");
+	auto readOpenFut = std::async(&testBufferMultithreadedOpenRead, pipeName, &readPipe, 32, "R");
+
+	if (!writeOpenFut.get() || !readOpenFut.get())
+		return false;
+
+	std::promise<bool> writeRes;
+	std::promise<bool> readRes;
+	auto writeFut = writeRes.get_future();
+	auto readFut = readRes.get_future();
+
+	testBufferCoroutineRead(&readPipe, buffer, &readRes);
+	testBufferCoroutineWrite(&writePipe, buffer, &writeRes);
+
+	return writeFut.get() && readFut.get();
+}
+
+/**
+ * @brief Tests that writer drops objects at the source when reader advertises no free slots.
+ * @return true if successful, otherwise false.
+ */
+bool testBufferCredit(const std::string &pipeName)
+{
+	std::shared_ptr<MF_BUFFER> buffer = std::make_shared<MF_BUFFER>();
+	buffer->flags = eMFBF_Buffer;
+	for (auto i = 0; i < 64 * 1024; ++i)
+		buffer->data.push_back(i);
+
+	MFPipeImpl writePipe;
+	MFPipeImpl readPipe;
+
+	auto writeOpenFut = std::async(&testBufferMultithreadedOpenWrite, pipeName, &writePipe, "W credit=drop");
+	auto readOpenFut = std::async(&testBufferMultithreadedOpenRead, pipeName, &readPipe, 4, "R");
+
+	if (!writeOpenFut.get() || !readOpenFut.get())
+	{
+		std::cerr << "Failed to open pipes" << std::endl;
+		return false;
+	}
+
+	// Let the first credit record reach the writer.
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+	const int count = 32;
+	for (auto i = 0; i < count; ++i)
+	{
+		if (writePipe.PipePut("", buffer, 1000, "") != MF_HRESULT::RES_OK)
+		{
+			std::cerr << "Write " << i << " failed" << std::endl;
+			return false;
+		}
+	}
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+	int received = 0;
+	std::shared_ptr<MF_BASE_TYPE> out;
+	while (readPipe.PipeGet("", out, 100, "") == MF_HRESULT::RES_OK)
+		received++;
+
+	MFPipe::MF_PIPE_INFO info;
+	writePipe.PipeInfoGet(nullptr, "", &info);
+
+	if (info.nObjectsDropped == 0 || received + info.nObjectsDropped != count)
+	{
+		std::cerr << "Received " << received << ", dropped " << info.nObjectsDropped << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * @brief Tests that close of a blocked writer doesn't wait forever for credit reader never gives.
+ * @return true if successful, otherwise false.
+ */
+bool testBufferCreditClose(const std::string &pipeName)
+{
+	std::shared_ptr<MF_BUFFER> buffer = std::make_shared<MF_BUFFER>();
+	buffer->flags = eMFBF_Buffer;
+	buffer->data.resize(64 * 1024);
+
+	MFPipeImpl writePipe;
+	MFPipeImpl readPipe;
+
+	auto writeOpenFut = std::async(&testBufferMultithreadedOpenWrite, pipeName, &writePipe, "W credit=block");
+	auto readOpenFut = std::async(&testBufferMultithreadedOpenRead, pipeName, &readPipe, 4, "R");
+
+	if (!writeOpenFut.get() || !readOpenFut.get())
+	{
+		std::cerr << "Failed to open pipes" << std::endl;
+		return false;
+	}
+
+	// Let the first credit record reach the writer.
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+	// Reader takes nothing, so most of the objects stay in the write queue.
+	for (auto i = 0; i < 16; ++i)
+	{
+		if (writePipe.PipePut("", buffer, 1000, "") != MF_HRESULT::RES_OK)
+		{
+			std::cerr << "Write " << i << " failed" << std::endl;
+			return false;
+		}
+	}
+
+	const auto start = std::chrono::steady_clock::now();
+	if (writePipe.PipeClose() != MF_HRESULT::RES_OK)
+	{
+		std::cerr << "Failed to close writer" << std::endl;
+		return false;
+	}
+
+	const auto elapsed = std::chrono::steady_clock::now() - start;
+	if (elapsed > std::chrono::seconds(5))
+	{
+		std::cerr << "Close took " << std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count()
+				  << " ms" << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * @brief Tests that every object gets all stage stamps in order.
+ * @param pipeName Name of pipe to open.
+ * @return true if successful, otherwise false.
+ */
+bool testBufferTrace(const std::string &pipeName)
+{
+#ifdef MFPIPE_TRACE
+	MFPipeImpl writePipe;
+	MFPipeImpl readPipe;
+
+	auto writeOpenFut = std::async(&testBufferMultithreadedOpenWrite, pipeName, &writePipe, "W");
+	auto readOpenFut = std::async(&testBufferMultithreadedOpenRead, pipeName, &readPipe, 32, "R");
+	if (!writeOpenFut.get() || !readOpenFut.get())
+		return false;
+
+	PipeTrace::clear();
+	PipeTrace::enable(true);
+
+	// Objects are released right away, so reader reuses pooled ones at the same addresses.
+	const int count = 8;
+	for (auto i = 0; i < count; ++i)
+	{
+		auto buffer = std::make_shared<MF_BUFFER>();
+		buffer->flags = eMFBF_Buffer;
+		buffer->data.resize(1024, static_cast<uint8_t>(i));
+
+		std::shared_ptr<MF_BASE_TYPE> out;
+		if (writePipe.PipePut("", buffer, 1000, "") != MF_HRESULT::RES_OK
+				|| readPipe.PipeGet("", out, 1000, "") != MF_HRESULT::RES_OK)
+		{
+			PipeTrace::enable(false);
+			std::cerr << "Transfer " << i << " failed" << std::endl;
+			return false;
+		}
+	}
+
+	PipeTrace::enable(false);
+
+	std::map<uint64_t, std::vector<PipeTrace::Stage>> stages;
+	for (const auto &event : PipeTrace::collect())
+		stages[event.id].push_back(event.stage);
+
+	// Each object put and each object parsed has stages of its own.
+	const std::vector<PipeTrace::Stage> written = { PipeTrace::Stage::PUT, PipeTrace::Stage::WRITER_DEQUEUE,
+												   PipeTrace::Stage::WRITE_COMPLETE };
+	const std::vector<PipeTrace::Stage> read = { PipeTrace::Stage::FIRST_BYTE_READ, PipeTrace::Stage::PARSE_COMPLETE,
+												PipeTrace::Stage::GET };
+	int writtenCount = 0;
+	int readCount = 0;
+	for (const auto &object : stages)
+	{
+		if (object.second == written)
+			writtenCount++;
+		else if (object.second == read)
+			readCount++;
+		else
+		{
+			std::cerr << "Wrong stages of object " << object.first << std::endl;
+			return false;
+		}
+	}
+	if (writtenCount != count || readCount != count)
+	{
+		std::cerr << "Traced " << writtenCount << " written and " << readCount << " read objects" << std::endl;
+		return false;
+	}
+
+	// Exports go to the temp directory, not to where the tests are run from.
+	const auto dir = std::filesystem::temp_directory_path();
+	return PipeTrace::exportChromeTrace((dir / "testTrace.json").string())
+			&& PipeTrace::exportBinary((dir / "testTrace.bin").string());
+#else
+	return true;
+#endif
+}
+
+/**
+ * @brief Tests per-channel latency histograms of both ends.
+ * @param pipeName Name of pipe to open.
+ * @return true if successful, otherwise false.
+ */
+bool testBufferLatency(const std::string &pipeName)
+{
+	MFPipeImpl writePipe;
+	MFPipeImpl readPipe;
+
+	auto writeOpenFut = std::async(&testBufferMultithreadedOpenWrite, pipeName, &writePipe, "W timestamps=on");
+	auto readOpenFut = std::async(&testBufferMultithreadedOpenRead, pipeName, &readPipe, 32, "R");
+
+	if (!writeOpenFut.get() || !readOpenFut.get())
+	{
+		std::cerr << "Failed to open pipes" << std::endl;
+		return false;
+	}
+
+	std::shared_ptr<MF_BUFFER> buffer = std::make_shared<MF_BUFFER>();
+	buffer->flags = eMFBF_Buffer;
+	buffer->data.resize(1024);
+
+	const int count = 16;
+	for (auto i = 0; i < count; ++i)
+	{
+		std::shared_ptr<MF_BASE_TYPE> out;
+		if (writePipe.PipePut("cam1", buffer, 1000, "") != MF_HRESULT::RES_OK
+				|| readPipe.PipeGet("cam1", out, 1000, "") != MF_HRESULT::RES_OK)
+		{
+			std::cerr << "Transfer " << i << " failed" << std::endl;
+			return false;
+		}
+	}
+
+	MFPipe::MF_PIPE_LATENCY_INFO writeInfo;
+	MFPipe::MF_PIPE_LATENCY_INFO readInfo;
+	MFPipe::MF_PIPE_LATENCY_INFO otherInfo;
+	writePipe.PipeLatencyGet("cam1", &writeInfo);
+	readPipe.PipeLatencyGet("cam1", &readInfo);
+	readPipe.PipeLatencyGet("cam2", &otherInfo);
+
+	auto isValid = [](const MFPipe::MF_PIPE_LATENCY &latency) {
+		return latency.nSamples == count
+				&& latency.nMinNs <= latency.nP50Ns
+				&& latency.nP50Ns <= latency.nP99Ns
+				&& latency.nP99Ns <= latency.nMaxNs;
+	};
+
+	if (!isValid(writeInfo.writeQueue) || !isValid(readInfo.readQueue) || !isValid(readInfo.endToEnd))
+	{
+		std::cerr << "Wrong latency samples: " << writeInfo.writeQueue.nSamples << ", "
+				  << readInfo.readQueue.nSamples << ", " << readInfo.endToEnd.nSamples << std::endl;
+		return false;
+	}
+
+	if (otherInfo.readQueue.nSamples != 0 || readInfo.endToEnd.nMinNs < readInfo.readQueue.nMinNs)
+	{
+		std::cerr << "Latency of wrong channel or stage" << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * @brief Tests that objects pass the pipe without heap allocations once pools are warm.
+ *        Checked only in MFPIPE_ALLOC_STATS builds.
+ * @param pipeName Name of pipe to open.
+ * @return true if successful, otherwise false.
+ */
+bool testBufferZeroAlloc(const std::string &pipeName)
+{
+	if (!PipeAlloc::isEnabled())
+		return true;
+
+	MFPipeImpl writePipe;
+	MFPipeImpl readPipe;
+
+	auto writeOpenFut = std::async(&testBufferMultithreadedOpenWrite, pipeName, &writePipe, "W");
+	auto readOpenFut = std::async(&testBufferMultithreadedOpenRead, pipeName, &readPipe, 32, "R");
+	if (!writeOpenFut.get() || !readOpenFut.get())
+		return false;
+
+	std::shared_ptr<MF_BUFFER> buffer = std::make_shared<MF_BUFFER>();
+	buffer->flags = eMFBF_Buffer;
+	buffer->data.resize(64 * 1024);
+
+	auto transfer = [&](int count) {
+		std::shared_ptr<MF_BASE_TYPE> out;
+		for (auto i = 0; i < count; ++i)
+		{
+			if (writePipe.PipePut("ch", buffer, 1000, "") != MF_HRESULT::RES_OK
+					|| readPipe.PipeGet("ch", out, 1000, "") != MF_HRESULT::RES_OK)
+				return false;
+			out.reset();
+		}
+		return true;
+	};
+
+	if (!transfer(64))
+	{
+		std::cerr << "Warm up failed" << std::endl;
+		return false;
+	}
+
+	PipeAlloc::reset();
+	const bool transferred = transfer(256);
+	const auto total = PipeAlloc::total();
+
+	if (!transferred || total != 0)
+	{
+		std::cerr << "Allocations in steady state:";
+		for (auto i = 0; i < static_cast<int>(PipeAlloc::Stage::COUNT); ++i)
+		{
+			const auto stage = static_cast<PipeAlloc::Stage>(i);
+			std::cerr << " " << PipeAlloc::stageName(stage) << "=" << PipeAlloc::count(stage);
+		}
+		std::cerr << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * @brief Tests that frames pass the pipe with either wire format and with negotiated one.
+ * @param pipeName Name of pipe to open.
+ * @return true if successful, otherwise false.
+ */
+bool testBufferWireVersions(const std::string &pipeName)
+{
+	std::shared_ptr<MF_FRAME> frame = std::make_shared<MF_FRAME>();
+	frame->time.rtStartTime = 100;
+	frame->time.rtEndTime = 200;
+	frame->av_props.vidProps.fccType = eMFCC_I420;
+	frame->av_props.vidProps.nWidth = 64;
+	frame->av_props.vidProps.nHeight = 32;
+	frame->av_props.vidProps.nRowBytes = 64;
+	frame->av_props.vidProps.dblRate = 25.0;
+	frame->str_user_props = "user_props";
+	frame->vec_video_data.resize(64 * 32 * 3 / 2, 0x10);
+	frame->vec_audio_data.resize(128, 0x20);
+
+	for (const auto &hints : { "W wire=1", "W wire=2", "W" })
+	{
+		MFPipeImpl writePipe;
+		MFPipeImpl readPipe;
+
+		auto writeOpenFut = std::async(&testBufferMultithreadedOpenWrite, pipeName, &writePipe, hints);
+		auto readOpenFut = std::async(&testBufferMultithreadedOpenRead, pipeName, &readPipe, 32, "R");
+
+		if (!writeOpenFut.get() || !readOpenFut.get())
+		{
+			std::cerr << "Failed to open pipes" << std::endl;
+			return false;
+		}
+
+		// Several frames, so auto mode has time to switch to v2 in the middle.
+		for (auto i = 0; i < 8; ++i)
+		{
+			std::shared_ptr<MF_BASE_TYPE> out;
+			if (writePipe.PipePut("ch", frame, 1000, "") != MF_HRESULT::RES_OK
+					|| readPipe.PipeGet("ch", out, 1000, "") != MF_HRESULT::RES_OK)
+			{
+				std::cerr << "Transfer with \"" << hints << "\" failed" << std::endl;
+				return false;
+			}
+
+			const auto outFrame = std::dynamic_pointer_cast<MF_FRAME>(out);
+			if (!outFrame || !(*outFrame == *frame))
+			{
+				std::cerr << "Wrong frame with \"" << hints << "\"" << std::endl;
+				return false;
+			}
+
+			std::this_thread::sleep_for(std::chrono::milliseconds(5));
+		}
+	}
+
+	return true;
+}
+
+/**
+ * @brief Tests that objects and messages of interleaved channels reach their channels over interned IDs.
+ * @param pipeName Name of pipe to open.
+ * @return true if successful, otherwise false.
+ */
+bool testBufferChannelIds(const std::string &pipeName)
+{
+	MFPipeImpl writePipe;
+	MFPipeImpl readPipe;
+
+	auto writeOpenFut = std::async(&testBufferMultithreadedOpenWrite, pipeName, &writePipe, "W wire=2");
+	auto readOpenFut = std::async(&testBufferMultithreadedOpenRead, pipeName, &readPipe, 32, "R");
+
+	if (!writeOpenFut.get() || !readOpenFut.get())
+	{
+		std::cerr << "Failed to open pipes" << std::endl;
+		return false;
+	}
+
+	const std::vector<std::string> channels = {
+		"studio/cameras/main/program",
+		"studio/cameras/main/preview",
+		"studio/cameras/backup/program",
+	};
+
+	const int count = 8;
+	for (auto i = 0; i < count; ++i)
+	{
+		for (size_t ch = 0; ch < channels.size(); ++ch)
+		{
+			std::shared_ptr<MF_BUFFER> buffer = std::make_shared<MF_BUFFER>();
+			buffer->flags = eMFBF_Packet;
+			buffer->data.assign(64, static_cast<uint8_t>(ch * count + i));
+			if (writePipe.PipePut(channels[ch], buffer, 1000, "") != MF_HRESULT::RES_OK)
+				return false;
+		}
+	}
+
+	if (writePipe.PipeMessagePut(channels[1], "event", "param", 1000) != MF_HRESULT::RES_OK)
+		return false;
+
+	// Channels are read in reverse order of writing, so each get has to skip the others.
+	for (auto ch = channels.size(); ch-- > 0;)
+	{
+		for (auto i = 0; i < count; ++i)
+		{
+			std::shared_ptr<MF_BASE_TYPE> out;
+			if (readPipe.PipeGet(channels[ch], out, 1000, "") != MF_HRESULT::RES_OK)
+				return false;
+
+			const auto buffer = std::dynamic_pointer_cast<MF_BUFFER>(out);
+			if (!buffer || buffer->data.empty() || buffer->data[0] != ch * count + i)
+			{
+				std::cerr << "Wrong object on channel " << channels[ch] << std::endl;
+				return false;
+			}
+		}
+	}
+
+	std::string name;
+	std::string param;
+	if (readPipe.PipeMessageGet(channels[1], &name, &param, 1000) != MF_HRESULT::RES_OK
+			|| name != "event" || param != "param")
+	{
+		std::cerr << "Wrong message" << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * @brief Tests that compressed channels arrive intact, poorly compressible one is bypassed and stats show it.
+ * @param pipeName Name of pipe to open.
+ * @return true if successful, otherwise false.
+ */
+bool testBufferCompression(const std::string &pipeName)
+{
+	MFPipeImpl writePipe;
+	MFPipeImpl readPipe;
+
+	auto writeOpenFut = std::async(&testBufferMultithreadedOpenWrite, pipeName, &writePipe, "W wire=2 compress=screen*|noise");
+	auto readOpenFut = std::async(&testBufferMultithreadedOpenRead, pipeName, &readPipe, 32, "R");
+
+	if (!writeOpenFut.get() || !readOpenFut.get())
+	{
+		std::cerr << "Failed to open pipes" << std::endl;
+		return false;
+	}
+
+	std::shared_ptr<MF_FRAME> screen = std::make_shared<MF_FRAME>();
+	screen->av_props.vidProps.fccType = eMFCC_RGB32;
+	screen->av_props.vidProps.nWidth = 256;
+	screen->av_props.vidProps.nHeight = 64;
+	screen->av_props.vidProps.nRowBytes = 256 * 4;
+	screen->vec_video_data.resize(256 * 64 * 4);
+	for (size_t i = 0; i < screen->vec_video_data.size(); ++i)
+		screen->vec_video_data[i] = static_cast<uint8_t>((i / 64) % 3);
+
+	std::shared_ptr<MF_BUFFER> noise = std::make_shared<MF_BUFFER>();
+	noise->flags = eMFBF_Buffer;
+	noise->data.resize(16 * 1024);
+	uint32_t seed = 7;
+	for (auto &byte : noise->data)
+	{
+		seed = seed * 1103515245 + 12345;
+		byte = static_cast<uint8_t>(seed >> 16);
+	}
+
+	const int count = 8;
+	for (auto i = 0; i < count; ++i)
+	{
+		std::shared_ptr<MF_BASE_TYPE> out;
+		if (writePipe.PipePut("screen1", screen, 1000, "") != MF_HRESULT::RES_OK
+				|| writePipe.PipePut("noise", noise, 1000, "") != MF_HRESULT::RES_OK
+				|| writePipe.PipePut("plain", noise, 1000, "") != MF_HRESULT::RES_OK)
+			return false;
+
+		for (const auto &channel : { "screen1", "noise", "plain" })
+		{
+			if (readPipe.PipeGet(channel, out, 1000, "") != MF_HRESULT::RES_OK)
+				return false;
+
+			const bool isEqual = channel == std::string("screen1")
+					? std::dynamic_pointer_cast<MF_FRAME>(out) && *std::dynamic_pointer_cast<MF_FRAME>(out) == *screen
+					: std::dynamic_pointer_cast<MF_BUFFER>(out) && *std::dynamic_pointer_cast<MF_BUFFER>(out) == *noise;
+			if (!isEqual)
+			{
+				std::cerr << "Wrong object on channel " << channel << std::endl;
+				return false;
+			}
+		}
+	}
+
+	MFPipe::MF_PIPE_COMPRESSION_INFO screenInfo;
+	MFPipe::MF_PIPE_COMPRESSION_INFO noiseInfo;
+	MFPipe::MF_PIPE_COMPRESSION_INFO plainInfo;
+	writePipe.PipeCompressionGet("screen1", &screenInfo);
+	writePipe.PipeCompressionGet("noise", &noiseInfo);
+	writePipe.PipeCompressionGet("plain", &plainInfo);
+
+	if (screenInfo.nObjectsCompressed != count || screenInfo.nBytesOut * 10 > screenInfo.nBytesIn
+			|| noiseInfo.nObjectsBypassed != count || noiseInfo.nObjectsCompressed != 0
+			|| plainInfo.nBytesIn != 0)
+	{
+		std::cerr << "Wrong stats: screen " << screenInfo.nObjectsCompressed << " " << screenInfo.nBytesIn << "->"
+				  << screenInfo.nBytesOut << ", noise " << noiseInfo.nObjectsBypassed << ", plain " << plainInfo.nBytesIn
+				  << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * @brief Tests reader converting frames of a channel into the format set by PipeFormatSet.
+ * @return true if successful, otherwise false.
+ */
+bool testBufferConvert(const std::string &pipeName)
+{
+	MFPipeImpl writePipe;
+	MFPipeImpl readPipe;
+
+	// Format set before open applies once the read buffer exists, unsupported targets are rejected.
+	if (readPipe.PipeFormatSet("nv12", eMFCC_NV12) != MF_HRESULT::RES_OK
+			|| readPipe.PipeFormatSet("rgb", eMFCC_RGB32) != MF_HRESULT::INVALIDARG)
+		return false;
+
+	auto writeOpenFut = std::async(&testBufferMultithreadedOpenWrite, pipeName, &writePipe, "W");
+	auto readOpenFut = std::async(&testBufferMultithreadedOpenRead, pipeName, &readPipe, 32, "R");
+
+	if (!writeOpenFut.get() || !readOpenFut.get())
+	{
+		std::cerr << "Failed to open pipes" << std::endl;
+		return false;
+	}
+
+	std::shared_ptr<MF_FRAME> frame = std::make_shared<MF_FRAME>();
+	frame->av_props.vidProps.fccType = eMFCC_UYVY;
+	frame->av_props.vidProps.nWidth = 640;
+	frame->av_props.vidProps.nHeight = 360;
+	frame->av_props.vidProps.nRowBytes = 640 * 2;
+	frame->vec_video_data.resize(640 * 2 * 360);
+	for (size_t i = 0; i < frame->vec_video_data.size(); ++i)
+		frame->vec_video_data[i] = static_cast<uint8_t>(i % 2 == 0 ? 128 : i / 1280);
+
+	for (auto i = 0; i < 4; ++i)
+	{
+		std::shared_ptr<MF_BASE_TYPE> out;
+		if (writePipe.PipePut("nv12", frame, 1000, "") != MF_HRESULT::RES_OK
+				|| writePipe.PipePut("asis", frame, 1000, "") != MF_HRESULT::RES_OK)
+			return false;
+
+		if (readPipe.PipeGet("nv12", out, 1000, "") != MF_HRESULT::RES_OK)
+			return false;
+
+		const auto converted = std::dynamic_pointer_cast<MF_FRAME>(out);
+		if (!converted || converted->av_props.vidProps.fccType != eMFCC_NV12
+				|| converted->vec_video_data.size() != 640 * 360 * 3 / 2
+				|| converted->vec_video_data[640 * 100 + 7] != 100
+				|| converted->vec_video_data[640 * 360 + 640 * 50 + 3] != 128)
+		{
+			std::cerr << "Frame on channel nv12 wasn't converted" << std::endl;
+			return false;
+		}
+
+		if (readPipe.PipeGet("asis", out, 1000, "") != MF_HRESULT::RES_OK
+				|| !std::dynamic_pointer_cast<MF_FRAME>(out) || !(*std::dynamic_pointer_cast<MF_FRAME>(out) == *frame))
+		{
+			std::cerr << "Frame on channel asis was changed" << std::endl;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * @brief Tests downscaled preview channel sent along with its source channel.
+ * @return true if successful, otherwise false.
+ */
+bool testBufferPreview(const std::string &pipeName)
+{
+	MFPipeImpl writePipe;
+	MFPipeImpl readPipe;
+
+	auto writeOpenFut = std::async(&testBufferMultithreadedOpenWrite, pipeName, &writePipe, "W");
+	auto readOpenFut = std::async(&testBufferMultithreadedOpenRead, pipeName, &readPipe, 32, "R");
+
+	if (!writeOpenFut.get() || !readOpenFut.get())
+	{
+		std::cerr << "Failed to open pipes" << std::endl;
+		return false;
+	}
+
+	if (writePipe.PipePreviewSet("cam1/preview", "cam1", 160, 90) != MF_HRESULT::RES_OK
+			|| writePipe.PipePreviewSet("cam1", "cam1", 160, 90) != MF_HRESULT::INVALIDARG)
+		return false;
+
+	std::shared_ptr<MF_FRAME> frame = std::make_shared<MF_FRAME>();
+	frame->av_props.vidProps.fccType = eMFCC_I420;
+	frame->av_props.vidProps.nWidth = 1280;
+	frame->av_props.vidProps.nHeight = 720;
+	frame->av_props.vidProps.nRowBytes = 1280;
+	frame->vec_video_data.assign(1280 * 720 * 3 / 2, 77);
+	frame->vec_audio_data.assign(1920, 1);
+
+	for (auto i = 0; i < 4; ++i)
+	{
+		if (writePipe.PipePut("cam1", frame, 1000, "") != MF_HRESULT::RES_OK)
+			return false;
+
+		std::shared_ptr<MF_BASE_TYPE> out;
+		if (readPipe.PipeGet("cam1", out, 1000, "") != MF_HRESULT::RES_OK
+				|| !std::dynamic_pointer_cast<MF_FRAME>(out) || !(*std::dynamic_pointer_cast<MF_FRAME>(out) == *frame))
+		{
+			std::cerr << "Source frame wasn't received" << std::endl;
+			return false;
+		}
+
+		if (readPipe.PipeGet("cam1/preview", out, 1000, "") != MF_HRESULT::RES_OK)
+			return false;
+
+		const auto preview = std::dynamic_pointer_cast<MF_FRAME>(out);
+		if (!preview || preview->av_props.vidProps.nWidth != 160 || preview->av_props.vidProps.nHeight != 90
+				|| preview->av_props.vidProps.fccType != eMFCC_I420 || !preview->vec_audio_data.empty()
+				|| preview->vec_video_data.size() != 160 * 90 * 3 / 2 || preview->vec_video_data[160 * 45 + 80] != 77)
+		{
+			std::cerr << "Wrong preview frame" << std::endl;
+			return false;
+		}
+	}
+
+	// Removed preview is no longer sent.
+	writePipe.PipePreviewSet("cam1/preview", "cam1", 0, 0);
+	std::shared_ptr<MF_BASE_TYPE> out;
+	if (writePipe.PipePut("cam1", frame, 1000, "") != MF_HRESULT::RES_OK
+			|| readPipe.PipeGet("cam1", out, 1000, "") != MF_HRESULT::RES_OK
+			|| readPipe.PipeGet("cam1/preview", out, 100, "") == MF_HRESULT::RES_OK)
+		return false;
+
+	return true;
+}
+
+/**
+ * @brief Tests frames of a "delta=" channel arriving whole when only some tiles change.
+ * @return true if successful, otherwise false.
+ */
+bool testBufferVideoDelta(const std::string &pipeName)
+{
+	MFPipeImpl writePipe;
+	MFPipeImpl readPipe;
+
+	auto writeOpenFut = std::async(&testBufferMultithreadedOpenWrite, pipeName, &writePipe, "W wire=2 delta=screen*");
+	auto readOpenFut = std::async(&testBufferMultithreadedOpenRead, pipeName, &readPipe, 32, "R");
+
+	if (!writeOpenFut.get() || !readOpenFut.get())
+	{
+		std::cerr << "Failed to open pipes" << std::endl;
+		return false;
+	}
+
+	MF_FRAME screen;
+	screen.av_props.vidProps.fccType = eMFCC_RGB32;
+	screen.av_props.vidProps.nWidth = 640;
+	screen.av_props.vidProps.nHeight = 360;
+	screen.av_props.vidProps.nRowBytes = 640 * 4;
+	screen.vec_video_data.resize(640 * 360 * 4);
+	for (size_t i = 0; i < screen.vec_video_data.size(); ++i)
+		screen.vec_video_data[i] = static_cast<uint8_t>(i % 251);
+
+	// Writer may still be sending the previous frame, so each put gets its own copy.
+	for (auto i = 0; i < 16; ++i)
+	{
+		std::fill_n(screen.vec_video_data.begin() + (i * 20 + 10) * 640 * 4 + i * 64, 128, 0xFF - i);
+		const auto frame = std::make_shared<MF_FRAME>(screen);
+
+		std::shared_ptr<MF_BASE_TYPE> out;
+		if (writePipe.PipePut("screen1", frame, 1000, "") != MF_HRESULT::RES_OK
+				|| readPipe.PipeGet("screen1", out, 1000, "") != MF_HRESULT::RES_OK)
+			return false;
+
+		if (!std::dynamic_pointer_cast<MF_FRAME>(out) || !(*std::dynamic_pointer_cast<MF_FRAME>(out) == screen))
+		{
+			std::cerr << "Wrong frame " << i << std::endl;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * @brief Tests jitter buffer putting frames that come late back in order of their start times.
+ * @return true if successful, otherwise false.
+ */
+bool testBufferJitter(const std::string &pipeName)
+{
+	MFPipeImpl writePipe;
+	MFPipeImpl readPipe;
+
+	if (readPipe.PipeJitterSet("cam1", 200) != MF_HRESULT::RES_OK)
+	{
+		std::cerr << "Failed to set jitter" << std::endl;
+		return false;
+	}
+
+	auto writeOpenFut = std::async(&testBufferMultithreadedOpenWrite, pipeName, &writePipe, "W");
+	auto readOpenFut = std::async(&testBufferMultithreadedOpenRead, pipeName, &readPipe, 32, "R");
+
+	if (!writeOpenFut.get() || !readOpenFut.get() || readPipe.PipeJitterSet("cam1", -1) != MF_HRESULT::INVALIDARG)
+	{
+		std::cerr << "Failed to open pipes" << std::endl;
+		return false;
+	}
+
+	// Frames go every 20 ms in real time, frame 2 goes before frame 1.
+	const int order[] = { 0, 2, 1, 3, 4, 5 };
+	for (const auto i : order)
+	{
+		const auto frame = std::make_shared<MF_FRAME>();
+		frame->time.rtStartTime = i * 20 * 10000;
+		frame->vec_video_data.resize(1024, static_cast<uint8_t>(i));
+		if (writePipe.PipePut("cam1", frame, 1000, "") != MF_HRESULT::RES_OK)
+			return false;
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	}
+
+	for (auto i = 0; i < 6; ++i)
+	{
+		std::shared_ptr<MF_BASE_TYPE> out;
+		if (readPipe.PipeGet("cam1", out, 1000, "") != MF_HRESULT::RES_OK)
+		{
+			std::cerr << "Jitter buffer lost frame " << i << std::endl;
+			return false;
+		}
+
+		const auto frame = std::dynamic_pointer_cast<MF_FRAME>(out);
+		if (!frame || frame->time.rtStartTime != i * 20 * 10000)
+		{
+			std::cerr << "Jitter buffer released frame out of order at " << i << std::endl;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * @brief Transport that keeps everything written to it, so a test sees the order writer sends records in.
+ */
+class RecordingIo : public IoInterface
+{
+public:
+	bool create(const std::string &pipeId) override { return true; }
+	bool open(const std::string &pipeId, Mode mode, int32_t timeoutMs = 1000) override { return true; }
+	bool close() override { return true; }
+	ssize_t read(uint8_t *buf, size_t size) override { return -1; }
+
+	ssize_t write(const uint8_t *buf, size_t size) override
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		data.insert(data.end(), buf, buf + size);
+		return static_cast<ssize_t>(size);
+	}
+
+	std::mutex mutex;
+	std::vector<uint8_t> data;
+};
+
+/**
+ * @brief Tests that object of a high priority channel overtakes a backlog of normal ones
+ *        in the write queue and in the read queue.
+ * @return true if successful, otherwise false.
+ */
+bool testBufferPriority()
+{
+	static constexpr auto BACKLOG = 8;
+
+	std::shared_ptr<MF_BUFFER> buffer = std::make_shared<MF_BUFFER>();
+	buffer->flags = eMFBF_Buffer;
+	buffer->data.resize(1024, 0);
+
+	// Writer: the whole backlog is queued before the writing thread starts, the urgent object last.
+	auto io = std::make_shared<RecordingIo>();
+	auto writeDataBuffer = std::make_shared<DataBuffer>();
+	writeDataBuffer->setPriority("urgent", eMFPR_High);
+	for (auto i = 0; i < BACKLOG; ++i)
+		writeDataBuffer->data.push_back({ writeDataBuffer->intern("bulk"), buffer });
+	writeDataBuffer->data.push_back({ writeDataBuffer->intern("urgent"), buffer });
+
+	{
+		PipeWriter writer(io, writeDataBuffer);
+		writer.start();
+		writer.stop();
+	}
+
+	std::vector<std::string> sent;
+	PipeParser parser;
+	size_t parsedBytes = 0;
+	while (parsedBytes < io->data.size())
+	{
+		const auto bytes = parser.parse(io->data.data() + parsedBytes, io->data.size() - parsedBytes);
+		if (parser.getState() == PipeParser::State::BUFFER_READY)
+		{
+			sent.push_back(parser.getChannel());
+			parser.reset();
+		}
+		else if (bytes == 0)
+		{
+			break;
+		}
+		parsedBytes += bytes;
+	}
+
+	if (sent.size() != BACKLOG + 1 || sent.front() != "urgent")
+	{
+		std::cerr << "Writer sent " << sent.size() << " objects, " << (sent.empty() ? "" : sent.front()) << " first"
+				  << std::endl;
+		return false;
+	}
+
+	// Reader: urgent object received after the backlog is queued ahead of it.
+	auto readDataBuffer = std::make_shared<DataBuffer>();
+	readDataBuffer->setPriority("urgent", eMFPR_High);
+	PipeReader reader(nullptr, BACKLOG + 1, readDataBuffer);
+	for (auto i = 0; i < BACKLOG; ++i)
+	{
+		if (!reader.receive("bulk", buffer, 0))
+			return false;
+	}
+	if (!reader.receive("urgent", buffer, 0))
+		return false;
+
+	if (readDataBuffer->data.size() != BACKLOG + 1
+		|| readDataBuffer->data.front().first != readDataBuffer->find("urgent"))
+	{
+		std::cerr << "Urgent object is not first in the read queue" << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * @brief Tests that "mem://" pipe hands over the put objects themselves and bounds the read queue.
+ * @return true if successful, otherwise false.
+ */
+bool testBufferMemory()
+{
+	MFPipeImpl writePipe;
+	MFPipeImpl readPipe;
+
+	const std::string pipeName = "mem://testPipe";
+	if (writePipe.PipeCreate(pipeName, "") != MF_HRESULT::RES_OK
+			|| writePipe.PipeOpen(pipeName, 4, "W") != MF_HRESULT::RES_OK
+			|| readPipe.PipeOpen(pipeName, 4, "R") != MF_HRESULT::RES_OK)
+	{
+		std::cerr << "Failed to open pipes" << std::endl;
+		return false;
+	}
+
+	std::shared_ptr<MF_BUFFER> buffer = std::make_shared<MF_BUFFER>();
+	buffer->flags = eMFBF_Buffer;
+	buffer->data.assign(1024, 7);
+
+	for (auto i = 0; i < 4; ++i)
+	{
+		if (writePipe.PipePut("ch", buffer, 100, "") != MF_HRESULT::RES_OK)
+			return false;
+	}
+
+	// Read queue is full, so is the pipe until reader takes something.
+	std::shared_ptr<MF_BASE_TYPE> out;
+	if (writePipe.PipePut("ch", buffer, 10, "") != MF_HRESULT::RES_FALSE
+			|| readPipe.PipeGet("ch", out, 100, "") != MF_HRESULT::RES_OK
+			|| out != buffer
+			|| writePipe.PipePut("ch", buffer, 10, "") != MF_HRESULT::RES_OK)
+	{
+		std::cerr << "Wrong queue bound" << std::endl;
+		return false;
+	}
+
+	std::string name;
+	std::string param;
+	if (writePipe.PipeMessagePut("ch", "event", "param", 100) != MF_HRESULT::RES_OK
+			|| readPipe.PipeMessageGet("ch", &name, &param, 100) != MF_HRESULT::RES_OK
+			|| name != "event" || param != "param")
+	{
+		std::cerr << "Wrong message" << std::endl;
+		return false;
+	}
+
+	// Awaited puts are resumed as reader takes objects.
+	return testBufferCoroutine("mem://testCoroutine");
+}
+
+TestTask testBufferMemoryLastWrite(std::unique_ptr<MFPipeImpl> pipe, std::shared_ptr<MF_BUFFER> buffer,
+								   std::shared_future<void> readerClosed, std::promise<bool> *result,
+								   std::promise<void> *writerClosed)
+{
+	const auto res = co_await pipe->put("ch", buffer, 1000);
+	result->set_value(res.hr == MF_HRESULT::RES_OK);
+
+	// Writer is the last one holding the link then, it goes away on the thread that resumed the put.
+	readerClosed.wait();
+	pipe.reset();
+	writerClosed->set_value();
+}
+
+/**
+ * @brief Tests that "mem://" link is destroyed by a coroutine resumed on its own notifier thread.
+ * @return true if successful, otherwise false.
+ */
+bool testBufferMemoryLastOwner()
+{
+	auto writePipe = std::make_unique<MFPipeImpl>();
+	auto readPipe = std::make_unique<MFPipeImpl>();
+
+	const std::string pipeName = "mem://testLastOwner";
+	std::shared_ptr<MF_BUFFER> buffer = std::make_shared<MF_BUFFER>();
+	buffer->flags = eMFBF_Buffer;
+	if (writePipe->PipeCreate(pipeName, "") != MF_HRESULT::RES_OK
+			|| writePipe->PipeOpen(pipeName, 1, "W") != MF_HRESULT::RES_OK
+			|| readPipe->PipeOpen(pipeName, 1, "R") != MF_HRESULT::RES_OK
+			|| writePipe->PipePut("ch", buffer, 100, "") != MF_HRESULT::RES_OK)
+	{
+		std::cerr << "Failed to open pipes" << std::endl;
+		return false;
+	}
+
+	// Read queue is full, so the put waits until the reader takes the first object.
+	std::promise<void> readerClosed;
+	std::promise<bool> writeRes;
+	std::promise<void> writerClosed;
+	auto writeFut = writeRes.get_future();
+	auto closeFut = writerClosed.get_future();
+	testBufferMemoryLastWrite(std::move(writePipe), buffer, readerClosed.get_future().share(), &writeRes,
+							  &writerClosed);
+
+	std::shared_ptr<MF_BASE_TYPE> out;
+	const bool isOk = readPipe->PipeGet("ch", out, 1000, "") == MF_HRESULT::RES_OK && writeFut.get();
+	readPipe.reset();
+	readerClosed.set_value();
+
+	return closeFut.wait_for(std::chrono::seconds(5)) == std::future_status::ready && isOk;
+}
+
 bool testPipeProcess(bool read)
 {
 	auto bool_to_str = [](bool res) {
@@ -822,6 +1956,108 @@ bool testPipeMultithreaded()
 		res = res && inRes;
 	}
 
+	{
+		bool inRes = testBufferSubscribe(testPipeName);
+		std::cout << "\ttestBufferSubscribe(): " << bool_to_str(inRes) << std::endl;
+		res = res && inRes;
+	}
+
+	{
+		bool inRes = testBufferCoroutine(testPipeName);
+		std::cout << "\ttestBufferCoroutine(): " << bool_to_str(inRes) << std::endl;
+		res = res && inRes;
+	}
+
+	{
+		bool inRes = testBufferCredit(testPipeName);
+		std::cout << "\ttestBufferCredit(): " << bool_to_str(inRes) << std::endl;
+		res = res && inRes;
+	}
+
+	{
+		bool inRes = testBufferCreditClose(testPipeName);
+		std::cout << "\ttestBufferCreditClose(): " << bool_to_str(inRes) << std::endl;
+		res = res && inRes;
+	}
+
+	{
+		bool inRes = testBufferTrace(testPipeName);
+		std::cout << "\ttestBufferTrace(): " << bool_to_str(inRes) << std::endl;
+		res = res && inRes;
+	}
+
+	{
+		bool inRes = testBufferLatency(testPipeName);
+		std::cout << "\ttestBufferLatency(): " << bool_to_str(inRes) << std::endl;
+		res = res && inRes;
+	}
+
+	{
+		bool inRes = testBufferZeroAlloc(testPipeName);
+		std::cout << "\ttestBufferZeroAlloc(): " << bool_to_str(inRes) << std::endl;
+		res = res && inRes;
+	}
+
+	{
+		bool inRes = testBufferWireVersions(testPipeName);
+		std::cout << "\ttestBufferWireVersions(): " << bool_to_str(inRes) << std::endl;
+		res = res && inRes;
+	}
+
+	{
+		bool inRes = testBufferChannelIds(testPipeName);
+		std::cout << "\ttestBufferChannelIds(): " << bool_to_str(inRes) << std::endl;
+		res = res && inRes;
+	}
+
+	{
+		bool inRes = testBufferCompression(testPipeName);
+		std::cout << "\ttestBufferCompression(): " << bool_to_str(inRes) << std::endl;
+		res = res && inRes;
+	}
+
+	{
+		bool inRes = testBufferConvert(testPipeName);
+		std::cout << "\ttestBufferConvert(): " << bool_to_str(inRes) << std::endl;
+		res = res && inRes;
+	}
+
+	{
+		bool inRes = testBufferPreview(testPipeName);
+		std::cout << "\ttestBufferPreview(): " << bool_to_str(inRes) << std::endl;
+		res = res && inRes;
+	}
+
+	{
+		bool inRes = testBufferVideoDelta(testPipeName);
+		std::cout << "\ttestBufferVideoDelta(): " << bool_to_str(inRes) << std::endl;
+		res = res && inRes;
+	}
+
+	{
+		bool inRes = testBufferJitter(testPipeName);
+		std::cout << "\ttestBufferJitter(): " << bool_to_str(inRes) << std::endl;
+		res = res && inRes;
+	}
+
+	{
+		bool inRes = testBufferMemory();
+		std::cout << "\ttestBufferMemory(): " << bool_to_str(inRes) << std::endl;
+		res = res && inRes;
+	}
+
+	{
+		bool inRes = testBufferMemoryLastOwner();
+		std::cout << "\ttestBufferMemoryLastOwner(): " << bool_to_str(inRes) << std::endl;
+		res = res && inRes;
+	}
+
+	{
+		bool inRes = testBufferPriority();
+		std::cout << "\ttestBufferPriority(): " << bool_to_str(inRes) << std::endl;
+		res = res && inRes;
+	}
+
 	return res;
 }
 
@@ -0,0 +1,242 @@
+#ifndef TCP_HPP
+#define TCP_HPP
+
+#include "tests/Pipe.hpp"
+
+static constexpr auto tcpAddr = "tcp://127.0.0.1:49170";
+
+/**
+ * @brief Tests that reader gets all buffers of writers which connect one after another.
+ * @param hints Hints of the writers.
+ * @return true if successful, otherwise false.
+ */
+bool testTcpWriters(const std::string &hints)
+{
+	static constexpr auto WRITERS = 2;
+	static constexpr auto COUNT = 16;
+
+	std::shared_ptr<MF_BUFFER> buffer = std::make_shared<MF_BUFFER>();
+	buffer->flags = eMFBF_Buffer;
+	for (auto i = 0; i < 1024 * 1024; ++i)
+		buffer->data.push_back(i);
+
+	MFPipeImpl readPipe;
+	if (readPipe.PipeOpen(tcpAddr, 32, "R") != MF_HRESULT::RES_OK)
+	{
+		std::cerr << "Failed to open TCP pipe on read" << std::endl;
+		return false;
+	}
+
+	auto writeFut = std::async([&]() {
+		for (auto w = 0; w < WRITERS; ++w)
+		{
+			MFPipeImpl writePipe;
+			if (writePipe.PipeCreate(tcpAddr, "") != MF_HRESULT::RES_OK
+				|| writePipe.PipeOpen(tcpAddr, 32, "W " + hints) != MF_HRESULT::RES_OK)
+				return false;
+
+			for (auto i = 0; i < COUNT; ++i)
+			{
+				auto numbered = std::make_shared<MF_BUFFER>(*buffer);
+				numbered->data[0] = static_cast<uint8_t>(w * COUNT + i);
+				if (writePipe.PipePut("", numbered, 1000, "") != MF_HRESULT::RES_OK)
+					return false;
+			}
+
+			if (writePipe.PipeClose() != MF_HRESULT::RES_OK)
+				return false;
+		}
+		return true;
+	});
+
+	for (auto i = 0; i < WRITERS * COUNT; ++i)
+	{
+		std::shared_ptr<MF_BASE_TYPE> out;
+		if (readPipe.PipeGet("", out, 2000, "") != MF_HRESULT::RES_OK)
+		{
+			std::cerr << "TCP read " << i << " failed" << std::endl;
+			return false;
+		}
+		const auto bp = dynamic_cast<MF_BUFFER *>(out.get());
+		if (bp->data.size() != buffer->data.size() || bp->data[0] != static_cast<uint8_t>(i))
+		{
+			std::cerr << "TCP read " << i << " failed: invalid data" << std::endl;
+			return false;
+		}
+	}
+
+	return writeFut.get();
+}
+
+/**
+ * @brief Tests that writer whose reader went away mid-object starts the stream over with the next reader:
+ *        objects after the first one it gets arrive whole and in order, none is skipped for stale wire state.
+ * @return true if successful, otherwise false.
+ */
+bool testTcpDropMidObject()
+{
+	static constexpr auto COUNT = 16;
+	static constexpr auto CHANNEL = "ch";
+
+	std::shared_ptr<MF_BUFFER> buffer = std::make_shared<MF_BUFFER>();
+	buffer->flags = eMFBF_Buffer;
+	for (auto i = 0; i < 1024 * 1024; ++i)
+		buffer->data.push_back(i);
+
+	auto isValid = [&](const std::shared_ptr<MF_BASE_TYPE> &object, int &number) {
+		const auto bp = dynamic_cast<MF_BUFFER *>(object.get());
+		if (bp == nullptr || bp->data.size() != buffer->data.size()
+			|| !std::equal(bp->data.begin() + 1, bp->data.end(), buffer->data.begin() + 1))
+			return false;
+		number = bp->data[0];
+		return true;
+	};
+
+	auto firstPipe = std::make_unique<MFPipeImpl>();
+	if (firstPipe->PipeOpen(tcpAddr, 1, "R sockbuf=64") != MF_HRESULT::RES_OK)
+	{
+		std::cerr << "Failed to open TCP pipe on read" << std::endl;
+		return false;
+	}
+
+	// Fixed v2, so channel IDs announced to the first reader would be stale for the second one.
+	MFPipeImpl writePipe;
+	if (writePipe.PipeCreate(tcpAddr, "") != MF_HRESULT::RES_OK
+		|| writePipe.PipeOpen(tcpAddr, COUNT, "W wire=2 sockbuf=64") != MF_HRESULT::RES_OK)
+	{
+		std::cerr << "Failed to open TCP pipe on write" << std::endl;
+		return false;
+	}
+
+	for (auto i = 0; i < COUNT; ++i)
+	{
+		auto numbered = std::make_shared<MF_BUFFER>(*buffer);
+		numbered->data[0] = static_cast<uint8_t>(i);
+		if (writePipe.PipePut(CHANNEL, numbered, 1000, "") != MF_HRESULT::RES_OK)
+		{
+			std::cerr << "TCP write " << i << " failed" << std::endl;
+			return false;
+		}
+	}
+
+	// First reader takes one object and goes away while writer is blocked in the middle of the next ones.
+	std::shared_ptr<MF_BASE_TYPE> out;
+	int number = -1;
+	if (firstPipe->PipeGet(CHANNEL, out, 2000, "") != MF_HRESULT::RES_OK || !isValid(out, number) || number != 0)
+	{
+		std::cerr << "TCP read of the first reader failed" << std::endl;
+		return false;
+	}
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	firstPipe.reset();
+
+	MFPipeImpl readPipe;
+	if (readPipe.PipeOpen(tcpAddr, COUNT, "R sockbuf=64") != MF_HRESULT::RES_OK)
+	{
+		std::cerr << "Failed to open TCP pipe on read again" << std::endl;
+		return false;
+	}
+
+	// Objects in the buffers of the lost connection are gone, the rest comes without gaps.
+	int last = -1;
+	while (last != COUNT - 1)
+	{
+		if (readPipe.PipeGet(CHANNEL, out, 3000, "") != MF_HRESULT::RES_OK)
+		{
+			std::cerr << "TCP read after " << last << " failed" << std::endl;
+			return false;
+		}
+		if (!isValid(out, number) || number <= 0 || (last != -1 && number != last + 1))
+		{
+			std::cerr << "TCP read after " << last << " failed: invalid data" << std::endl;
+			return false;
+		}
+		last = number;
+	}
+
+	return writePipe.PipeClose() == MF_HRESULT::RES_OK;
+}
+
+bool testTcp(bool read)
+{
+	auto bool_to_str = [](bool res) {
+		return res ? "OK" : "FAILED";
+	};
+
+	bool res = true;
+
+	{
+		bool inRes = testBuffer(tcpAddr, read);
+		std::cout << "\ttestTcpBuffer(): " << bool_to_str(inRes) << std::endl;
+		res = res && inRes;
+	}
+
+	{
+		bool inRes = testFrame(tcpAddr, read);
+		std::cout << "\ttestTcpFrame(): " << bool_to_str(inRes) << std::endl;
+		res = res && inRes;
+	}
+
+	{
+		bool inRes = testMessage(tcpAddr, read);
+		std::cout << "\ttestTcpMessage(): " << bool_to_str(inRes) << std::endl;
+		res = res && inRes;
+	}
+
+	{
+		bool inRes = testAll(tcpAddr, read);
+		std::cout << "\ttestTcpAll(): " << bool_to_str(inRes) << std::endl;
+		res = res && inRes;
+	}
+
+	return res;
+}
+
+bool testTcpMultithreaded()
+{
+	auto bool_to_str = [](bool res) {
+		return res ? "OK" : "FAILED";
+	};
+
+	bool res = true;
+
+	{
+		bool inRes = testBufferMultithreadedOwnThreads(tcpAddr);
+		std::cout << "\ttestTcpBufferMultithreadedOwnThreads(): " << bool_to_str(inRes) << std::endl;
+		res = res && inRes;
+	}
+
+	{
+		bool inRes = testBufferMultithreaded(tcpAddr);
+		std::cout << "\ttestTcpBufferMultithreaded(): " << bool_to_str(inRes) << std::endl;
+		res = res && inRes;
+	}
+
+	{
+		bool inRes = testBufferCredit(tcpAddr);
+		std::cout << "\ttestTcpBufferCredit(): " << bool_to_str(inRes) << std::endl;
+		res = res && inRes;
+	}
+
+	{
+		bool inRes = testTcpWriters("");
+		std::cout << "\ttestTcpSequentialWriters(): " << bool_to_str(inRes) << std::endl;
+		res = res && inRes;
+	}
+
+	{
+		bool inRes = testTcpDropMidObject();
+		std::cout << "\ttestTcpDropMidObject(): " << bool_to_str(inRes) << std::endl;
+		res = res && inRes;
+	}
+
+	{
+		bool inRes = testTcpWriters("zerocopy=on sockbuf=4096");
+		std::cout << "\ttestTcpZeroCopy(): " << bool_to_str(inRes) << std::endl;
+		res = res && inRes;
+	}
+
+	return res;
+}
+
+#endif // TCP_HPP
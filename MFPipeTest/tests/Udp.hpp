@@ -5,6 +5,299 @@
 
 static constexpr auto udpAddr = "udp://127.0.0.10:49152";
 
+/**
+ * @brief Tests that no buffer is lost when writer outpaces the reader socket.
+ * @param hints Hints of both ends turning loss recovery or pacing on.
+ * @return true if successful, otherwise false.
+ */
+bool testUdpLossless(const std::string &hints)
+{
+	std::shared_ptr<MF_BUFFER> buffer = std::make_shared<MF_BUFFER>();
+	buffer->flags = eMFBF_Buffer;
+	for (auto i = 0; i < 64 * 1024; ++i)
+		buffer->data.push_back(i);
+
+	// Reader goes first, datagrams sent before it is there can't be recovered.
+	MFPipeImpl readPipe;
+	MFPipeImpl writePipe;
+	if (readPipe.PipeOpen(udpAddr, 32, "R " + hints) != MF_HRESULT::RES_OK
+		|| writePipe.PipeCreate(udpAddr, "") != MF_HRESULT::RES_OK
+		|| writePipe.PipeOpen(udpAddr, 32, "W " + hints) != MF_HRESULT::RES_OK)
+	{
+		std::cerr << "Failed to open lossless pipe" << std::endl;
+		return false;
+	}
+
+	static constexpr auto COUNT = 512;
+	auto writeFut = std::async([&]() {
+		for (auto i = 0; i < COUNT; ++i)
+		{
+			auto numbered = std::make_shared<MF_BUFFER>(*buffer);
+			numbered->data[0] = static_cast<uint8_t>(i);
+			if (writePipe.PipePut("", numbered, 1000, "") != MF_HRESULT::RES_OK)
+				return false;
+		}
+		return true;
+	});
+
+	for (auto i = 0; i < COUNT; ++i)
+	{
+		std::shared_ptr<MF_BASE_TYPE> out;
+		if (readPipe.PipeGet("", out, 1000, "") != MF_HRESULT::RES_OK)
+		{
+			std::cerr << "Lossless read " << i << " failed" << std::endl;
+			return false;
+		}
+		const auto bp = dynamic_cast<MF_BUFFER *>(out.get());
+		if (bp->data.size() != buffer->data.size() || bp->data[0] != static_cast<uint8_t>(i))
+		{
+			std::cerr << "Lossless read " << i << " failed: invalid data" << std::endl;
+			return false;
+		}
+	}
+
+	return writeFut.get();
+}
+
+/**
+ * @brief Tests that reliable reader gets all buffers of a writer opened after the previous one closed.
+ * @return true if successful, otherwise false.
+ */
+bool testUdpReliableWriters()
+{
+	std::shared_ptr<MF_BUFFER> buffer = std::make_shared<MF_BUFFER>();
+	buffer->flags = eMFBF_Buffer;
+	for (auto i = 0; i < 16 * 1024; ++i)
+		buffer->data.push_back(i);
+
+	MFPipeImpl readPipe;
+	if (readPipe.PipeOpen(udpAddr, 32, "R reliable=500") != MF_HRESULT::RES_OK)
+	{
+		std::cerr << "Failed to open reliable pipe" << std::endl;
+		return false;
+	}
+
+	// Each writer numbers its datagrams from the start, reader must not take the second one's for duplicates.
+	static constexpr auto COUNT = 16;
+	for (auto w = 0; w < 2; ++w)
+	{
+		MFPipeImpl writePipe;
+		if (writePipe.PipeCreate(udpAddr, "") != MF_HRESULT::RES_OK
+			|| writePipe.PipeOpen(udpAddr, 32, "W reliable=500") != MF_HRESULT::RES_OK)
+		{
+			std::cerr << "Failed to open reliable writer " << w << std::endl;
+			return false;
+		}
+
+		for (auto i = 0; i < COUNT; ++i)
+		{
+			auto numbered = std::make_shared<MF_BUFFER>(*buffer);
+			numbered->data[0] = static_cast<uint8_t>(w * COUNT + i);
+			if (writePipe.PipePut("", numbered, 1000, "") != MF_HRESULT::RES_OK)
+				return false;
+
+			std::shared_ptr<MF_BASE_TYPE> out;
+			if (readPipe.PipeGet("", out, 1000, "") != MF_HRESULT::RES_OK)
+			{
+				std::cerr << "Reliable writer " << w << " read " << i << " failed" << std::endl;
+				return false;
+			}
+			const auto bp = dynamic_cast<MF_BUFFER *>(out.get());
+			if (bp->data.size() != buffer->data.size() || bp->data[0] != static_cast<uint8_t>(w * COUNT + i))
+			{
+				std::cerr << "Reliable writer " << w << " read " << i << " failed: invalid data" << std::endl;
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+/**
+ * @brief Tests that every reader of multicast group gets all buffers of one writer over loopback.
+ * @return true if successful, otherwise false.
+ */
+bool testUdpMulticast()
+{
+	static constexpr auto groupAddr = "udp://239.255.0.10:49153";
+	static constexpr auto hints = " iface=127.0.0.1 pace=200";
+
+	std::shared_ptr<MF_BUFFER> buffer = std::make_shared<MF_BUFFER>();
+	buffer->flags = eMFBF_Buffer;
+	for (auto i = 0; i < 16 * 1024; ++i)
+		buffer->data.push_back(i);
+
+	MFPipeImpl readPipes[2];
+	MFPipeImpl writePipe;
+	if (readPipes[0].PipeOpen(groupAddr, 32, std::string("R") + hints) != MF_HRESULT::RES_OK
+		|| readPipes[1].PipeOpen(groupAddr, 32, std::string("R") + hints) != MF_HRESULT::RES_OK
+		|| writePipe.PipeCreate(groupAddr, "") != MF_HRESULT::RES_OK
+		|| writePipe.PipeOpen(groupAddr, 32, std::string("W") + hints) != MF_HRESULT::RES_OK)
+	{
+		std::cerr << "Failed to open multicast pipe" << std::endl;
+		return false;
+	}
+
+	static constexpr auto COUNT = 32;
+	for (auto i = 0; i < COUNT; ++i)
+	{
+		auto numbered = std::make_shared<MF_BUFFER>(*buffer);
+		numbered->data[0] = static_cast<uint8_t>(i);
+		if (writePipe.PipePut("", numbered, 1000, "") != MF_HRESULT::RES_OK)
+			return false;
+	}
+
+	for (auto &readPipe : readPipes)
+	{
+		for (auto i = 0; i < COUNT; ++i)
+		{
+			std::shared_ptr<MF_BASE_TYPE> out;
+			if (readPipe.PipeGet("", out, 1000, "") != MF_HRESULT::RES_OK)
+			{
+				std::cerr << "Multicast read " << i << " failed" << std::endl;
+				return false;
+			}
+			const auto bp = dynamic_cast<MF_BUFFER *>(out.get());
+			if (bp->data.size() != buffer->data.size() || bp->data[0] != static_cast<uint8_t>(i))
+			{
+				std::cerr << "Multicast read " << i << " failed: invalid data" << std::endl;
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+/**
+ * @brief Tests that reader of several sockets gets buffers of every writer in order.
+ * @return true if successful, otherwise false.
+ */
+bool testUdpSockets()
+{
+	static constexpr auto WRITERS = 4;
+	static constexpr auto COUNT = 32;
+
+	std::shared_ptr<MF_BUFFER> buffer = std::make_shared<MF_BUFFER>();
+	buffer->flags = eMFBF_Buffer;
+	for (auto i = 0; i < 256 * 1024; ++i)
+		buffer->data.push_back(i);
+
+	MFPipeImpl readPipe;
+	MFPipeImpl writePipes[WRITERS];
+
+	// Reader opens a socket per core at most, each writer needs one of its own.
+	const auto writers = std::min<int>(WRITERS, std::max(1u, std::thread::hardware_concurrency()));
+	if (readPipe.PipeOpen(udpAddr, 4 * COUNT, "R sockets=4") != MF_HRESULT::RES_OK)
+	{
+		std::cerr << "Failed to open pipe of several sockets" << std::endl;
+		return false;
+	}
+
+	// Writers start one by one, so each finds a free socket, and then write at once.
+	std::vector<std::future<bool>> writeFuts;
+	for (auto w = 0; w < writers; ++w)
+	{
+		auto first = std::make_shared<MF_BUFFER>(*buffer);
+		first->data[0] = 0;
+		if (writePipes[w].PipeCreate(udpAddr, "") != MF_HRESULT::RES_OK
+			|| writePipes[w].PipeOpen(udpAddr, 32, "W pace=100") != MF_HRESULT::RES_OK
+			|| writePipes[w].PipePut("ch" + std::to_string(w), first, 1000, "") != MF_HRESULT::RES_OK)
+			return false;
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+		writeFuts.push_back(std::async([&, w]() {
+			for (auto i = 1; i < COUNT; ++i)
+			{
+				auto numbered = std::make_shared<MF_BUFFER>(*buffer);
+				numbered->data[0] = static_cast<uint8_t>(i);
+				if (writePipes[w].PipePut("ch" + std::to_string(w), numbered, 1000, "") != MF_HRESULT::RES_OK)
+					return false;
+			}
+			return true;
+		}));
+	}
+
+	for (auto w = 0; w < writers; ++w)
+	{
+		for (auto i = 0; i < COUNT; ++i)
+		{
+			std::shared_ptr<MF_BASE_TYPE> out;
+			if (readPipe.PipeGet("ch" + std::to_string(w), out, 1000, "") != MF_HRESULT::RES_OK)
+			{
+				std::cerr << "Read " << i << " of writer " << w << " failed" << std::endl;
+				return false;
+			}
+			const auto bp = dynamic_cast<MF_BUFFER *>(out.get());
+			if (bp->data.size() != buffer->data.size() || bp->data[0] != static_cast<uint8_t>(i))
+			{
+				std::cerr << "Read " << i << " of writer " << w << " failed: invalid data" << std::endl;
+				return false;
+			}
+		}
+	}
+
+	for (auto &writeFut : writeFuts)
+	{
+		if (!writeFut.get())
+			return false;
+	}
+
+	return true;
+}
+
+/**
+ * @brief Tests that the only writer of a reader of several sockets is granted all free slots of its queue.
+ * @return true if successful, otherwise false.
+ */
+bool testUdpSocketsCredit()
+{
+	static constexpr auto COUNT = 8;
+
+	std::shared_ptr<MF_BUFFER> buffer = std::make_shared<MF_BUFFER>();
+	buffer->flags = eMFBF_Buffer;
+	buffer->data.resize(16 * 1024);
+
+	MFPipeImpl readPipe;
+	MFPipeImpl writePipe;
+	if (readPipe.PipeOpen(udpAddr, COUNT, "R sockets=4") != MF_HRESULT::RES_OK
+		|| writePipe.PipeCreate(udpAddr, "") != MF_HRESULT::RES_OK
+		|| writePipe.PipeOpen(udpAddr, 32, "W credit=drop") != MF_HRESULT::RES_OK)
+	{
+		std::cerr << "Failed to open pipe of several sockets" << std::endl;
+		return false;
+	}
+
+	// First object takes a socket, its reader then advertises the slots other readers have no writer for.
+	std::shared_ptr<MF_BASE_TYPE> out;
+	if (writePipe.PipePut("", buffer, 1000, "") != MF_HRESULT::RES_OK
+		|| readPipe.PipeGet("", out, 1000, "") != MF_HRESULT::RES_OK)
+		return false;
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+	for (auto i = 0; i < COUNT; ++i)
+	{
+		if (writePipe.PipePut("", buffer, 1000, "") != MF_HRESULT::RES_OK)
+			return false;
+	}
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+	int received = 0;
+	while (readPipe.PipeGet("", out, 100, "") == MF_HRESULT::RES_OK)
+		received++;
+
+	MFPipe::MF_PIPE_INFO info;
+	writePipe.PipeInfoGet(nullptr, "", &info);
+	if (received != COUNT || info.nObjectsDropped != 0)
+	{
+		std::cerr << "Received " << received << ", dropped " << info.nObjectsDropped << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
 bool testUdp(bool read)
 {
 	auto bool_to_str = [](bool res) {
@@ -60,6 +353,48 @@ bool testUdpMultithreaded()
 		res = res && inRes;
 	}
 
+	{
+		bool inRes = testUdpLossless("reliable=500");
+		std::cout << "\ttestUdpReliable(): " << bool_to_str(inRes) << std::endl;
+		res = res && inRes;
+	}
+
+	{
+		bool inRes = testUdpLossless("reliable=500 fec=8");
+		std::cout << "\ttestUdpReliableParity(): " << bool_to_str(inRes) << std::endl;
+		res = res && inRes;
+	}
+
+	{
+		bool inRes = testUdpReliableWriters();
+		std::cout << "\ttestUdpReliableWriters(): " << bool_to_str(inRes) << std::endl;
+		res = res && inRes;
+	}
+
+	{
+		bool inRes = testUdpLossless("pace=400");
+		std::cout << "\ttestUdpPacing(): " << bool_to_str(inRes) << std::endl;
+		res = res && inRes;
+	}
+
+	{
+		bool inRes = testUdpMulticast();
+		std::cout << "\ttestUdpMulticast(): " << bool_to_str(inRes) << std::endl;
+		res = res && inRes;
+	}
+
+	{
+		bool inRes = testUdpSockets();
+		std::cout << "\ttestUdpSockets(): " << bool_to_str(inRes) << std::endl;
+		res = res && inRes;
+	}
+
+	{
+		bool inRes = testUdpSocketsCredit();
+		std::cout << "\ttestUdpSocketsCredit(): " << bool_to_str(inRes) << std::endl;
+		res = res && inRes;
+	}
+
 	return res;
 }
 
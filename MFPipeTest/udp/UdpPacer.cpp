@@ -0,0 +1,46 @@
+#include "UdpPacer.hpp"
+
+#include <algorithm>
+#include <thread>
+
+static constexpr auto BURST = std::chrono::milliseconds(2);
+// Bucket holds at least two datagrams of max size, whatever the rate.
+static constexpr uint64_t MIN_BURST_BYTES = 2 * 65507;
+// Shorter waits spin, sleeps overshoot them.
+static constexpr auto MIN_SLEEP = std::chrono::microseconds(100);
+
+UdpPacer::UdpPacer()
+	: rate(0)
+{}
+
+void UdpPacer::setRate(uint64_t bytesPerSecond)
+{
+	rate = bytesPerSecond;
+}
+
+uint64_t UdpPacer::getRate() const
+{
+	return rate;
+}
+
+void UdpPacer::wait(size_t size)
+{
+	const uint64_t bytesPerSecond = rate;
+	if (bytesPerSecond == 0)
+		return;
+
+	const auto now = Clock::now();
+	const auto burst = std::max<Clock::duration>(BURST,
+			std::chrono::nanoseconds(MIN_BURST_BYTES * 1000000000 / bytesPerSecond));
+	emptyTime = std::max(emptyTime, now) + std::chrono::nanoseconds(size * 1000000000 / bytesPerSecond);
+
+	// Sending goes on while less than burst of it is outstanding.
+	const auto sendTime = emptyTime - burst;
+	if (sendTime <= now)
+		return;
+
+	if (sendTime - now > MIN_SLEEP)
+		std::this_thread::sleep_until(sendTime - MIN_SLEEP / 2);
+	while (Clock::now() < sendTime)
+		std::this_thread::yield();
+}
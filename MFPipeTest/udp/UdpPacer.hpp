@@ -0,0 +1,37 @@
+#ifndef UDPPACER_HPP
+#define UDPPACER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+/**
+ * @brief Token bucket spreading datagrams of UDP writer at the set rate, so a large object doesn't leave as
+ *        one burst that overflows switch buffers and socket buffer of reader. Bucket holds a couple of
+ *        milliseconds of sending, so steady traffic under the rate isn't delayed.
+ */
+class UdpPacer
+{
+public:
+	UdpPacer();
+
+	/**
+	 * @brief Sets rate in bytes per second, 0 turns pacing off. May be called while writing.
+	 */
+	void setRate(uint64_t bytesPerSecond);
+	uint64_t getRate() const;
+
+	/**
+	 * @brief Waits until size bytes may be sent. Called by the writing thread only.
+	 */
+	void wait(size_t size);
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	std::atomic<uint64_t> rate;
+	// Time sending so far is done at the rate, each datagram moves it forward.
+	Clock::time_point emptyTime;
+};
+
+#endif // UDPPACER_HPP
@@ -0,0 +1,495 @@
+#include "UdpReliable.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <iostream>
+#include <random>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define UDP_RELIABLE_SSE2
+#include <emmintrin.h>
+#endif
+
+// Datagrams sender keeps for retransmission and receiver keeps for reordering.
+static constexpr size_t WINDOW_SLOTS = 1024;
+// Sequences asked for in one NACK datagram.
+static constexpr size_t MAX_NACKS = 256;
+static constexpr auto NACK_INTERVAL = std::chrono::milliseconds(5);
+static constexpr auto STATUS_INTERVAL = std::chrono::milliseconds(10);
+// Groups receiver keeps XOR of, parity comes right after its group.
+static constexpr size_t PARITY_GROUPS = 16;
+
+static void putU32(uint8_t *ptr, uint32_t value)
+{
+	for (auto i = 0; i < 4; ++i)
+		ptr[i] = static_cast<uint8_t>(value >> (8 * i));
+}
+
+static uint32_t getU32(const uint8_t *ptr)
+{
+	return ptr[0] | (ptr[1] << 8) | (ptr[2] << 16) | (static_cast<uint32_t>(ptr[3]) << 24);
+}
+
+/**
+ * @brief XORs size bytes of src into dst.
+ */
+static void xorInto(uint8_t *dst, const uint8_t *src, size_t size)
+{
+	size_t i = 0;
+#ifdef UDP_RELIABLE_SSE2
+	for (; i + 64 <= size; i += 64)
+	{
+		auto *out = reinterpret_cast<__m128i *>(dst + i);
+		const auto *in = reinterpret_cast<const __m128i *>(src + i);
+		const auto a = _mm_xor_si128(_mm_loadu_si128(out), _mm_loadu_si128(in));
+		const auto b = _mm_xor_si128(_mm_loadu_si128(out + 1), _mm_loadu_si128(in + 1));
+		const auto c = _mm_xor_si128(_mm_loadu_si128(out + 2), _mm_loadu_si128(in + 2));
+		const auto d = _mm_xor_si128(_mm_loadu_si128(out + 3), _mm_loadu_si128(in + 3));
+		_mm_storeu_si128(out, a);
+		_mm_storeu_si128(out + 1, b);
+		_mm_storeu_si128(out + 2, c);
+		_mm_storeu_si128(out + 3, d);
+	}
+#endif
+	for (; i + 8 <= size; i += 8)
+	{
+		uint64_t a;
+		uint64_t b;
+		memcpy(&a, dst + i, 8);
+		memcpy(&b, src + i, 8);
+		a ^= b;
+		memcpy(dst + i, &a, 8);
+	}
+	for (; i < size; ++i)
+		dst[i] ^= src[i];
+}
+
+/**
+ * @brief Distance from b to a, negative if a is before b. Survives wrap of sequences.
+ */
+static int32_t distance(uint32_t a, uint32_t b)
+{
+	return static_cast<int32_t>(a - b);
+}
+
+UdpReliable::UdpReliable(int deadlineMs, Send send)
+	: deadline(std::chrono::milliseconds(deadlineMs > 0 ? deadlineMs : DEFAULT_DEADLINE_MS)),
+	  sendDatagram(std::move(send)),
+	  parityGroup(0),
+	  isRetransmit(true),
+	  stream(std::random_device()()),
+	  nextSeq(0),
+	  sent(WINDOW_SLOTS),
+	  sentParity(0),
+	  isStarted(false),
+	  receivedStream(0),
+	  expectedSeq(0),
+	  knownSeq(0),
+	  received(WINDOW_SLOTS),
+	  isGap(false),
+	  gapSeq(0),
+	  abandoned(0),
+	  recovered(0)
+{}
+
+void UdpReliable::setParity(size_t groupSize)
+{
+	parityGroup = groupSize;
+	receivedGroups.resize(groupSize != 0 ? PARITY_GROUPS : 0);
+}
+
+void UdpReliable::setRetransmit(bool isRetransmit)
+{
+	this->isRetransmit = isRetransmit;
+}
+
+size_t UdpReliable::send(const uint8_t *data, size_t size, size_t maxDatagram)
+{
+	// PARITY of the largest DATA has to fit a datagram too.
+	const size_t payload = std::min(size, maxDatagram - (parityGroup != 0 ? PARITY_HEADER_SIZE : HEADER_SIZE));
+	const auto now = Clock::now();
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	if (isRetransmit)
+	{
+		auto &entry = slot(sent, nextSeq);
+		entry.seq = nextSeq;
+		entry.isFull = true;
+		entry.time = now;
+		entry.data.resize(HEADER_SIZE + payload);
+		entry.data[0] = static_cast<uint8_t>(Kind::DATA);
+		putU32(entry.data.data() + 1, stream);
+		putU32(entry.data.data() + 5, nextSeq);
+		memcpy(entry.data.data() + HEADER_SIZE, data, payload);
+		sendDatagram(entry.data.data(), entry.data.size());
+	}
+	else
+	{
+		sentPacket.resize(HEADER_SIZE + payload);
+		sentPacket[0] = static_cast<uint8_t>(Kind::DATA);
+		putU32(sentPacket.data() + 1, stream);
+		putU32(sentPacket.data() + 5, nextSeq);
+		memcpy(sentPacket.data() + HEADER_SIZE, data, payload);
+		sendDatagram(sentPacket.data(), sentPacket.size());
+	}
+
+	if (parityGroup != 0)
+	{
+		if (nextSeq % parityGroup == 0)
+		{
+			resetGroup(sentGroup, nextSeq);
+			sentParity = 0;
+		}
+		addToGroup(sentGroup, nextSeq, data, payload);
+	}
+
+	nextSeq++;
+	lastSendTime = now;
+	if (parityGroup != 0 && nextSeq % parityGroup == 0)
+		sendParity(now);
+	return payload;
+}
+
+size_t UdpReliable::onFeedback(uint8_t *datagram, size_t size)
+{
+	if (size == 0)
+		return 0;
+
+	const auto kind = static_cast<Kind>(datagram[0]);
+	if (kind == Kind::FEEDBACK)
+	{
+		memmove(datagram, datagram + 1, size - 1);
+		return size - 1;
+	}
+
+	// NACKs of a stream before this one come from receiver that hasn't seen it yet.
+	if (kind != Kind::NACK || size < 7 || getU32(datagram + 1) != stream)
+		return 0;
+
+	const size_t count = std::min<size_t>(datagram[5] | (datagram[6] << 8), (size - 7) / 4);
+	const auto now = Clock::now();
+
+	std::lock_guard<std::mutex> lock(mutex);
+	for (size_t i = 0; i < count; ++i)
+	{
+		const uint32_t seq = getU32(datagram + 7 + 4 * i);
+		const auto &entry = slot(sent, seq);
+		// Overwritten or too old datagrams are gone, receiver gives them up on its own.
+		if (entry.isFull && entry.seq == seq && now - entry.time <= deadline)
+			sendDatagram(entry.data.data(), entry.data.size());
+	}
+
+	return 0;
+}
+
+void UdpReliable::tick()
+{
+	const auto now = Clock::now();
+
+	std::lock_guard<std::mutex> lock(mutex);
+	if (nextSeq == 0 || now - lastSendTime > deadline || now - lastStatusTime < STATUS_INTERVAL)
+		return;
+
+	// Last datagrams before a pause get their parity early, rest of the group goes with a full one later.
+	const size_t members = std::popcount(sentGroup.members);
+	if (parityGroup != 0 && sentParity < members && now - lastSendTime >= STATUS_INTERVAL)
+		sendParity(now);
+
+	uint8_t status[HEADER_SIZE];
+	status[0] = static_cast<uint8_t>(Kind::STATUS);
+	putU32(status + 1, stream);
+	putU32(status + 5, nextSeq);
+	lastStatusTime = now;
+	sendDatagram(status, sizeof(status));
+}
+
+size_t UdpReliable::receive(uint8_t *datagram, size_t size)
+{
+	if (size < HEADER_SIZE)
+		return 0;
+
+	const auto kind = static_cast<Kind>(datagram[0]);
+	const uint32_t sender = getU32(datagram + 1);
+	const uint32_t seq = getU32(datagram + 5);
+
+	// Another sender took the socket, its stream starts with its first DATA as with the first sender.
+	if (isStarted && sender != receivedStream)
+	{
+		if (kind != Kind::DATA)
+			return 0;
+		restart();
+	}
+
+	if (kind == Kind::STATUS)
+	{
+		if (isStarted && distance(seq, knownSeq) > 0)
+			knownSeq = seq;
+		return 0;
+	}
+
+	if (kind == Kind::PARITY)
+	{
+		if (isStarted && parityGroup != 0)
+			rebuild(datagram, size);
+		return 0;
+	}
+
+	if (kind != Kind::DATA)
+		return 0;
+
+	if (!isStarted)
+	{
+		// Stream starts with whatever comes first, earlier datagrams were sent before the reader was there.
+		isStarted = true;
+		receivedStream = sender;
+		expectedSeq = seq;
+		knownSeq = seq;
+	}
+
+	const auto ahead = distance(seq, expectedSeq);
+	if (ahead < 0)
+		return 0; // Duplicate or given up already.
+
+	if (distance(seq + 1, knownSeq) > 0)
+		knownSeq = seq + 1;
+
+	const size_t payload = size - HEADER_SIZE;
+	if (parityGroup != 0)
+	{
+		if (auto entry = group(seq))
+			addToGroup(*entry, seq, datagram + HEADER_SIZE, payload);
+	}
+	if (ahead == 0)
+	{
+		memmove(datagram, datagram + HEADER_SIZE, payload);
+		expectedSeq++;
+		return payload;
+	}
+
+	if (static_cast<size_t>(ahead) >= WINDOW_SLOTS)
+	{
+		// Gap fell out of the window, sender can't have it any more.
+		abandonGap();
+		if (static_cast<size_t>(distance(seq, expectedSeq)) >= WINDOW_SLOTS)
+			return 0;
+	}
+
+	auto &entry = slot(received, seq);
+	entry.seq = seq;
+	entry.isFull = true;
+	entry.data.assign(datagram + HEADER_SIZE, datagram + size);
+	return 0;
+}
+
+size_t UdpReliable::next(uint8_t *buf, size_t size)
+{
+	while (expectedSeq != knownSeq)
+	{
+		auto &entry = slot(received, expectedSeq);
+		if (entry.isFull && entry.seq == expectedSeq)
+		{
+			const size_t payload = std::min(size, entry.data.size());
+			memcpy(buf, entry.data.data(), payload);
+			entry.isFull = false;
+			expectedSeq++;
+			return payload;
+		}
+
+		const auto now = Clock::now();
+		if (!isGap || gapSeq != expectedSeq)
+		{
+			isGap = true;
+			gapSeq = expectedSeq;
+			gapTime = now;
+			lastNackTime = {};
+		}
+
+		if (now - gapTime <= deadline)
+		{
+			if (isRetransmit && now - lastNackTime >= NACK_INTERVAL)
+				sendNacks(now);
+			return 0;
+		}
+
+		abandonGap();
+	}
+
+	return 0;
+}
+
+void UdpReliable::sendFeedback(const uint8_t *data, size_t size)
+{
+	feedback.resize(size + 1);
+	feedback[0] = static_cast<uint8_t>(Kind::FEEDBACK);
+	memcpy(feedback.data() + 1, data, size);
+	sendDatagram(feedback.data(), feedback.size());
+}
+
+uint64_t UdpReliable::getAbandoned() const
+{
+	return abandoned;
+}
+
+uint64_t UdpReliable::getRecovered() const
+{
+	return recovered;
+}
+
+UdpReliable::Slot &UdpReliable::slot(std::vector<Slot> &slots, uint32_t seq)
+{
+	return slots[seq % slots.size()];
+}
+
+/**
+ * @brief Received group of the sequence, reset when the group is new. nullptr if the group is gone already.
+ */
+UdpReliable::Group *UdpReliable::group(uint32_t seq)
+{
+	const uint32_t first = seq - seq % parityGroup;
+	auto &res = receivedGroups[first / parityGroup % receivedGroups.size()];
+	if (distance(first, res.first) < 0)
+		return nullptr;
+	if (res.first != first)
+		resetGroup(res, first);
+	return &res;
+}
+
+void UdpReliable::addToGroup(Group &group, uint32_t seq, const uint8_t *data, size_t size)
+{
+	const uint64_t bit = uint64_t(1) << (seq - group.first);
+	if ((group.members & bit) != 0)
+		return; // Retransmitted.
+
+	if (group.data.size() < size)
+		group.data.resize(size);
+	xorInto(group.data.data(), data, size);
+	group.members |= bit;
+	group.sizes ^= static_cast<uint16_t>(size);
+	group.size = std::max(group.size, size);
+}
+
+void UdpReliable::resetGroup(Group &group, uint32_t first)
+{
+	std::fill_n(group.data.begin(), group.size, 0);
+	group.first = first;
+	group.members = 0;
+	group.sizes = 0;
+	group.size = 0;
+}
+
+void UdpReliable::sendParity(Clock::time_point now)
+{
+	sentParity = std::popcount(sentGroup.members);
+
+	sentPacket.resize(PARITY_HEADER_SIZE + sentGroup.size);
+	sentPacket[0] = static_cast<uint8_t>(Kind::PARITY);
+	putU32(sentPacket.data() + 1, stream);
+	putU32(sentPacket.data() + 5, sentGroup.first);
+	sentPacket[9] = static_cast<uint8_t>(sentParity);
+	sentPacket[10] = static_cast<uint8_t>(sentGroup.sizes);
+	sentPacket[11] = static_cast<uint8_t>(sentGroup.sizes >> 8);
+	memcpy(sentPacket.data() + PARITY_HEADER_SIZE, sentGroup.data.data(), sentGroup.size);
+
+	lastStatusTime = now;
+	sendDatagram(sentPacket.data(), sentPacket.size());
+}
+
+/**
+ * @brief Rebuilds DATA datagram from PARITY of its group if it is the only one of the group missing.
+ */
+void UdpReliable::rebuild(const uint8_t *datagram, size_t size)
+{
+	if (size < PARITY_HEADER_SIZE)
+		return;
+
+	const uint32_t first = getU32(datagram + 5);
+	const size_t count = datagram[9];
+	if (first % parityGroup != 0 || count == 0 || count > parityGroup)
+		return;
+
+	// Parity sent in a pause covers the start of the group, datagrams after it can't be taken out of it.
+	const auto entry = group(first);
+	if (entry == nullptr)
+		return;
+
+	const uint64_t covered = count == 64 ? ~uint64_t(0) : (uint64_t(1) << count) - 1;
+	const uint64_t missing = covered & ~entry->members;
+	if ((entry->members & ~covered) != 0 || std::popcount(missing) != 1)
+		return;
+
+	const uint32_t seq = first + std::countr_zero(missing);
+	const size_t payload = (datagram[10] | (datagram[11] << 8)) ^ entry->sizes;
+	const auto ahead = distance(seq, expectedSeq);
+	if (ahead < 0 || static_cast<size_t>(ahead) >= WINDOW_SLOTS || payload > size - PARITY_HEADER_SIZE)
+		return;
+
+	auto &target = slot(received, seq);
+	target.seq = seq;
+	target.isFull = true;
+	target.data.assign(datagram + PARITY_HEADER_SIZE, datagram + PARITY_HEADER_SIZE + payload);
+	xorInto(target.data.data(), entry->data.data(), std::min(payload, entry->size));
+
+	entry->members |= missing;
+	if (distance(seq + 1, knownSeq) > 0)
+		knownSeq = seq + 1;
+	recovered++;
+}
+
+void UdpReliable::sendNacks(Clock::time_point now)
+{
+	packet.resize(7 + 4 * MAX_NACKS);
+	packet[0] = static_cast<uint8_t>(Kind::NACK);
+	putU32(packet.data() + 1, receivedStream);
+
+	size_t count = 0;
+	for (uint32_t seq = expectedSeq; seq != knownSeq && count < MAX_NACKS; ++seq)
+	{
+		const auto &entry = slot(received, seq);
+		if (!entry.isFull || entry.seq != seq)
+			putU32(packet.data() + 7 + 4 * count++, seq);
+	}
+
+	packet[5] = static_cast<uint8_t>(count);
+	packet[6] = static_cast<uint8_t>(count >> 8);
+	lastNackTime = now;
+	sendDatagram(packet.data(), 7 + 4 * count);
+}
+
+/**
+ * @brief Skips missing datagrams up to the next one received, parser of the stream resyncs after them.
+ */
+void UdpReliable::abandonGap()
+{
+	const auto start = expectedSeq;
+	while (expectedSeq != knownSeq)
+	{
+		const auto &entry = slot(received, expectedSeq);
+		if (entry.isFull && entry.seq == expectedSeq)
+			break;
+		expectedSeq++;
+	}
+
+	isGap = false;
+	if (expectedSeq == start)
+		return;
+
+	abandoned += expectedSeq - start;
+	std::cerr << "Gave up " << expectedSeq - start << " lost datagrams" << std::endl;
+}
+
+/**
+ * @brief Drops what receiver kept of the previous stream, the next DATA starts the new one.
+ */
+void UdpReliable::restart()
+{
+	std::cerr << "Reliable stream of another writer started" << std::endl;
+
+	isStarted = false;
+	for (auto &entry : received)
+		entry.isFull = false;
+	for (auto &entry : receivedGroups)
+		resetGroup(entry, 0);
+	isGap = false;
+}
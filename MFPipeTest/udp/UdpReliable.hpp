@@ -0,0 +1,181 @@
+#ifndef UDPRELIABLE_HPP
+#define UDPRELIABLE_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+/**
+ * @brief Reliable mode of UDP pipes. Sender numbers datagrams and keeps the recent ones, receiver puts them
+ *        back in order and asks for missing ones with NACKs. Datagrams older than the deadline are given up
+ *        on both sides, so a loss costs the stream at most the deadline instead of blocking it.
+ *        With parity on, sender follows each group of DATA datagrams with their XOR, so receiver rebuilds
+ *        one lost datagram per group without a round trip. Links without a way back turn retransmission off.
+ *        Sockets stay with IoUdp, datagrams go out through the send callback.
+ *
+ *        Sender numbers its stream at random, so receiver starts over when another sender takes the socket
+ *        instead of taking its sequences for old ones.
+ *
+ *        Each datagram starts with its kind:
+ *            DATA     - u32 stream, u32 sequence, payload.
+ *            STATUS   - u32 stream, u32 sequence of the next DATA, so receiver learns about lost tail datagrams.
+ *            NACK     - u32 stream, u16 count, u32 sequences receiver asks for again.
+ *            FEEDBACK - payload of reader feedback records.
+ *            PARITY   - u32 stream, u32 sequence of the first DATA of the group, u8 count of DATA covered,
+ *                       u16 XOR of their payload sizes, XOR of their payloads.
+ */
+class UdpReliable
+{
+public:
+	enum class Kind : uint8_t
+	{
+		DATA = 0x01,
+		STATUS,
+		NACK,
+		FEEDBACK,
+		PARITY,
+	};
+
+	static constexpr size_t HEADER_SIZE = 9;
+	static constexpr size_t PARITY_HEADER_SIZE = 12;
+	static constexpr int DEFAULT_DEADLINE_MS = 100;
+	static constexpr size_t MAX_PARITY_GROUP = 64;
+
+	typedef std::function<void(const uint8_t *data, size_t size)> Send;
+
+	/**
+	 * @param deadlineMs Age after which datagrams are given up, DEFAULT_DEADLINE_MS if not positive.
+	 */
+	UdpReliable(int deadlineMs, Send send);
+
+	/**
+	 * @brief Sends PARITY after every groupSize DATA datagrams, 2 to MAX_PARITY_GROUP, 0 turns it off.
+	 *        Both ends need the same size.
+	 */
+	void setParity(size_t groupSize);
+
+	/**
+	 * @brief Turns NACKs and retransmission on or off, they are on by default.
+	 */
+	void setRetransmit(bool isRetransmit);
+
+	/**
+	 * @brief Sender: sends the start of data as the next DATA datagram of at most maxDatagram bytes.
+	 * @return bytes of data sent.
+	 */
+	size_t send(const uint8_t *data, size_t size, size_t maxDatagram);
+
+	/**
+	 * @brief Sender: handles datagram that came from receiver, retransmits what it asks for.
+	 * @return size of FEEDBACK payload moved to the front of datagram, 0 for other kinds.
+	 */
+	size_t onFeedback(uint8_t *datagram, size_t size);
+
+	/**
+	 * @brief Sender: sends STATUS while the last datagram can still be asked for and PARITY of the group
+	 *        sent so far when stream pauses. Called periodically.
+	 */
+	void tick();
+
+	/**
+	 * @brief Receiver: handles datagram that came from sender.
+	 * @return size of payload moved to the front of datagram if it is the next one in order, 0 otherwise.
+	 */
+	size_t receive(uint8_t *datagram, size_t size);
+
+	/**
+	 * @brief Receiver: copies payload of the next buffered datagram in order into buf.
+	 *        Asks for missing datagrams again and gives them up after the deadline.
+	 * @return payload size, 0 if the next datagram hasn't arrived.
+	 */
+	size_t next(uint8_t *buf, size_t size);
+
+	/**
+	 * @brief Receiver: sends feedback records as FEEDBACK datagram.
+	 */
+	void sendFeedback(const uint8_t *data, size_t size);
+
+	/**
+	 * @brief Receiver: datagrams given up so far.
+	 */
+	uint64_t getAbandoned() const;
+
+	/**
+	 * @brief Receiver: datagrams rebuilt from parity so far.
+	 */
+	uint64_t getRecovered() const;
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	struct Slot
+	{
+		uint32_t seq = 0;
+		bool isFull = false;
+		Clock::time_point time;
+		std::vector<uint8_t> data;
+	};
+
+	/**
+	 * @brief XOR of payloads of a group, which of its datagrams it has and XOR of their sizes.
+	 */
+	struct Group
+	{
+		uint32_t first = 0;
+		uint64_t members = 0;
+		uint16_t sizes = 0;
+		size_t size = 0;
+		std::vector<uint8_t> data;
+	};
+
+	Slot &slot(std::vector<Slot> &slots, uint32_t seq);
+	Group *group(uint32_t seq);
+	void addToGroup(Group &group, uint32_t seq, const uint8_t *data, size_t size);
+	void resetGroup(Group &group, uint32_t first);
+	void sendParity(Clock::time_point now);
+	void rebuild(const uint8_t *datagram, size_t size);
+	void noteSeen(uint32_t seq);
+	void sendNacks(Clock::time_point now);
+	void abandonGap();
+	void restart();
+
+	const Clock::duration deadline;
+	Send sendDatagram;
+	size_t parityGroup;
+	bool isRetransmit;
+
+	// Sender state, shared by writer and service threads.
+	std::mutex mutex;
+	const uint32_t stream;
+	uint32_t nextSeq;
+	std::vector<Slot> sent;
+	Clock::time_point lastSendTime;
+	Clock::time_point lastStatusTime;
+	Group sentGroup;
+	// DATA datagrams of sentGroup covered by PARITY sent so far.
+	size_t sentParity;
+	// DATA not kept for retransmission and PARITY are built here.
+	std::vector<uint8_t> sentPacket;
+
+	// Receiver state, used by reader thread only.
+	bool isStarted;
+	uint32_t receivedStream;
+	uint32_t expectedSeq;
+	// Highest sequence known to be sent + 1.
+	uint32_t knownSeq;
+	std::vector<Slot> received;
+	std::vector<Group> receivedGroups;
+	std::vector<uint8_t> packet;
+	std::vector<uint8_t> feedback;
+	// Missing datagram the gap timer runs for.
+	bool isGap;
+	uint32_t gapSeq;
+	Clock::time_point gapTime;
+	Clock::time_point lastNackTime;
+	uint64_t abandoned;
+	uint64_t recovered;
+};
+
+#endif // UDPRELIABLE_HPP
@@ -1,16 +1,34 @@
 #include "UnixIoUdp.hpp"
 
+#include <algorithm>
+#include <cerrno>
 #include <chrono>
 #include <iostream>
 #include <thread>
 #include "memory.h"
+#include "poll.h"
 #include "unistd.h"
 
 static constexpr size_t MAX_MES_SIZE = 65507; // Max UDP message size.
+static constexpr int SERVICE_POLL_MS = 5;
+// Feedback datagrams kept for writer, oldest ones go first.
+static constexpr size_t MAX_FEEDBACK = 64;
+static constexpr size_t DEFAULT_BUFFER_SIZE = 10 * 1024 * 1024;
+// Silence of writer after which socket sharing the address takes another one.
+static constexpr auto PEER_IDLE = std::chrono::seconds(2);
 
 IoUdp::IoUdp()
 	: fd(-1),
-	  addrinfo(nullptr)
+	  addrinfo(nullptr),
+	  peerLen(0),
+	  reliableDeadlineMs(-1),
+	  parityGroup(0),
+	  isServing(false),
+	  isReusePort(false),
+	  isConnected(false),
+	  bufferSize(DEFAULT_BUFFER_SIZE),
+	  multicastTtl(1),
+	  isMulticastLoop(true)
 {}
 
 IoUdp::~IoUdp()
@@ -50,7 +68,7 @@ bool IoUdp::create(const std::string &id)
 		return false;
 	}
 
-	int32_t bufSize = 10 * 1024 * 1024;
+	const int32_t bufSize = static_cast<int32_t>(std::min<size_t>(bufferSize, INT32_MAX));
 	res = setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &bufSize, sizeof(bufSize));
 	if (res != 0)
 	{
@@ -81,8 +99,27 @@ bool IoUdp::open(const std::string &id, Mode mode, int32_t timeoutMs)
 		{
 			if (create(id))
 			{
-				if (bind(fd, addrinfo->ai_addr, addrinfo->ai_addrlen) == 0)
+				// Readers of a group share its port, binding the group address keeps other traffic out.
+				const int32_t reuse = 1;
+				if (isMulticast())
+					setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+#ifdef SO_REUSEPORT
+				if (isReusePort)
+					setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse));
+#endif
+
+				if (bind(fd, addrinfo->ai_addr, addrinfo->ai_addrlen) == 0 && (!isMulticast() || joinGroup()))
+				{
+					// Reader sends NACKs and feedback to the sender it heard from last.
+					reliable = makeReliable(
+							[this](const uint8_t *data, size_t size)
+							{
+								if (peerLen != 0)
+									sendto(fd, data, size, MSG_DONTWAIT, reinterpret_cast<const sockaddr *>(&peer),
+											peerLen);
+							});
 					return true;
+				}
 				freeaddrinfo(addrinfo);
 				::close(fd);
 			}
@@ -91,6 +128,22 @@ bool IoUdp::open(const std::string &id, Mode mode, int32_t timeoutMs)
 	}
 	else if (mode == Mode::WRITE)
 	{
+		if (fd != -1 && isMulticast() && !setSendGroup())
+			return false;
+
+		if (!reliable && fd != -1)
+		{
+			reliable = makeReliable(
+					[this](const uint8_t *data, size_t size)
+					{
+						sendto(fd, data, size, MSG_CONFIRM, addrinfo->ai_addr, addrinfo->ai_addrlen);
+					});
+		}
+		if (reliable && !service)
+		{
+			isServing = true;
+			service.reset(new std::thread(&IoUdp::serve, this));
+		}
 		return true;
 	}
 
@@ -102,6 +155,12 @@ bool IoUdp::close()
 	if (fd == -1)
 		return true;
 
+	isServing = false;
+	if (service && service->joinable())
+		service->join();
+	service.reset();
+	reliable.reset();
+
 	freeaddrinfo(addrinfo);
 	auto res = ::close(fd);
 
@@ -109,17 +168,296 @@ bool IoUdp::close()
 		return false;
 
 	fd = -1;
+	isConnected = false;
 	return true;
 }
 
 ssize_t IoUdp::write(const uint8_t *buf, size_t size)
 {
 	size = size > MAX_MES_SIZE ? MAX_MES_SIZE : size;
+	pacer.wait(size);
+
+	if (reliable)
+		return reliable->send(buf, size, MAX_MES_SIZE);
 
 	return sendto(fd, buf, size, MSG_CONFIRM, addrinfo->ai_addr, addrinfo->ai_addrlen);
 }
 
 ssize_t IoUdp::read(uint8_t *buf, size_t size)
 {
+	if (!reliable)
+		return receive(buf, size);
+
+	if (const auto payload = reliable->next(buf, size))
+		return payload;
+
+	while (true)
+	{
+		const auto res = receive(buf, size);
+		if (res <= 0)
+			return res;
+
+		// Datagrams out of order are kept until the ones before them come or are given up.
+		if (const auto payload = reliable->receive(buf, res))
+			return payload;
+		if (const auto payload = reliable->next(buf, size))
+			return payload;
+	}
+}
+
+/**
+ * @brief Receives datagram, its sender is kept as destination for feedback records.
+ *        Socket sharing the address connects to the first sender, so kernel passes the rest of its datagrams
+ *        to this socket only and datagrams of other writers to unconnected sockets. Datagrams of other senders
+ *        queued before that are dropped. Sender gone quiet for PEER_IDLE leaves the socket to the next one.
+ */
+ssize_t IoUdp::receive(uint8_t *buf, size_t size)
+{
+	while (true)
+	{
+		sockaddr_storage from;
+		socklen_t len = sizeof(from);
+		const auto res = recvfrom(fd, buf, size, MSG_DONTWAIT, reinterpret_cast<sockaddr *>(&from), &len);
+		if (!isReusePort)
+		{
+			if (res > 0)
+			{
+				peer = from;
+				peerLen = len;
+			}
+			return res;
+		}
+
+		const auto now = std::chrono::steady_clock::now();
+		if (res <= 0)
+		{
+			if (isConnected && now - lastReceiveTime > PEER_IDLE)
+			{
+				sockaddr unspec;
+				memset(&unspec, 0x00, sizeof(unspec));
+				unspec.sa_family = AF_UNSPEC;
+				connect(fd, &unspec, sizeof(unspec));
+				isConnected = false;
+			}
+			return res;
+		}
+
+		if (isConnected && (len != peerLen || memcmp(&from, &peer, len) != 0))
+			continue;
+
+		if (!isConnected)
+		{
+			peer = from;
+			peerLen = len;
+			isConnected = connect(fd, reinterpret_cast<const sockaddr *>(&peer), peerLen) == 0;
+		}
+		lastReceiveTime = now;
+		return res;
+	}
+}
+
+bool IoUdp::hasFeedback() const
+{
+	return true;
+}
+
+ssize_t IoUdp::readFeedback(uint8_t *buf, size_t size)
+{
+	if (reliable)
+	{
+		std::lock_guard<std::mutex> lock(feedbackMutex);
+		if (feedback.empty())
+			return -1;
+
+		const size_t res = std::min(size, feedback.front().size());
+		memcpy(buf, feedback.front().data(), res);
+		feedback.pop_front();
+		return res;
+	}
+
 	return recvfrom(fd, buf, size, MSG_DONTWAIT, nullptr, nullptr);
 }
+
+ssize_t IoUdp::writeFeedback(const uint8_t *buf, size_t size)
+{
+	if (fd == -1 || peerLen == 0)
+		return -1;
+
+	if (reliable)
+	{
+		reliable->sendFeedback(buf, size);
+		return size;
+	}
+
+	return sendto(fd, buf, size, MSG_DONTWAIT, reinterpret_cast<const sockaddr *>(&peer), peerLen);
+}
+
+bool IoUdp::setReliable(int deadlineMs)
+{
+	reliableDeadlineMs = std::max(deadlineMs, 0);
+	return true;
+}
+
+bool IoUdp::setParity(int groupSize)
+{
+	if (groupSize < 2 || groupSize > static_cast<int>(UdpReliable::MAX_PARITY_GROUP))
+		return false;
+
+	parityGroup = groupSize;
+	return true;
+}
+
+bool IoUdp::setPacing(uint64_t bytesPerSecond)
+{
+#ifdef SO_MAX_PACING_RATE
+	// Kernel paces too if fq qdisc is on the interface, user space pacer works anyway.
+	if (fd != -1)
+	{
+		const uint32_t kernelRate = bytesPerSecond == 0 ? ~0U
+				: static_cast<uint32_t>(std::min<uint64_t>(bytesPerSecond, ~0U - 1));
+		setsockopt(fd, SOL_SOCKET, SO_MAX_PACING_RATE, &kernelRate, sizeof(kernelRate));
+	}
+#endif
+	pacer.setRate(bytesPerSecond);
+	return true;
+}
+
+bool IoUdp::setMulticast(int ttl, bool isLoop, const std::string &iface)
+{
+	if (ttl < 0 || ttl > 255)
+		return false;
+
+	in_addr ifaceAddr;
+	if (!iface.empty() && inet_pton(AF_INET, iface.c_str(), &ifaceAddr) != 1)
+		return false;
+
+	multicastTtl = ttl;
+	isMulticastLoop = isLoop;
+	multicastIface = iface;
+	return true;
+}
+
+bool IoUdp::setBuffers(size_t bytes)
+{
+	bufferSize = bytes;
+	return true;
+}
+
+bool IoUdp::setReusePort()
+{
+#ifdef SO_REUSEPORT
+	// Kernel passes datagrams of a new writer to one of unconnected sockets by hash of their addresses,
+	// receive() connects it to the writer, so its stream stays in order on that socket.
+	isReusePort = true;
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool IoUdp::hasPeer() const
+{
+	return !isReusePort || isConnected;
+}
+
+bool IoUdp::isMulticast() const
+{
+	return addrinfo != nullptr
+		&& IN_MULTICAST(ntohl(reinterpret_cast<const sockaddr_in *>(addrinfo->ai_addr)->sin_addr.s_addr));
+}
+
+/**
+ * @brief Reader: joins the group on the interface of multicastIface, the default one if it is empty.
+ */
+bool IoUdp::joinGroup()
+{
+	ip_mreq request;
+	memset(&request, 0x00, sizeof(request));
+	request.imr_multiaddr = reinterpret_cast<const sockaddr_in *>(addrinfo->ai_addr)->sin_addr;
+	request.imr_interface.s_addr = htonl(INADDR_ANY);
+	if (!multicastIface.empty())
+		inet_pton(AF_INET, multicastIface.c_str(), &request.imr_interface);
+
+	if (setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &request, sizeof(request)) != 0)
+	{
+		std::cerr << "Failed to join multicast group. ERRNO: " << errno << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * @brief Writer: sets hop limit, loopback and interface of datagrams sent to the group.
+ *        Group gets one copy of each datagram whatever the number of readers.
+ */
+bool IoUdp::setSendGroup()
+{
+	const uint8_t ttl = static_cast<uint8_t>(multicastTtl);
+	const uint8_t loop = isMulticastLoop ? 1 : 0;
+	if (setsockopt(fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)) != 0
+		|| setsockopt(fd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop)) != 0)
+	{
+		std::cerr << "Failed to set multicast options" << std::endl;
+		return false;
+	}
+
+	if (!multicastIface.empty())
+	{
+		in_addr iface;
+		inet_pton(AF_INET, multicastIface.c_str(), &iface);
+		if (setsockopt(fd, IPPROTO_IP, IP_MULTICAST_IF, &iface, sizeof(iface)) != 0)
+		{
+			std::cerr << "Failed to set multicast interface " << multicastIface << std::endl;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * @brief Datagram layer of reliable mode and parity, nullptr if neither is on.
+ *        Parity alone doesn't need a way back, so it goes without retransmission.
+ */
+std::unique_ptr<UdpReliable> IoUdp::makeReliable(UdpReliable::Send send) const
+{
+	if (reliableDeadlineMs < 0 && parityGroup == 0)
+		return nullptr;
+
+	auto res = std::make_unique<UdpReliable>(reliableDeadlineMs, std::move(send));
+	res->setParity(parityGroup);
+	res->setRetransmit(reliableDeadlineMs >= 0);
+	return res;
+}
+
+/**
+ * @brief Service thread of reliable writer. Answers NACKs of reader, keeps its feedback for readFeedback
+ *        and sends status and parity of the stream, so reader notices and rebuilds lost datagrams at its end.
+ */
+void IoUdp::serve()
+{
+	std::vector<uint8_t> buffer(MAX_MES_SIZE);
+	pollfd request = {fd, POLLIN, 0};
+
+	while (isServing)
+	{
+		if (poll(&request, 1, SERVICE_POLL_MS) > 0)
+		{
+			ssize_t res;
+			while ((res = recvfrom(fd, buffer.data(), buffer.size(), MSG_DONTWAIT, nullptr, nullptr)) > 0)
+			{
+				const auto size = reliable->onFeedback(buffer.data(), res);
+				if (size == 0)
+					continue;
+
+				std::lock_guard<std::mutex> lock(feedbackMutex);
+				if (feedback.size() == MAX_FEEDBACK)
+					feedback.pop_front();
+				feedback.emplace_back(buffer.begin(), buffer.begin() + size);
+			}
+		}
+
+		reliable->tick();
+	}
+}
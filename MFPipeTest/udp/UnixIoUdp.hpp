@@ -1,11 +1,21 @@
 #ifndef UNIXIOUDP_HPP
 #define UNIXIOUDP_HPP
 
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
 #include "arpa/inet.h"
 #include "netdb.h"
 #include "sys/socket.h"
 
 #include "IoInterface.hpp"
+#include "UdpPacer.hpp"
+#include "UdpReliable.hpp"
 
 class IoUdp : public IoInterface
 {
@@ -18,11 +28,53 @@ public:
 	bool close() override;
 	ssize_t read(uint8_t *buf, size_t size) override;
 	ssize_t write(const uint8_t *buf, size_t size) override;
+	ssize_t readFeedback(uint8_t *buf, size_t size) override;
+	ssize_t writeFeedback(const uint8_t *buf, size_t size) override;
+	bool hasFeedback() const override;
+	bool setReliable(int deadlineMs) override;
+	bool setParity(int groupSize) override;
+	bool setPacing(uint64_t bytesPerSecond) override;
+	bool setMulticast(int ttl, bool isLoop, const std::string &iface) override;
+	bool setReusePort() override;
+	bool hasPeer() const override;
+	bool setBuffers(size_t bytes) override;
 
 private:
+	ssize_t receive(uint8_t *buf, size_t size);
+	bool isMulticast() const;
+	bool joinGroup();
+	bool setSendGroup();
+	std::unique_ptr<UdpReliable> makeReliable(UdpReliable::Send send) const;
+	void serve();
+
 	int32_t fd;
 	sockaddr_in addr;
 	struct addrinfo *addrinfo;
+	sockaddr_storage peer;
+	socklen_t peerLen;
+
+	// Reliable mode and parity, writer's datagrams from reader are taken by the service thread.
+	int reliableDeadlineMs;
+	size_t parityGroup;
+	std::unique_ptr<UdpReliable> reliable;
+	std::unique_ptr<std::thread> service;
+	std::atomic<bool> isServing;
+	std::mutex feedbackMutex;
+	std::deque<std::vector<uint8_t>> feedback;
+	UdpPacer pacer;
+
+	// Other sockets bind the address too, kernel picks one for each sender.
+	// Socket is connected to peer while it takes datagrams of that writer only.
+	bool isReusePort;
+	bool isConnected;
+	std::chrono::steady_clock::time_point lastReceiveTime;
+
+	size_t bufferSize;
+
+	// Used if address is a multicast group.
+	int multicastTtl;
+	bool isMulticastLoop;
+	std::string multicastIface;
 };
 
 #endif // UNIXIOUDP_HPP
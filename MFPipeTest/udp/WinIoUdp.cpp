@@ -1,13 +1,18 @@
 #include "WinIoUdp.hpp"
 
+#include <algorithm>
 #include <chrono>
 #include <iostream>
 #include <thread>
 
 static constexpr size_t MAX_MES_SIZE = 65507; // Max UDP message size.
+static constexpr size_t DEFAULT_BUFFER_SIZE = 10 * 1024 * 1024;
 
 IoUdp::IoUdp()
-	: fd(INVALID_SOCKET)
+	: fd(INVALID_SOCKET),
+	  bufferSize(DEFAULT_BUFFER_SIZE),
+	  multicastTtl(1),
+	  isMulticastLoop(true)
 {}
 
 IoUdp::~IoUdp()
@@ -43,7 +48,7 @@ bool IoUdp::create(const std::string &id)
 	if (fd == INVALID_SOCKET)
 		return false;
 
-	int32_t bufSize = 10 * 1024 * 1024;
+	const int32_t bufSize = static_cast<int32_t>(std::min<size_t>(bufferSize, INT32_MAX));
 	res = setsockopt(fd, SOL_SOCKET, SO_SNDBUF, reinterpret_cast<const char *>(&bufSize), sizeof(bufSize));
 	if (res != 0)
 	{
@@ -74,7 +79,17 @@ bool IoUdp::open(const std::string &id, Mode mode, int32_t timeoutMs)
 		{
 			if (create(id))
 			{
-				if (bind(fd, reinterpret_cast<SOCKADDR *>(&addr), sizeof(addr)) == 0)
+				// Windows doesn't bind group addresses, readers of a group share any address and its port.
+				struct sockaddr_in local = addr;
+				const BOOL reuse = TRUE;
+				if (isMulticast())
+				{
+					local.sin_addr.s_addr = htonl(INADDR_ANY);
+					setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char *>(&reuse), sizeof(reuse));
+				}
+
+				if (bind(fd, reinterpret_cast<SOCKADDR *>(&local), sizeof(local)) == 0
+					&& (!isMulticast() || joinGroup()))
 				{
 					int32_t timeout = 1;
 					if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char *>(&timeout), sizeof(timeout)) == 0)
@@ -88,7 +103,7 @@ bool IoUdp::open(const std::string &id, Mode mode, int32_t timeoutMs)
 	}
 	else if (mode == Mode::WRITE)
 	{
-		return true;
+		return !isMulticast() || setSendGroup();
 	}
 
 	return false;
@@ -108,10 +123,95 @@ bool IoUdp::close()
 ssize_t IoUdp::write(const uint8_t *buf, size_t size)
 {
 	size = size > MAX_MES_SIZE ? MAX_MES_SIZE : size;
+	pacer.wait(size);
 
 	return sendto(fd, reinterpret_cast<const char *>(buf), size, 0, reinterpret_cast<SOCKADDR *>(&addr), sizeof(addr));
 }
 
+bool IoUdp::setPacing(uint64_t bytesPerSecond)
+{
+	pacer.setRate(bytesPerSecond);
+	return true;
+}
+
+bool IoUdp::setBuffers(size_t bytes)
+{
+	bufferSize = bytes;
+	return true;
+}
+
+bool IoUdp::setMulticast(int ttl, bool isLoop, const std::string &iface)
+{
+	if (ttl < 0 || ttl > 255)
+		return false;
+
+	in_addr ifaceAddr;
+	if (!iface.empty() && inet_pton(AF_INET, iface.c_str(), &ifaceAddr) != 1)
+		return false;
+
+	multicastTtl = ttl;
+	isMulticastLoop = isLoop;
+	multicastIface = iface;
+	return true;
+}
+
+bool IoUdp::isMulticast() const
+{
+	return IN_MULTICAST(ntohl(addr.sin_addr.s_addr));
+}
+
+/**
+ * @brief Reader: joins the group on the interface of multicastIface, the default one if it is empty.
+ *        Windows applies loopback option at the receiving end, so it is set here too.
+ */
+bool IoUdp::joinGroup()
+{
+	ip_mreq request = {};
+	request.imr_multiaddr = addr.sin_addr;
+	request.imr_interface.s_addr = htonl(INADDR_ANY);
+	if (!multicastIface.empty())
+		inet_pton(AF_INET, multicastIface.c_str(), &request.imr_interface);
+
+	const DWORD loop = isMulticastLoop ? 1 : 0;
+	if (setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, reinterpret_cast<const char *>(&request), sizeof(request)) != 0
+		|| setsockopt(fd, IPPROTO_IP, IP_MULTICAST_LOOP, reinterpret_cast<const char *>(&loop), sizeof(loop)) != 0)
+	{
+		std::cerr << "Failed to join multicast group " << WSAGetLastError() << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * @brief Writer: sets hop limit, loopback and interface of datagrams sent to the group.
+ *        Group gets one copy of each datagram whatever the number of readers.
+ */
+bool IoUdp::setSendGroup()
+{
+	const DWORD ttl = multicastTtl;
+	const DWORD loop = isMulticastLoop ? 1 : 0;
+	if (setsockopt(fd, IPPROTO_IP, IP_MULTICAST_TTL, reinterpret_cast<const char *>(&ttl), sizeof(ttl)) != 0
+		|| setsockopt(fd, IPPROTO_IP, IP_MULTICAST_LOOP, reinterpret_cast<const char *>(&loop), sizeof(loop)) != 0)
+	{
+		std::cerr << "Failed to set multicast options" << std::endl;
+		return false;
+	}
+
+	if (!multicastIface.empty())
+	{
+		in_addr iface;
+		inet_pton(AF_INET, multicastIface.c_str(), &iface);
+		if (setsockopt(fd, IPPROTO_IP, IP_MULTICAST_IF, reinterpret_cast<const char *>(&iface), sizeof(iface)) != 0)
+		{
+			std::cerr << "Failed to set multicast interface " << multicastIface << std::endl;
+			return false;
+		}
+	}
+
+	return true;
+}
+
 ssize_t IoUdp::read(uint8_t *buf, size_t size)
 {
 	auto res = recvfrom(fd, reinterpret_cast<char *>(buf), size,
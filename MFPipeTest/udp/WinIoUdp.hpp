@@ -2,8 +2,10 @@
 #define WINIOUDP_HPP
 
 #include "winsock2.h"
+#include "ws2tcpip.h"
 
 #include "IoInterface.hpp"
+#include "UdpPacer.hpp"
 
 class IoUdp : public IoInterface
 {
@@ -16,10 +18,24 @@ public:
 	bool close() override;
 	ssize_t read(uint8_t *buf, size_t size) override;
 	ssize_t write(const uint8_t *buf, size_t size) override;
+	bool setPacing(uint64_t bytesPerSecond) override;
+	bool setMulticast(int ttl, bool isLoop, const std::string &iface) override;
+	bool setBuffers(size_t bytes) override;
 
 private:
+	bool isMulticast() const;
+	bool joinGroup();
+	bool setSendGroup();
+
 	SOCKET fd;
 	struct sockaddr_in addr;
+	UdpPacer pacer;
+	size_t bufferSize;
+
+	// Used if address is a multicast group.
+	int multicastTtl;
+	bool isMulticastLoop;
+	std::string multicastIface;
 };
 
 #endif // WINIOUDP_HPP
@@ -1,5 +1,6 @@
 #include "tests/Parser.hpp"
 #include "tests/Pipe.hpp"
+#include "tests/Tcp.hpp"
 #include "tests/Udp.hpp"
 #include <iostream>
 #include <algorithm>
@@ -17,6 +18,7 @@ int main(int argc, char *argv[])
 	bool writeProcess = argExists(argv, argv + argc, "write");
 	bool multithreaded = argExists(argv, argv + argc, "multi");
 	bool udp = argExists(argv, argv + argc, "udp");
+	bool tcp = argExists(argv, argv + argc, "tcp");
 	bool pipe = argExists(argv, argv + argc, "pipe");
 	bool all = argExists(argv, argv + argc, "all");
 
@@ -26,6 +28,7 @@ int main(int argc, char *argv[])
 		multithreaded = true;
 		pipe = true;
 		udp = true;
+		tcp = true;
 	}
 
 	auto bool_to_str = [](bool res) {
@@ -47,6 +50,12 @@ int main(int argc, char *argv[])
 			bool res = testUdp(true);
 			std::cout << "testUdp() READ: " << bool_to_str(res) << std::endl;
 		}
+		if (tcp)
+		{
+			std::cout << "testTcp() READ: " << std::endl;
+			bool res = testTcp(true);
+			std::cout << "testTcp() READ: " << bool_to_str(res) << std::endl;
+		}
 		if (pipe)
 		{
 			std::cout << "testPipe() READ: " << std::endl;
@@ -63,6 +72,12 @@ int main(int argc, char *argv[])
 			bool res = testUdp(false);
 			std::cout << "testUdp() WRITE: " << bool_to_str(res) << std::endl;
 		}
+		if (tcp)
+		{
+			std::cout << "testTcp() WRITE: " << std::endl;
+			bool res = testTcp(false);
+			std::cout << "testTcp() WRITE: " << bool_to_str(res) << std::endl;
+		}
 		if (pipe)
 		{
 			std::cout << "testPipe() WRITE: " << std::endl;
@@ -79,6 +94,12 @@ int main(int argc, char *argv[])
 			bool res = testUdpMultithreaded();
 			std::cout << "testUdpMultithreaded(): " << bool_to_str(res) << std::endl;
 		}
+		if (tcp)
+		{
+			std::cout << "testTcpMultithreaded(): " << std::endl;
+			bool res = testTcpMultithreaded();
+			std::cout << "testTcpMultithreaded(): " << bool_to_str(res) << std::endl;
+		}
 		if (pipe)
 		{
 			std::cout << "testPipeMultithreaded(): " << std::endl;